@@ -123,9 +123,10 @@ namespace CyberAsm
 
 	constexpr void ByteChunk::WriteFixedImmediate(const Immediate& imm, const WordSize fixed)
 	{
+		// Shifting instead of reading Bytes keeps this usable in constant expressions and yields little endian on any host:
 		for (std::uint8_t i = 0; i < static_cast<std::underlying_type_t<WordSize>>(fixed); ++i)
 		{
-			*this << imm.Bytes[i];
+			*this << static_cast<std::uint8_t>(imm.UValue >> (i * 8));
 		}
 	}
 
@@ -148,7 +149,7 @@ namespace CyberAsm
 	{
 		for (std::uint8_t i = 0; i < static_cast<std::underlying_type_t<WordSize>>(ComputeRequiredBytes(imm.UValue)); ++i)
 		{
-			*this << imm.Bytes[i];
+			*this << static_cast<std::uint8_t>(imm.UValue >> (i * 8));
 		}
 		return *this;
 	}
@@ -0,0 +1,441 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <execution>
+#include <limits>
+#include <numeric>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <vector>
+
+#if defined(__AVX2__) || defined(__SSE2__) || defined(_M_X64)
+#	include <immintrin.h>
+#endif
+
+namespace CyberAsm
+{
+	/// <summary>
+	/// Returned by the search functions if nothing was found.
+	/// </summary>
+	inline constexpr std::size_t NotFound = std::numeric_limits<std::size_t>::max();
+
+	/// <summary>
+	/// Inputs at least this large are searched in parallel chunks, smaller ones serially to avoid the thread pool overhead.
+	/// </summary>
+	inline constexpr std::size_t ParallelSearchThreshold = 4 * 1024 * 1024;
+
+	/// <summary>
+	/// The size of one chunk of a parallel search.
+	/// </summary>
+	inline constexpr std::size_t ParallelSearchChunkSize = 1024 * 1024;
+
+	/// <summary>
+	/// Returns the offset of the first occurrence of the byte or NotFound.
+	/// </summary>
+	[[nodiscard]] auto FindByte(std::span<const std::uint8_t> haystack, std::uint8_t target) noexcept -> std::size_t;
+
+	/// <summary>
+	/// Returns the offset of the first occurrence of the needle or NotFound, an empty needle is found at 0.
+	/// Candidates are filtered with a SIMD compare of the first and last needle byte and verified with memcmp.
+	/// Inputs of at least ParallelSearchThreshold bytes are split into overlapping chunks searched in parallel.
+	/// </summary>
+	[[nodiscard]] auto FindSequence(std::span<const std::uint8_t> haystack, std::span<const std::uint8_t> needle) -> std::size_t;
+
+	/// <summary>
+	/// One match of a MultiPatternSearcher.
+	/// </summary>
+	struct PatternMatch final
+	{
+		/// <summary>
+		/// The index of the pattern in the order the patterns were given.
+		/// </summary>
+		std::size_t Pattern = 0;
+
+		/// <summary>
+		/// The offset of the first byte of the match.
+		/// </summary>
+		std::size_t Offset = 0;
+
+		[[nodiscard]] constexpr auto operator ==(const PatternMatch&) const noexcept -> bool = default;
+	};
+
+	/// <summary>
+	/// Finds many byte patterns, such as opcode signatures, in one pass over the input (Aho-Corasick).
+	/// The patterns are compiled into a dense automaton with one transition per state and byte,
+	/// so every input byte costs a single table lookup, independent of the number of patterns.
+	/// </summary>
+	class MultiPatternSearcher final
+	{
+	public:
+		/// <summary>
+		/// Compiles the patterns, throws if a pattern is empty.
+		/// </summary>
+		explicit MultiPatternSearcher(std::span<const std::span<const std::uint8_t>> patterns);
+		MultiPatternSearcher(std::initializer_list<std::span<const std::uint8_t>> patterns);
+
+		/// <summary>
+		/// Returns all matches, including overlapping ones, sorted by offset and pattern.
+		/// Inputs of at least ParallelSearchThreshold bytes are scanned in parallel chunks.
+		/// </summary>
+		[[nodiscard]] auto FindAll(std::span<const std::uint8_t> haystack) const -> std::vector<PatternMatch>;
+
+		/// <summary>
+		/// Returns the match with the lowest offset, the lowest pattern index among matches at the same offset.
+		/// </summary>
+		[[nodiscard]] auto FindFirst(std::span<const std::uint8_t> haystack) const -> std::optional<PatternMatch>;
+
+		[[nodiscard]] auto ContainsAny(std::span<const std::uint8_t> haystack) const -> bool;
+		[[nodiscard]] auto PatternCount() const noexcept -> std::size_t;
+		[[nodiscard]] auto StateCount() const noexcept -> std::size_t;
+
+	private:
+		using State = std::uint32_t;
+		static constexpr State Root = 0;
+		static constexpr State NoOutput = std::numeric_limits<State>::max();
+
+		void Build(std::span<const std::span<const std::uint8_t>> patterns);
+
+		/// <summary>
+		/// Scans [begin, end) of the haystack, reports matches starting in [begin, reportEnd).
+		/// </summary>
+		template <typename F>
+		void Scan(std::span<const std::uint8_t> haystack, std::size_t begin, std::size_t end, std::size_t reportEnd, F&& report) const;
+
+		/// <summary>
+		/// transitions[state * 256 + byte] = next state.
+		/// </summary>
+		std::vector<State> transitions = {};
+
+		/// <summary>
+		/// The pattern ending in the state or NoOutput.
+		/// </summary>
+		std::vector<State> outputs = {};
+
+		/// <summary>
+		/// The next state on the suffix link chain with an output or NoOutput.
+		/// </summary>
+		std::vector<State> outputLinks = {};
+		std::vector<std::size_t> lengths = {};
+		std::size_t maxLength = 0;
+	};
+
+	namespace ByteSearchDetail
+	{
+		/// <summary>
+		/// Serial first/last byte filter search, returns an offset relative to the haystack or NotFound.
+		/// </summary>
+		inline auto FindSequenceSerial(const std::span<const std::uint8_t> haystack, const std::span<const std::uint8_t> needle) noexcept -> std::size_t
+		{
+			const std::size_t size = needle.size();
+			if (size > haystack.size()) [[unlikely]]
+			{
+				return NotFound;
+			}
+			const std::uint8_t* const data = haystack.data();
+			if (size == 1)
+			{
+				const void* const hit = std::memchr(data, needle[0], haystack.size());
+				return hit ? static_cast<std::size_t>(static_cast<const std::uint8_t*>(hit) - data) : NotFound;
+			}
+
+			const std::size_t lastStart = haystack.size() - size;
+			const auto verify = [&](const std::size_t offset) noexcept
+			{
+				return std::memcmp(data + offset + 1, needle.data() + 1, size - 2) == 0;
+			};
+
+			std::size_t offset = 0;
+#if defined(__AVX2__)
+			const __m256i first = _mm256_set1_epi8(static_cast<char>(needle[0]));
+			const __m256i last = _mm256_set1_epi8(static_cast<char>(needle[size - 1]));
+			for (; offset + 32 <= lastStart + 1; offset += 32)
+			{
+				const __m256i head = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + offset));
+				const __m256i tail = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + offset + size - 1));
+				auto mask = static_cast<std::uint32_t>(_mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(head, first), _mm256_cmpeq_epi8(tail, last))));
+				while (mask != 0)
+				{
+					const auto candidate = offset + static_cast<std::size_t>(std::countr_zero(mask));
+					if (verify(candidate))
+					{
+						return candidate;
+					}
+					mask &= mask - 1;
+				}
+			}
+#elif defined(__SSE2__) || defined(_M_X64)
+			const __m128i first = _mm_set1_epi8(static_cast<char>(needle[0]));
+			const __m128i last = _mm_set1_epi8(static_cast<char>(needle[size - 1]));
+			for (; offset + 16 <= lastStart + 1; offset += 16)
+			{
+				const __m128i head = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + offset));
+				const __m128i tail = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + offset + size - 1));
+				auto mask = static_cast<std::uint32_t>(_mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(head, first), _mm_cmpeq_epi8(tail, last))));
+				while (mask != 0)
+				{
+					const auto candidate = offset + static_cast<std::size_t>(std::countr_zero(mask));
+					if (verify(candidate))
+					{
+						return candidate;
+					}
+					mask &= mask - 1;
+				}
+			}
+#endif
+			// Remaining starts, or all of them without SIMD, skip ahead with memchr on the first byte:
+			while (offset <= lastStart)
+			{
+				const void* const hit = std::memchr(data + offset, needle[0], lastStart + 1 - offset);
+				if (!hit)
+				{
+					return NotFound;
+				}
+				offset = static_cast<std::size_t>(static_cast<const std::uint8_t*>(hit) - data);
+				if (data[offset + size - 1] == needle[size - 1] && verify(offset))
+				{
+					return offset;
+				}
+				++offset;
+			}
+			return NotFound;
+		}
+
+		/// <summary>
+		/// Returns the number of chunks of a parallel scan.
+		/// </summary>
+		[[nodiscard]] inline auto ChunkCount(const std::size_t size) noexcept -> std::size_t
+		{
+			return (size + ParallelSearchChunkSize - 1) / ParallelSearchChunkSize;
+		}
+	}
+
+	inline auto FindByte(const std::span<const std::uint8_t> haystack, const std::uint8_t target) noexcept -> std::size_t
+	{
+		if (haystack.empty())
+		{
+			return NotFound;
+		}
+		const void* const hit = std::memchr(haystack.data(), target, haystack.size());
+		return hit ? static_cast<std::size_t>(static_cast<const std::uint8_t*>(hit) - haystack.data()) : NotFound;
+	}
+
+	inline auto FindSequence(const std::span<const std::uint8_t> haystack, const std::span<const std::uint8_t> needle) -> std::size_t
+	{
+		if (needle.empty())
+		{
+			return 0;
+		}
+		if (haystack.size() < ParallelSearchThreshold || needle.size() > ParallelSearchChunkSize) [[likely]]
+		{
+			return ByteSearchDetail::FindSequenceSerial(haystack, needle);
+		}
+
+		// Every chunk also covers the starts of its last needle.size() - 1 bytes, the lowest hit wins:
+		std::vector<std::size_t> chunks(ByteSearchDetail::ChunkCount(haystack.size()));
+		std::iota(chunks.begin(), chunks.end(), std::size_t{0});
+		return std::transform_reduce(std::execution::par, chunks.begin(), chunks.end(), NotFound, [](const std::size_t lhs, const std::size_t rhs)
+		{
+			return std::min(lhs, rhs);
+		}, [&](const std::size_t chunk)
+		{
+			const std::size_t begin = chunk * ParallelSearchChunkSize;
+			const std::size_t end = std::min(haystack.size(), begin + ParallelSearchChunkSize + needle.size() - 1);
+			const std::size_t hit = ByteSearchDetail::FindSequenceSerial(haystack.subspan(begin, end - begin), needle);
+			return hit == NotFound ? NotFound : begin + hit;
+		});
+	}
+
+	inline MultiPatternSearcher::MultiPatternSearcher(const std::span<const std::span<const std::uint8_t>> patterns)
+	{
+		this->Build(patterns);
+	}
+
+	inline MultiPatternSearcher::MultiPatternSearcher(const std::initializer_list<std::span<const std::uint8_t>> patterns)
+	{
+		this->Build(std::span<const std::span<const std::uint8_t>>(patterns.begin(), patterns.size()));
+	}
+
+	inline void MultiPatternSearcher::Build(const std::span<const std::span<const std::uint8_t>> patterns)
+	{
+		constexpr State unset = std::numeric_limits<State>::max();
+
+		// Trie of all patterns:
+		this->transitions.assign(256, unset);
+		this->outputs.assign(1, NoOutput);
+		this->lengths.reserve(patterns.size());
+		for (std::size_t pattern = 0; pattern < patterns.size(); ++pattern)
+		{
+			if (patterns[pattern].empty()) [[unlikely]]
+			{
+				throw std::runtime_error("Search patterns must not be empty!");
+			}
+			State state = Root;
+			for (const std::uint8_t byte : patterns[pattern])
+			{
+				State& next = this->transitions[state * 256 + byte];
+				if (next == unset)
+				{
+					next = static_cast<State>(this->outputs.size());
+					this->outputs.push_back(NoOutput);
+					this->transitions.resize(this->transitions.size() + 256, unset);
+				}
+				state = this->transitions[state * 256 + byte];
+			}
+
+			// Duplicates report the first pattern only:
+			if (this->outputs[state] == NoOutput)
+			{
+				this->outputs[state] = static_cast<State>(pattern);
+			}
+			this->lengths.push_back(patterns[pattern].size());
+			this->maxLength = std::max(this->maxLength, patterns[pattern].size());
+		}
+
+		// Breadth first: fill the missing transitions from the failure links, so the automaton is a complete DFA:
+		const std::size_t count = this->outputs.size();
+		std::vector<State> failure(count, Root);
+		this->outputLinks.assign(count, NoOutput);
+		std::vector<State> queue = {};
+		queue.reserve(count);
+		for (std::size_t byte = 0; byte < 256; ++byte)
+		{
+			State& next = this->transitions[byte];
+			if (next == unset)
+			{
+				next = Root;
+			}
+			else
+			{
+				queue.push_back(next);
+			}
+		}
+		for (std::size_t head = 0; head < queue.size(); ++head)
+		{
+			const State state = queue[head];
+			for (std::size_t byte = 0; byte < 256; ++byte)
+			{
+				State& next = this->transitions[state * 256 + byte];
+				const State fallback = this->transitions[failure[state] * 256 + byte];
+				if (next == unset)
+				{
+					next = fallback;
+					continue;
+				}
+				failure[next] = fallback;
+				this->outputLinks[next] = this->outputs[fallback] != NoOutput ? fallback : this->outputLinks[fallback];
+				queue.push_back(next);
+			}
+		}
+	}
+
+	template <typename F>
+	inline void MultiPatternSearcher::Scan(const std::span<const std::uint8_t> haystack, const std::size_t begin, const std::size_t end, const std::size_t reportEnd, F&& report) const
+	{
+		const State* const table = this->transitions.data();
+		State state = Root;
+		for (std::size_t i = begin; i < end; ++i)
+		{
+			state = table[state * 256 + haystack[i]];
+			for (State match = this->outputs[state] != NoOutput ? state : this->outputLinks[state]; match != NoOutput; match = this->outputLinks[match])
+			{
+				const std::size_t pattern = this->outputs[match];
+				const std::size_t offset = i + 1 - this->lengths[pattern];
+				if (offset >= begin && offset < reportEnd)
+				{
+					report(PatternMatch{pattern, offset});
+				}
+			}
+		}
+	}
+
+	inline auto MultiPatternSearcher::FindAll(const std::span<const std::uint8_t> haystack) const -> std::vector<PatternMatch>
+	{
+		std::vector<PatternMatch> matches = {};
+		if (haystack.size() < ParallelSearchThreshold) [[likely]]
+		{
+			this->Scan(haystack, 0, haystack.size(), haystack.size(), [&matches](const PatternMatch& match)
+			{
+				matches.push_back(match);
+			});
+		}
+		else
+		{
+			// Chunks overlap by the longest pattern, each reports the matches starting inside it:
+			std::vector<std::vector<PatternMatch>> chunks(ByteSearchDetail::ChunkCount(haystack.size()));
+			std::for_each(std::execution::par, chunks.begin(), chunks.end(), [&](std::vector<PatternMatch>& chunk)
+			{
+				const std::size_t begin = static_cast<std::size_t>(&chunk - chunks.data()) * ParallelSearchChunkSize;
+				const std::size_t reportEnd = std::min(haystack.size(), begin + ParallelSearchChunkSize);
+				const std::size_t end = std::min(haystack.size(), reportEnd + this->maxLength - 1);
+				this->Scan(haystack, begin, end, reportEnd, [&chunk](const PatternMatch& match)
+				{
+					chunk.push_back(match);
+				});
+			});
+			for (const auto& chunk : chunks)
+			{
+				matches.insert(matches.end(), chunk.begin(), chunk.end());
+			}
+		}
+		std::sort(matches.begin(), matches.end(), [](const PatternMatch& lhs, const PatternMatch& rhs)
+		{
+			return lhs.Offset != rhs.Offset ? lhs.Offset < rhs.Offset : lhs.Pattern < rhs.Pattern;
+		});
+		return matches;
+	}
+
+	inline auto MultiPatternSearcher::FindFirst(const std::span<const std::uint8_t> haystack) const -> std::optional<PatternMatch>
+	{
+		// A match ending at i can still be preceded by a longer match ending up to maxLength - 1 bytes later:
+		std::optional<PatternMatch> best = std::nullopt;
+		const State* const table = this->transitions.data();
+		State state = Root;
+		for (std::size_t i = 0; i < haystack.size(); ++i)
+		{
+			if (best && i >= best->Offset + this->maxLength) [[unlikely]]
+			{
+				break;
+			}
+			state = table[state * 256 + haystack[i]];
+			for (State match = this->outputs[state] != NoOutput ? state : this->outputLinks[state]; match != NoOutput; match = this->outputLinks[match])
+			{
+				const PatternMatch candidate = {this->outputs[match], i + 1 - this->lengths[this->outputs[match]]};
+				if (!best || candidate.Offset < best->Offset || (candidate.Offset == best->Offset && candidate.Pattern < best->Pattern))
+				{
+					best = candidate;
+				}
+			}
+		}
+		return best;
+	}
+
+	inline auto MultiPatternSearcher::ContainsAny(const std::span<const std::uint8_t> haystack) const -> bool
+	{
+		const State* const table = this->transitions.data();
+		State state = Root;
+		for (const std::uint8_t byte : haystack)
+		{
+			state = table[state * 256 + byte];
+			if (this->outputs[state] != NoOutput || this->outputLinks[state] != NoOutput)
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+
+	inline auto MultiPatternSearcher::PatternCount() const noexcept -> std::size_t
+	{
+		return this->lengths.size();
+	}
+
+	inline auto MultiPatternSearcher::StateCount() const noexcept -> std::size_t
+	{
+		return this->outputs.size();
+	}
+}
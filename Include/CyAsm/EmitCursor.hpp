@@ -0,0 +1,173 @@
+#pragma once
+
+#include <cstdint>
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <cstring>
+#include <memory_resource>
+#include <type_traits>
+#include <vector>
+
+#include "ByteChunk.hpp"
+
+namespace CyberAsm
+{
+	/// <summary>
+	/// Reserve-ahead write cursor over a byte buffer.
+	/// Ensure() grows the buffer by a block of headroom, the Put functions then write through a raw pointer
+	/// without any bounds checks or size bookkeeping, and Commit() trims the buffer to the bytes actually written.
+	/// The buffer must not be modified by anyone else between Ensure() and Commit().
+	/// </summary>
+	class EmitCursor final
+	{
+	public:
+		using Buffer = std::pmr::vector<std::uint8_t>;
+
+		/// <summary>
+		/// Default number of bytes the buffer grows by at least, so a few hundred instructions share one resize.
+		/// </summary>
+		static constexpr std::size_t DefaultHeadroom = 4096;
+
+		/// <param name="buffer">The buffer to append to.</param>
+		/// <param name="headroom">The minimum growth, 0 for single writes of known size.</param>
+		explicit EmitCursor(Buffer& buffer, std::size_t headroom = DefaultHeadroom) noexcept;
+		EmitCursor(const EmitCursor&) = delete;
+		EmitCursor(EmitCursor&&) = delete;
+		auto operator =(const EmitCursor&) -> EmitCursor& = delete;
+		auto operator =(EmitCursor&&) -> EmitCursor& = delete;
+		~EmitCursor();
+
+		/// <summary>
+		/// Makes sure at least byteSize bytes can be written unchecked.
+		/// </summary>
+		void Ensure(std::size_t byteSize);
+
+		/// <summary>
+		/// Trims the buffer to the written bytes, the cursor can be used again after the next Ensure().
+		/// </summary>
+		void Commit();
+
+		/// <summary>
+		/// Returns the number of bytes which can be written without calling Ensure().
+		/// </summary>
+		[[nodiscard]] auto Remaining() const noexcept -> std::size_t;
+
+		/// <summary>
+		/// Returns the buffer offset of the next byte written.
+		/// </summary>
+		[[nodiscard]] auto Offset() const noexcept -> std::size_t;
+
+		/// <summary>
+		/// Returns the write position, for encoders writing directly into the buffer.
+		/// Advance() must be called with the number of bytes written.
+		/// </summary>
+		[[nodiscard]] auto Position() const noexcept -> std::uint8_t*;
+		void Advance(std::size_t byteSize) noexcept;
+
+		void Put(std::uint8_t value) noexcept;
+
+		/// <summary>
+		/// Copies the whole fixed size chunk buffer and advances by the chunk size.
+		/// Requires ByteChunk::MaxByteChunkSize bytes of headroom.
+		/// </summary>
+		void Put(const ByteChunk& chunk) noexcept;
+
+		/// <summary>
+		/// Stores the scalar in little endian byte order.
+		/// </summary>
+		template <typename T> requires std::is_trivially_copyable_v<T>
+		void PutLittle(const T& value) noexcept;
+
+		void Write(const void* memory, std::size_t size) noexcept;
+
+	private:
+		Buffer& buffer;
+		std::size_t headroom = DefaultHeadroom;
+		std::uint8_t* position = nullptr;
+		std::uint8_t* limit = nullptr;
+	};
+
+	inline EmitCursor::EmitCursor(Buffer& buffer, const std::size_t headroom) noexcept : buffer(buffer), headroom(headroom) { }
+
+	inline EmitCursor::~EmitCursor()
+	{
+		this->Commit();
+	}
+
+	inline void EmitCursor::Ensure(const std::size_t byteSize)
+	{
+		if (static_cast<std::size_t>(this->limit - this->position) >= byteSize) [[likely]]
+		{
+			return;
+		}
+		const auto used = this->Offset();
+		this->buffer.resize(used + std::max(byteSize, this->headroom));
+		this->position = this->buffer.data() + used;
+		this->limit = this->buffer.data() + this->buffer.size();
+	}
+
+	inline void EmitCursor::Commit()
+	{
+		if (this->limit == nullptr)
+		{
+			return;
+		}
+		this->buffer.resize(this->Offset());
+		this->position = nullptr;
+		this->limit = nullptr;
+	}
+
+	inline auto EmitCursor::Remaining() const noexcept -> std::size_t
+	{
+		return static_cast<std::size_t>(this->limit - this->position);
+	}
+
+	inline auto EmitCursor::Offset() const noexcept -> std::size_t
+	{
+		return this->limit == nullptr ? this->buffer.size() : static_cast<std::size_t>(this->position - this->buffer.data());
+	}
+
+	inline auto EmitCursor::Position() const noexcept -> std::uint8_t*
+	{
+		return this->position;
+	}
+
+	inline void EmitCursor::Advance(const std::size_t byteSize) noexcept
+	{
+		assert(byteSize <= this->Remaining());
+		this->position += byteSize;
+	}
+
+	inline void EmitCursor::Put(const std::uint8_t value) noexcept
+	{
+		assert(this->Remaining() >= 1);
+		*this->position++ = value;
+	}
+
+	inline void EmitCursor::Put(const ByteChunk& chunk) noexcept
+	{
+		assert(this->Remaining() >= ByteChunk::MaxByteChunkSize);
+		std::memcpy(this->position, chunk.Data(), ByteChunk::MaxByteChunkSize);
+		this->position += chunk.Size();
+	}
+
+	template <typename T> requires std::is_trivially_copyable_v<T>
+	inline void EmitCursor::PutLittle(const T& value) noexcept
+	{
+		assert(this->Remaining() >= sizeof(T));
+		std::memcpy(this->position, &value, sizeof(T));
+		if constexpr (std::endian::native == std::endian::big)
+		{
+			std::reverse(this->position, this->position + sizeof(T));
+		}
+		this->position += sizeof(T);
+	}
+
+	inline void EmitCursor::Write(const void* const memory, const std::size_t size) noexcept
+	{
+		assert(this->Remaining() >= size);
+		std::memcpy(this->position, memory, size);
+		this->position += size;
+	}
+}
@@ -0,0 +1,255 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <span>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "ByteChunk.hpp"
+#include "MachineStream.hpp"
+
+namespace CyberAsm
+{
+	/// <summary>
+	/// Time and volume of a file output, kept apart from the encode time.
+	/// </summary>
+	struct FileOutputStats final
+	{
+		std::size_t BytesWritten = 0;
+
+		/// <summary>
+		/// Time spent in file system calls.
+		/// </summary>
+		std::chrono::nanoseconds IoTime = {};
+
+		/// <summary>
+		/// Time the producer waited for the disk, zero if I/O fully overlapped with encoding.
+		/// </summary>
+		std::chrono::nanoseconds StallTime = {};
+	};
+
+	/// <summary>
+	/// Streaming binary file writer with double buffering.
+	/// Code is collected in a block of blockSize bytes, a full block is handed to a writer thread
+	/// and encoding continues in the second block while the first one is written to disk.
+	/// Only two blocks are ever resident, independent of the file size.
+	/// </summary>
+	class FileWriter final
+	{
+	public:
+		static constexpr std::size_t DefaultBlockSize = 1024 * 1024;
+
+		/// <summary>
+		/// Creates or truncates the file, throws if it cannot be opened.
+		/// </summary>
+		explicit FileWriter(const std::filesystem::path& file, std::size_t blockSize = DefaultBlockSize);
+		FileWriter(const FileWriter&) = delete;
+		FileWriter(FileWriter&&) = delete;
+		auto operator =(const FileWriter&) -> FileWriter& = delete;
+		auto operator =(FileWriter&&) -> FileWriter& = delete;
+
+		/// <summary>
+		/// Closes the file, errors are swallowed, call Close() to observe them.
+		/// </summary>
+		~FileWriter();
+
+		/// <summary>
+		/// Appends the bytes to the current block, throws if the writer is closed.
+		/// </summary>
+		void Write(const void* memory, std::size_t size);
+		auto operator <<(const ByteChunk& chunk) -> FileWriter&;
+		auto operator <<(std::span<const std::uint8_t> code) -> FileWriter&;
+
+		template <Abi Arch>
+		auto operator <<(const MachineStream<Arch>& stream) -> FileWriter&;
+
+		/// <summary>
+		/// Hands the current block to the writer thread, even if it is not full.
+		/// </summary>
+		void Flush();
+
+		/// <summary>
+		/// Writes all remaining code and closes the file.
+		/// Throws if any write failed.
+		/// </summary>
+		void Close();
+
+		/// <summary>
+		/// Returns the statistics, complete after Close().
+		/// </summary>
+		[[nodiscard]] auto Stats() const noexcept -> const FileOutputStats&;
+
+	private:
+		void WriterLoop();
+
+		std::ofstream file = {};
+		std::size_t blockSize = DefaultBlockSize;
+		std::vector<std::uint8_t> active = {};
+		std::vector<std::uint8_t> pending = {};
+		std::size_t activeSize = 0;
+		std::size_t pendingSize = 0;
+		std::mutex mutex = {};
+		std::condition_variable signal = {};
+		bool hasPending = false;
+		bool closing = false;
+		bool closed = false;
+		bool failed = false;
+		FileOutputStats stats = {};
+		std::thread writer = {};
+	};
+
+	inline FileWriter::FileWriter(const std::filesystem::path& file, const std::size_t blockSize) : blockSize(std::max<std::size_t>(blockSize, 1))
+	{
+		const auto begin = std::chrono::steady_clock::now();
+		this->file.open(file, std::ios::out | std::ios::binary | std::ios::trunc);
+		this->stats.IoTime += std::chrono::steady_clock::now() - begin;
+		if (!this->file) [[unlikely]]
+		{
+			throw std::runtime_error("Failed to open the output file!");
+		}
+		this->active.resize(this->blockSize);
+		this->pending.resize(this->blockSize);
+		this->writer = std::thread(&FileWriter::WriterLoop, this);
+	}
+
+	inline FileWriter::~FileWriter()
+	{
+		try
+		{
+			this->Close();
+		}
+		catch (...)
+		{
+		}
+	}
+
+	inline void FileWriter::Write(const void* const memory, std::size_t size)
+	{
+		if (this->closed) [[unlikely]]
+		{
+			throw std::runtime_error("The output file is already closed!");
+		}
+		auto source = static_cast<const std::uint8_t*>(memory);
+		if (size < this->blockSize - this->activeSize) [[likely]]
+		{
+			std::memcpy(this->active.data() + this->activeSize, source, size);
+			this->activeSize += size;
+			return;
+		}
+		while (size != 0)
+		{
+			const auto count = std::min(size, this->blockSize - this->activeSize);
+			std::memcpy(this->active.data() + this->activeSize, source, count);
+			this->activeSize += count;
+			source += count;
+			size -= count;
+			if (this->activeSize == this->blockSize)
+			{
+				this->Flush();
+			}
+		}
+	}
+
+	inline auto FileWriter::operator<<(const ByteChunk& chunk) -> FileWriter&
+	{
+		this->Write(chunk.Data(), chunk.Size());
+		return *this;
+	}
+
+	inline auto FileWriter::operator<<(const std::span<const std::uint8_t> code) -> FileWriter&
+	{
+		this->Write(code.data(), code.size());
+		return *this;
+	}
+
+	template <Abi Arch>
+	inline auto FileWriter::operator<<(const MachineStream<Arch>& stream) -> FileWriter&
+	{
+		this->Write(stream.begin(), stream.Size());
+		return *this;
+	}
+
+	inline void FileWriter::Flush()
+	{
+		if (this->activeSize == 0 || this->closed)
+		{
+			return;
+		}
+		const auto begin = std::chrono::steady_clock::now();
+		std::unique_lock lock(this->mutex);
+		this->signal.wait(lock, [this] { return !this->hasPending; });
+		this->stats.StallTime += std::chrono::steady_clock::now() - begin;
+		this->active.swap(this->pending);
+		this->pendingSize = std::exchange(this->activeSize, 0);
+		this->hasPending = true;
+		lock.unlock();
+		this->signal.notify_all();
+	}
+
+	inline void FileWriter::Close()
+	{
+		if (this->closed)
+		{
+			return;
+		}
+		this->Flush();
+		{
+			std::lock_guard lock(this->mutex);
+			this->closing = true;
+		}
+		this->signal.notify_all();
+		const auto begin = std::chrono::steady_clock::now();
+		this->writer.join();
+		this->stats.StallTime += std::chrono::steady_clock::now() - begin;
+
+		const auto closeBegin = std::chrono::steady_clock::now();
+		this->file.close();
+		this->stats.IoTime += std::chrono::steady_clock::now() - closeBegin;
+		this->closed = true;
+		if (this->failed || this->file.fail()) [[unlikely]]
+		{
+			throw std::runtime_error("Failed to write the output file!");
+		}
+	}
+
+	inline auto FileWriter::Stats() const noexcept -> const FileOutputStats&
+	{
+		return this->stats;
+	}
+
+	inline void FileWriter::WriterLoop()
+	{
+		std::unique_lock lock(this->mutex);
+		for (;;)
+		{
+			this->signal.wait(lock, [this] { return this->hasPending || this->closing; });
+			if (!this->hasPending)
+			{
+				return;
+			}
+			lock.unlock();
+
+			// The pending block is owned by this thread until hasPending is cleared:
+			const auto begin = std::chrono::steady_clock::now();
+			this->file.write(reinterpret_cast<const char*>(this->pending.data()), static_cast<std::streamsize>(this->pendingSize));
+			const auto io = std::chrono::steady_clock::now() - begin;
+			const bool ok = static_cast<bool>(this->file);
+
+			lock.lock();
+			this->stats.IoTime += io;
+			this->stats.BytesWritten += ok ? this->pendingSize : 0;
+			this->failed |= !ok;
+			this->hasPending = false;
+			this->signal.notify_all();
+		}
+	}
+}
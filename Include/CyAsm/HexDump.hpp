@@ -0,0 +1,307 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <array>
+#include <ostream>
+#include <span>
+#include <string>
+#include <string_view>
+
+#if defined(__SSSE3__) || defined(__AVX__)
+#	include <immintrin.h>
+#	define CYBERASM_HEXDUMP_SSSE3 1
+#endif
+
+namespace CyberAsm
+{
+	enum class DumpFormat : std::uint8_t
+	{
+		/// <summary>
+		/// 'XX XX XX | ascii' lines, the last line is padded so the ASCII column stays aligned.
+		/// </summary>
+		Listing,
+
+		/// <summary>
+		/// '0xXX, 0xXX,' lines, to paste between the braces of a C array initializer.
+		/// </summary>
+		CArray,
+
+		/// <summary>
+		/// 'XXXXXX' lines without separators.
+		/// </summary>
+		RawHex,
+
+		Count
+	};
+
+	/// <summary>
+	/// Bytes the formatter may write past the end of the dump, buffers passed to FormatHexDump() need this headroom.
+	/// </summary>
+	inline constexpr std::size_t HexDumpSlack = 64;
+
+	/// <summary>
+	/// Returns the exact number of characters of a dump.
+	/// </summary>
+	[[nodiscard]] constexpr auto HexDumpSize(std::size_t byteCount, std::size_t lineLimit, DumpFormat format) noexcept -> std::size_t;
+
+	/// <summary>
+	/// Formats the bytes in one pass into the preallocated buffer.
+	/// The hex digits of 8 bytes at a time are looked up with a nibble shuffle and spread into the output layout with a second shuffle.
+	/// </summary>
+	/// <param name="bytes">The bytes to dump.</param>
+	/// <param name="lineLimit">The number of bytes per line.</param>
+	/// <param name="format">The output format.</param>
+	/// <param name="out">The buffer, must hold HexDumpSize() + HexDumpSlack characters.</param>
+	/// <returns>The end of the dump.</returns>
+	auto FormatHexDump(std::span<const std::uint8_t> bytes, std::size_t lineLimit, DumpFormat format, char* out) noexcept -> char*;
+
+	/// <summary>
+	/// Returns the dump as a string.
+	/// </summary>
+	[[nodiscard]] auto HexDump(std::span<const std::uint8_t> bytes, std::size_t lineLimit = 8, DumpFormat format = DumpFormat::Listing) -> std::string;
+
+	/// <summary>
+	/// Writes the dump in blocks of whole lines, so the memory used is independent of the dump size.
+	/// </summary>
+	void WriteHexDump(std::ostream& out, std::span<const std::uint8_t> bytes, std::size_t lineLimit = 8, DumpFormat format = DumpFormat::Listing);
+
+	namespace HexDumpDetail
+	{
+		inline constexpr std::string_view Digits = "0123456789ABCDEF";
+
+		/// <summary>
+		/// Output pattern of one byte, 'H' and 'L' are the high and low hex digit, everything else is copied.
+		/// </summary>
+		inline constexpr std::array<std::string_view, static_cast<std::size_t>(DumpFormat::Count)> Patterns =
+		{
+			"HL ",
+			"0xHL, ",
+			"HL"
+		};
+
+		/// <summary>
+		/// Shuffle masks spreading the 16 hex digits of 8 bytes over 8 output patterns.
+		/// </summary>
+		struct Layout final
+		{
+			static constexpr std::size_t MaxBlocks = 3;
+
+			std::size_t Stride = 0;
+			std::size_t Blocks = 0;
+			std::array<std::array<std::uint8_t, 16>, MaxBlocks> Index = {};
+			std::array<std::array<char, 16>, MaxBlocks> Filler = {};
+		};
+
+		[[nodiscard]] constexpr auto MakeLayout(const std::string_view pattern) noexcept -> Layout
+		{
+			Layout layout = {};
+			layout.Stride = pattern.size();
+			layout.Blocks = (8 * pattern.size() + 15) / 16;
+			for (std::size_t position = 0; position < layout.Blocks * 16; ++position)
+			{
+				const std::size_t byte = position / pattern.size();
+				const char slot = byte < 8 ? pattern[position % pattern.size()] : '\0';
+				auto& index = layout.Index[position / 16][position % 16];
+				auto& filler = layout.Filler[position / 16][position % 16];
+				index = slot == 'H' ? static_cast<std::uint8_t>(2 * byte) : slot == 'L' ? static_cast<std::uint8_t>(2 * byte + 1) : 0x80;
+				filler = slot == 'H' || slot == 'L' ? '\0' : slot;
+			}
+			return layout;
+		}
+
+		inline constexpr std::array<Layout, static_cast<std::size_t>(DumpFormat::Count)> Layouts =
+		{
+			MakeLayout(Patterns[0]),
+			MakeLayout(Patterns[1]),
+			MakeLayout(Patterns[2])
+		};
+
+		/// <summary>
+		/// Formats count (at most 8) bytes, writes up to Layout::MaxBlocks * 16 characters.
+		/// At least 8 bytes must be readable at source.
+		/// </summary>
+		template <DumpFormat Format>
+		inline void FormatBytes(const std::uint8_t* const source, char* const out, [[maybe_unused]] const std::size_t count) noexcept
+		{
+			constexpr const Layout& layout = Layouts[static_cast<std::size_t>(Format)];
+#if defined(CYBERASM_HEXDUMP_SSSE3)
+			const __m128i digits = _mm_loadu_si128(reinterpret_cast<const __m128i*>(Digits.data()));
+			const __m128i nibble = _mm_set1_epi8(0x0F);
+			const __m128i value = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(source));
+			const __m128i high = _mm_shuffle_epi8(digits, _mm_and_si128(_mm_srli_epi16(value, 4), nibble));
+			const __m128i low = _mm_shuffle_epi8(digits, _mm_and_si128(value, nibble));
+			const __m128i pairs = _mm_unpacklo_epi8(high, low);
+			for (std::size_t block = 0; block < layout.Blocks; ++block)
+			{
+				const __m128i index = _mm_loadu_si128(reinterpret_cast<const __m128i*>(layout.Index[block].data()));
+				const __m128i filler = _mm_loadu_si128(reinterpret_cast<const __m128i*>(layout.Filler[block].data()));
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(out + block * 16), _mm_or_si128(_mm_shuffle_epi8(pairs, index), filler));
+			}
+#else
+			constexpr std::string_view pattern = Patterns[static_cast<std::size_t>(Format)];
+			char* target = out;
+			for (std::size_t i = 0; i < count; ++i)
+			{
+				for (const char slot : pattern)
+				{
+					*target++ = slot == 'H' ? Digits[source[i] >> 4] : slot == 'L' ? Digits[source[i] & 0x0F] : slot;
+				}
+			}
+#endif
+		}
+
+		/// <summary>
+		/// Writes 8 characters of the ASCII column, non printable bytes become '.'.
+		/// At least 8 bytes must be readable at source.
+		/// </summary>
+		inline void FormatAscii(const std::uint8_t* const source, char* const out) noexcept
+		{
+#if defined(CYBERASM_HEXDUMP_SSSE3)
+			const __m128i value = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(source));
+			const __m128i offset = _mm_sub_epi8(value, _mm_set1_epi8(0x20));
+			const __m128i printable = _mm_cmpeq_epi8(_mm_min_epu8(offset, _mm_set1_epi8(0x5E)), offset);
+			const __m128i ascii = _mm_or_si128(_mm_and_si128(printable, value), _mm_andnot_si128(printable, _mm_set1_epi8('.')));
+			_mm_storel_epi64(reinterpret_cast<__m128i*>(out), ascii);
+#else
+			for (std::size_t i = 0; i < 8; ++i)
+			{
+				out[i] = source[i] >= 0x20 && source[i] <= 0x7E ? static_cast<char>(source[i]) : '.';
+			}
+#endif
+		}
+
+		template <DumpFormat Format>
+		inline auto FormatLines(const std::span<const std::uint8_t> bytes, const std::size_t lineLimit, char* out) noexcept -> char*
+		{
+			constexpr std::size_t stride = Patterns[static_cast<std::size_t>(Format)].size();
+			const std::uint8_t* const end = bytes.data() + bytes.size();
+
+			// Groups at the very end are copied, so the 8 byte loads never read past the input:
+			const auto load = [end](const std::uint8_t* const source, std::array<std::uint8_t, 8>& scratch) noexcept -> const std::uint8_t*
+			{
+				if (end - source >= 8) [[likely]]
+				{
+					return source;
+				}
+				scratch = {};
+				std::memcpy(scratch.data(), source, static_cast<std::size_t>(end - source));
+				return scratch.data();
+			};
+
+			std::array<std::uint8_t, 8> scratch = {};
+			for (const std::uint8_t* line = bytes.data(); line < end; line += lineLimit)
+			{
+				const auto count = std::min<std::size_t>(lineLimit, static_cast<std::size_t>(end - line));
+				if constexpr (Format == DumpFormat::CArray)
+				{
+					*out++ = '\t';
+				}
+				for (std::size_t i = 0; i < count; i += 8)
+				{
+					const auto group = std::min<std::size_t>(8, count - i);
+					FormatBytes<Format>(load(line + i, scratch), out, group);
+					out += group * stride;
+				}
+
+				if constexpr (Format == DumpFormat::Listing)
+				{
+					std::memset(out, ' ', (lineLimit - count) * stride);
+					out += (lineLimit - count) * stride;
+					std::memcpy(out, " | ", 3);
+					out += 3;
+					for (std::size_t i = 0; i < count; i += 8)
+					{
+						FormatAscii(load(line + i, scratch), out + i);
+					}
+					out += count;
+					*out++ = '\n';
+				}
+				else if constexpr (Format == DumpFormat::CArray)
+				{
+					// Replace the space after the last comma:
+					out[-1] = '\n';
+				}
+				else
+				{
+					*out++ = '\n';
+				}
+			}
+			return out;
+		}
+
+		/// <summary>
+		/// Formats the bytes as 'XX ' groups without a line break, the input may end anywhere.
+		/// Writes up to HexDumpSlack characters past the returned end.
+		/// </summary>
+		inline auto FormatByteRun(const std::span<const std::uint8_t> bytes, char* out) noexcept -> char*
+		{
+			constexpr std::size_t stride = Patterns[static_cast<std::size_t>(DumpFormat::Listing)].size();
+			std::array<std::uint8_t, 8> scratch = {};
+			for (std::size_t i = 0; i < bytes.size(); i += 8)
+			{
+				const auto group = std::min<std::size_t>(8, bytes.size() - i);
+				const std::uint8_t* source = bytes.data() + i;
+				if (group < 8)
+				{
+					std::memcpy(scratch.data(), source, group);
+					source = scratch.data();
+				}
+				FormatBytes<DumpFormat::Listing>(source, out, group);
+				out += group * stride;
+			}
+			return out;
+		}
+	}
+
+	constexpr auto HexDumpSize(const std::size_t byteCount, std::size_t lineLimit, const DumpFormat format) noexcept -> std::size_t
+	{
+		lineLimit = std::max<std::size_t>(lineLimit, 1);
+		const std::size_t lines = (byteCount + lineLimit - 1) / lineLimit;
+		switch (format)
+		{
+			case DumpFormat::Listing: return lines * (lineLimit * 3 + 4) + byteCount;
+			case DumpFormat::CArray: return lines + byteCount * 6;
+			case DumpFormat::RawHex: return lines + byteCount * 2;
+			default: return 0;
+		}
+	}
+
+	inline auto FormatHexDump(const std::span<const std::uint8_t> bytes, std::size_t lineLimit, const DumpFormat format, char* const out) noexcept -> char*
+	{
+		lineLimit = std::max<std::size_t>(lineLimit, 1);
+		switch (format)
+		{
+			case DumpFormat::Listing: return HexDumpDetail::FormatLines<DumpFormat::Listing>(bytes, lineLimit, out);
+			case DumpFormat::CArray: return HexDumpDetail::FormatLines<DumpFormat::CArray>(bytes, lineLimit, out);
+			case DumpFormat::RawHex: return HexDumpDetail::FormatLines<DumpFormat::RawHex>(bytes, lineLimit, out);
+			default: return out;
+		}
+	}
+
+	inline auto HexDump(const std::span<const std::uint8_t> bytes, const std::size_t lineLimit, const DumpFormat format) -> std::string
+	{
+		const std::size_t size = HexDumpSize(bytes.size(), lineLimit, format);
+		std::string result(size + HexDumpSlack, '\0');
+		const char* const end = FormatHexDump(bytes, lineLimit, format, result.data());
+		result.resize(static_cast<std::size_t>(end - result.data()));
+		return result;
+	}
+
+	inline void WriteHexDump(std::ostream& out, const std::span<const std::uint8_t> bytes, std::size_t lineLimit, const DumpFormat format)
+	{
+		constexpr std::size_t blockBytes = 16 * 1024;
+		lineLimit = std::max<std::size_t>(lineLimit, 1);
+		const std::size_t linesPerBlock = std::max<std::size_t>(1, blockBytes / lineLimit);
+		const std::size_t bytesPerBlock = linesPerBlock * lineLimit;
+
+		std::string buffer(HexDumpSize(std::min(bytes.size(), bytesPerBlock), lineLimit, format) + HexDumpSlack, '\0');
+		for (std::size_t offset = 0; offset < bytes.size(); offset += bytesPerBlock)
+		{
+			const auto block = bytes.subspan(offset, std::min(bytesPerBlock, bytes.size() - offset));
+			const char* const end = FormatHexDump(block, lineLimit, format, buffer.data());
+			out.write(buffer.data(), end - buffer.data());
+		}
+	}
+}
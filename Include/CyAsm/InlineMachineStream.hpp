@@ -0,0 +1,195 @@
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+
+#include "MachineStream.hpp"
+
+namespace CyberAsm
+{
+	/// <summary>
+	/// Memory resource with one inline block for the first allocation of at most InlineSize bytes.
+	/// Larger or concurrent allocations go to the upstream resource.
+	/// A vector reserving InlineSize bytes up front lives entirely inside the resource,
+	/// and when it grows past the block it moves to the heap and frees the block again.
+	/// </summary>
+	template <std::size_t InlineSize>
+	class InlineBufferResource final : public std::pmr::memory_resource
+	{
+	public:
+		explicit InlineBufferResource(std::pmr::memory_resource* upstream = std::pmr::get_default_resource()) noexcept;
+		InlineBufferResource(const InlineBufferResource&) = delete;
+		InlineBufferResource(InlineBufferResource&&) = delete;
+		auto operator =(const InlineBufferResource&) -> InlineBufferResource& = delete;
+		auto operator =(InlineBufferResource&&) -> InlineBufferResource& = delete;
+		~InlineBufferResource() override = default;
+
+		/// <summary>
+		/// Returns true if the memory is the inline block.
+		/// </summary>
+		[[nodiscard]] auto Owns(const void* memory) const noexcept -> bool;
+
+		/// <summary>
+		/// Returns true if the inline block is allocated.
+		/// </summary>
+		[[nodiscard]] auto InUse() const noexcept -> bool;
+
+	private:
+		auto do_allocate(std::size_t bytes, std::size_t alignment) -> void* override;
+		void do_deallocate(void* memory, std::size_t bytes, std::size_t alignment) override;
+		[[nodiscard]] auto do_is_equal(const std::pmr::memory_resource& other) const noexcept -> bool override;
+
+		alignas(std::max_align_t) std::byte block[InlineSize];
+		bool blockInUse = false;
+		std::pmr::memory_resource* upstream = nullptr;
+	};
+
+	/// <summary>
+	/// Machine stream with inline storage for tiny stubs such as trampolines, thunks and inline cache stubs.
+	/// Code up to InlineSize bytes stays inside the object, without any heap allocation,
+	/// and spills to the heap only when it grows beyond that.
+	/// The object is pinned because the stream points into it, access the stream with Get(), * or ->.
+	/// Copies of the stream allocate from the default resource and may outlive this object, use Release() to take the code.
+	/// Move construction keeps the allocator, so MachineStream(std::move(*stub)) would still point into this object,
+	/// the destructor asserts that the stream was not moved out.
+	/// </summary>
+	template <std::size_t InlineSize = 64, Abi Arch = Abi::X86_64>
+	class InlineMachineStream final
+	{
+	public:
+		InlineMachineStream();
+		InlineMachineStream(const InlineMachineStream&) = delete;
+		InlineMachineStream(InlineMachineStream&&) = delete;
+		auto operator =(const InlineMachineStream&) -> InlineMachineStream& = delete;
+		auto operator =(InlineMachineStream&&) -> InlineMachineStream& = delete;
+		~InlineMachineStream();
+
+		[[nodiscard]] auto Get() noexcept -> MachineStream<Arch>&;
+		[[nodiscard]] auto Get() const noexcept -> const MachineStream<Arch>&;
+		[[nodiscard]] auto operator *() noexcept -> MachineStream<Arch>&;
+		[[nodiscard]] auto operator *() const noexcept -> const MachineStream<Arch>&;
+		[[nodiscard]] auto operator ->() noexcept -> MachineStream<Arch>*;
+		[[nodiscard]] auto operator ->() const noexcept -> const MachineStream<Arch>*;
+
+		/// <summary>
+		/// Returns true if the code is still stored inside the object.
+		/// </summary>
+		[[nodiscard]] auto IsInline() const noexcept -> bool;
+
+		/// <summary>
+		/// Returns a copy of the stream on the default resource, which may outlive this object, and clears the stream.
+		/// </summary>
+		[[nodiscard]] auto Release() -> MachineStream<Arch>;
+
+	private:
+		// Declared first, so it outlives the stream:
+		InlineBufferResource<InlineSize> storage;
+		MachineStream<Arch> stream;
+	};
+
+	template <std::size_t InlineSize>
+	inline InlineBufferResource<InlineSize>::InlineBufferResource(std::pmr::memory_resource* const upstream) noexcept : upstream(upstream) { }
+
+	template <std::size_t InlineSize>
+	inline auto InlineBufferResource<InlineSize>::Owns(const void* const memory) const noexcept -> bool
+	{
+		return memory == this->block;
+	}
+
+	template <std::size_t InlineSize>
+	inline auto InlineBufferResource<InlineSize>::InUse() const noexcept -> bool
+	{
+		return this->blockInUse;
+	}
+
+	template <std::size_t InlineSize>
+	inline auto InlineBufferResource<InlineSize>::do_allocate(const std::size_t bytes, const std::size_t alignment) -> void*
+	{
+		if (!this->blockInUse && bytes <= InlineSize && alignment <= alignof(std::max_align_t)) [[likely]]
+		{
+			this->blockInUse = true;
+			return this->block;
+		}
+		return this->upstream->allocate(bytes, alignment);
+	}
+
+	template <std::size_t InlineSize>
+	inline void InlineBufferResource<InlineSize>::do_deallocate(void* const memory, const std::size_t bytes, const std::size_t alignment)
+	{
+		if (this->Owns(memory)) [[likely]]
+		{
+			this->blockInUse = false;
+			return;
+		}
+		this->upstream->deallocate(memory, bytes, alignment);
+	}
+
+	template <std::size_t InlineSize>
+	inline auto InlineBufferResource<InlineSize>::do_is_equal(const std::pmr::memory_resource& other) const noexcept -> bool
+	{
+		return this == &other;
+	}
+
+	template <std::size_t InlineSize, Abi Arch>
+	inline InlineMachineStream<InlineSize, Arch>::InlineMachineStream() : stream(InlineSize, &this->storage) { }
+
+	template <std::size_t InlineSize, Abi Arch>
+	inline InlineMachineStream<InlineSize, Arch>::~InlineMachineStream()
+	{
+		// A stream move constructed from ours keeps this resource and would dangle, the moved-from buffer has no capacity left:
+		assert(this->stream.Stream().capacity() != 0);
+		assert(!this->storage.InUse() || this->IsInline());
+	}
+
+	template <std::size_t InlineSize, Abi Arch>
+	inline auto InlineMachineStream<InlineSize, Arch>::Get() noexcept -> MachineStream<Arch>&
+	{
+		return this->stream;
+	}
+
+	template <std::size_t InlineSize, Abi Arch>
+	inline auto InlineMachineStream<InlineSize, Arch>::Get() const noexcept -> const MachineStream<Arch>&
+	{
+		return this->stream;
+	}
+
+	template <std::size_t InlineSize, Abi Arch>
+	inline auto InlineMachineStream<InlineSize, Arch>::operator*() noexcept -> MachineStream<Arch>&
+	{
+		return this->stream;
+	}
+
+	template <std::size_t InlineSize, Abi Arch>
+	inline auto InlineMachineStream<InlineSize, Arch>::operator*() const noexcept -> const MachineStream<Arch>&
+	{
+		return this->stream;
+	}
+
+	template <std::size_t InlineSize, Abi Arch>
+	inline auto InlineMachineStream<InlineSize, Arch>::operator->() noexcept -> MachineStream<Arch>*
+	{
+		return &this->stream;
+	}
+
+	template <std::size_t InlineSize, Abi Arch>
+	inline auto InlineMachineStream<InlineSize, Arch>::operator->() const noexcept -> const MachineStream<Arch>*
+	{
+		return &this->stream;
+	}
+
+	template <std::size_t InlineSize, Abi Arch>
+	inline auto InlineMachineStream<InlineSize, Arch>::IsInline() const noexcept -> bool
+	{
+		return this->storage.Owns(this->stream.Stream().data());
+	}
+
+	template <std::size_t InlineSize, Abi Arch>
+	inline auto InlineMachineStream<InlineSize, Arch>::Release() -> MachineStream<Arch>
+	{
+		MachineStream<Arch> result = this->stream;
+		this->stream.Clear();
+		return result;
+	}
+}
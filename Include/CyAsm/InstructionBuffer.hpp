@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstdint>
+#include <array>
+#include <concepts>
+
+#include "Immediate.hpp"
+#include "MachineLanguage.hpp"
+
+namespace CyberAsm
+{
+	/// <summary>
+	/// Receives the bytes of one encoded instruction.
+	/// Satisfied by ByteChunk and InstructionBuffer.
+	/// </summary>
+	template <typename T>
+	concept MachineCodeSink = requires(T& out, const std::uint8_t byte, const Immediate& immediate, const WordSize size)
+	{
+		out << byte;
+		out.WriteFixedImmediate(immediate, size);
+		{ out.Size() } -> std::convertible_to<std::size_t>;
+	};
+
+	/// <summary>
+	/// Unchecked scratch buffer for a single instruction.
+	/// x86 instructions are at most 15 bytes long, so the whole buffer can be copied with one 16-byte store.
+	/// </summary>
+	struct InstructionBuffer final
+	{
+		static constexpr std::size_t Capacity = 16;
+
+		alignas(Capacity) std::array<std::uint8_t, Capacity> Bytes = {};
+		std::uint8_t Length = 0;
+
+		constexpr auto operator <<(std::uint8_t value) noexcept -> InstructionBuffer&;
+		constexpr void WriteFixedImmediate(const Immediate& imm, WordSize fixed) noexcept;
+		[[nodiscard]] constexpr auto Size() const noexcept -> std::size_t;
+		[[nodiscard]] constexpr auto Data() const noexcept -> const std::uint8_t*;
+	};
+
+	constexpr auto InstructionBuffer::operator<<(const std::uint8_t value) noexcept -> InstructionBuffer&
+	{
+		this->Bytes[this->Length++] = value;
+		return *this;
+	}
+
+	constexpr void InstructionBuffer::WriteFixedImmediate(const Immediate& imm, const WordSize fixed) noexcept
+	{
+		for (std::uint8_t i = 0; i < static_cast<std::uint8_t>(fixed); ++i)
+		{
+			this->Bytes[this->Length++] = static_cast<std::uint8_t>(imm.UValue >> (i * 8));
+		}
+	}
+
+	constexpr auto InstructionBuffer::Size() const noexcept -> std::size_t
+	{
+		return this->Length;
+	}
+
+	constexpr auto InstructionBuffer::Data() const noexcept -> const std::uint8_t*
+	{
+		return this->Bytes.data();
+	}
+}
@@ -0,0 +1,331 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <span>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#if defined(_WIN32)
+#	ifndef NOMINMAX
+#		define NOMINMAX
+#	endif
+#	include <Windows.h>
+#else
+#	include <sys/mman.h>
+#	include <unistd.h>
+#endif
+
+#include "MachineStream.hpp"
+
+namespace CyberAsm
+{
+	/// <summary>
+	/// W^X executable memory arena for running generated machine code in-process.
+	/// Code is written into read/write pages. Seal() flips all pending pages to read/execute with
+	/// one protection change per region, so many functions share one syscall instead of paying it per function.
+	/// A page is never writable and executable at the same time.
+	///
+	/// Encoders can write directly into arena memory with Reserve() and Commit(), which avoids any copy.
+	/// Emit() copies a finished MachineStream, because a heap allocated vector buffer cannot be made executable in place.
+	/// </summary>
+	class JitArena final
+	{
+	public:
+		static constexpr std::size_t DefaultRegionSize = 256 * 1024;
+		static constexpr std::size_t DefaultAlignment = 16;
+
+		/// <summary>
+		/// int3, fills the gaps between functions.
+		/// </summary>
+		static constexpr std::uint8_t PaddingByte = 0xCC;
+
+		JitArena() noexcept = default;
+		explicit JitArena(std::size_t regionSize);
+		JitArena(const JitArena&) = delete;
+		JitArena(JitArena&& other) noexcept;
+		auto operator =(const JitArena&) -> JitArena& = delete;
+		auto operator =(JitArena&& other) noexcept -> JitArena&;
+		~JitArena();
+
+		/// <summary>
+		/// Reserves writable memory for a function of at most size bytes.
+		/// The memory stays valid until the next call of Reserve(), Emit() or Seal().
+		/// </summary>
+		/// <param name="size">The maximum size of the function.</param>
+		/// <param name="alignment">The entry alignment, must be a power of two.</param>
+		/// <returns>The writable memory.</returns>
+		[[nodiscard]] auto Reserve(std::size_t size, std::size_t alignment = DefaultAlignment) -> std::span<std::uint8_t>;
+
+		/// <summary>
+		/// Commits the last reservation.
+		/// </summary>
+		/// <param name="size">The number of bytes actually written.</param>
+		/// <returns>The entry point of the function, callable after Seal().</returns>
+		auto Commit(std::size_t size) -> const void*;
+
+		/// <summary>
+		/// Copies the machine code into the arena.
+		/// </summary>
+		/// <returns>The entry point of the function, callable after Seal().</returns>
+		auto Emit(std::span<const std::uint8_t> code, std::size_t alignment = DefaultAlignment) -> const void*;
+
+		template <Abi Arch>
+		auto Emit(const MachineStream<Arch>& stream, std::size_t alignment = DefaultAlignment) -> const void*;
+
+		/// <summary>
+		/// Makes all code emitted since the last call executable and write protects it.
+		/// </summary>
+		void Seal();
+
+		[[nodiscard]] auto IsExecutable(const void* entry) const noexcept -> bool;
+
+		/// <summary>
+		/// Returns a typed function pointer to sealed code.
+		/// Throws if the entry was not sealed yet.
+		/// </summary>
+		template <typename F> requires std::is_function_v<F>
+		[[nodiscard]] auto Function(const void* entry) const -> F*;
+
+		/// <summary>
+		/// The number of protection changes issued so far.
+		/// </summary>
+		[[nodiscard]] auto ProtectionFlips() const noexcept -> std::size_t;
+
+		/// <summary>
+		/// The number of bytes emitted but not sealed yet.
+		/// </summary>
+		[[nodiscard]] auto PendingBytes() const noexcept -> std::size_t;
+
+		[[nodiscard]] static auto PageSize() noexcept -> std::size_t;
+
+	private:
+		struct Region final
+		{
+			std::uint8_t* Base = nullptr;
+			std::size_t Capacity = 0;
+
+			/// <summary>
+			/// Bytes [0, Sealed) are read/execute, the rest is read/write.
+			/// </summary>
+			std::size_t Sealed = 0;
+			std::size_t Used = 0;
+		};
+
+		[[nodiscard]] static auto AlignUp(std::size_t value, std::size_t alignment) noexcept -> std::size_t;
+		[[nodiscard]] static auto MapRegion(std::size_t capacity) -> Region;
+		static void UnmapRegion(const Region& region) noexcept;
+		static void ProtectExecutable(std::uint8_t* begin, std::size_t size);
+		void Release() noexcept;
+
+		std::vector<Region> regions = {};
+		std::size_t regionSize = DefaultRegionSize;
+		std::size_t reservationOffset = 0;
+		std::size_t reservationSize = 0;
+		std::size_t protectionFlips = 0;
+	};
+
+	inline JitArena::JitArena(const std::size_t regionSize) : regionSize(AlignUp(regionSize, PageSize())) { }
+
+	inline JitArena::JitArena(JitArena&& other) noexcept :
+		regions(std::move(other.regions)),
+		regionSize(other.regionSize),
+		reservationOffset(other.reservationOffset),
+		reservationSize(other.reservationSize),
+		protectionFlips(other.protectionFlips)
+	{
+		other.regions.clear();
+		other.reservationSize = 0;
+	}
+
+	inline auto JitArena::operator=(JitArena&& other) noexcept -> JitArena&
+	{
+		if (this != &other) [[likely]]
+		{
+			this->Release();
+			this->regions = std::move(other.regions);
+			this->regionSize = other.regionSize;
+			this->reservationOffset = other.reservationOffset;
+			this->reservationSize = other.reservationSize;
+			this->protectionFlips = other.protectionFlips;
+			other.regions.clear();
+			other.reservationSize = 0;
+		}
+		return *this;
+	}
+
+	inline JitArena::~JitArena()
+	{
+		this->Release();
+	}
+
+	inline auto JitArena::Reserve(const std::size_t size, const std::size_t alignment) -> std::span<std::uint8_t>
+	{
+		std::size_t offset = this->regions.empty() ? 0 : AlignUp(this->regions.back().Used, alignment);
+		if (this->regions.empty() || offset + size > this->regions.back().Capacity) [[unlikely]]
+		{
+			this->regions.push_back(MapRegion(std::max(this->regionSize, AlignUp(size, PageSize()))));
+			offset = 0;
+		}
+
+		Region& region = this->regions.back();
+		std::memset(region.Base + region.Used, PaddingByte, offset - region.Used);
+		region.Used = offset;
+		this->reservationOffset = offset;
+		this->reservationSize = size;
+		return {region.Base + offset, size};
+	}
+
+	inline auto JitArena::Commit(const std::size_t size) -> const void*
+	{
+		if (size > this->reservationSize || this->regions.empty()) [[unlikely]]
+		{
+			throw std::runtime_error("Commit exceeds the reserved JIT memory!");
+		}
+		Region& region = this->regions.back();
+		region.Used = this->reservationOffset + size;
+		this->reservationSize = 0;
+		return region.Base + this->reservationOffset;
+	}
+
+	inline auto JitArena::Emit(const std::span<const std::uint8_t> code, const std::size_t alignment) -> const void*
+	{
+		const auto memory = this->Reserve(code.size(), alignment);
+		std::memcpy(memory.data(), code.data(), code.size());
+		return this->Commit(code.size());
+	}
+
+	template <Abi Arch>
+	inline auto JitArena::Emit(const MachineStream<Arch>& stream, const std::size_t alignment) -> const void*
+	{
+		return this->Emit(std::span<const std::uint8_t>(stream.begin(), stream.end()), alignment);
+	}
+
+	inline void JitArena::Seal()
+	{
+		const auto pageSize = PageSize();
+		for (Region& region : this->regions)
+		{
+			if (region.Used == region.Sealed) [[likely]]
+			{
+				continue;
+			}
+
+			// The remaining bytes of the last page become executable too, fill them with traps:
+			const auto end = std::min(AlignUp(region.Used, pageSize), region.Capacity);
+			std::memset(region.Base + region.Used, PaddingByte, end - region.Used);
+			ProtectExecutable(region.Base + region.Sealed, end - region.Sealed);
+			++this->protectionFlips;
+			region.Sealed = region.Used = end;
+		}
+		this->reservationSize = 0;
+	}
+
+	inline auto JitArena::IsExecutable(const void* const entry) const noexcept -> bool
+	{
+		const auto* const address = static_cast<const std::uint8_t*>(entry);
+		for (const Region& region : this->regions)
+		{
+			if (address >= region.Base && address < region.Base + region.Sealed)
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+
+	template <typename F> requires std::is_function_v<F>
+	inline auto JitArena::Function(const void* const entry) const -> F*
+	{
+		if (!this->IsExecutable(entry)) [[unlikely]]
+		{
+			throw std::runtime_error("JIT code must be sealed before it is called!");
+		}
+		return reinterpret_cast<F*>(const_cast<void*>(entry));
+	}
+
+	inline auto JitArena::ProtectionFlips() const noexcept -> std::size_t
+	{
+		return this->protectionFlips;
+	}
+
+	inline auto JitArena::PendingBytes() const noexcept -> std::size_t
+	{
+		std::size_t pending = 0;
+		for (const Region& region : this->regions)
+		{
+			pending += region.Used - region.Sealed;
+		}
+		return pending;
+	}
+
+	inline auto JitArena::PageSize() noexcept -> std::size_t
+	{
+#if defined(_WIN32)
+		SYSTEM_INFO info = {};
+		GetSystemInfo(&info);
+		return info.dwPageSize;
+#else
+		return static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+#endif
+	}
+
+	inline auto JitArena::AlignUp(const std::size_t value, const std::size_t alignment) noexcept -> std::size_t
+	{
+		return (value + alignment - 1) & ~(alignment - 1);
+	}
+
+	inline auto JitArena::MapRegion(const std::size_t capacity) -> Region
+	{
+#if defined(_WIN32)
+		void* const memory = VirtualAlloc(nullptr, capacity, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+		if (!memory) [[unlikely]]
+#else
+		void* const memory = mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (memory == MAP_FAILED) [[unlikely]]
+#endif
+		{
+			throw std::runtime_error("Failed to map JIT memory!");
+		}
+		return {static_cast<std::uint8_t*>(memory), capacity, 0, 0};
+	}
+
+	inline void JitArena::UnmapRegion(const Region& region) noexcept
+	{
+#if defined(_WIN32)
+		VirtualFree(region.Base, 0, MEM_RELEASE);
+#else
+		munmap(region.Base, region.Capacity);
+#endif
+	}
+
+	inline void JitArena::ProtectExecutable(std::uint8_t* const begin, const std::size_t size)
+	{
+#if defined(_WIN32)
+		DWORD old = 0;
+		if (!VirtualProtect(begin, size, PAGE_EXECUTE_READ, &old)) [[unlikely]]
+		{
+			throw std::runtime_error("Failed to make JIT memory executable!");
+		}
+		FlushInstructionCache(GetCurrentProcess(), begin, size);
+#else
+		if (mprotect(begin, size, PROT_READ | PROT_EXEC) != 0) [[unlikely]]
+		{
+			throw std::runtime_error("Failed to make JIT memory executable!");
+		}
+		__builtin___clear_cache(reinterpret_cast<char*>(begin), reinterpret_cast<char*>(begin + size));
+#endif
+	}
+
+	inline void JitArena::Release() noexcept
+	{
+		for (const Region& region : this->regions)
+		{
+			UnmapRegion(region);
+		}
+		this->regions.clear();
+	}
+}
@@ -0,0 +1,691 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <array>
+#include <functional>
+#include <limits>
+#include <memory_resource>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace CyberAsm
+{
+	/// <summary>
+	/// Handle to a code position which may be bound later.
+	/// Labels are cheap indices into the LabelTable of the stream which created them.
+	/// </summary>
+	struct Label final
+	{
+		static constexpr std::uint32_t InvalidId = std::numeric_limits<std::uint32_t>::max();
+
+		std::uint32_t Id = InvalidId;
+
+		[[nodiscard]] constexpr auto IsValid() const noexcept -> bool
+		{
+			return this->Id != InvalidId;
+		}
+
+		constexpr auto operator ==(const Label& rhs) const noexcept -> bool = default;
+		constexpr auto operator !=(const Label& rhs) const noexcept -> bool = default;
+	};
+
+	enum class FixupKind : std::uint8_t
+	{
+		/// <summary>
+		/// Signed 8-bit displacement relative to the end of the field.
+		/// </summary>
+		Relative8,
+
+		/// <summary>
+		/// Signed 32-bit displacement relative to the end of the field.
+		/// </summary>
+		Relative32,
+
+		/// <summary>
+		/// 32-bit absolute address (base address + label offset).
+		/// </summary>
+		Absolute32,
+
+		/// <summary>
+		/// 64-bit absolute address (base address + label offset).
+		/// </summary>
+		Absolute64
+	};
+
+	[[nodiscard]] constexpr auto FixupWidth(const FixupKind kind) noexcept -> std::size_t
+	{
+		switch (kind)
+		{
+			case FixupKind::Relative8: return 1;
+			case FixupKind::Relative32:
+			case FixupKind::Absolute32: return 4;
+			case FixupKind::Absolute64: return 8;
+		}
+		return 0;
+	}
+
+	/// <summary>
+	/// A pending reference to a label which is patched when the stream is finalized.
+	/// </summary>
+	struct Fixup final
+	{
+		/// <summary>
+		/// Stream offset of the field to patch.
+		/// </summary>
+		std::size_t Offset = 0;
+
+		Label Target = {};
+		FixupKind Kind = FixupKind::Relative32;
+
+		/// <summary>
+		/// Added to the resolved value, for example to compensate trailing immediates after a relative field.
+		/// </summary>
+		std::int64_t Addend = 0;
+	};
+
+	/// <summary>
+	/// A branch which is emitted in its short form (opcode + rel8) and widened to its long form (opcode + rel32)
+	/// by relaxation when the displacement does not fit.
+	/// </summary>
+	struct RelaxableBranch final
+	{
+		static constexpr std::size_t ShortSize = 2;
+		static constexpr std::size_t MaxLongOpCodeSize = 2;
+
+		/// <summary>
+		/// Stream offset of the short opcode.
+		/// </summary>
+		std::size_t Offset = 0;
+
+		Label Target = {};
+		std::uint8_t ShortOpCode = 0;
+		std::array<std::uint8_t, MaxLongOpCodeSize> LongOpCode = {};
+		std::uint8_t LongOpCodeSize = 0;
+		bool IsLong = false;
+
+		[[nodiscard]] constexpr auto LongSize() const noexcept -> std::size_t
+		{
+			return this->LongOpCodeSize + sizeof(std::int32_t);
+		}
+
+		/// <summary>
+		/// The number of bytes the branch grows by when it is widened.
+		/// </summary>
+		[[nodiscard]] constexpr auto Growth() const noexcept -> std::size_t
+		{
+			return this->LongSize() - ShortSize;
+		}
+	};
+
+	/// <summary>
+	/// Statistics of the last branch relaxation.
+	/// </summary>
+	struct RelaxationStats final
+	{
+		/// <summary>
+		/// The number of sweeps over the branch list, including the final sweep which found nothing to widen.
+		/// </summary>
+		std::size_t Iterations = 0;
+
+		std::size_t Branches = 0;
+		std::size_t Widened = 0;
+
+		/// <summary>
+		/// The bytes saved compared to encoding every branch in its long form.
+		/// </summary>
+		std::size_t BytesSaved = 0;
+	};
+
+	/// <summary>
+	/// Stores the labels and fixups of one machine code stream.
+	/// Code is emitted in a single linear sweep: forward references are recorded as fixups and
+	/// patched in one pass by Resolve(), so nothing has to be assembled twice.
+	/// </summary>
+	class LabelTable final
+	{
+	public:
+		static constexpr std::size_t UnboundOffset = std::numeric_limits<std::size_t>::max();
+
+		/// <summary>
+		/// Creates a new anonymous label.
+		/// </summary>
+		[[nodiscard]] auto Create() -> Label;
+
+		/// <summary>
+		/// Creates a new named label, throws if the name already exists.
+		/// </summary>
+		[[nodiscard]] auto Create(std::string_view name) -> Label;
+
+		[[nodiscard]] auto Find(std::string_view name) const -> std::optional<Label>;
+		[[nodiscard]] auto FindOrCreate(std::string_view name) -> Label;
+
+		/// <summary>
+		/// Binds the label to a stream offset, throws if it is already bound.
+		/// </summary>
+		void Bind(Label label, std::size_t offset);
+
+		[[nodiscard]] auto Offset(Label label) const -> std::optional<std::size_t>;
+		[[nodiscard]] auto Name(Label label) const -> std::string_view;
+
+		void AddFixup(const Fixup& fixup);
+		[[nodiscard]] auto Fixups() const noexcept -> std::span<const Fixup>;
+		[[nodiscard]] auto LabelCount() const noexcept -> std::size_t;
+
+		/// <summary>
+		/// Records a short branch, the branches must be added in stream order.
+		/// </summary>
+		void AddBranch(const RelaxableBranch& branch);
+		[[nodiscard]] auto Branches() const noexcept -> std::span<const RelaxableBranch>;
+
+		/// <summary>
+		/// Widens every short branch whose displacement does not fit into rel8, then patches all branch displacements.
+		/// Every branch starts short and is only ever widened, so the sweeps converge.
+		/// Each sweep only recomputes the growth prefix sums, the code is moved once at the end and nothing is re-encoded.
+		/// Label and fixup offsets are adjusted, the branches are removed.
+		/// </summary>
+		/// <param name="code">The machine code of the owning stream, grows by the widened bytes.</param>
+		/// <param name="markers">Further stream offsets owned by the caller, such as listing rows, which are moved with the code.</param>
+		/// <param name="limit">Only the branches in front of this offset are relaxed, they must not refer to labels behind it, see SettledEnd().
+		/// The code behind it moves as a whole and keeps its branches.</param>
+		/// <returns>The relaxation statistics.</returns>
+		auto Relax(std::pmr::vector<std::uint8_t>& code, std::span<std::size_t> markers = {}, std::size_t limit = UnboundOffset) -> RelaxationStats;
+
+		/// <summary>
+		/// Takes over the labels, fixups and branches of another table whose code was appended at codeOffset.
+		/// mapping[i] is the label of this table which label i of the other table becomes,
+		/// invalid entries are filled with the label of the same name or a new anonymous label.
+		/// Throws if a label is bound in both tables.
+		/// </summary>
+		/// <param name="other">The table to take over, must not be relaxed yet.</param>
+		/// <param name="codeOffset">The offset of the other code in the owning stream.</param>
+		/// <param name="mapping">One entry per label of the other table.</param>
+		void Merge(const LabelTable& other, std::size_t codeOffset, std::span<Label> mapping);
+
+		/// <summary>
+		/// Patches all fixups into the code and removes them.
+		/// Throws if a label is unbound or a value does not fit into its field.
+		/// </summary>
+		/// <param name="code">The machine code of the owning stream.</param>
+		/// <param name="baseAddress">The load address of the code, used for absolute fixups.</param>
+		/// <param name="limit">Only the fixups in front of this offset are patched, the others are kept.</param>
+		void Resolve(std::span<std::uint8_t> code, std::uint64_t baseAddress = 0, std::size_t limit = UnboundOffset);
+
+		/// <summary>
+		/// Returns the end of the longest prefix of the code in front of end whose branches and fixups only refer to labels bound inside it.
+		/// Relaxing and resolving up to there makes the bytes of the prefix final, no matter which code follows.
+		/// </summary>
+		/// <param name="end">The end of the code of the owning stream.</param>
+		[[nodiscard]] auto SettledEnd(std::size_t end) const -> std::size_t;
+
+		/// <summary>
+		/// Moves the origin behind code which was written out and removed from the owning stream.
+		/// Offsets stay relative to the start of the whole stream, so later code may still refer to labels in the removed code.
+		/// </summary>
+		/// <param name="size">The number of removed bytes, all branches and fixups in them must be resolved.</param>
+		void Discard(std::size_t size);
+
+		/// <summary>
+		/// Returns the offset of the first byte of the code of the owning stream, the number of discarded bytes.
+		/// </summary>
+		[[nodiscard]] auto Origin() const noexcept -> std::size_t;
+
+		void Clear() noexcept;
+
+	private:
+		struct NameHash final
+		{
+			using is_transparent = void;
+
+			[[nodiscard]] auto operator ()(const std::string_view name) const noexcept -> std::size_t
+			{
+				return std::hash<std::string_view>{}(name);
+			}
+		};
+
+		[[nodiscard]] auto Describe(Label label) const -> std::string;
+		[[nodiscard]] auto BoundOffset(Label label) const -> std::size_t;
+
+		/// <summary>
+		/// After this many sweeps all remaining short branches are widened at once.
+		/// </summary>
+		static constexpr std::size_t MaxRelaxationIterations = 16;
+
+		std::vector<std::size_t> offsets = {};
+		std::unordered_map<std::string, Label, NameHash, std::equal_to<>> names = {};
+		std::vector<Fixup> fixups = {};
+		std::vector<RelaxableBranch> branches = {};
+		std::size_t origin = 0;
+	};
+
+	inline auto LabelTable::Create() -> Label
+	{
+		this->offsets.push_back(UnboundOffset);
+		return Label{static_cast<std::uint32_t>(this->offsets.size() - 1)};
+	}
+
+	inline auto LabelTable::Create(const std::string_view name) -> Label
+	{
+		if (this->names.contains(name)) [[unlikely]]
+		{
+			throw std::runtime_error("Label '" + std::string(name) + "' already exists!");
+		}
+		const Label label = this->Create();
+		this->names.emplace(name, label);
+		return label;
+	}
+
+	inline auto LabelTable::Find(const std::string_view name) const -> std::optional<Label>
+	{
+		const auto it = this->names.find(name);
+		if (it == this->names.end())
+		{
+			return std::nullopt;
+		}
+		return it->second;
+	}
+
+	inline auto LabelTable::FindOrCreate(const std::string_view name) -> Label
+	{
+		if (const auto label = this->Find(name))
+		{
+			return *label;
+		}
+		return this->Create(name);
+	}
+
+	inline void LabelTable::Bind(const Label label, const std::size_t offset)
+	{
+		if (label.Id >= this->offsets.size()) [[unlikely]]
+		{
+			throw std::runtime_error("Invalid label!");
+		}
+		if (this->offsets[label.Id] != UnboundOffset) [[unlikely]]
+		{
+			throw std::runtime_error("Label " + this->Describe(label) + " is already bound!");
+		}
+		this->offsets[label.Id] = offset;
+	}
+
+	inline auto LabelTable::Offset(const Label label) const -> std::optional<std::size_t>
+	{
+		if (label.Id >= this->offsets.size() || this->offsets[label.Id] == UnboundOffset)
+		{
+			return std::nullopt;
+		}
+		return this->offsets[label.Id];
+	}
+
+	inline auto LabelTable::Name(const Label label) const -> std::string_view
+	{
+		for (const auto& [name, value] : this->names)
+		{
+			if (value == label)
+			{
+				return name;
+			}
+		}
+		return {};
+	}
+
+	inline void LabelTable::AddFixup(const Fixup& fixup)
+	{
+		this->fixups.push_back(fixup);
+	}
+
+	inline auto LabelTable::Fixups() const noexcept -> std::span<const Fixup>
+	{
+		return this->fixups;
+	}
+
+	inline auto LabelTable::LabelCount() const noexcept -> std::size_t
+	{
+		return this->offsets.size();
+	}
+
+	inline void LabelTable::AddBranch(const RelaxableBranch& branch)
+	{
+		if (!this->branches.empty() && branch.Offset < this->branches.back().Offset + RelaxableBranch::ShortSize) [[unlikely]]
+		{
+			throw std::runtime_error("Branches must be added in stream order!");
+		}
+		this->branches.push_back(branch);
+	}
+
+	inline auto LabelTable::Branches() const noexcept -> std::span<const RelaxableBranch>
+	{
+		return this->branches;
+	}
+
+	inline void LabelTable::Merge(const LabelTable& other, const std::size_t codeOffset, const std::span<Label> mapping)
+	{
+		if (mapping.size() != other.offsets.size()) [[unlikely]]
+		{
+			throw std::runtime_error("Label mapping does not match the label table!");
+		}
+		for (const auto& [name, label] : other.names)
+		{
+			if (!mapping[label.Id].IsValid())
+			{
+				mapping[label.Id] = this->FindOrCreate(name);
+			}
+		}
+		// The other code may have been discarded from already, its origin lands at codeOffset:
+		const auto shift = [&other, codeOffset](const std::size_t offset) noexcept
+		{
+			return offset - other.origin + codeOffset;
+		};
+		for (std::size_t i = 0; i < mapping.size(); ++i)
+		{
+			if (!mapping[i].IsValid())
+			{
+				mapping[i] = this->Create();
+			}
+			if (other.offsets[i] != UnboundOffset)
+			{
+				this->Bind(mapping[i], shift(other.offsets[i]));
+			}
+		}
+
+		this->fixups.reserve(this->fixups.size() + other.fixups.size());
+		for (Fixup fixup : other.fixups)
+		{
+			fixup.Offset = shift(fixup.Offset);
+			fixup.Target = mapping[fixup.Target.Id];
+			this->fixups.push_back(fixup);
+		}
+		this->branches.reserve(this->branches.size() + other.branches.size());
+		for (RelaxableBranch branch : other.branches)
+		{
+			branch.Offset = shift(branch.Offset);
+			branch.Target = mapping[branch.Target.Id];
+			this->AddBranch(branch);
+		}
+	}
+
+	inline auto LabelTable::Relax(std::pmr::vector<std::uint8_t>& code, const std::span<std::size_t> markers, const std::size_t limit) -> RelaxationStats
+	{
+		const auto last = std::lower_bound(this->branches.begin(), this->branches.end(), limit, [](const RelaxableBranch& branch, const std::size_t value)
+		{
+			return branch.Offset < value;
+		});
+		const auto count = static_cast<std::size_t>(last - this->branches.begin());
+		RelaxationStats stats = {};
+		stats.Branches = count;
+		if (count == 0) [[likely]]
+		{
+			return stats;
+		}
+
+		// shifts[i] = growth of all branches before branch i, shifts[n] = total growth:
+		std::vector<std::size_t> shifts(count + 1, 0);
+		const auto computeShifts = [&]
+		{
+			for (std::size_t i = 0; i < count; ++i)
+			{
+				const auto& branch = this->branches[i];
+				shifts[i + 1] = shifts[i] + (branch.IsLong ? branch.Growth() : 0);
+			}
+		};
+
+		// The new position of an old offset which is not inside a branch:
+		const auto relocate = [&](const std::size_t offset) noexcept -> std::size_t
+		{
+			const auto it = std::lower_bound(this->branches.begin(), last, offset, [](const RelaxableBranch& branch, const std::size_t value)
+			{
+				return branch.Offset < value;
+			});
+			return offset + shifts[static_cast<std::size_t>(it - this->branches.begin())];
+		};
+
+		bool changed = true;
+		while (changed)
+		{
+			changed = false;
+			++stats.Iterations;
+			if (stats.Iterations > MaxRelaxationIterations) [[unlikely]]
+			{
+				std::for_each(this->branches.begin(), last, [](RelaxableBranch& branch)
+				{
+					branch.IsLong = true;
+				});
+				break;
+			}
+
+			computeShifts();
+			for (std::size_t i = 0; i < count; ++i)
+			{
+				auto& branch = this->branches[i];
+				if (branch.IsLong)
+				{
+					continue;
+				}
+				const auto end = static_cast<std::int64_t>(branch.Offset + shifts[i] + RelaxableBranch::ShortSize);
+				const auto displacement = static_cast<std::int64_t>(relocate(this->BoundOffset(branch.Target))) - end;
+				if (displacement < std::numeric_limits<std::int8_t>::min() || displacement > std::numeric_limits<std::int8_t>::max())
+				{
+					branch.IsLong = true;
+					changed = true;
+				}
+			}
+		}
+		computeShifts();
+
+		// Move the code between the branches once, back to front so nothing is overwritten before it is moved.
+		// The code starts at the origin, everything in front of it was discarded and does not move:
+		const std::size_t oldSize = code.size();
+		code.resize(oldSize + shifts[count]);
+		std::size_t segmentEnd = oldSize;
+		for (std::size_t i = count; i-- > 0;)
+		{
+			const auto& branch = this->branches[i];
+			const auto segmentBegin = branch.Offset - this->origin + RelaxableBranch::ShortSize;
+			std::memmove(code.data() + segmentBegin + shifts[i + 1], code.data() + segmentBegin, segmentEnd - segmentBegin);
+			segmentEnd = branch.Offset - this->origin;
+		}
+
+		// Labels and fixups move with the code:
+		for (auto& offset : this->offsets)
+		{
+			if (offset != UnboundOffset)
+			{
+				offset = relocate(offset);
+			}
+		}
+		for (auto& fixup : this->fixups)
+		{
+			fixup.Offset = relocate(fixup.Offset);
+		}
+		for (auto it = last; it != this->branches.end(); ++it)
+		{
+			it->Offset += shifts[count];
+		}
+
+		// Markers are usually ascending, so the branch index is advanced instead of searched:
+		std::size_t next = 0;
+		std::size_t previous = 0;
+		for (auto& marker : markers)
+		{
+			if (marker < previous) [[unlikely]]
+			{
+				next = 0;
+			}
+			previous = marker;
+			while (next < count && this->branches[next].Offset < marker)
+			{
+				++next;
+			}
+			marker += shifts[next];
+		}
+
+		// Write the final branch encodings:
+		for (std::size_t i = 0; i < count; ++i)
+		{
+			const auto& branch = this->branches[i];
+			auto* const out = code.data() + branch.Offset - this->origin + shifts[i];
+			const auto target = static_cast<std::int64_t>(this->offsets[branch.Target.Id]);
+			if (branch.IsLong)
+			{
+				std::memcpy(out, branch.LongOpCode.data(), branch.LongOpCodeSize);
+				const auto displacement = target - static_cast<std::int64_t>(branch.Offset + shifts[i] + branch.LongSize());
+				if (displacement < std::numeric_limits<std::int32_t>::min() || displacement > std::numeric_limits<std::int32_t>::max()) [[unlikely]]
+				{
+					throw std::runtime_error("Branch to label " + this->Describe(branch.Target) + " does not fit into rel32!");
+				}
+				for (std::size_t j = 0; j < sizeof(std::int32_t); ++j)
+				{
+					out[branch.LongOpCodeSize + j] = static_cast<std::uint8_t>(static_cast<std::uint64_t>(displacement) >> (j * 8U));
+				}
+				++stats.Widened;
+			}
+			else
+			{
+				out[0] = branch.ShortOpCode;
+				out[1] = static_cast<std::uint8_t>(target - static_cast<std::int64_t>(branch.Offset + shifts[i] + RelaxableBranch::ShortSize));
+				stats.BytesSaved += branch.Growth();
+			}
+		}
+		this->branches.erase(this->branches.begin(), last);
+		return stats;
+	}
+
+	inline void LabelTable::Resolve(const std::span<std::uint8_t> code, const std::uint64_t baseAddress, const std::size_t limit)
+	{
+		const auto kept = limit == UnboundOffset ? this->fixups.end() : std::stable_partition(this->fixups.begin(), this->fixups.end(), [limit](const Fixup& fixup)
+		{
+			return fixup.Offset < limit;
+		});
+		for (auto it = this->fixups.begin(); it != kept; ++it)
+		{
+			const Fixup& fixup = *it;
+			const auto target = this->BoundOffset(fixup.Target);
+
+			const auto width = FixupWidth(fixup.Kind);
+			if (fixup.Offset < this->origin || fixup.Offset - this->origin + width > code.size()) [[unlikely]]
+			{
+				throw std::runtime_error("Fixup is outside of the stream!");
+			}
+
+			std::int64_t value;
+			bool fits;
+			switch (fixup.Kind)
+			{
+				case FixupKind::Relative8:
+					value = static_cast<std::int64_t>(target) - static_cast<std::int64_t>(fixup.Offset + width) + fixup.Addend;
+					fits = value >= std::numeric_limits<std::int8_t>::min() && value <= std::numeric_limits<std::int8_t>::max();
+					break;
+
+				case FixupKind::Relative32:
+					value = static_cast<std::int64_t>(target) - static_cast<std::int64_t>(fixup.Offset + width) + fixup.Addend;
+					fits = value >= std::numeric_limits<std::int32_t>::min() && value <= std::numeric_limits<std::int32_t>::max();
+					break;
+
+				case FixupKind::Absolute32:
+					value = static_cast<std::int64_t>(baseAddress + target) + fixup.Addend;
+					fits = static_cast<std::uint64_t>(value) <= std::numeric_limits<std::uint32_t>::max();
+					break;
+
+				default:
+					value = static_cast<std::int64_t>(baseAddress + target) + fixup.Addend;
+					fits = true;
+					break;
+			}
+			if (!fits) [[unlikely]]
+			{
+				throw std::runtime_error("Reference to label " + this->Describe(fixup.Target) + " does not fit into its field!");
+			}
+
+			// Little endian:
+			for (std::size_t i = 0; i < width; ++i)
+			{
+				code[fixup.Offset - this->origin + i] = static_cast<std::uint8_t>(static_cast<std::uint64_t>(value) >> (i * 8U));
+			}
+		}
+		this->fixups.erase(this->fixups.begin(), kept);
+	}
+
+	inline auto LabelTable::SettledEnd(const std::size_t end) const -> std::size_t
+	{
+		// Cutting in front of a reference which leaves the prefix can move other targets behind the cut, so repeat until nothing leaves:
+		std::size_t settled = end;
+		const auto leaves = [this, &settled](const Label target) noexcept
+		{
+			const std::size_t offset = this->offsets[target.Id];
+			return offset == UnboundOffset || offset > settled;
+		};
+		for (bool changed = true; changed;)
+		{
+			changed = false;
+			for (const RelaxableBranch& branch : this->branches)
+			{
+				if (branch.Offset >= settled)
+				{
+					break;
+				}
+				if (leaves(branch.Target))
+				{
+					settled = branch.Offset;
+					changed = true;
+					break;
+				}
+			}
+			for (const Fixup& fixup : this->fixups)
+			{
+				if (fixup.Offset < settled && leaves(fixup.Target))
+				{
+					settled = fixup.Offset;
+					changed = true;
+				}
+			}
+		}
+		return settled;
+	}
+
+	inline void LabelTable::Discard(const std::size_t size)
+	{
+		const std::size_t origin = this->origin + size;
+		const bool pending = std::any_of(this->fixups.begin(), this->fixups.end(), [origin](const Fixup& fixup) { return fixup.Offset < origin; })
+			|| (!this->branches.empty() && this->branches.front().Offset < origin);
+		if (pending) [[unlikely]]
+		{
+			throw std::runtime_error("Discarded code has unresolved label references!");
+		}
+		this->origin = origin;
+	}
+
+	inline auto LabelTable::Origin() const noexcept -> std::size_t
+	{
+		return this->origin;
+	}
+
+	inline void LabelTable::Clear() noexcept
+	{
+		this->offsets.clear();
+		this->names.clear();
+		this->fixups.clear();
+		this->branches.clear();
+		this->origin = 0;
+	}
+
+	inline auto LabelTable::BoundOffset(const Label label) const -> std::size_t
+	{
+		const auto offset = this->Offset(label);
+		if (!offset) [[unlikely]]
+		{
+			throw std::runtime_error("Label " + this->Describe(label) + " is referenced but never bound!");
+		}
+		return *offset;
+	}
+
+	inline auto LabelTable::Describe(const Label label) const -> std::string
+	{
+		const auto name = this->Name(label);
+		return name.empty() ? '#' + std::to_string(label.Id) : '\'' + std::string(name) + '\'';
+	}
+}
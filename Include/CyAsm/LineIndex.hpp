@@ -0,0 +1,196 @@
+#pragma once
+
+#include <cstdint>
+#include <algorithm>
+#include <bit>
+#include <span>
+#include <string_view>
+#include <vector>
+
+#include "X86/CharClassifier.hpp"
+
+namespace CyberAsm
+{
+	/// <summary>
+	/// Offsets of all lines of a source buffer and the code part of every line in front of its comment.
+	/// Built in one pass over the NewLine and Comment masks of the X86::CharClassifier: the line break bits are
+	/// flattened into the offset array without a branch per line, and only the first byte of every comment is visited.
+	/// The index refers to the source buffer, which must outlive it.
+	/// </summary>
+	class LineIndex final
+	{
+	public:
+		LineIndex() noexcept = default;
+
+		/// <param name="source">The source code.</param>
+		explicit LineIndex(std::string_view source);
+
+		/// <summary>
+		/// Indexes the source, replacing the previous index.
+		/// </summary>
+		void Build(std::string_view source);
+
+		/// <summary>
+		/// Returns the number of lines, a line break at the very end does not start another line.
+		/// </summary>
+		[[nodiscard]] auto Count() const noexcept -> std::size_t;
+
+		/// <summary>
+		/// Returns the source offset of the first character of every line.
+		/// </summary>
+		[[nodiscard]] auto Starts() const noexcept -> std::span<const std::size_t>;
+
+		/// <summary>
+		/// Returns the 0-based line without its line break, the '\r' of a CRLF line break is removed as well.
+		/// </summary>
+		[[nodiscard]] auto Line(std::size_t index) const noexcept -> std::string_view;
+
+		/// <summary>
+		/// Returns the 0-based line up to its comment.
+		/// </summary>
+		[[nodiscard]] auto Code(std::size_t index) const noexcept -> std::string_view;
+
+		/// <summary>
+		/// Returns the 0-based line containing the source offset.
+		/// </summary>
+		[[nodiscard]] auto LineOf(std::size_t offset) const noexcept -> std::size_t;
+
+		[[nodiscard]] auto Source() const noexcept -> std::string_view;
+
+	private:
+		/// <summary>
+		/// Returns the offset of the line break ending the line, or the end of the source.
+		/// </summary>
+		[[nodiscard]] auto LineEnd(std::size_t index) const noexcept -> std::size_t;
+
+		std::string_view source = {};
+		std::vector<std::size_t> starts = {};
+		std::size_t count = 0;
+
+		/// <summary>
+		/// The offset of the first comment character of every line which has one, ascending.
+		/// </summary>
+		std::vector<std::size_t> comments = {};
+	};
+
+	inline LineIndex::LineIndex(const std::string_view source)
+	{
+		this->Build(source);
+	}
+
+	inline void LineIndex::Build(const std::string_view source)
+	{
+		constexpr std::size_t blockSize = X86::CharClassifier::BlockSize;
+
+		this->source = source;
+		this->count = 0;
+		this->comments.clear();
+		if (source.empty())
+		{
+			return;
+		}
+
+		// Every line break writes the start of the next line through a raw pointer, the array grows in steps
+		// with room for a whole block, and each step is sized for lines of 16 bytes so most inputs grow once.
+		// The array is never shrunk, so indexing again does not clear it again:
+		std::size_t used = 1;
+		this->starts.resize(std::max(this->starts.size(), source.size() / 16 + 2 * blockSize));
+		std::size_t* out = this->starts.data();
+		out[0] = 0;
+		std::uint64_t commented = 0;
+
+		X86::ClassifySourceLines(source, [&](const std::size_t offset, const X86::CharMasks& masks)
+		{
+			if (used + blockSize > this->starts.size()) [[unlikely]]
+			{
+				this->starts.resize(this->starts.size() * 2);
+				out = this->starts.data();
+			}
+
+			// A comment runs to the end of its line, so only the first byte of each comment run is recorded:
+			for (std::uint64_t first = masks.Comment & ~(masks.Comment << 1 | commented); first != 0; first &= first - 1) [[unlikely]]
+			{
+				this->comments.push_back(offset + static_cast<std::size_t>(std::countr_zero(first)));
+			}
+			commented = masks.Comment >> 63;
+
+			// The first 8 line breaks are written unconditionally, the extra writes land in the slack:
+			std::uint64_t lineBreaks = masks.NewLine;
+			const auto breaks = static_cast<std::size_t>(std::popcount(lineBreaks));
+			std::size_t* target = out + used;
+			for (std::size_t i = 0; i < 8; ++i)
+			{
+				target[i] = offset + static_cast<std::size_t>(std::countr_zero(lineBreaks)) + 1;
+				lineBreaks &= lineBreaks - 1;
+			}
+			for (std::size_t i = 8; i < breaks; ++i) [[unlikely]]
+			{
+				target[i] = offset + static_cast<std::size_t>(std::countr_zero(lineBreaks)) + 1;
+				lineBreaks &= lineBreaks - 1;
+			}
+			used += breaks;
+		});
+
+		// A line break at the very end does not start another line:
+		if (out[used - 1] == source.size())
+		{
+			--used;
+		}
+		this->count = used;
+	}
+
+	inline auto LineIndex::Count() const noexcept -> std::size_t
+	{
+		return this->count;
+	}
+
+	inline auto LineIndex::Starts() const noexcept -> std::span<const std::size_t>
+	{
+		return {this->starts.data(), this->count};
+	}
+
+	inline auto LineIndex::LineEnd(const std::size_t index) const noexcept -> std::size_t
+	{
+		if (index + 1 < this->count)
+		{
+			return this->starts[index + 1] - 1;
+		}
+		// The last line may still end with a line break:
+		return !this->source.empty() && this->source.back() == '\n' ? this->source.size() - 1 : this->source.size();
+	}
+
+	inline auto LineIndex::Line(const std::size_t index) const noexcept -> std::string_view
+	{
+		const std::size_t start = this->starts[index];
+		std::size_t end = this->LineEnd(index);
+		if (end > start && this->source[end - 1] == '\r')
+		{
+			--end;
+		}
+		return this->source.substr(start, end - start);
+	}
+
+	inline auto LineIndex::Code(const std::size_t index) const noexcept -> std::string_view
+	{
+		const std::size_t start = this->starts[index];
+		std::size_t end = this->LineEnd(index);
+		const auto comment = std::lower_bound(this->comments.begin(), this->comments.end(), start);
+		if (comment != this->comments.end() && *comment < end)
+		{
+			end = *comment;
+		}
+		return this->source.substr(start, end - start);
+	}
+
+	inline auto LineIndex::LineOf(const std::size_t offset) const noexcept -> std::size_t
+	{
+		const auto starts = this->Starts();
+		const auto it = std::upper_bound(starts.begin(), starts.end(), offset);
+		return it == starts.begin() ? 0 : static_cast<std::size_t>(it - starts.begin()) - 1;
+	}
+
+	inline auto LineIndex::Source() const noexcept -> std::string_view
+	{
+		return this->source;
+	}
+}
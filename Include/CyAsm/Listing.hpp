@@ -0,0 +1,291 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <array>
+#include <ostream>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "HexDump.hpp"
+
+namespace CyberAsm
+{
+	/// <summary>
+	/// Maps source lines to the code they produced.
+	/// The assembler records the stream offset of the first statement of each line while it encodes,
+	/// so the listing is formatted from the finished stream and the source buffer without parsing anything twice.
+	/// </summary>
+	class AssemblyListing final
+	{
+	public:
+		/// <summary>
+		/// Records the stream offset of a statement, only the first statement of a line is kept.
+		/// Lines must be recorded in ascending order.
+		/// </summary>
+		/// <param name="line">The 1-based source line.</param>
+		/// <param name="offset">The stream offset of the first byte of the statement.</param>
+		void Record(std::size_t line, std::size_t offset);
+
+		/// <summary>
+		/// Returns the recorded offsets for MachineStream::Finalize(), so they follow the widened branches.
+		/// </summary>
+		[[nodiscard]] auto Markers() noexcept -> std::span<std::size_t>;
+
+		/// <summary>
+		/// Appends the rows of a listing recorded for a later piece of the source, which starts after the recorded lines.
+		/// </summary>
+		/// <param name="other">The listing of the piece.</param>
+		/// <param name="offsetShift">The stream offset the code of the piece was appended at.</param>
+		/// <param name="lineShift">The number of source lines in front of the piece.</param>
+		void Append(const AssemblyListing& other, std::size_t offsetShift, std::size_t lineShift);
+
+		[[nodiscard]] auto Lines() const noexcept -> std::span<const std::size_t>;
+		[[nodiscard]] auto Offsets() const noexcept -> std::span<const std::size_t>;
+		[[nodiscard]] auto Size() const noexcept -> std::size_t;
+		void Reserve(std::size_t rows);
+		void Clear() noexcept;
+
+		/// <summary>
+		/// The number of code bytes per row, longer encodings continue on the following rows.
+		/// </summary>
+		std::size_t BytesPerRow = 8;
+
+	private:
+		std::vector<std::size_t> lines = {};
+		std::vector<std::size_t> offsets = {};
+	};
+
+	/// <summary>
+	/// Writes the listing in blocks of rows 'line  offset  bytes  source', every source line gets a row.
+	/// </summary>
+	/// <param name="out">The output stream.</param>
+	/// <param name="source">The source code the listing was recorded from.</param>
+	/// <param name="code">The finalized code of the whole stream, the last recorded line owns the code up to its end.</param>
+	/// <param name="listing">The recorded listing.</param>
+	void WriteListing(std::ostream& out, std::string_view source, std::span<const std::uint8_t> code, const AssemblyListing& listing);
+
+	/// <summary>
+	/// Returns the listing as a string, see WriteListing().
+	/// </summary>
+	[[nodiscard]] auto FormatListing(std::string_view source, std::span<const std::uint8_t> code, const AssemblyListing& listing) -> std::string;
+
+	namespace ListingDetail
+	{
+		inline constexpr std::size_t LineColumn = 6;
+		inline constexpr std::size_t OffsetColumn = 8;
+		inline constexpr std::size_t BlockSize = 64 * 1024;
+
+		/// <summary>
+		/// Writes the number right aligned into at least width characters.
+		/// </summary>
+		inline auto FormatNumber(std::size_t value, const std::size_t width, const std::size_t radix, char* const out) noexcept -> char*
+		{
+			std::array<char, 24> digits = {};
+			std::size_t count = 0;
+			do
+			{
+				digits[count++] = HexDumpDetail::Digits[value % radix];
+				value /= radix;
+			}
+			while (value != 0);
+
+			char* target = out;
+			for (std::size_t i = count; i < width; ++i)
+			{
+				*target++ = radix == 16 ? '0' : ' ';
+			}
+			while (count != 0)
+			{
+				*target++ = digits[--count];
+			}
+			return target;
+		}
+
+		/// <summary>
+		/// Formats all rows into a block buffer and hands every full block to the sink.
+		/// </summary>
+		template <typename Sink>
+		inline void EmitListing(const std::string_view source, const std::span<const std::uint8_t> code, const AssemblyListing& listing, Sink&& sink)
+		{
+			const std::size_t bytesPerRow = std::max<std::size_t>(listing.BytesPerRow, 1);
+			const std::size_t bytesColumn = bytesPerRow * 3;
+			const auto lines = listing.Lines();
+			const auto offsets = listing.Offsets();
+
+			std::string buffer(BlockSize + HexDumpSlack, '\0');
+			std::size_t used = 0;
+			const auto reserve = [&](const std::size_t size) -> char*
+			{
+				if (used + size + HexDumpSlack > buffer.size()) [[unlikely]]
+				{
+					sink(std::string_view(buffer.data(), used));
+					used = 0;
+					if (size + HexDumpSlack > buffer.size())
+					{
+						buffer.resize(size + HexDumpSlack);
+					}
+				}
+				return buffer.data() + used;
+			};
+			const auto rowPrefix = [&](char* out, const std::size_t line, const std::size_t offset, const std::span<const std::uint8_t> bytes) noexcept -> char*
+			{
+				if (line != 0)
+				{
+					out = FormatNumber(line, LineColumn, 10, out);
+				}
+				else
+				{
+					out = std::fill_n(out, LineColumn, ' ');
+				}
+				out = std::fill_n(out, 2, ' ');
+				out = FormatNumber(offset, OffsetColumn, 16, out);
+				out = std::fill_n(out, 2, ' ');
+				std::fill(HexDumpDetail::FormatByteRun(bytes, out), out + bytesColumn, ' ');
+				return out + bytesColumn;
+			};
+
+			const char* text = source.data();
+			const char* const sourceEnd = source.data() + source.size();
+			std::size_t row = 0;
+			for (std::size_t line = 1; text < sourceEnd; ++line)
+			{
+				const auto* newLine = static_cast<const char*>(std::memchr(text, '\n', static_cast<std::size_t>(sourceEnd - text)));
+				const char* const lineEnd = newLine ? newLine : sourceEnd;
+				std::string_view lineText(text, static_cast<std::size_t>(lineEnd - text));
+				if (!lineText.empty() && lineText.back() == '\r')
+				{
+					lineText.remove_suffix(1);
+				}
+				text = newLine ? newLine + 1 : sourceEnd;
+
+				while (row < lines.size() && lines[row] < line) [[unlikely]]
+				{
+					++row;
+				}
+				// Room for the columns, separators and numbers wider than their column:
+				const std::size_t fixedSize = LineColumn + OffsetColumn + bytesColumn + 64;
+				if (row == lines.size() || lines[row] != line)
+				{
+					// No code, only the line number and the text:
+					char* out = reserve(fixedSize + lineText.size());
+					char* const begin = out;
+					out = FormatNumber(line, LineColumn, 10, out);
+					if (!lineText.empty())
+					{
+						out = std::fill_n(out, 6 + OffsetColumn + bytesColumn, ' ');
+						out = std::copy(lineText.begin(), lineText.end(), out);
+					}
+					*out++ = '\n';
+					used += static_cast<std::size_t>(out - begin);
+					continue;
+				}
+
+				const std::size_t begin = std::min(offsets[row], code.size());
+				const std::size_t end = std::max(begin, std::min(row + 1 < offsets.size() ? offsets[row + 1] : code.size(), code.size()));
+				++row;
+
+				// The first row carries the source text, longer encodings continue below:
+				std::size_t offset = begin;
+				const std::size_t first = std::min(bytesPerRow, end - offset);
+				char* out = reserve(fixedSize + lineText.size());
+				char* const rowBegin = out;
+				out = rowPrefix(out, line, offset, code.subspan(offset, first));
+				out = std::fill_n(out, 2, ' ');
+				out = std::copy(lineText.begin(), lineText.end(), out);
+				*out++ = '\n';
+				used += static_cast<std::size_t>(out - rowBegin);
+				offset += first;
+				while (offset < end)
+				{
+					const std::size_t count = std::min(bytesPerRow, end - offset);
+					out = reserve(fixedSize);
+					char* const continuationBegin = out;
+					out = rowPrefix(out, 0, offset, code.subspan(offset, count));
+					while (out[-1] == ' ')
+					{
+						--out;
+					}
+					*out++ = '\n';
+					used += static_cast<std::size_t>(out - continuationBegin);
+					offset += count;
+				}
+			}
+			if (used != 0)
+			{
+				sink(std::string_view(buffer.data(), used));
+			}
+		}
+	}
+
+	inline void AssemblyListing::Record(const std::size_t line, const std::size_t offset)
+	{
+		if (!this->lines.empty() && this->lines.back() == line)
+		{
+			return;
+		}
+		this->lines.push_back(line);
+		this->offsets.push_back(offset);
+	}
+
+	inline auto AssemblyListing::Markers() noexcept -> std::span<std::size_t>
+	{
+		return this->offsets;
+	}
+
+	inline void AssemblyListing::Append(const AssemblyListing& other, const std::size_t offsetShift, const std::size_t lineShift)
+	{
+		for (std::size_t i = 0; i < other.lines.size(); ++i)
+		{
+			this->Record(other.lines[i] + lineShift, other.offsets[i] + offsetShift);
+		}
+	}
+
+	inline auto AssemblyListing::Lines() const noexcept -> std::span<const std::size_t>
+	{
+		return this->lines;
+	}
+
+	inline auto AssemblyListing::Offsets() const noexcept -> std::span<const std::size_t>
+	{
+		return this->offsets;
+	}
+
+	inline auto AssemblyListing::Size() const noexcept -> std::size_t
+	{
+		return this->lines.size();
+	}
+
+	inline void AssemblyListing::Reserve(const std::size_t rows)
+	{
+		this->lines.reserve(rows);
+		this->offsets.reserve(rows);
+	}
+
+	inline void AssemblyListing::Clear() noexcept
+	{
+		this->lines.clear();
+		this->offsets.clear();
+	}
+
+	inline void WriteListing(std::ostream& out, const std::string_view source, const std::span<const std::uint8_t> code, const AssemblyListing& listing)
+	{
+		ListingDetail::EmitListing(source, code, listing, [&out](const std::string_view block)
+		{
+			out.write(block.data(), static_cast<std::streamsize>(block.size()));
+		});
+	}
+
+	inline auto FormatListing(const std::string_view source, const std::span<const std::uint8_t> code, const AssemblyListing& listing) -> std::string
+	{
+		std::string result = {};
+		ListingDetail::EmitListing(source, code, listing, [&result](const std::string_view block)
+		{
+			result += block;
+		});
+		return result;
+	}
+}
@@ -1,15 +1,20 @@
 #pragma once
 
 #include <filesystem>
-#include <execution>
+#include <memory_resource>
 #include <optional>
 #include <string>
 #include <fstream>
 #include <vector>
 #include <span>
 #include <bitset>
+#include <type_traits>
 
 #include "ByteChunk.hpp"
+#include "ByteSearch.hpp"
+#include "EmitCursor.hpp"
+#include "HexDump.hpp"
+#include "Label.hpp"
 #include "MachineLanguage.hpp"
 
 namespace CyberAsm
@@ -19,14 +24,17 @@ namespace CyberAsm
 	/// It uses std::uint8_t as byte type (because a stream byte can be an ASCII character or a value)
 	/// The stream can also be loaded and saved to a binary file.
 	/// Dumping the contents to an fstream, std::stringstream or std::cout is easily possible.
+	/// The byte buffer allocates from a std::pmr::memory_resource, so short-lived streams can live in a StreamArena.
+	/// Copies allocate from the default resource, the label table always uses the heap.
 	/// </summary>
 	template <Abi Arch = Abi::X86_64>
 	class [[nodiscard]] MachineStream final
 	{
 	public:
-		using StreamBuffer = std::vector<std::uint8_t>;
+		using StreamBuffer = std::pmr::vector<std::uint8_t>;
+		using allocator_type = StreamBuffer::allocator_type;
 		using Iterator = std::uint8_t*;
-		using ConstIterator = const Iterator;
+		using ConstIterator = const std::uint8_t*;
 		using ReverseIterator = std::reverse_iterator<Iterator>;
 		using ConstReverseIterator = std::reverse_iterator<ConstIterator>;
 
@@ -36,17 +44,29 @@ namespace CyberAsm
 		explicit MachineStream(const std::uint8_t* memory, std::size_t size);
 		explicit MachineStream(const std::byte* memory, std::size_t size);
 		explicit MachineStream(std::size_t capacity);
+		explicit MachineStream(std::pmr::memory_resource* resource) noexcept;
+		explicit MachineStream(std::size_t capacity, std::pmr::memory_resource* resource);
 		MachineStream(const MachineStream&) = default;
 		MachineStream(MachineStream&&) noexcept = default;
 		auto operator=(const MachineStream&) -> MachineStream& = default;
 		auto operator=(MachineStream&&) noexcept -> MachineStream& = default;
 		~MachineStream() = default;
 
-		template <typename... Ts> requires std::is_trivial_v<Ts...>
+		/// <summary>
+		/// Appends the scalars in little endian byte order with a single resize.
+		/// Pointers are excluded, so Insert(pointer, size) selects the raw memory overload.
+		/// </summary>
+		template <typename... Ts> requires ((std::is_trivially_copyable_v<std::remove_cvref_t<Ts>> && !std::is_pointer_v<std::remove_cvref_t<Ts>>) && ...)
 		auto Insert(Ts&&... value) -> StreamBuffer&;
 		auto Insert(ConstIterator begin, ConstIterator end) -> StreamBuffer&;
 		auto Insert(const void* mem, std::size_t size) -> StreamBuffer&;
 
+		/// <summary>
+		/// Returns a cursor for bulk appending, see EmitCursor.
+		/// The stream must not be modified otherwise until the cursor is committed or destroyed.
+		/// </summary>
+		[[nodiscard]] auto BeginEmit(std::size_t headroom = EmitCursor::DefaultHeadroom) -> EmitCursor;
+
 		[[nodiscard]] auto begin() const noexcept -> ConstIterator;
 		[[nodiscard]] auto end() const noexcept -> ConstIterator;
 		[[nodiscard]] auto begin() noexcept -> Iterator;
@@ -92,7 +112,7 @@ namespace CyberAsm
 		auto operator [](std::size_t idx) const -> std::uint8_t;
 		auto operator *() -> std::uint8_t&;
 		auto operator *() const -> std::uint8_t;
-		auto operator ()(const std::filesystem::path& file) -> bool;
+		auto operator ()(const std::filesystem::path& file) const -> bool;
 		auto operator ==(const MachineStream& rhs) const -> bool;
 		auto operator !=(const MachineStream& rhs) const -> bool;
 		auto operator ==(std::u8string_view rhs) const -> bool;
@@ -101,12 +121,16 @@ namespace CyberAsm
 		[[nodiscard]] auto Stream() const & noexcept -> const StreamBuffer&;
 		[[nodiscard]] auto Stream() & noexcept -> StreamBuffer&;
 		[[nodiscard]] auto Stream() && noexcept -> StreamBuffer&&;
+		[[nodiscard]] auto Resource() const noexcept -> std::pmr::memory_resource*;
 		void Reserve(std::size_t size);
 		void Clear();
 		void Resize(std::size_t size);
 		[[nodiscard]] auto Size() const noexcept -> std::size_t;
-		void InsertPadding(std::size_t byteSize, std::uint8_t scalar = 0, std::size_t needle = 0);
+		void InsertPadding(std::size_t byteSize, std::uint8_t scalar = 0);
 		void InsertPadding(std::size_t from, std::size_t to, std::uint8_t scalar);
+		/// <summary>
+		/// Byte and sequence search, see FindByte() and FindSequence().
+		/// </summary>
 		[[nodiscard]] auto Contains(std::uint8_t target) const -> bool;
 		[[nodiscard]] auto Find(std::uint8_t target) -> Iterator;
 		[[nodiscard]] auto Find(std::uint8_t target) const -> ConstIterator;
@@ -114,24 +138,91 @@ namespace CyberAsm
 		[[nodiscard]] auto Find(std::span<std::uint8_t> sequence) -> Iterator;
 		[[nodiscard]] auto Find(std::span<std::uint8_t> sequence) const -> ConstIterator;
 
+		/// <summary>
+		/// Creates a new anonymous label.
+		/// </summary>
+		[[nodiscard]] auto CreateLabel() -> Label;
+
+		/// <summary>
+		/// Creates a new named label, throws if the name already exists.
+		/// </summary>
+		[[nodiscard]] auto CreateLabel(std::string_view name) -> Label;
+		[[nodiscard]] auto FindLabel(std::string_view name) const -> std::optional<Label>;
+		[[nodiscard]] auto FindOrCreateLabel(std::string_view name) -> Label;
+
+		/// <summary>
+		/// Binds the label to the current end of the stream.
+		/// </summary>
+		void BindLabel(Label label);
+
+		/// <summary>
+		/// Appends a zero placeholder field for a label reference and records the fixup.
+		/// </summary>
+		void InsertFixup(Label target, FixupKind kind, std::int64_t addend = 0);
+
+		/// <summary>
+		/// Appends a branch in its short form (opcode + rel8), Finalize() widens it to the long form if required.
+		/// </summary>
+		/// <param name="target">The branch target.</param>
+		/// <param name="shortOpCode">The opcode of the rel8 form.</param>
+		/// <param name="longOpCode">The opcode bytes of the rel32 form.</param>
+		void InsertBranch(Label target, std::uint8_t shortOpCode, std::span<const std::uint8_t> longOpCode);
+
+		/// <summary>
+		/// Appends the code of another unfinalized stream and takes over its labels, fixups and branches, see LabelTable::Merge().
+		/// </summary>
+		/// <param name="other">The stream to append.</param>
+		/// <param name="labelMapping">One entry per label of the other stream, invalid entries are filled in.</param>
+		void Append(const MachineStream& other, std::span<Label> labelMapping);
+
+		/// <summary>
+		/// Relaxes all branches, then resolves all label references in one pass.
+		/// </summary>
+		/// <param name="baseAddress">The load address of the code, used for absolute fixups.</param>
+		/// <param name="markers">Stream offsets recorded during encoding, moved along with the code when branches are widened.</param>
+		/// <returns>The branch relaxation statistics.</returns>
+		auto Finalize(std::uint64_t baseAddress = 0, std::span<std::size_t> markers = {}) -> RelaxationStats;
+
+		/// <summary>
+		/// Finalizes the longest prefix of the stream which only refers to labels inside it or in discarded code, see LabelTable::SettledEnd().
+		/// The bytes of the prefix are then final and may be written out before the rest of the stream is encoded.
+		/// </summary>
+		/// <param name="baseAddress">The load address of the whole stream, used for absolute fixups.</param>
+		/// <returns>The size of the finalized prefix.</returns>
+		auto SettlePrefix(std::uint64_t baseAddress = 0) -> std::size_t;
+
+		/// <summary>
+		/// Removes settled bytes from the front, labels keep their offsets in the whole stream, see LabelTable::Discard().
+		/// </summary>
+		/// <param name="size">The number of bytes, at most the result of SettlePrefix().</param>
+		void DiscardPrefix(std::size_t size);
+
+		[[nodiscard]] auto Labels() const noexcept -> const LabelTable&;
+		[[nodiscard]] auto Labels() noexcept -> LabelTable&;
+
+		/// <summary>
+		/// Formats the code as hex dump with DumpTextLineLimit bytes per line, see HexDump().
+		/// </summary>
+		[[nodiscard]] auto Dump(DumpFormat format = DumpFormat::Listing) const -> std::string;
+
 		std::size_t DumpTextLineLimit = 8;
 
 	private:
 		StreamBuffer stream = {};
+		LabelTable labels = {};
 	};
 
 	extern auto operator <<(std::ostream& out, const MachineStream<Abi::X86_64>& stream) -> std::ostream&;
 	extern auto operator <<(std::ofstream& out, Endianness endianness) -> std::ostream&;
 
 	template <Abi Arch>
-	template <typename... Ts> requires std::is_trivial_v<Ts...>
+	template <typename... Ts> requires ((std::is_trivially_copyable_v<std::remove_cvref_t<Ts>> && !std::is_pointer_v<std::remove_cvref_t<Ts>>) && ...)
 	inline auto MachineStream<Arch>::Insert(Ts&&... value) -> StreamBuffer&
 	{
 		static_assert(sizeof...(value));
-		std::array<std::uint8_t, sizeof...(value)> raw = {};
-		BytePack<std::common_type_t<Ts...>, Endianness::Little>(raw, value...);
-		this->stream.insert(this->stream.end(), raw.begin(), raw.end());
-		(this->template Insert<Ts>(value...), ...);
+		EmitCursor cursor(this->stream, 0);
+		cursor.Ensure((sizeof(std::remove_cvref_t<Ts>) + ...));
+		(cursor.PutLittle(value), ...);
 		return this->stream;
 	}
 
@@ -163,6 +254,15 @@ namespace CyberAsm
 		stream.reserve(capacity);
 	}
 
+	template <Abi Arch>
+	inline MachineStream<Arch>::MachineStream(std::pmr::memory_resource* const resource) noexcept : stream(resource) { }
+
+	template <Abi Arch>
+	inline MachineStream<Arch>::MachineStream(const std::size_t capacity, std::pmr::memory_resource* const resource) : stream(resource)
+	{
+		this->stream.reserve(capacity);
+	}
+
 	template <Abi Arch>
 	inline auto MachineStream<Arch>::operator<<(const std::byte value) -> MachineStream<Arch>&
 	{
@@ -173,7 +273,7 @@ namespace CyberAsm
 	template <Abi Arch>
 	inline auto MachineStream<Arch>::operator<<(const std::uint8_t value) -> MachineStream<Arch>&
 	{
-		this->Insert(value);
+		this->stream.push_back(value);
 		return *this;
 	}
 
@@ -401,14 +501,14 @@ namespace CyberAsm
 	template <Abi Arch>
 	inline auto MachineStream<Arch>::operator<<(const void* const value) -> MachineStream<Arch>&
 	{
-		this->Insert(value);
+		this->Insert(reinterpret_cast<std::uintptr_t>(value));
 		return *this;
 	}
 
 	template <Abi Arch>
 	inline auto MachineStream<Arch>::operator<<(const ByteChunk& chunk) -> MachineStream&
 	{
-		this->stream.insert(this->stream.end(), chunk.begin(), chunk.end());
+		this->Insert(chunk.Data(), chunk.Size());
 		return *this;
 	}
 
@@ -437,7 +537,7 @@ namespace CyberAsm
 	}
 
 	template <Abi Arch>
-	inline auto MachineStream<Arch>::operator()(const std::filesystem::path& file) -> bool
+	inline auto MachineStream<Arch>::operator()(const std::filesystem::path& file) const -> bool
 	{
 		std::ofstream fstream(file, std::ios::out | std::ios::binary);
 		if (!fstream) [[unlikely]]
@@ -490,6 +590,18 @@ namespace CyberAsm
 		return std::move(this->stream);
 	}
 
+	template <Abi Arch>
+	inline auto MachineStream<Arch>::Dump(const DumpFormat format) const -> std::string
+	{
+		return HexDump(std::span<const std::uint8_t>(this->begin(), this->end()), this->DumpTextLineLimit, format);
+	}
+
+	template <Abi Arch>
+	inline auto MachineStream<Arch>::Resource() const noexcept -> std::pmr::memory_resource*
+	{
+		return this->stream.get_allocator().resource();
+	}
+
 	template <Abi Arch>
 	inline void MachineStream<Arch>::Reserve(const std::size_t size)
 	{
@@ -500,6 +612,7 @@ namespace CyberAsm
 	inline void MachineStream<Arch>::Clear()
 	{
 		this->stream.clear();
+		this->labels.Clear();
 	}
 
 	template <Abi Arch>
@@ -515,10 +628,9 @@ namespace CyberAsm
 	}
 
 	template <Abi Arch>
-	inline void MachineStream<Arch>::InsertPadding(const std::size_t byteSize, const std::uint8_t scalar, const std::size_t needle)
+	inline void MachineStream<Arch>::InsertPadding(const std::size_t byteSize, const std::uint8_t scalar)
 	{
-		this->stream.resize(this->stream.size() + byteSize);
-		std::fill_n(this->stream.end() - byteSize, byteSize, scalar);
+		this->stream.resize(this->stream.size() + byteSize, scalar);
 	}
 
 	template <Abi Arch>
@@ -540,96 +652,70 @@ namespace CyberAsm
 	template <Abi Arch>
 	inline auto MachineStream<Arch>::begin() const noexcept -> ConstIterator
 	{
-		return this->stream.begin();
+		return this->stream.data();
 	}
 
 	template <Abi Arch>
 	inline auto MachineStream<Arch>::end() const noexcept -> ConstIterator
 	{
-		return this->stream.end();
+		return this->stream.data() + this->stream.size();
 	}
 
 	template <Abi Arch>
 	inline auto MachineStream<Arch>::begin() noexcept -> Iterator
 	{
-		return this->stream.begin();
+		return this->stream.data();
 	}
 
 	template <Abi Arch>
 	inline auto MachineStream<Arch>::end() noexcept -> Iterator
 	{
-		return this->stream.end();
+		return this->stream.data() + this->stream.size();
 	}
 
 	template <Abi Arch>
 	inline auto MachineStream<Arch>::rbegin() const noexcept -> ConstReverseIterator
 	{
-		return this->stream.rbegin();
+		return ConstReverseIterator(this->end());
 	}
 
 	template <Abi Arch>
 	inline auto MachineStream<Arch>::rend() const noexcept -> ConstReverseIterator
 	{
-		return this->stream.rend();
+		return ConstReverseIterator(this->begin());
 	}
 
 	template <Abi Arch>
 	inline auto MachineStream<Arch>::rbegin() noexcept -> ReverseIterator
 	{
-		return this->stream.rbegin();
+		return ReverseIterator(this->end());
 	}
 
 	template <Abi Arch>
 	inline auto MachineStream<Arch>::rend() noexcept -> ReverseIterator
 	{
-		return this->stream.rend();
+		return ReverseIterator(this->begin());
 	}
 
 	template <Abi Arch>
 	inline auto MachineStream<Arch>::Insert(const void* const mem, const std::size_t size) -> StreamBuffer&
 	{
-		const auto* byte = static_cast<const std::uint8_t*>(mem);
-		const auto* const end = static_cast<const std::uint8_t*>(mem) + size - 1;
-		while (byte != end)
-		{
-			*this << *byte++;
-		}
+		// A pointer range insert is a single capacity check and memmove:
+		const auto* const bytes = static_cast<const std::uint8_t*>(mem);
+		this->stream.insert(this->stream.end(), bytes, bytes + size);
 		return this->stream;
 	}
 
+	template <Abi Arch>
+	inline auto MachineStream<Arch>::BeginEmit(const std::size_t headroom) -> EmitCursor
+	{
+		return EmitCursor(this->stream, headroom);
+	}
+
 	inline auto operator <<(std::ostream& out, const MachineStream<Abi::X86_64>& stream) -> std::ostream&
 	{
-		auto printAscii = [&](const std::size_t i, const std::size_t count)
-		{
-			out << " | ";
-			for (std::size_t j = 0; j < count; ++j)
-			{
-				const auto val = stream[i - (count - 1 - j)];
-				out << static_cast<char>(std::isprint(val) ? val : u8'.');
-			}
-			out << '\n';
-		};
-
-		const auto hexLimit = stream.DumpTextLineLimit;
-
-		for (std::size_t i = 0; i < stream.Size(); ++i)
-		{
-			out << std::setw(2) << std::setfill('0') << std::right << std::hex << std::uppercase;
-			const auto value = stream[i];
-			if (value == 0) [[unlikely]]
-			{
-				out << "00 ";
-			}
-			else
-			{
-				out << +value << ' ';
-			}
-			if ((i + 1) % hexLimit == 0) [[unlikely]]
-			{
-				printAscii(i, hexLimit);
-			}
-		}
-		out << std::dec << std::endl;
+		WriteHexDump(out, std::span<const std::uint8_t>(stream.begin(), stream.end()), stream.DumpTextLineLimit, DumpFormat::Listing);
+		out.flush();
 		return out;
 	}
 
@@ -642,36 +728,144 @@ namespace CyberAsm
 	template <Abi Arch>
 	inline auto MachineStream<Arch>::Contains(const std::uint8_t target) const -> bool
 	{
-		return std::find(std::execution::par_unseq, this->stream.begin(), this->stream.end(), target) != this->stream.end();
+		return FindByte(this->stream, target) != NotFound;
 	}
 
 	template <Abi Arch>
 	inline auto MachineStream<Arch>::Find(const std::uint8_t target) -> Iterator
 	{
-		return std::find(std::execution::par_unseq, this->stream.begin(), this->stream.end(), target);
+		const auto offset = FindByte(this->stream, target);
+		return offset == NotFound ? this->end() : this->begin() + offset;
 	}
 
 	template <Abi Arch>
 	inline auto MachineStream<Arch>::Find(const std::uint8_t target) const -> ConstIterator
 	{
-		return std::find(std::execution::par_unseq, this->stream.begin(), this->stream.end(), target);
+		const auto offset = FindByte(this->stream, target);
+		return offset == NotFound ? this->end() : this->begin() + offset;
 	}
 
 	template <Abi Arch>
 	inline auto MachineStream<Arch>::Contains(const std::span<std::uint8_t> sequence) const -> bool
 	{
-		return std::search(std::execution::par_unseq, this->stream.begin(), this->stream.end(), sequence.begin(), sequence.end()) != this->stream.end();
+		return FindSequence(this->stream, sequence) != NotFound;
 	}
 
 	template <Abi Arch>
 	inline auto MachineStream<Arch>::Find(const std::span<std::uint8_t> sequence) -> Iterator
 	{
-		return std::search(std::execution::par_unseq, this->stream.begin(), this->stream.end(), sequence.begin(), sequence.end());
+		const auto offset = FindSequence(this->stream, sequence);
+		return offset == NotFound ? this->end() : this->begin() + offset;
 	}
 
 	template <Abi Arch>
 	inline auto MachineStream<Arch>::Find(const std::span<std::uint8_t> sequence) const -> ConstIterator
 	{
-		return std::search(std::execution::par_unseq, this->stream.begin(), this->stream.end(), sequence.begin(), sequence.end());
+		const auto offset = FindSequence(this->stream, sequence);
+		return offset == NotFound ? this->end() : this->begin() + offset;
+	}
+
+	template <Abi Arch>
+	inline auto MachineStream<Arch>::CreateLabel() -> Label
+	{
+		return this->labels.Create();
+	}
+
+	template <Abi Arch>
+	inline auto MachineStream<Arch>::CreateLabel(const std::string_view name) -> Label
+	{
+		return this->labels.Create(name);
+	}
+
+	template <Abi Arch>
+	inline auto MachineStream<Arch>::FindLabel(const std::string_view name) const -> std::optional<Label>
+	{
+		return this->labels.Find(name);
+	}
+
+	template <Abi Arch>
+	inline auto MachineStream<Arch>::FindOrCreateLabel(const std::string_view name) -> Label
+	{
+		return this->labels.FindOrCreate(name);
+	}
+
+	template <Abi Arch>
+	inline void MachineStream<Arch>::BindLabel(const Label label)
+	{
+		this->labels.Bind(label, this->labels.Origin() + this->stream.size());
+	}
+
+	template <Abi Arch>
+	inline void MachineStream<Arch>::InsertFixup(const Label target, const FixupKind kind, const std::int64_t addend)
+	{
+		this->labels.AddFixup(Fixup{this->labels.Origin() + this->stream.size(), target, kind, addend});
+		this->InsertPadding(FixupWidth(kind));
+	}
+
+	template <Abi Arch>
+	inline void MachineStream<Arch>::InsertBranch(const Label target, const std::uint8_t shortOpCode, const std::span<const std::uint8_t> longOpCode)
+	{
+		if (longOpCode.size() > RelaxableBranch::MaxLongOpCodeSize) [[unlikely]]
+		{
+			throw std::runtime_error("Long branch opcode is too large!");
+		}
+		RelaxableBranch branch = {};
+		branch.Offset = this->labels.Origin() + this->stream.size();
+		branch.Target = target;
+		branch.ShortOpCode = shortOpCode;
+		std::copy(longOpCode.begin(), longOpCode.end(), branch.LongOpCode.begin());
+		branch.LongOpCodeSize = static_cast<std::uint8_t>(longOpCode.size());
+		this->labels.AddBranch(branch);
+		this->stream.push_back(shortOpCode);
+		this->stream.push_back(0);
+	}
+
+	template <Abi Arch>
+	inline void MachineStream<Arch>::Append(const MachineStream& other, const std::span<Label> labelMapping)
+	{
+		const std::size_t codeOffset = this->labels.Origin() + this->stream.size();
+		this->stream.insert(this->stream.end(), other.stream.begin(), other.stream.end());
+		this->labels.Merge(other.labels, codeOffset, labelMapping);
+	}
+
+	template <Abi Arch>
+	inline auto MachineStream<Arch>::Finalize(const std::uint64_t baseAddress, const std::span<std::size_t> markers) -> RelaxationStats
+	{
+		const RelaxationStats stats = this->labels.Relax(this->stream, markers);
+		this->labels.Resolve(this->stream, baseAddress);
+		return stats;
+	}
+
+	template <Abi Arch>
+	inline auto MachineStream<Arch>::SettlePrefix(const std::uint64_t baseAddress) -> std::size_t
+	{
+		const std::size_t origin = this->labels.Origin();
+		const std::size_t settled = this->labels.SettledEnd(origin + this->stream.size());
+		const std::size_t size = this->stream.size();
+		this->labels.Relax(this->stream, {}, settled);
+
+		// The prefix grew by the widened branches, the code behind it moved along:
+		const std::size_t end = settled + (this->stream.size() - size);
+		this->labels.Resolve(this->stream, baseAddress, end);
+		return end - origin;
+	}
+
+	template <Abi Arch>
+	inline void MachineStream<Arch>::DiscardPrefix(const std::size_t size)
+	{
+		this->labels.Discard(size);
+		this->stream.erase(this->stream.begin(), this->stream.begin() + static_cast<std::ptrdiff_t>(size));
+	}
+
+	template <Abi Arch>
+	inline auto MachineStream<Arch>::Labels() const noexcept -> const LabelTable&
+	{
+		return this->labels;
+	}
+
+	template <Abi Arch>
+	inline auto MachineStream<Arch>::Labels() noexcept -> LabelTable&
+	{
+		return this->labels;
 	}
 }
@@ -0,0 +1,302 @@
+#pragma once
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <span>
+#include <stdexcept>
+
+#if defined(_WIN32)
+#	ifndef NOMINMAX
+#		define NOMINMAX
+#	endif
+#	include <Windows.h>
+#else
+#	include <fcntl.h>
+#	include <sys/mman.h>
+#	include <unistd.h>
+#endif
+
+#include "FileWriter.hpp"
+#include "MachineStream.hpp"
+
+namespace CyberAsm
+{
+	/// <summary>
+	/// Binary output file which is preallocated and mapped into memory, so encoders write directly into the page cache.
+	/// Reserve() returns writable file memory, Commit() appends the bytes actually written, like JitArena.
+	/// The file grows by remapping if the capacity is exceeded, which invalidates earlier reservations.
+	/// Close() unmaps the file and truncates it to the committed size.
+	/// </summary>
+	class MappedFileOutput final
+	{
+	public:
+		/// <summary>
+		/// Creates or truncates the file and preallocates the capacity, throws on failure.
+		/// </summary>
+		/// <param name="file">The output file.</param>
+		/// <param name="capacity">The expected file size, the file grows if required.</param>
+		explicit MappedFileOutput(const std::filesystem::path& file, std::size_t capacity);
+		MappedFileOutput(const MappedFileOutput&) = delete;
+		MappedFileOutput(MappedFileOutput&&) = delete;
+		auto operator =(const MappedFileOutput&) -> MappedFileOutput& = delete;
+		auto operator =(MappedFileOutput&&) -> MappedFileOutput& = delete;
+
+		/// <summary>
+		/// Closes the file, errors are swallowed, call Close() to observe them.
+		/// </summary>
+		~MappedFileOutput();
+
+		/// <summary>
+		/// Returns at least size bytes of writable file memory behind the committed bytes.
+		/// Throws if the output is closed, or if the file cannot be mapped again after a failed regrow.
+		/// </summary>
+		[[nodiscard]] auto Reserve(std::size_t size) -> std::span<std::uint8_t>;
+
+		/// <summary>
+		/// Appends size bytes of the last reservation to the file, throws if the output is closed or unmapped.
+		/// </summary>
+		void Commit(std::size_t size);
+
+		/// <summary>
+		/// Appends the bytes, throws if the output is closed.
+		/// </summary>
+		void Write(const void* memory, std::size_t size);
+
+		template <Abi Arch>
+		auto operator <<(const MachineStream<Arch>& stream) -> MappedFileOutput&;
+
+		/// <summary>
+		/// Returns the number of committed bytes.
+		/// </summary>
+		[[nodiscard]] auto Size() const noexcept -> std::size_t;
+		[[nodiscard]] auto Capacity() const noexcept -> std::size_t;
+
+		/// <summary>
+		/// Unmaps the file and truncates it to the committed size.
+		/// Throws if the file could not be finished.
+		/// </summary>
+		void Close();
+
+		/// <summary>
+		/// Returns the statistics, complete after Close().
+		/// Page faults taken while writing into the mapping are not part of the I/O time.
+		/// </summary>
+		[[nodiscard]] auto Stats() const noexcept -> const FileOutputStats&;
+
+	private:
+		[[nodiscard]] auto IsOpen() const noexcept -> bool;
+		void Map(std::size_t capacity);
+		void Unmap() noexcept;
+		[[nodiscard]] auto Resize(std::size_t size) noexcept -> bool;
+
+#if defined(_WIN32)
+		HANDLE file = INVALID_HANDLE_VALUE;
+		HANDLE mapping = nullptr;
+#else
+		int file = -1;
+#endif
+		std::uint8_t* base = nullptr;
+		std::size_t capacity = 0;
+		std::size_t used = 0;
+		std::size_t reserved = 0;
+		FileOutputStats stats = {};
+	};
+
+	inline MappedFileOutput::MappedFileOutput(const std::filesystem::path& file, const std::size_t capacity)
+	{
+		const auto begin = std::chrono::steady_clock::now();
+#if defined(_WIN32)
+		this->file = CreateFileW(file.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (this->file == INVALID_HANDLE_VALUE) [[unlikely]]
+#else
+		this->file = open(file.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+		if (this->file < 0) [[unlikely]]
+#endif
+		{
+			throw std::runtime_error("Failed to open the output file!");
+		}
+		this->stats.IoTime += std::chrono::steady_clock::now() - begin;
+		try
+		{
+			this->Map(std::max<std::size_t>(capacity, 1));
+		}
+		catch (...)
+		{
+			this->Close();
+			throw;
+		}
+	}
+
+	inline MappedFileOutput::~MappedFileOutput()
+	{
+		try
+		{
+			this->Close();
+		}
+		catch (...)
+		{
+		}
+	}
+
+	inline auto MappedFileOutput::Reserve(const std::size_t size) -> std::span<std::uint8_t>
+	{
+		if (!this->IsOpen()) [[unlikely]]
+		{
+			throw std::runtime_error("The output file is already closed!");
+		}
+
+		// A regrow which failed to map leaves the output unmapped, the next reservation maps it again:
+		if (!this->base || this->capacity - this->used < size) [[unlikely]]
+		{
+			const std::size_t grown = std::max(this->capacity * 2, this->used + size);
+			this->Unmap();
+			this->Map(grown);
+		}
+		this->reserved = size;
+		return {this->base + this->used, size};
+	}
+
+	inline void MappedFileOutput::Commit(const std::size_t size)
+	{
+		if (!this->base) [[unlikely]]
+		{
+			throw std::runtime_error(this->IsOpen() ? "The output file is not mapped!" : "The output file is already closed!");
+		}
+		if (size > this->reserved) [[unlikely]]
+		{
+			throw std::runtime_error("Commit exceeds the reserved file memory!");
+		}
+		this->used += size;
+		this->reserved = 0;
+	}
+
+	inline void MappedFileOutput::Write(const void* const memory, const std::size_t size)
+	{
+		std::memcpy(this->Reserve(size).data(), memory, size);
+		this->Commit(size);
+	}
+
+	template <Abi Arch>
+	inline auto MappedFileOutput::operator<<(const MachineStream<Arch>& stream) -> MappedFileOutput&
+	{
+		this->Write(stream.begin(), stream.Size());
+		return *this;
+	}
+
+	inline auto MappedFileOutput::Size() const noexcept -> std::size_t
+	{
+		return this->used;
+	}
+
+	inline auto MappedFileOutput::Capacity() const noexcept -> std::size_t
+	{
+		return this->capacity;
+	}
+
+	inline void MappedFileOutput::Close()
+	{
+		if (!this->IsOpen())
+		{
+			return;
+		}
+		const auto begin = std::chrono::steady_clock::now();
+		this->Unmap();
+		const bool truncated = this->Resize(this->used);
+#if defined(_WIN32)
+		const bool closed = CloseHandle(this->file);
+		this->file = INVALID_HANDLE_VALUE;
+#else
+		const bool closed = close(this->file) == 0;
+		this->file = -1;
+#endif
+		this->stats.IoTime += std::chrono::steady_clock::now() - begin;
+		this->stats.BytesWritten = this->used;
+		if (!truncated || !closed) [[unlikely]]
+		{
+			throw std::runtime_error("Failed to write the output file!");
+		}
+	}
+
+	inline auto MappedFileOutput::Stats() const noexcept -> const FileOutputStats&
+	{
+		return this->stats;
+	}
+
+	inline auto MappedFileOutput::IsOpen() const noexcept -> bool
+	{
+#if defined(_WIN32)
+		return this->file != INVALID_HANDLE_VALUE;
+#else
+		return this->file >= 0;
+#endif
+	}
+
+	inline void MappedFileOutput::Map(const std::size_t capacity)
+	{
+		const auto begin = std::chrono::steady_clock::now();
+#if defined(_WIN32)
+		if (!this->Resize(capacity)) [[unlikely]]
+		{
+			throw std::runtime_error("Failed to preallocate the output file!");
+		}
+		const auto size = static_cast<std::uint64_t>(capacity);
+		this->mapping = CreateFileMappingW(this->file, nullptr, PAGE_READWRITE, static_cast<DWORD>(size >> 32), static_cast<DWORD>(size), nullptr);
+		void* const memory = this->mapping ? MapViewOfFile(this->mapping, FILE_MAP_WRITE, 0, 0, capacity) : nullptr;
+		if (!memory) [[unlikely]]
+#else
+		// Allocate the blocks up front, so writes into the mapping cannot fail with SIGBUS on a full disk.
+		// File systems without fallocate support get a sparse file instead:
+		const int error = posix_fallocate(this->file, 0, static_cast<off_t>(capacity));
+		if (error != 0 && !((error == EOPNOTSUPP || error == EINVAL) && this->Resize(capacity))) [[unlikely]]
+		{
+			throw std::runtime_error("Failed to preallocate the output file!");
+		}
+		void* const memory = mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, this->file, 0);
+		if (memory == MAP_FAILED) [[unlikely]]
+#endif
+		{
+			throw std::runtime_error("Failed to map the output file!");
+		}
+		this->base = static_cast<std::uint8_t*>(memory);
+		this->capacity = capacity;
+		this->stats.IoTime += std::chrono::steady_clock::now() - begin;
+	}
+
+	inline void MappedFileOutput::Unmap() noexcept
+	{
+#if defined(_WIN32)
+		if (this->base)
+		{
+			UnmapViewOfFile(this->base);
+		}
+		if (this->mapping)
+		{
+			CloseHandle(this->mapping);
+			this->mapping = nullptr;
+		}
+#else
+		if (this->base)
+		{
+			munmap(this->base, this->capacity);
+		}
+#endif
+		this->base = nullptr;
+		this->capacity = 0;
+		this->reserved = 0;
+	}
+
+	inline auto MappedFileOutput::Resize(const std::size_t size) noexcept -> bool
+	{
+#if defined(_WIN32)
+		LARGE_INTEGER position = {};
+		position.QuadPart = static_cast<LONGLONG>(size);
+		return SetFilePointerEx(this->file, position, nullptr, FILE_BEGIN) && SetEndOfFile(this->file);
+#else
+		return ftruncate(this->file, static_cast<off_t>(size)) == 0;
+#endif
+	}
+}
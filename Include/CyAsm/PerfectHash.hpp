@@ -0,0 +1,170 @@
+#pragma once
+
+#include <cstdint>
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <optional>
+#include <stdexcept>
+#include <string_view>
+
+namespace CyberAsm
+{
+	/// <summary>
+	/// Converts an ASCII upper case letter into lower case, all other characters are returned unchanged.
+	/// </summary>
+	[[nodiscard]] constexpr auto FoldCase(const char c) noexcept -> char
+	{
+		return static_cast<char>(c + (static_cast<unsigned char>(c - 'A') < 26 ? 'a' - 'A' : 0));
+	}
+
+	/// <summary>
+	/// Case insensitive 64-bit FNV-1a hash.
+	/// </summary>
+	[[nodiscard]] constexpr auto HashFoldedKey(const std::string_view key) noexcept -> std::uint64_t
+	{
+		std::uint64_t hash = UINT64_C(0xCBF2'9CE4'8422'2325);
+		for (const char c : key)
+		{
+			hash ^= static_cast<std::uint8_t>(FoldCase(c));
+			hash *= UINT64_C(0x0000'0100'0000'01B3);
+		}
+		return hash;
+	}
+
+	/// <summary>
+	/// Remixes a key hash with a bucket displacement.
+	/// </summary>
+	[[nodiscard]] constexpr auto MixHash(std::uint64_t hash, const std::uint32_t displacement) noexcept -> std::uint64_t
+	{
+		hash ^= displacement * UINT64_C(0x9E37'79B9'7F4A'7C15);
+		hash ^= hash >> 33U;
+		hash *= UINT64_C(0xFF51'AFD7'ED55'8CCD);
+		hash ^= hash >> 33U;
+		return hash;
+	}
+
+	/// <summary>
+	/// Compile time generated perfect hash table (hash and displace) over a fixed set of lower case keys.
+	/// Maps a key to its index in the key table with one hash pass, two table loads and one compare.
+	/// Lookups are case insensitive, nothing is allocated.
+	/// </summary>
+	template <std::size_t N>
+	class PerfectHashTable final
+	{
+	public:
+		static constexpr std::size_t SlotCount = std::bit_ceil(N) * 2;
+		static constexpr std::size_t BucketCount = std::max<std::size_t>(std::bit_ceil(N) / 4, 1);
+
+		using KeyTable = std::array<std::string_view, N>;
+
+		consteval explicit PerfectHashTable(const KeyTable& keys);
+
+		/// <summary>
+		/// Looks up the key.
+		/// </summary>
+		/// <param name="key">The key to look up, case is ignored.</param>
+		/// <returns>The index of the key in the key table or std::nullopt if the key is unknown.</returns>
+		[[nodiscard]] constexpr auto Find(std::string_view key) const noexcept -> std::optional<std::size_t>;
+
+	private:
+		static constexpr std::uint16_t EmptySlot = 0;
+
+		KeyTable keys;
+		std::array<std::uint16_t, BucketCount> displacements = {};
+
+		/// <summary>
+		/// Key index + 1, 0 means empty.
+		/// </summary>
+		std::array<std::uint16_t, SlotCount> slots = {};
+	};
+
+	template <std::size_t N>
+	consteval PerfectHashTable<N>::PerfectHashTable(const KeyTable& keys) : keys(keys)
+	{
+		static_assert(N < 0xFFFF, "Too many keys for 16-bit slots!");
+
+		// Distribute the keys into buckets:
+		std::array<std::size_t, BucketCount> bucketSizes = {};
+		std::array<std::array<std::uint16_t, N>, BucketCount> buckets = {};
+		for (std::size_t i = 0; i < N; ++i)
+		{
+			for (const char c : keys[i])
+			{
+				if (c != FoldCase(c))
+				{
+					throw std::logic_error("Perfect hash keys must be lower case!");
+				}
+			}
+			const auto bucket = HashFoldedKey(keys[i]) & (BucketCount - 1);
+			buckets[bucket][bucketSizes[bucket]++] = static_cast<std::uint16_t>(i);
+		}
+
+		// Place the largest buckets first, they are the hardest to fit:
+		std::array<std::size_t, BucketCount> order = {};
+		for (std::size_t i = 0; i < BucketCount; ++i)
+		{
+			order[i] = i;
+		}
+		std::sort(order.begin(), order.end(), [&](const std::size_t a, const std::size_t b)
+		{
+			return bucketSizes[a] > bucketSizes[b];
+		});
+
+		for (const auto bucket : order)
+		{
+			for (std::uint32_t displacement = 0;; ++displacement)
+			{
+				if (displacement == 0xFFFF)
+				{
+					throw std::logic_error("Failed to find a perfect hash (duplicate keys?)!");
+				}
+				std::array<std::size_t, N> candidates = {};
+				bool fits = true;
+				for (std::size_t i = 0; i < bucketSizes[bucket] && fits; ++i)
+				{
+					const auto slot = MixHash(HashFoldedKey(keys[buckets[bucket][i]]), displacement) & (SlotCount - 1);
+					fits = this->slots[slot] == EmptySlot && std::find(candidates.begin(), candidates.begin() + i, slot) == candidates.begin() + i;
+					candidates[i] = slot;
+				}
+				if (fits)
+				{
+					for (std::size_t i = 0; i < bucketSizes[bucket]; ++i)
+					{
+						this->slots[candidates[i]] = static_cast<std::uint16_t>(buckets[bucket][i] + 1);
+					}
+					this->displacements[bucket] = static_cast<std::uint16_t>(displacement);
+					break;
+				}
+			}
+		}
+	}
+
+	template <std::size_t N>
+	constexpr auto PerfectHashTable<N>::Find(const std::string_view key) const noexcept -> std::optional<std::size_t>
+	{
+		const auto hash = HashFoldedKey(key);
+		const auto displacement = this->displacements[hash & (BucketCount - 1)];
+		const auto entry = this->slots[MixHash(hash, displacement) & (SlotCount - 1)];
+		if (entry == EmptySlot) [[unlikely]]
+		{
+			return std::nullopt;
+		}
+
+		// The slot could belong to another key, verify:
+		const auto index = static_cast<std::size_t>(entry - 1);
+		const auto candidate = this->keys[index];
+		if (candidate.size() != key.size()) [[unlikely]]
+		{
+			return std::nullopt;
+		}
+		for (std::size_t i = 0; i < key.size(); ++i)
+		{
+			if (FoldCase(key[i]) != candidate[i]) [[unlikely]]
+			{
+				return std::nullopt;
+			}
+		}
+		return index;
+	}
+}
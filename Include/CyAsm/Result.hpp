@@ -0,0 +1,207 @@
+#pragma once
+
+#include <cstdint>
+#include <charconv>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+namespace CyberAsm
+{
+	enum class ErrorCode : std::uint8_t
+	{
+		None,
+		NoMatchingVariation,
+		ImmediateTooLarge,
+		OperandSizeMismatch,
+		HighByteRegisterWithRex,
+		InvalidImplicitRegister,
+		InvalidRegister,
+		UnsupportedRegister,
+		InvalidAddress,
+		UnsupportedOperands,
+		BufferTooSmall,
+		UnknownOpCode,
+		TruncatedInstruction,
+		InstructionTooLong,
+
+		Count
+	};
+
+	/// <summary>
+	/// Returns the human readable message of the error code.
+	/// </summary>
+	[[nodiscard]] constexpr auto DescribeError(const ErrorCode code) noexcept -> std::string_view
+	{
+		switch (code)
+		{
+			case ErrorCode::None: return "No error";
+			case ErrorCode::NoMatchingVariation: return "Found no corresponding instruction for operand types!";
+			case ErrorCode::ImmediateTooLarge: return "Immediate value is too large for destination register!";
+			case ErrorCode::OperandSizeMismatch: return "Register operands must have the same size!";
+			case ErrorCode::HighByteRegisterWithRex: return "The high byte registers 'ah', 'bh', 'ch' and 'dh' are not addressable when a REX prefix is used!";
+			case ErrorCode::InvalidImplicitRegister: return "Invalid implicit GPR! Must be 'al', 'ax', 'eax' or 'rax'!";
+			case ErrorCode::InvalidRegister: return "Invalid register!";
+			case ErrorCode::UnsupportedRegister: return "Register class is not supported as operand!";
+			case ErrorCode::InvalidAddress: return "Invalid address operand!";
+			case ErrorCode::UnsupportedOperands: return "Unsupported operand combination!";
+			case ErrorCode::BufferTooSmall: return "The output buffer is too small for the instruction!";
+			case ErrorCode::UnknownOpCode: return "Unknown or unsupported op code!";
+			case ErrorCode::TruncatedInstruction: return "The machine code ends inside of an instruction!";
+			case ErrorCode::InstructionTooLong: return "The instruction exceeds the maximum length of 15 bytes!";
+			default: return "Unknown error";
+		}
+	}
+
+	/// <summary>
+	/// Describes why an operation failed without allocating.
+	/// </summary>
+	struct Diagnostic final
+	{
+		static constexpr std::uint8_t NoOperand = 0xFF;
+
+		ErrorCode Code = ErrorCode::None;
+
+		/// <summary>
+		/// The index of the offending operand in Intel order or NoOperand.
+		/// </summary>
+		std::uint8_t OperandIndex = NoOperand;
+
+		/// <summary>
+		/// The offending value, such as the immediate or the register.
+		/// </summary>
+		std::uint64_t Value = 0;
+
+		[[nodiscard]] constexpr auto Message() const noexcept -> std::string_view;
+
+		/// <summary>
+		/// Returns the message followed by the operand index and the value if they are set,
+		/// for example "Immediate value is too large for destination register! (operand 1, value 0x100000000)".
+		/// </summary>
+		[[nodiscard]] auto Describe() const -> std::string;
+	};
+
+	constexpr auto Diagnostic::Message() const noexcept -> std::string_view
+	{
+		return DescribeError(this->Code);
+	}
+
+	inline auto Diagnostic::Describe() const -> std::string
+	{
+		std::string text(this->Message());
+		if (this->OperandIndex == NoOperand && this->Value == 0)
+		{
+			return text;
+		}
+		text += " (";
+		if (this->OperandIndex != NoOperand)
+		{
+			text += "operand " + std::to_string(this->OperandIndex);
+		}
+		if (this->Value != 0)
+		{
+			char digits[16] = {};
+			const auto end = std::to_chars(digits, digits + sizeof(digits), this->Value, 16).ptr;
+			text += this->OperandIndex != NoOperand ? ", value 0x" : "value 0x";
+			text.append(digits, end);
+		}
+		text += ')';
+		return text;
+	}
+
+	/// <summary>
+	/// Holds either a value or the diagnostic of the failure, like std::expected.
+	/// Used by the non-throwing APIs, which are usable in constant expressions.
+	/// </summary>
+	template <typename T>
+	class Result final
+	{
+	public:
+		constexpr Result(const T& value) noexcept;
+		constexpr Result(const Diagnostic& error) noexcept;
+
+		[[nodiscard]] constexpr auto HasValue() const noexcept -> bool;
+		[[nodiscard]] constexpr explicit operator bool() const noexcept;
+		[[nodiscard]] constexpr auto Value() const noexcept -> const T&;
+		[[nodiscard]] constexpr auto Error() const noexcept -> const Diagnostic&;
+		[[nodiscard]] constexpr auto ValueOr(const T& fallback) const noexcept -> T;
+
+		/// <summary>
+		/// Returns the value or throws std::runtime_error with the diagnostic, see Diagnostic::Describe().
+		/// </summary>
+		[[nodiscard]] constexpr auto ValueOrThrow() const -> const T&;
+
+		[[nodiscard]] constexpr auto operator *() const noexcept -> const T&;
+		[[nodiscard]] constexpr auto operator ->() const noexcept -> const T*;
+
+	private:
+		T value = {};
+		Diagnostic error = {};
+	};
+
+	/// <summary>
+	/// Creates a failed result.
+	/// </summary>
+	[[nodiscard]] constexpr auto Fail(const ErrorCode code, const std::uint8_t operandIndex = Diagnostic::NoOperand, const std::uint64_t value = 0) noexcept -> Diagnostic
+	{
+		return Diagnostic{code, operandIndex, value};
+	}
+
+	template <typename T>
+	constexpr Result<T>::Result(const T& value) noexcept : value(value) { }
+
+	template <typename T>
+	constexpr Result<T>::Result(const Diagnostic& error) noexcept : error(error) { }
+
+	template <typename T>
+	constexpr auto Result<T>::HasValue() const noexcept -> bool
+	{
+		return this->error.Code == ErrorCode::None;
+	}
+
+	template <typename T>
+	constexpr Result<T>::operator bool() const noexcept
+	{
+		return this->HasValue();
+	}
+
+	template <typename T>
+	constexpr auto Result<T>::Value() const noexcept -> const T&
+	{
+		return this->value;
+	}
+
+	template <typename T>
+	constexpr auto Result<T>::Error() const noexcept -> const Diagnostic&
+	{
+		return this->error;
+	}
+
+	template <typename T>
+	constexpr auto Result<T>::ValueOr(const T& fallback) const noexcept -> T
+	{
+		return this->HasValue() ? this->value : fallback;
+	}
+
+	template <typename T>
+	constexpr auto Result<T>::ValueOrThrow() const -> const T&
+	{
+		if (!this->HasValue()) [[unlikely]]
+		{
+			throw std::runtime_error(this->error.Describe());
+		}
+		return this->value;
+	}
+
+	template <typename T>
+	constexpr auto Result<T>::operator*() const noexcept -> const T&
+	{
+		return this->value;
+	}
+
+	template <typename T>
+	constexpr auto Result<T>::operator->() const noexcept -> const T*
+	{
+		return &this->value;
+	}
+}
@@ -0,0 +1,328 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cassert>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <span>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "ByteChunk.hpp"
+#include "MachineStream.hpp"
+
+namespace CyberAsm
+{
+	/// <summary>
+	/// Append-only code buffer made of fixed-size segments, for outputs too large for one contiguous vector.
+	/// Appending never moves code emitted before, so addresses returned by At() stay valid until Clear(),
+	/// and the peak memory is the code size plus one segment instead of twice the code size.
+	/// Every segment except the last is completely filled, so an offset maps to its segment with a shift.
+	/// The code is flattened once at the end with CopyTo(), ToStream() or by saving it to a file.
+	/// </summary>
+	class SegmentedCodeBuffer final
+	{
+	public:
+		static constexpr std::size_t DefaultSegmentSize = 1024 * 1024;
+
+		SegmentedCodeBuffer();
+
+		/// <param name="segmentSize">The size of every segment, must be a power of two.</param>
+		explicit SegmentedCodeBuffer(std::size_t segmentSize);
+		SegmentedCodeBuffer(const SegmentedCodeBuffer&) = delete;
+		SegmentedCodeBuffer(SegmentedCodeBuffer&& other) noexcept;
+		auto operator =(const SegmentedCodeBuffer&) -> SegmentedCodeBuffer& = delete;
+		auto operator =(SegmentedCodeBuffer&& other) noexcept -> SegmentedCodeBuffer&;
+		~SegmentedCodeBuffer() = default;
+
+		auto operator <<(std::uint8_t value) -> SegmentedCodeBuffer&;
+
+		/// <summary>
+		/// Copies the whole fixed size chunk buffer if the current segment has room for it, else splits the chunk.
+		/// </summary>
+		auto operator <<(const ByteChunk& chunk) -> SegmentedCodeBuffer&;
+		auto operator <<(std::span<const std::uint8_t> code) -> SegmentedCodeBuffer&;
+
+		void Write(const void* memory, std::size_t size);
+
+		/// <summary>
+		/// Stores the scalar in little endian byte order.
+		/// </summary>
+		template <typename T> requires std::is_trivially_copyable_v<T>
+		void WriteLittle(const T& value);
+
+		/// <summary>
+		/// Overwrites already emitted bytes in little endian byte order, for example a fixup field.
+		/// The field may span two segments.
+		/// </summary>
+		template <typename T> requires std::is_trivially_copyable_v<T>
+		void Patch(std::size_t offset, const T& value);
+
+		/// <summary>
+		/// Returns the stable address of an emitted byte.
+		/// </summary>
+		[[nodiscard]] auto At(std::size_t offset) noexcept -> std::uint8_t*;
+		[[nodiscard]] auto At(std::size_t offset) const noexcept -> const std::uint8_t*;
+
+		[[nodiscard]] auto Size() const noexcept -> std::size_t;
+		[[nodiscard]] auto SegmentSize() const noexcept -> std::size_t;
+
+		/// <summary>
+		/// Returns the number of segments holding code.
+		/// </summary>
+		[[nodiscard]] auto SegmentCount() const noexcept -> std::size_t;
+
+		/// <summary>
+		/// Returns the code of one segment, all segments in order form the whole code.
+		/// </summary>
+		[[nodiscard]] auto Segment(std::size_t index) const noexcept -> std::span<const std::uint8_t>;
+
+		/// <summary>
+		/// Gathers the code into contiguous memory, such as a JitArena reservation.
+		/// Throws if the memory is too small.
+		/// </summary>
+		/// <returns>The number of bytes copied.</returns>
+		auto CopyTo(std::span<std::uint8_t> out) const -> std::size_t;
+
+		/// <summary>
+		/// Gathers the code into a machine stream with a single allocation.
+		/// </summary>
+		template <Abi Arch = Abi::X86_64>
+		[[nodiscard]] auto ToStream() const -> MachineStream<Arch>;
+
+		/// <summary>
+		/// Writes the code segment by segment into a binary file.
+		/// </summary>
+		/// <returns>True on success.</returns>
+		auto operator ()(const std::filesystem::path& file) const -> bool;
+
+		/// <summary>
+		/// Removes all code, the segments are kept for reuse.
+		/// </summary>
+		void Clear() noexcept;
+
+	private:
+		void NextSegment();
+
+		std::size_t segmentShift = 0;
+		std::vector<std::unique_ptr<std::uint8_t[]>> segments = {};
+		std::size_t tailOffset = 0;
+		std::uint8_t* tail = nullptr;
+		std::uint8_t* position = nullptr;
+		std::uint8_t* limit = nullptr;
+	};
+
+	inline SegmentedCodeBuffer::SegmentedCodeBuffer() : SegmentedCodeBuffer(DefaultSegmentSize) { }
+
+	inline SegmentedCodeBuffer::SegmentedCodeBuffer(const std::size_t segmentSize)
+	{
+		if (segmentSize < ByteChunk::MaxByteChunkSize || !std::has_single_bit(segmentSize)) [[unlikely]]
+		{
+			throw std::runtime_error("Segment size must be a power of two and hold at least one instruction!");
+		}
+		this->segmentShift = static_cast<std::size_t>(std::countr_zero(segmentSize));
+	}
+
+	inline SegmentedCodeBuffer::SegmentedCodeBuffer(SegmentedCodeBuffer&& other) noexcept :
+		segmentShift(other.segmentShift),
+		segments(std::move(other.segments)),
+		tailOffset(std::exchange(other.tailOffset, 0)),
+		tail(std::exchange(other.tail, nullptr)),
+		position(std::exchange(other.position, nullptr)),
+		limit(std::exchange(other.limit, nullptr)) { }
+
+	inline auto SegmentedCodeBuffer::operator=(SegmentedCodeBuffer&& other) noexcept -> SegmentedCodeBuffer&
+	{
+		if (this != &other)
+		{
+			this->segmentShift = other.segmentShift;
+			this->segments = std::move(other.segments);
+			this->tailOffset = std::exchange(other.tailOffset, 0);
+			this->tail = std::exchange(other.tail, nullptr);
+			this->position = std::exchange(other.position, nullptr);
+			this->limit = std::exchange(other.limit, nullptr);
+		}
+		return *this;
+	}
+
+	inline auto SegmentedCodeBuffer::operator<<(const std::uint8_t value) -> SegmentedCodeBuffer&
+	{
+		if (this->position == this->limit) [[unlikely]]
+		{
+			this->NextSegment();
+		}
+		*this->position++ = value;
+		return *this;
+	}
+
+	inline auto SegmentedCodeBuffer::operator<<(const ByteChunk& chunk) -> SegmentedCodeBuffer&
+	{
+		if (static_cast<std::size_t>(this->limit - this->position) >= ByteChunk::MaxByteChunkSize) [[likely]]
+		{
+			std::memcpy(this->position, chunk.Data(), ByteChunk::MaxByteChunkSize);
+			this->position += chunk.Size();
+			return *this;
+		}
+		this->Write(chunk.Data(), chunk.Size());
+		return *this;
+	}
+
+	inline auto SegmentedCodeBuffer::operator<<(const std::span<const std::uint8_t> code) -> SegmentedCodeBuffer&
+	{
+		this->Write(code.data(), code.size());
+		return *this;
+	}
+
+	inline void SegmentedCodeBuffer::Write(const void* const memory, std::size_t size)
+	{
+		auto source = static_cast<const std::uint8_t*>(memory);
+		while (size != 0)
+		{
+			if (this->position == this->limit)
+			{
+				this->NextSegment();
+			}
+			const auto count = std::min(size, static_cast<std::size_t>(this->limit - this->position));
+			std::memcpy(this->position, source, count);
+			this->position += count;
+			source += count;
+			size -= count;
+		}
+	}
+
+	template <typename T> requires std::is_trivially_copyable_v<T>
+	inline void SegmentedCodeBuffer::WriteLittle(const T& value)
+	{
+		std::array<std::uint8_t, sizeof(T)> bytes = {};
+		std::memcpy(bytes.data(), &value, sizeof(T));
+		if constexpr (std::endian::native == std::endian::big)
+		{
+			std::reverse(bytes.begin(), bytes.end());
+		}
+		this->Write(bytes.data(), sizeof(T));
+	}
+
+	template <typename T> requires std::is_trivially_copyable_v<T>
+	inline void SegmentedCodeBuffer::Patch(const std::size_t offset, const T& value)
+	{
+		if (offset + sizeof(T) > this->Size()) [[unlikely]]
+		{
+			throw std::runtime_error("Patch is out of range!");
+		}
+		std::array<std::uint8_t, sizeof(T)> bytes = {};
+		std::memcpy(bytes.data(), &value, sizeof(T));
+		if constexpr (std::endian::native == std::endian::big)
+		{
+			std::reverse(bytes.begin(), bytes.end());
+		}
+		for (std::size_t i = 0; i < sizeof(T); ++i)
+		{
+			*this->At(offset + i) = bytes[i];
+		}
+	}
+
+	inline auto SegmentedCodeBuffer::At(const std::size_t offset) noexcept -> std::uint8_t*
+	{
+		assert(offset < this->Size());
+		return this->segments[offset >> this->segmentShift].get() + (offset & (this->SegmentSize() - 1));
+	}
+
+	inline auto SegmentedCodeBuffer::At(const std::size_t offset) const noexcept -> const std::uint8_t*
+	{
+		assert(offset < this->Size());
+		return this->segments[offset >> this->segmentShift].get() + (offset & (this->SegmentSize() - 1));
+	}
+
+	inline auto SegmentedCodeBuffer::Size() const noexcept -> std::size_t
+	{
+		return this->tail == nullptr ? 0 : this->tailOffset + static_cast<std::size_t>(this->position - this->tail);
+	}
+
+	inline auto SegmentedCodeBuffer::SegmentSize() const noexcept -> std::size_t
+	{
+		return std::size_t{1} << this->segmentShift;
+	}
+
+	inline auto SegmentedCodeBuffer::SegmentCount() const noexcept -> std::size_t
+	{
+		return this->tail == nullptr ? 0 : (this->tailOffset >> this->segmentShift) + 1;
+	}
+
+	inline auto SegmentedCodeBuffer::Segment(const std::size_t index) const noexcept -> std::span<const std::uint8_t>
+	{
+		assert(index < this->SegmentCount());
+		const std::size_t size = index + 1 == this->SegmentCount() ? static_cast<std::size_t>(this->position - this->tail) : this->SegmentSize();
+		return {this->segments[index].get(), size};
+	}
+
+	inline auto SegmentedCodeBuffer::CopyTo(const std::span<std::uint8_t> out) const -> std::size_t
+	{
+		if (out.size() < this->Size()) [[unlikely]]
+		{
+			throw std::runtime_error("Output memory is too small for the code!");
+		}
+		std::size_t offset = 0;
+		for (std::size_t i = 0; i < this->SegmentCount(); ++i)
+		{
+			const auto segment = this->Segment(i);
+			std::memcpy(out.data() + offset, segment.data(), segment.size());
+			offset += segment.size();
+		}
+		return offset;
+	}
+
+	template <Abi Arch>
+	inline auto SegmentedCodeBuffer::ToStream() const -> MachineStream<Arch>
+	{
+		MachineStream<Arch> stream = {};
+		stream.Resize(this->Size());
+		static_cast<void>(this->CopyTo(std::span<std::uint8_t>(stream.begin(), stream.Size())));
+		return stream;
+	}
+
+	inline auto SegmentedCodeBuffer::operator()(const std::filesystem::path& file) const -> bool
+	{
+		std::ofstream fstream(file, std::ios::out | std::ios::binary);
+		if (!fstream) [[unlikely]]
+		{
+			return false;
+		}
+		for (std::size_t i = 0; i < this->SegmentCount(); ++i)
+		{
+			const auto segment = this->Segment(i);
+			fstream.write(reinterpret_cast<const char*>(segment.data()), static_cast<std::streamsize>(segment.size()));
+		}
+		return static_cast<bool>(fstream);
+	}
+
+	inline void SegmentedCodeBuffer::Clear() noexcept
+	{
+		this->tailOffset = 0;
+		this->tail = nullptr;
+		this->position = nullptr;
+		this->limit = nullptr;
+	}
+
+	inline void SegmentedCodeBuffer::NextSegment()
+	{
+		if (this->tail != nullptr)
+		{
+			this->tailOffset += this->SegmentSize();
+		}
+		const auto index = this->tailOffset >> this->segmentShift;
+		if (index == this->segments.size())
+		{
+			this->segments.push_back(std::make_unique_for_overwrite<std::uint8_t[]>(this->SegmentSize()));
+		}
+		this->tail = this->segments[index].get();
+		this->position = this->tail;
+		this->limit = this->tail + this->SegmentSize();
+	}
+}
@@ -0,0 +1,162 @@
+#pragma once
+
+#include <cstdint>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <utility>
+#include <vector>
+
+namespace CyberAsm
+{
+	/// <summary>
+	/// Bounded lock-free queue between exactly one producer thread and one consumer thread.
+	/// Both ends only touch their own counter and read the other one, the slots in between are owned by one side at a time.
+	/// A full queue blocks the producer and an empty queue blocks the consumer, which gives a pipeline its backpressure;
+	/// waiting uses std::atomic::wait(), so a blocked thread sleeps instead of spinning.
+	/// Either side may close the queue, which wakes the other one.
+	/// </summary>
+	template <typename T>
+	class SpscQueue final
+	{
+	public:
+		/// <param name="capacity">The number of values the queue holds before the producer blocks.</param>
+		explicit SpscQueue(std::size_t capacity);
+		SpscQueue(const SpscQueue&) = delete;
+		SpscQueue(SpscQueue&&) = delete;
+		auto operator =(const SpscQueue&) -> SpscQueue& = delete;
+		auto operator =(SpscQueue&&) -> SpscQueue& = delete;
+		~SpscQueue() = default;
+
+		/// <summary>
+		/// Moves the value into the queue, blocks while the queue is full.
+		/// Only called by the producer.
+		/// </summary>
+		/// <returns>False if the queue was closed, the value is dropped.</returns>
+		[[nodiscard]] auto Push(T&& value) -> bool;
+
+		/// <summary>
+		/// Moves the oldest value out of the queue, blocks while the queue is empty.
+		/// Only called by the consumer.
+		/// </summary>
+		/// <returns>False if the queue was closed and all values before the close were taken.</returns>
+		[[nodiscard]] auto Pop(T& value) -> bool;
+
+		/// <summary>
+		/// Ends the queue, the producer closes it after its last value, the consumer to stop the producer early.
+		/// </summary>
+		void Close() noexcept;
+
+		[[nodiscard]] auto Capacity() const noexcept -> std::size_t;
+
+		/// <summary>
+		/// Returns the time the producer was blocked by a full queue.
+		/// </summary>
+		[[nodiscard]] auto PushWaitTime() const noexcept -> std::chrono::nanoseconds;
+
+		/// <summary>
+		/// Returns the time the consumer was blocked by an empty queue.
+		/// </summary>
+		[[nodiscard]] auto PopWaitTime() const noexcept -> std::chrono::nanoseconds;
+
+	private:
+		/// <summary>
+		/// The counters step by two, the lowest bit marks the closed queue so closing changes the value a blocked side waits on.
+		/// </summary>
+		static constexpr std::uint64_t ClosedBit = 1;
+		static constexpr std::uint64_t Step = 2;
+
+		std::vector<T> slots = {};
+		alignas(64) std::atomic<std::uint64_t> pushed = 0;
+		std::chrono::nanoseconds pushWait = {};
+		alignas(64) std::atomic<std::uint64_t> popped = 0;
+		std::chrono::nanoseconds popWait = {};
+	};
+
+	template <typename T>
+	inline SpscQueue<T>::SpscQueue(const std::size_t capacity) : slots(std::max<std::size_t>(capacity, 1)) { }
+
+	template <typename T>
+	inline auto SpscQueue<T>::Push(T&& value) -> bool
+	{
+		const std::uint64_t count = this->pushed.load(std::memory_order_relaxed);
+		std::uint64_t consumed = this->popped.load(std::memory_order_acquire);
+		if (((count | consumed) & ClosedBit) != 0) [[unlikely]]
+		{
+			return false;
+		}
+		if (count - consumed >= this->slots.size() * Step) [[unlikely]]
+		{
+			const auto begin = std::chrono::steady_clock::now();
+			do
+			{
+				this->popped.wait(consumed, std::memory_order_acquire);
+				consumed = this->popped.load(std::memory_order_acquire);
+				if (((consumed | this->pushed.load(std::memory_order_relaxed)) & ClosedBit) != 0)
+				{
+					this->pushWait += std::chrono::steady_clock::now() - begin;
+					return false;
+				}
+			}
+			while (count - consumed >= this->slots.size() * Step);
+			this->pushWait += std::chrono::steady_clock::now() - begin;
+		}
+		this->slots[count / Step % this->slots.size()] = std::move(value);
+		this->pushed.fetch_add(Step, std::memory_order_release);
+		this->pushed.notify_one();
+		return true;
+	}
+
+	template <typename T>
+	inline auto SpscQueue<T>::Pop(T& value) -> bool
+	{
+		const std::uint64_t count = this->popped.load(std::memory_order_relaxed) & ~ClosedBit;
+		std::uint64_t produced = this->pushed.load(std::memory_order_acquire);
+		if ((produced & ~ClosedBit) == count) [[unlikely]]
+		{
+			const auto begin = std::chrono::steady_clock::now();
+			while ((produced & ~ClosedBit) == count)
+			{
+				if (((produced | this->popped.load(std::memory_order_relaxed)) & ClosedBit) != 0)
+				{
+					this->popWait += std::chrono::steady_clock::now() - begin;
+					return false;
+				}
+				this->pushed.wait(produced, std::memory_order_acquire);
+				produced = this->pushed.load(std::memory_order_acquire);
+			}
+			this->popWait += std::chrono::steady_clock::now() - begin;
+		}
+		value = std::move(this->slots[count / Step % this->slots.size()]);
+		this->popped.fetch_add(Step, std::memory_order_release);
+		this->popped.notify_one();
+		return true;
+	}
+
+	template <typename T>
+	inline void SpscQueue<T>::Close() noexcept
+	{
+		this->pushed.fetch_or(ClosedBit, std::memory_order_acq_rel);
+		this->popped.fetch_or(ClosedBit, std::memory_order_acq_rel);
+		this->pushed.notify_all();
+		this->popped.notify_all();
+	}
+
+	template <typename T>
+	inline auto SpscQueue<T>::Capacity() const noexcept -> std::size_t
+	{
+		return this->slots.size();
+	}
+
+	template <typename T>
+	inline auto SpscQueue<T>::PushWaitTime() const noexcept -> std::chrono::nanoseconds
+	{
+		return this->pushWait;
+	}
+
+	template <typename T>
+	inline auto SpscQueue<T>::PopWaitTime() const noexcept -> std::chrono::nanoseconds
+	{
+		return this->popWait;
+	}
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <memory_resource>
+
+#include "MachineStream.hpp"
+
+namespace CyberAsm
+{
+	/// <summary>
+	/// Monotonic arena for short-lived machine streams, for example all streams of one compilation unit.
+	/// Allocations are a pointer bump into an owned block, freeing is a no-op and Reset() releases everything at once.
+	/// Blocks beyond the first one come from the upstream resource and are returned by Reset(),
+	/// so size the first block for a whole compilation unit to keep the steady state off the heap.
+	/// The arena is not thread safe, use one arena per thread.
+	/// </summary>
+	class StreamArena final
+	{
+	public:
+		static constexpr std::size_t DefaultBlockSize = 64 * 1024;
+
+		StreamArena();
+		explicit StreamArena(std::size_t blockSize, std::pmr::memory_resource* upstream = std::pmr::new_delete_resource());
+		StreamArena(const StreamArena&) = delete;
+		StreamArena(StreamArena&&) = delete;
+		auto operator =(const StreamArena&) -> StreamArena& = delete;
+		auto operator =(StreamArena&&) -> StreamArena& = delete;
+		~StreamArena() = default;
+
+		/// <summary>
+		/// Creates an empty stream allocating from the arena.
+		/// </summary>
+		/// <param name="capacity">The number of bytes to reserve up front, avoids the growth copies.</param>
+		template <Abi Arch = Abi::X86_64>
+		[[nodiscard]] auto CreateStream(std::size_t capacity = 0) -> MachineStream<Arch>;
+
+		/// <summary>
+		/// Releases all allocations at once.
+		/// Streams created before must not be used afterwards, destroying them is allowed.
+		/// </summary>
+		void Reset() noexcept;
+
+		[[nodiscard]] auto Resource() noexcept -> std::pmr::memory_resource*;
+		[[nodiscard]] auto BlockSize() const noexcept -> std::size_t;
+
+	private:
+		std::size_t blockSize = DefaultBlockSize;
+		std::unique_ptr<std::byte[]> block = {};
+		std::pmr::monotonic_buffer_resource resource;
+	};
+
+	inline StreamArena::StreamArena() : StreamArena(DefaultBlockSize) { }
+
+	inline StreamArena::StreamArena(const std::size_t blockSize, std::pmr::memory_resource* const upstream) :
+		blockSize(blockSize),
+		block(std::make_unique_for_overwrite<std::byte[]>(blockSize)),
+		resource(this->block.get(), blockSize, upstream) { }
+
+	template <Abi Arch>
+	inline auto StreamArena::CreateStream(const std::size_t capacity) -> MachineStream<Arch>
+	{
+		return MachineStream<Arch>(capacity, &this->resource);
+	}
+
+	inline void StreamArena::Reset() noexcept
+	{
+		this->resource.release();
+	}
+
+	inline auto StreamArena::Resource() noexcept -> std::pmr::memory_resource*
+	{
+		return &this->resource;
+	}
+
+	inline auto StreamArena::BlockSize() const noexcept -> std::size_t
+	{
+		return this->blockSize;
+	}
+}
@@ -1,34 +1,200 @@
 #pragma once
 
-#include <fstream>
+#include <cstdint>
+#include <cstring>
 #include <filesystem>
+#include <fstream>
+#include <stdexcept>
 #include <string>
-#include <algorithm>
-#include <execution>
+#include <string_view>
+#include <vector>
+
+#if defined(_WIN32)
+#	ifndef NOMINMAX
+#		define NOMINMAX
+#	endif
+#	include <Windows.h>
+#else
+#	include <fcntl.h>
+#	include <sys/mman.h>
+#	include <sys/stat.h>
+#	include <unistd.h>
+#endif
+
+#include "LineIndex.hpp"
 
 namespace CyberAsm
 {
+	/// <summary>
+	/// Reads the whole file into the string with one read call.
+	/// </summary>
 	inline void ReadFile(std::string& out, const std::filesystem::path& path)
 	{
-		std::ifstream stream(path);
+		std::ifstream stream(path, std::ios::in | std::ios::binary);
 		if (!stream) [[unlikely]]
 		{
 			throw std::runtime_error("failed to open file!");
 		}
 		stream.seekg(0, std::ios::end);
-		out.reserve(stream.tellg());
-		stream.seekg(0, std::ios::beg);
-		out.assign(std::istreambuf_iterator<char>(stream), std::istreambuf_iterator<char>(stream));
+		const std::streamoff size = stream.tellg();
+		out.clear();
+		if (size > 0)
+		{
+			out.resize(static_cast<std::size_t>(size));
+			stream.seekg(0, std::ios::beg);
+			stream.read(out.data(), size);
+			out.resize(static_cast<std::size_t>(stream.gcount()));
+			return;
+		}
+
+		// Pipes and special files have no size, they are read in blocks:
+		stream.clear();
+		constexpr std::size_t blockSize = 64 * 1024;
+		for (;;)
+		{
+			const std::size_t used = out.size();
+			out.resize(used + blockSize);
+			stream.read(out.data() + used, static_cast<std::streamsize>(blockSize));
+			out.resize(used + static_cast<std::size_t>(stream.gcount()));
+			if (!stream)
+			{
+				return;
+			}
+		}
+	}
+
+	/// <summary>
+	/// Appends the offset of every line break.
+	/// </summary>
+	inline void SplitLines(const std::string_view target, std::vector<std::size_t>& needles)
+	{
+		const LineIndex index(target);
+		const auto starts = index.Starts();
+		for (std::size_t i = 1; i < starts.size(); ++i)
+		{
+			needles.push_back(starts[i] - 1);
+		}
+		if (!target.empty() && target.back() == '\n')
+		{
+			needles.push_back(target.size() - 1);
+		}
 	}
 
-	inline void SplitLines(const std::string& target, std::vector<std::size_t>& needles)
+	/// <summary>
+	/// Read-only view of a source file.
+	/// Regular files are mapped into memory, so the parser reads straight from the page cache without copying;
+	/// pipes and other files which cannot be mapped are read into an owned buffer instead.
+	/// </summary>
+	class MappedSourceFile final
 	{
-		for (auto i = target.begin(); (i = std::find_if(i, target.end(), [](const char x)
+	public:
+		/// <summary>
+		/// Opens and maps the file, throws if it cannot be read.
+		/// </summary>
+		explicit MappedSourceFile(const std::filesystem::path& file);
+		MappedSourceFile(const MappedSourceFile&) = delete;
+		MappedSourceFile(MappedSourceFile&&) = delete;
+		auto operator =(const MappedSourceFile&) -> MappedSourceFile& = delete;
+		auto operator =(MappedSourceFile&&) -> MappedSourceFile& = delete;
+		~MappedSourceFile();
+
+		/// <summary>
+		/// Returns the contents, valid until the view is destroyed.
+		/// </summary>
+		[[nodiscard]] auto Text() const noexcept -> std::string_view;
+		[[nodiscard]] auto Size() const noexcept -> std::size_t;
+
+		/// <summary>
+		/// Returns true if the contents are mapped rather than copied.
+		/// </summary>
+		[[nodiscard]] auto IsMapped() const noexcept -> bool;
+
+	private:
+		const char* base = nullptr;
+		std::size_t size = 0;
+		std::string fallback = {};
+		bool mapped = false;
+#if defined(_WIN32)
+		HANDLE mapping = nullptr;
+#endif
+	};
+
+	inline MappedSourceFile::MappedSourceFile(const std::filesystem::path& file)
+	{
+#if defined(_WIN32)
+		const HANDLE handle = CreateFileW(file.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+		if (handle == INVALID_HANDLE_VALUE) [[unlikely]]
+		{
+			throw std::runtime_error("failed to open file!");
+		}
+		LARGE_INTEGER fileSize = {};
+		const bool sized = GetFileSizeEx(handle, &fileSize) && fileSize.QuadPart > 0;
+		this->mapping = sized ? CreateFileMappingW(handle, nullptr, PAGE_READONLY, 0, 0, nullptr) : nullptr;
+		CloseHandle(handle);
+		void* const memory = this->mapping ? MapViewOfFile(this->mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+		if (memory)
+		{
+			this->base = static_cast<const char*>(memory);
+			this->size = static_cast<std::size_t>(fileSize.QuadPart);
+			this->mapped = true;
+			return;
+		}
+		if (this->mapping)
+		{
+			CloseHandle(this->mapping);
+			this->mapping = nullptr;
+		}
+#else
+		const int handle = open(file.c_str(), O_RDONLY | O_CLOEXEC);
+		if (handle < 0) [[unlikely]]
 		{
-			return x == '\n';
-		})) != target.end(); ++i)
+			throw std::runtime_error("failed to open file!");
+		}
+		struct stat info = {};
+		const bool regular = fstat(handle, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0;
+		void* const memory = regular ? mmap(nullptr, static_cast<std::size_t>(info.st_size), PROT_READ, MAP_PRIVATE, handle, 0) : MAP_FAILED;
+		close(handle);
+		if (memory != MAP_FAILED)
+		{
+			// The parser reads front to back, so the kernel may read ahead aggressively:
+			madvise(memory, static_cast<std::size_t>(info.st_size), MADV_SEQUENTIAL);
+			this->base = static_cast<const char*>(memory);
+			this->size = static_cast<std::size_t>(info.st_size);
+			this->mapped = true;
+			return;
+		}
+#endif
+		ReadFile(this->fallback, file);
+		this->base = this->fallback.data();
+		this->size = this->fallback.size();
+	}
+
+	inline MappedSourceFile::~MappedSourceFile()
+	{
+		if (!this->IsMapped())
 		{
-			needles.push_back(*i);
+			return;
 		}
+#if defined(_WIN32)
+		UnmapViewOfFile(this->base);
+		CloseHandle(this->mapping);
+#else
+		munmap(const_cast<char*>(this->base), this->size);
+#endif
+	}
+
+	inline auto MappedSourceFile::Text() const noexcept -> std::string_view
+	{
+		return {this->base, this->size};
+	}
+
+	inline auto MappedSourceFile::Size() const noexcept -> std::size_t
+	{
+		return this->size;
+	}
+
+	inline auto MappedSourceFile::IsMapped() const noexcept -> bool
+	{
+		return this->mapped;
 	}
 }
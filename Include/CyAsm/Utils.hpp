@@ -69,7 +69,8 @@ namespace CyberAsm
 		bytes |= bytes >> 4U;
 		bytes |= bytes >> 8U;
 		bytes |= bytes >> 16U;
-		bytes = std::clamp<std::uint8_t>(static_cast<std::uint8_t>(++bytes), 1, static_cast<std::uint8_t>(WordSize::QOWord));
+		++bytes;
+		bytes = std::clamp<std::uint8_t>(static_cast<std::uint8_t>(bytes), 1, static_cast<std::uint8_t>(WordSize::QOWord));
 		return static_cast<WordSize>(bytes);
 	}
 
@@ -0,0 +1,284 @@
+#pragma once
+
+#include <cstdint>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <span>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace CyberAsm
+{
+	/// <summary>
+	/// Fixed set of threads which run batches of weighted tasks.
+	/// Every thread owns a queue; the tasks are dealt heaviest first to the queue with the least total weight,
+	/// so the queues start out balanced. A thread works its own queue from the heavy end and, once it is empty,
+	/// steals from the light end of the fullest other queue, which evens out weights that were only estimates.
+	/// The thread calling Run() works as well, so the pool starts one thread less than its size.
+	/// </summary>
+	class WorkStealingPool final
+	{
+	public:
+		/// <param name="threadCount">The number of threads including the caller of Run(), 0 uses every hardware thread.</param>
+		explicit WorkStealingPool(std::size_t threadCount = 0);
+		WorkStealingPool(const WorkStealingPool&) = delete;
+		WorkStealingPool(WorkStealingPool&&) = delete;
+		auto operator =(const WorkStealingPool&) -> WorkStealingPool& = delete;
+		auto operator =(WorkStealingPool&&) -> WorkStealingPool& = delete;
+		~WorkStealingPool();
+
+		/// <summary>
+		/// Calls task(index, worker) once for every weight and blocks until all tasks are done.
+		/// worker is the 0-based thread running the task, 0 is the calling thread.
+		/// The first exception thrown by a task is rethrown after all other tasks are done.
+		/// Must not be called from a task.
+		/// </summary>
+		/// <param name="weights">The estimated cost of each task, such as its input size.</param>
+		/// <param name="task">Called concurrently from all threads.</param>
+		template <typename F>
+		void Run(std::span<const std::uint64_t> weights, F&& task);
+
+		[[nodiscard]] auto ThreadCount() const noexcept -> std::size_t;
+
+		/// <summary>
+		/// Returns the number of tasks taken from the queue of another thread during the last run.
+		/// </summary>
+		[[nodiscard]] auto Steals() const noexcept -> std::size_t;
+
+	private:
+		struct alignas(64) TaskQueue final
+		{
+			std::mutex Mutex = {};
+			std::deque<std::size_t> Tasks = {};
+			std::uint64_t Weight = 0;
+		};
+
+		void Deal(std::span<const std::uint64_t> weights);
+		void WorkerLoop(std::size_t worker);
+		void Work(std::size_t worker) noexcept;
+		[[nodiscard]] auto Take(std::size_t worker, std::size_t& task) -> bool;
+
+		std::vector<std::unique_ptr<TaskQueue>> queues = {};
+		std::vector<std::thread> threads = {};
+		void (*invoke)(void* context, std::size_t task, std::size_t worker) = nullptr;
+		void* context = nullptr;
+		std::mutex mutex = {};
+		std::condition_variable wake = {};
+		std::condition_variable finished = {};
+		std::size_t generation = 0;
+		std::size_t running = 0;
+		bool stopping = false;
+		std::exception_ptr error = {};
+		std::atomic<std::size_t> steals = 0;
+	};
+
+	inline WorkStealingPool::WorkStealingPool(const std::size_t threadCount)
+	{
+		const std::size_t count = threadCount != 0 ? threadCount : std::max<std::size_t>(std::thread::hardware_concurrency(), 1);
+		this->queues.reserve(count);
+		for (std::size_t i = 0; i < count; ++i)
+		{
+			this->queues.push_back(std::make_unique<TaskQueue>());
+		}
+		this->threads.reserve(count - 1);
+		try
+		{
+			for (std::size_t i = 1; i < count; ++i)
+			{
+				this->threads.emplace_back(&WorkStealingPool::WorkerLoop, this, i);
+			}
+		}
+		catch (...)
+		{
+			{
+				const std::lock_guard lock(this->mutex);
+				this->stopping = true;
+			}
+			this->wake.notify_all();
+			for (auto& thread : this->threads)
+			{
+				thread.join();
+			}
+			throw;
+		}
+	}
+
+	inline WorkStealingPool::~WorkStealingPool()
+	{
+		{
+			const std::lock_guard lock(this->mutex);
+			this->stopping = true;
+		}
+		this->wake.notify_all();
+		for (auto& thread : this->threads)
+		{
+			thread.join();
+		}
+	}
+
+	template <typename F>
+	inline void WorkStealingPool::Run(const std::span<const std::uint64_t> weights, F&& task)
+	{
+		if (weights.empty())
+		{
+			return;
+		}
+		this->Deal(weights);
+		{
+			const std::lock_guard lock(this->mutex);
+			this->invoke = [](void* const context, const std::size_t index, const std::size_t worker)
+			{
+				(*static_cast<std::remove_reference_t<F>*>(context))(index, worker);
+			};
+			this->context = const_cast<void*>(static_cast<const void*>(std::addressof(task)));
+			this->running = this->threads.size();
+			this->error = nullptr;
+			this->steals = 0;
+			++this->generation;
+		}
+		this->wake.notify_all();
+		this->Work(0);
+
+		std::unique_lock lock(this->mutex);
+		this->finished.wait(lock, [this]
+		{
+			return this->running == 0;
+		});
+		if (this->error) [[unlikely]]
+		{
+			std::rethrow_exception(std::exchange(this->error, nullptr));
+		}
+	}
+
+	inline auto WorkStealingPool::ThreadCount() const noexcept -> std::size_t
+	{
+		return this->queues.size();
+	}
+
+	inline auto WorkStealingPool::Steals() const noexcept -> std::size_t
+	{
+		return this->steals.load(std::memory_order_relaxed);
+	}
+
+	inline void WorkStealingPool::Deal(const std::span<const std::uint64_t> weights)
+	{
+		std::vector<std::size_t> order(weights.size());
+		std::iota(order.begin(), order.end(), std::size_t{0});
+		std::stable_sort(order.begin(), order.end(), [weights](const std::size_t lhs, const std::size_t rhs)
+		{
+			return weights[lhs] > weights[rhs];
+		});
+		for (const auto& queue : this->queues)
+		{
+			queue->Tasks.clear();
+			queue->Weight = 0;
+		}
+		for (const std::size_t task : order)
+		{
+			const auto lightest = std::min_element(this->queues.begin(), this->queues.end(), [](const auto& lhs, const auto& rhs)
+			{
+				return lhs->Weight < rhs->Weight;
+			});
+			(*lightest)->Tasks.push_back(task);
+			(*lightest)->Weight += weights[task];
+		}
+	}
+
+	inline void WorkStealingPool::WorkerLoop(const std::size_t worker)
+	{
+		std::size_t seen = 0;
+		for (;;)
+		{
+			{
+				std::unique_lock lock(this->mutex);
+				this->wake.wait(lock, [this, seen]
+				{
+					return this->stopping || this->generation != seen;
+				});
+				if (this->stopping)
+				{
+					return;
+				}
+				seen = this->generation;
+			}
+			this->Work(worker);
+			{
+				const std::lock_guard lock(this->mutex);
+				if (--this->running == 0)
+				{
+					this->finished.notify_one();
+				}
+			}
+		}
+	}
+
+	inline void WorkStealingPool::Work(const std::size_t worker) noexcept
+	{
+		std::size_t task = 0;
+		while (this->Take(worker, task))
+		{
+			try
+			{
+				this->invoke(this->context, task, worker);
+			}
+			catch (...)
+			{
+				const std::lock_guard lock(this->mutex);
+				if (!this->error)
+				{
+					this->error = std::current_exception();
+				}
+			}
+		}
+	}
+
+	inline auto WorkStealingPool::Take(const std::size_t worker, std::size_t& task) -> bool
+	{
+		{
+			TaskQueue& own = *this->queues[worker];
+			const std::lock_guard lock(own.Mutex);
+			if (!own.Tasks.empty()) [[likely]]
+			{
+				task = own.Tasks.front();
+				own.Tasks.pop_front();
+				return true;
+			}
+		}
+
+		// The fullest queue has the most work left to share, its sizes are only read as a hint:
+		for (;;)
+		{
+			TaskQueue* victim = nullptr;
+			std::size_t most = 0;
+			for (const auto& queue : this->queues)
+			{
+				const std::lock_guard lock(queue->Mutex);
+				if (queue->Tasks.size() > most)
+				{
+					most = queue->Tasks.size();
+					victim = queue.get();
+				}
+			}
+			if (!victim)
+			{
+				return false;
+			}
+			const std::lock_guard lock(victim->Mutex);
+			if (!victim->Tasks.empty())
+			{
+				task = victim->Tasks.back();
+				victim->Tasks.pop_back();
+				this->steals.fetch_add(1, std::memory_order_relaxed);
+				return true;
+			}
+		}
+	}
+}
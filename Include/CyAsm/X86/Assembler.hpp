@@ -0,0 +1,352 @@
+#pragma once
+
+#include <algorithm>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "../Listing.hpp"
+#include "../MachineStream.hpp"
+#include "Cas2.hpp"
+#include "Parser.hpp"
+#include "Peephole.hpp"
+
+namespace CyberAsm::X86
+{
+	/// <summary>
+	/// Maps the label names of one source file to stream labels.
+	/// Named labels live in the label table of the stream.
+	/// Numeric local labels ('1:') may be defined many times, so 'Nb' refers to the last and 'Nf' to the next definition of N.
+	/// A deferred scope assembles one piece of a larger source: 'Nb' without a previous definition is imported
+	/// instead of rejected, and the local labels at both ends of the piece are kept for stitching the pieces together.
+	/// </summary>
+	template <Abi Arch = Abi::X86_64>
+	class SymbolScope final
+	{
+	public:
+		using LocalLabels = std::unordered_map<std::string_view, Label>;
+
+		/// <param name="out">The stream which owns the labels.</param>
+		/// <param name="deferred">True to import unknown backward references, see the class description.</param>
+		explicit SymbolScope(MachineStream<Arch>& out, bool deferred = false) noexcept;
+
+		/// <summary>
+		/// Binds the label defined by the statement to the current end of the stream.
+		/// </summary>
+		void Define(std::string_view symbol);
+
+		/// <summary>
+		/// Returns the label a branch operand refers to, creating it for forward references.
+		/// </summary>
+		[[nodiscard]] auto Reference(std::string_view symbol) -> Label;
+
+		/// <summary>
+		/// Throws if a forward local label reference was never defined.
+		/// </summary>
+		void Validate() const;
+
+		/// <summary>
+		/// Returns the 'Nf' references which are still waiting for a definition of N.
+		/// </summary>
+		[[nodiscard]] auto Forward() const noexcept -> const LocalLabels&;
+
+		/// <summary>
+		/// Returns the label each 'Nb' refers to at the current position.
+		/// </summary>
+		[[nodiscard]] auto Backward() const noexcept -> const LocalLabels&;
+
+		/// <summary>
+		/// Returns the 'Nb' references a deferred scope could not resolve, they refer to a definition in front of the piece.
+		/// </summary>
+		[[nodiscard]] auto Imports() const noexcept -> const LocalLabels&;
+
+		/// <summary>
+		/// Returns the first definition of each local label of a deferred scope.
+		/// </summary>
+		[[nodiscard]] auto FirstDefinitions() const noexcept -> const LocalLabels&;
+
+	private:
+		MachineStream<Arch>& out;
+		LocalLabels forward = {};
+		LocalLabels backward = {};
+		LocalLabels imports = {};
+		LocalLabels firstDefinitions = {};
+		bool deferred = false;
+	};
+
+	template <Abi Arch>
+	inline SymbolScope<Arch>::SymbolScope(MachineStream<Arch>& out, const bool deferred) noexcept : out(out), deferred(deferred) { }
+
+	template <Abi Arch>
+	inline void SymbolScope<Arch>::Define(const std::string_view symbol)
+	{
+		if (!IsLocalLabelName(symbol)) [[likely]]
+		{
+			this->out.BindLabel(this->out.FindOrCreateLabel(symbol));
+			return;
+		}
+
+		Label label;
+		if (const auto it = this->forward.find(symbol); it != this->forward.end())
+		{
+			label = it->second;
+			this->forward.erase(it);
+		}
+		else
+		{
+			label = this->out.CreateLabel();
+		}
+		this->out.BindLabel(label);
+		this->backward.insert_or_assign(symbol, label);
+		if (this->deferred) [[unlikely]]
+		{
+			this->firstDefinitions.emplace(symbol, label);
+		}
+	}
+
+	template <Abi Arch>
+	inline auto SymbolScope<Arch>::Reference(const std::string_view symbol) -> Label
+	{
+		if (!IsLocalLabelReference(symbol)) [[likely]]
+		{
+			return this->out.FindOrCreateLabel(symbol);
+		}
+
+		const auto name = symbol.substr(0, symbol.size() - 1);
+		if (symbol.back() == X64::BackwardLocalLabel)
+		{
+			const auto it = this->backward.find(name);
+			if (it != this->backward.end()) [[likely]]
+			{
+				return it->second;
+			}
+			if (!this->deferred) [[unlikely]]
+			{
+				throw std::runtime_error("Local label '" + std::string(symbol) + "' has no previous definition!");
+			}
+			const Label label = this->out.CreateLabel();
+			this->imports.emplace(name, label);
+			this->backward.emplace(name, label);
+			return label;
+		}
+
+		if (const auto it = this->forward.find(name); it != this->forward.end())
+		{
+			return it->second;
+		}
+		const Label label = this->out.CreateLabel();
+		this->forward.emplace(name, label);
+		return label;
+	}
+
+	template <Abi Arch>
+	inline void SymbolScope<Arch>::Validate() const
+	{
+		for (const auto& [name, label] : this->forward)
+		{
+			throw std::runtime_error("Local label '" + std::string(name) + X64::ForwardLocalLabel + "' has no following definition!");
+		}
+	}
+
+	template <Abi Arch>
+	inline auto SymbolScope<Arch>::Forward() const noexcept -> const LocalLabels&
+	{
+		return this->forward;
+	}
+
+	template <Abi Arch>
+	inline auto SymbolScope<Arch>::Backward() const noexcept -> const LocalLabels&
+	{
+		return this->backward;
+	}
+
+	template <Abi Arch>
+	inline auto SymbolScope<Arch>::Imports() const noexcept -> const LocalLabels&
+	{
+		return this->imports;
+	}
+
+	template <Abi Arch>
+	inline auto SymbolScope<Arch>::FirstDefinitions() const noexcept -> const LocalLabels&
+	{
+		return this->firstDefinitions;
+	}
+
+	struct AssembleOptions final
+	{
+		/// <summary>
+		/// Runs the peephole optimizer over the whole file before encoding.
+		/// </summary>
+		bool Peephole = false;
+
+		/// <summary>
+		/// Receives the peephole statistics if not null.
+		/// </summary>
+		PeepholeStats* PeepholeResult = nullptr;
+
+		/// <summary>
+		/// Records the stream offset of every source line if not null.
+		/// Pass its markers to MachineStream::Finalize(), then format it with WriteListing().
+		/// </summary>
+		AssemblyListing* Listing = nullptr;
+	};
+
+	/// <summary>
+	/// Encodes one statement into the stream.
+	/// Instructions are written through the cursor, which is committed before labels and branches touch the stream.
+	/// </summary>
+	template <Abi Arch>
+	inline void EmitStatement(const InstructionNode& node, SymbolScope<Arch>& symbols, EmitCursor& cursor, MachineStream<Arch>& out)
+	{
+		try
+		{
+			if (node.Kind == StatementKind::LabelDefinition)
+			{
+				cursor.Commit();
+				symbols.Define(node.Symbol);
+			}
+			else if (node.OperandCount == 1 && node.Operands[0].IsLabel())
+			{
+				cursor.Commit();
+				Cas2EncodeBranch<Arch>(out, node.Instr, symbols.Reference(node.Operands[0].Symbol));
+			}
+			else [[likely]]
+			{
+				const Result<std::size_t> size = TryCas2EncodeInto<Arch>(cursor, node);
+				if (!size) [[unlikely]]
+				{
+					throw std::runtime_error(std::string(size.Error().Message()));
+				}
+			}
+		}
+		catch (const std::runtime_error& ex)
+		{
+			throw std::runtime_error("Line " + std::to_string(node.Line) + ": " + ex.what());
+		}
+	}
+
+	/// <summary>
+	/// Assembles AT&T source code and appends the machine code to the stream.
+	/// Parsing and encoding run in a single pass over the source buffer,
+	/// unless the peephole optimizer is enabled, which needs all statements first.
+	/// Label references are recorded as fixups in the stream and are not resolved,
+	/// so more code can be appended before calling MachineStream::Finalize().
+	/// </summary>
+	/// <param name="source">The source code.</param>
+	/// <param name="out">The stream which receives the machine code.</param>
+	/// <param name="options">The assembler options.</param>
+	template <Abi Arch = Abi::X86_64>
+	inline void Assemble(const std::string_view source, MachineStream<Arch>& out, const AssembleOptions& options = {})
+	{
+		// Most instructions are much shorter than their source line:
+		out.Reserve(out.Size() + source.size() / 3);
+
+		Parser parser(source);
+		SymbolScope<Arch> symbols(out);
+		EmitCursor cursor = out.BeginEmit();
+		InstructionNode node = {};
+		if (!options.Peephole) [[likely]]
+		{
+			while (parser.Next(node))
+			{
+				if (options.Listing) [[unlikely]]
+				{
+					options.Listing->Record(node.Line, cursor.Offset());
+				}
+				EmitStatement<Arch>(node, symbols, cursor, out);
+			}
+			cursor.Commit();
+			symbols.Validate();
+			return;
+		}
+
+		std::vector<InstructionNode> nodes = {};
+		while (parser.Next(node))
+		{
+			nodes.push_back(node);
+		}
+		const PeepholeStats stats = OptimizePeephole(nodes);
+		if (options.PeepholeResult)
+		{
+			*options.PeepholeResult = stats;
+		}
+		for (const auto& statement : nodes)
+		{
+			if (options.Listing) [[unlikely]]
+			{
+				options.Listing->Record(statement.Line, cursor.Offset());
+			}
+			EmitStatement<Arch>(statement, symbols, cursor, out);
+		}
+		cursor.Commit();
+		symbols.Validate();
+	}
+
+	/// <summary>
+	/// Assembles AT&T source code into a new stream and resolves all labels.
+	/// The listing of the options, if any, is finalized along with the stream.
+	/// </summary>
+	/// <param name="source">The source code.</param>
+	/// <param name="options">The assembler options.</param>
+	/// <returns>The machine code.</returns>
+	template <Abi Arch = Abi::X86_64>
+	[[nodiscard]] inline auto Assemble(const std::string_view source, const AssembleOptions& options = {}) -> MachineStream<Arch>
+	{
+		MachineStream<Arch> result = {};
+		Assemble<Arch>(source, result, options);
+		result.Finalize(0, options.Listing ? options.Listing->Markers() : std::span<std::size_t>{});
+		return result;
+	}
+
+	/// <summary>
+	/// Assembles AT&T source code and hands the machine code to the sink while encoding.
+	/// Whenever the unwritten code reached the flush size, its settled prefix is finalized, passed to
+	/// sink(std::span<const std::uint8_t>) and dropped from the stream, see MachineStream::SettlePrefix().
+	/// Only the code behind the last flush stays in memory, plus the code behind a reference to a label which is defined much later.
+	/// The code is byte-identical to Assemble() followed by MachineStream::Finalize().
+	/// The peephole optimizer and listings need the whole file and are not supported.
+	/// </summary>
+	/// <param name="source">The source code.</param>
+	/// <param name="sink">Receives the machine code in order.</param>
+	/// <param name="flushSize">The number of unwritten bytes which triggers a flush.</param>
+	/// <param name="baseAddress">The load address of the code, used for absolute fixups.</param>
+	/// <returns>The size of the machine code.</returns>
+	template <Abi Arch = Abi::X86_64, typename F>
+	inline auto AssembleStreaming(const std::string_view source, F&& sink, const std::size_t flushSize = 64 * 1024, const std::uint64_t baseAddress = 0) -> std::size_t
+	{
+		MachineStream<Arch> out = {};
+		out.Reserve(std::min(source.size() / 3, 2 * flushSize));
+
+		const auto flush = [&out, &sink](const std::size_t size)
+		{
+			sink(std::span<const std::uint8_t>(out.begin(), size));
+			out.DiscardPrefix(size);
+		};
+		Parser parser(source);
+		SymbolScope<Arch> symbols(out);
+		EmitCursor cursor = out.BeginEmit();
+		InstructionNode node = {};
+
+		// Code which cannot be settled yet waits for the next flush, so it is not examined after every statement:
+		std::size_t threshold = flushSize;
+		while (parser.Next(node))
+		{
+			EmitStatement<Arch>(node, symbols, cursor, out);
+			if (cursor.Offset() >= threshold) [[unlikely]]
+			{
+				cursor.Commit();
+				flush(out.SettlePrefix(baseAddress));
+				threshold = out.Size() + flushSize;
+			}
+		}
+		cursor.Commit();
+		symbols.Validate();
+		out.Finalize(baseAddress);
+		const std::size_t size = out.Labels().Origin() + out.Size();
+		flush(out.Size());
+		return size;
+	}
+}
@@ -0,0 +1,402 @@
+#pragma once
+
+#include <cstdint>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <istream>
+#include <mutex>
+#include <ostream>
+#include <stdexcept>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "../SpscQueue.hpp"
+#include "ParallelAssembler.hpp"
+
+namespace CyberAsm::X86
+{
+	struct PipelineOptions final
+	{
+		/// <summary>
+		/// The source bytes read per batch, a batch ends behind its last line break and the rest moves to the next batch.
+		/// </summary>
+		std::size_t BatchSize = 256 * 1024;
+
+		/// <summary>
+		/// The batches a queue between two stages holds before the stage in front of it waits.
+		/// </summary>
+		std::size_t QueueDepth = 4;
+
+		/// <summary>
+		/// The load address of the code, used for absolute fixups.
+		/// </summary>
+		std::uint64_t BaseAddress = 0;
+	};
+
+	enum class PipelineStage : std::uint8_t
+	{
+		Read,
+		Parse,
+		Encode,
+		Write
+	};
+
+	inline constexpr std::size_t PipelineStageCount = 4;
+	inline constexpr std::array<std::string_view, PipelineStageCount> PipelineStageNames = {"read", "parse", "encode", "write"};
+
+	/// <summary>
+	/// Where the thread of one stage spent the time of the run.
+	/// </summary>
+	struct PipelineStageStats final
+	{
+		std::size_t Batches = 0;
+
+		/// <summary>
+		/// Time spent on the work of the stage, including its file system calls.
+		/// </summary>
+		std::chrono::nanoseconds BusyTime = {};
+
+		/// <summary>
+		/// Time the stage waited for the stage in front of it.
+		/// </summary>
+		std::chrono::nanoseconds InputWaitTime = {};
+
+		/// <summary>
+		/// Time the stage waited for room in the queue behind it, the backpressure of slower stages.
+		/// </summary>
+		std::chrono::nanoseconds OutputWaitTime = {};
+
+		/// <summary>
+		/// Returns the busy share of the wall time of the run, the slowest stage is close to 1.
+		/// </summary>
+		[[nodiscard]] auto Utilization(const std::chrono::nanoseconds wallTime) const noexcept -> double
+		{
+			return wallTime.count() > 0 ? static_cast<double>(this->BusyTime.count()) / static_cast<double>(wallTime.count()) : 0.0;
+		}
+	};
+
+	struct PipelineStats final
+	{
+		std::array<PipelineStageStats, PipelineStageCount> Stages = {};
+		std::size_t SourceBytes = 0;
+		std::size_t CodeBytes = 0;
+
+		/// <summary>
+		/// The most code held back at once, code is written as soon as it no longer refers to labels which are not defined yet.
+		/// </summary>
+		std::size_t PeakPendingBytes = 0;
+
+		std::chrono::nanoseconds WallTime = {};
+
+		[[nodiscard]] auto operator [](const PipelineStage stage) const noexcept -> const PipelineStageStats&
+		{
+			return this->Stages[static_cast<std::size_t>(stage)];
+		}
+	};
+
+	namespace AssemblyPipelineDetail
+	{
+		/// <summary>
+		/// Complete source lines, the statements refer into the text, so both move through the pipeline together.
+		/// </summary>
+		struct SourceBatch final
+		{
+			std::vector<char> Text = {};
+			std::vector<InstructionNode> Statements = {};
+		};
+
+		struct CodeBatch final
+		{
+			std::vector<std::uint8_t> Code = {};
+		};
+
+		/// <summary>
+		/// Measures the busy time of a stage.
+		/// </summary>
+		class BusyScope final
+		{
+		public:
+			explicit BusyScope(PipelineStageStats& stats) noexcept : stats(stats), begin(std::chrono::steady_clock::now()) { }
+			BusyScope(const BusyScope&) = delete;
+			BusyScope(BusyScope&&) = delete;
+			auto operator =(const BusyScope&) -> BusyScope& = delete;
+			auto operator =(BusyScope&&) -> BusyScope& = delete;
+
+			~BusyScope()
+			{
+				this->stats.BusyTime += std::chrono::steady_clock::now() - this->begin;
+			}
+
+		private:
+			PipelineStageStats& stats;
+			std::chrono::steady_clock::time_point begin;
+		};
+
+		/// <summary>
+		/// Reads the input in batches of whole lines.
+		/// </summary>
+		inline void ReadStage(std::istream& input, SpscQueue<SourceBatch>& out, const std::size_t batchSize, PipelineStageStats& stats, std::size_t& sourceBytes)
+		{
+			std::vector<char> carry = {};
+			for (bool end = false; !end;)
+			{
+				SourceBatch batch = {};
+				{
+					const BusyScope busy(stats);
+					batch.Text = std::move(carry);
+					carry = {};
+					const std::size_t used = batch.Text.size();
+					batch.Text.resize(used + batchSize);
+					input.read(batch.Text.data() + used, static_cast<std::streamsize>(batchSize));
+					const auto read = static_cast<std::size_t>(input.gcount());
+					batch.Text.resize(used + read);
+					sourceBytes += read;
+					end = !input;
+					if (input.bad()) [[unlikely]]
+					{
+						throw std::runtime_error("Failed to read the input!");
+					}
+
+					// The partial last line moves to the next batch, a line longer than a batch grows the batch:
+					if (!end)
+					{
+						const auto lineEnd = std::find(batch.Text.rbegin(), batch.Text.rend(), '\n');
+						if (lineEnd == batch.Text.rend())
+						{
+							carry = std::move(batch.Text);
+							continue;
+						}
+						const auto split = batch.Text.size() - static_cast<std::size_t>(lineEnd - batch.Text.rbegin());
+						carry.assign(batch.Text.begin() + static_cast<std::ptrdiff_t>(split), batch.Text.end());
+						batch.Text.resize(split);
+					}
+				}
+				if (batch.Text.empty())
+				{
+					continue;
+				}
+				++stats.Batches;
+				if (!out.Push(std::move(batch)))
+				{
+					return;
+				}
+			}
+		}
+
+		/// <summary>
+		/// Lexes and parses the batches, line numbers continue across batches.
+		/// </summary>
+		inline void ParseStage(SpscQueue<SourceBatch>& in, SpscQueue<SourceBatch>& out, PipelineStageStats& stats)
+		{
+			std::size_t line = 1;
+			SourceBatch batch = {};
+			while (in.Pop(batch))
+			{
+				{
+					const BusyScope busy(stats);
+					const std::string_view text(batch.Text.data(), batch.Text.size());
+					Parser parser(text, line);
+					InstructionNode node = {};
+					while (parser.Next(node))
+					{
+						batch.Statements.push_back(node);
+					}
+					line += static_cast<std::size_t>(std::count(text.begin(), text.end(), '\n'));
+				}
+				++stats.Batches;
+				if (!out.Push(std::move(batch)))
+				{
+					return;
+				}
+			}
+		}
+
+		/// <summary>
+		/// Encodes every batch into its own stream, appends it to the pending code and hands on the prefix which became final.
+		/// </summary>
+		template <Abi Arch>
+		inline void EncodeStage(SpscQueue<SourceBatch>& in, SpscQueue<CodeBatch>& out, const std::uint64_t baseAddress, const std::atomic<bool>& failed,
+			PipelineStageStats& stats, std::size_t& peakPending)
+		{
+			MachineStream<Arch> pending = {};
+			ParallelAssemblerDetail::ChunkStitcher<Arch> stitcher(pending);
+			SourceBatch batch = {};
+			while (in.Pop(batch))
+			{
+				CodeBatch code = {};
+				{
+					const BusyScope busy(stats);
+					ParallelAssemblerDetail::Chunk<Arch> chunk = {};
+					chunk.Code.Reserve(batch.Text.size() / 3);
+					SymbolScope<Arch> symbols(chunk.Code, true);
+					EmitCursor cursor = chunk.Code.BeginEmit();
+					for (const auto& node : batch.Statements)
+					{
+						EmitStatement<Arch>(node, symbols, cursor, chunk.Code);
+					}
+					cursor.Commit();
+					ParallelAssemblerDetail::TakeBorderLabels(chunk, symbols);
+					stitcher.Append(chunk, nullptr);
+					peakPending = std::max(peakPending, pending.Size());
+
+					const std::size_t settled = pending.SettlePrefix(baseAddress);
+					code.Code.assign(pending.begin(), pending.begin() + static_cast<std::ptrdiff_t>(settled));
+					pending.DiscardPrefix(settled);
+				}
+				++stats.Batches;
+				if (!code.Code.empty() && !out.Push(std::move(code)))
+				{
+					return;
+				}
+			}
+
+			// The end of the source, unless a stage in front failed, the remaining code refers to labels which must be defined by now:
+			if (failed)
+			{
+				return;
+			}
+			CodeBatch code = {};
+			{
+				const BusyScope busy(stats);
+				stitcher.Validate();
+				pending.Finalize(baseAddress);
+				code.Code.assign(pending.begin(), pending.end());
+			}
+			if (!code.Code.empty())
+			{
+				static_cast<void>(out.Push(std::move(code)));
+			}
+		}
+
+		inline void WriteStage(SpscQueue<CodeBatch>& in, std::ostream& output, PipelineStageStats& stats, std::size_t& codeBytes)
+		{
+			CodeBatch batch = {};
+			while (in.Pop(batch))
+			{
+				const BusyScope busy(stats);
+				output.write(reinterpret_cast<const char*>(batch.Code.data()), static_cast<std::streamsize>(batch.Code.size()));
+				if (!output) [[unlikely]]
+				{
+					throw std::runtime_error("Failed to write the output!");
+				}
+				codeBytes += batch.Code.size();
+				++stats.Batches;
+			}
+			const BusyScope busy(stats);
+			output.flush();
+		}
+	}
+
+	/// <summary>
+	/// Assembles AT&T source code from a stream into a stream in four concurrent stages:
+	/// reading batches of whole lines, parsing them, encoding them and writing the code.
+	/// Neighboring stages are connected by bounded lock-free queues, so a slow stage stalls the ones in front of it
+	/// instead of letting batches pile up, and the wall time approaches the time of the slowest stage.
+	/// Each batch is encoded into its own stream and appended to the pending code like the chunks of AssembleParallel();
+	/// the longest prefix which no longer refers to undefined labels is relaxed, resolved and written right away.
+	/// Memory therefore stays at a few batches, plus the code behind a reference to a label which is defined much later.
+	/// The code is byte-identical to Assemble() followed by MachineStream::Finalize().
+	/// The peephole optimizer and listings need the whole file and are not supported.
+	/// Throws the first error of any stage once all stages stopped, errors of a later batch only stop the run after
+	/// the code in front of it was written.
+	/// </summary>
+	/// <param name="input">The source code.</param>
+	/// <param name="output">Receives the machine code.</param>
+	/// <param name="options">The batch size, queue depth and base address.</param>
+	/// <returns>The utilization of every stage.</returns>
+	template <Abi Arch = Abi::X86_64>
+	inline auto AssemblePipelined(std::istream& input, std::ostream& output, const PipelineOptions& options = {}) -> PipelineStats
+	{
+		using namespace AssemblyPipelineDetail;
+
+		const auto begin = std::chrono::steady_clock::now();
+		PipelineStats stats = {};
+		auto& stages = stats.Stages;
+		SpscQueue<SourceBatch> sources(options.QueueDepth);
+		SpscQueue<SourceBatch> statements(options.QueueDepth);
+		SpscQueue<CodeBatch> code(options.QueueDepth);
+
+		// A failing stage closes both of its queues, which stops the stages in front of it and drains the ones behind it:
+		std::mutex errorMutex = {};
+		std::exception_ptr error = {};
+		std::atomic<bool> failed = false;
+		const auto run = [&](auto&& stage, auto* const in, auto* const out) noexcept
+		{
+			try
+			{
+				stage();
+			}
+			catch (...)
+			{
+				const std::lock_guard lock(errorMutex);
+				if (!error)
+				{
+					error = std::current_exception();
+				}
+				failed = true;
+			}
+			if (in)
+			{
+				in->Close();
+			}
+			if (out)
+			{
+				out->Close();
+			}
+		};
+		const auto batchSize = std::max<std::size_t>(options.BatchSize, 1);
+		std::array<std::thread, 3> threads = {};
+		try
+		{
+			threads[0] = std::thread([&]
+			{
+				run([&] { ReadStage(input, sources, batchSize, stages[0], stats.SourceBytes); }, static_cast<SpscQueue<SourceBatch>*>(nullptr), &sources);
+			});
+			threads[1] = std::thread([&]
+			{
+				run([&] { ParseStage(sources, statements, stages[1]); }, &sources, &statements);
+			});
+			threads[2] = std::thread([&]
+			{
+				run([&] { EncodeStage<Arch>(statements, code, options.BaseAddress, failed, stages[2], stats.PeakPendingBytes); }, &statements, &code);
+			});
+		}
+		catch (...)
+		{
+			// The stages which did start are blocked on their queues, closing them lets the threads finish before they are joined:
+			sources.Close();
+			statements.Close();
+			code.Close();
+			for (auto& thread : threads)
+			{
+				if (thread.joinable())
+				{
+					thread.join();
+				}
+			}
+			throw;
+		}
+		run([&] { WriteStage(code, output, stages[3], stats.CodeBytes); }, &code, static_cast<SpscQueue<CodeBatch>*>(nullptr));
+		for (auto& thread : threads)
+		{
+			thread.join();
+		}
+
+		stages[1].InputWaitTime = sources.PopWaitTime();
+		stages[2].InputWaitTime = statements.PopWaitTime();
+		stages[3].InputWaitTime = code.PopWaitTime();
+		stages[0].OutputWaitTime = sources.PushWaitTime();
+		stages[1].OutputWaitTime = statements.PushWaitTime();
+		stages[2].OutputWaitTime = code.PushWaitTime();
+		stats.WallTime = std::chrono::steady_clock::now() - begin;
+		if (error)
+		{
+			std::rethrow_exception(error);
+		}
+		return stats;
+	}
+}
@@ -0,0 +1,205 @@
+#pragma once
+
+#include <cstdint>
+#include <chrono>
+#include <filesystem>
+#include <set>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+#include "../StreamReader.hpp"
+#include "../WorkStealingPool.hpp"
+#include "Assembler.hpp"
+
+namespace CyberAsm::X86
+{
+	/// <summary>
+	/// One source file of a batch and the file receiving its machine code.
+	/// </summary>
+	struct BatchJob final
+	{
+		std::filesystem::path Input = {};
+		std::filesystem::path Output = {};
+	};
+
+	/// <summary>
+	/// Volume and timing of one file of a batch.
+	/// </summary>
+	struct BatchFileResult final
+	{
+		std::size_t SourceBytes = 0;
+		std::size_t CodeBytes = 0;
+		std::chrono::nanoseconds ReadTime = {};
+		std::chrono::nanoseconds EncodeTime = {};
+		std::chrono::nanoseconds WriteTime = {};
+
+		/// <summary>
+		/// The pool thread which assembled the file.
+		/// </summary>
+		std::size_t Worker = 0;
+
+		/// <summary>
+		/// The error message, empty if the file was assembled and written.
+		/// </summary>
+		std::string Error = {};
+
+		[[nodiscard]] auto Succeeded() const noexcept -> bool
+		{
+			return this->Error.empty();
+		}
+	};
+
+	/// <summary>
+	/// The results of all files of a batch in job order and their totals.
+	/// The times of the files are summed over all threads, the wall time is the time of the whole batch.
+	/// </summary>
+	struct BatchStats final
+	{
+		std::vector<BatchFileResult> Files = {};
+		std::size_t Failed = 0;
+		std::size_t SourceBytes = 0;
+		std::size_t CodeBytes = 0;
+		std::chrono::nanoseconds ReadTime = {};
+		std::chrono::nanoseconds EncodeTime = {};
+		std::chrono::nanoseconds WriteTime = {};
+		std::chrono::nanoseconds WallTime = {};
+
+		/// <summary>
+		/// The number of files a thread took over from the queue of another thread.
+		/// </summary>
+		std::size_t Steals = 0;
+	};
+
+	/// <summary>
+	/// Returns the file names of a response file, one per line.
+	/// Surrounding whitespace and quotes are removed, empty lines and lines starting with '#' are skipped.
+	/// Relative names are relative to the working directory, like names on the command line.
+	/// </summary>
+	[[nodiscard]] inline auto ReadResponseFile(const std::filesystem::path& file) -> std::vector<std::filesystem::path>
+	{
+		std::string text = {};
+		ReadFile(text, file);
+		const LineIndex index(text);
+		std::vector<std::filesystem::path> names = {};
+		names.reserve(index.Count());
+		for (std::size_t i = 0; i < index.Count(); ++i)
+		{
+			std::string_view line = index.Line(i);
+			const std::size_t begin = line.find_first_not_of(" \t");
+			if (begin == std::string_view::npos || line[begin] == '#')
+			{
+				continue;
+			}
+			line = line.substr(begin, line.find_last_not_of(" \t") - begin + 1);
+			if (line.size() >= 2 && line.front() == '"' && line.back() == '"')
+			{
+				line = line.substr(1, line.size() - 2);
+			}
+			names.emplace_back(line);
+		}
+		return names;
+	}
+
+	/// <summary>
+	/// Throws if two jobs write the same output file, their threads would truncate and overwrite each other's code.
+	/// Paths are compared after resolving the working directory, '.', '..' and symbolic links of existing directories.
+	/// </summary>
+	inline void ValidateBatchOutputs(const std::span<const BatchJob> jobs)
+	{
+		std::set<std::filesystem::path> outputs = {};
+		for (const auto& job : jobs)
+		{
+			std::error_code error = {};
+			std::filesystem::path output = std::filesystem::weakly_canonical(job.Output, error);
+			if (error)
+			{
+				output = std::filesystem::absolute(job.Output).lexically_normal();
+			}
+			if (!outputs.insert(std::move(output)).second) [[unlikely]]
+			{
+				throw std::runtime_error("Several inputs are assembled into " + job.Output.string() + "!");
+			}
+		}
+	}
+
+	/// <summary>
+	/// Assembles many source files concurrently on the pool, every file is read, assembled, finalized and written by one thread.
+	/// The files are weighted by their size, so the largest files start first and the small ones fill the gaps.
+	/// Every thread writes its own output files, so writes overlap with each other and with encoding on the other threads.
+	/// Errors are recorded per file and do not stop the other files, jobs sharing an output file are rejected up front, see ValidateBatchOutputs().
+	/// The listing and peephole result pointers of the options are ignored, they cannot be shared between files.
+	/// </summary>
+	/// <param name="jobs">The files to assemble.</param>
+	/// <param name="pool">The threads to assemble on.</param>
+	/// <param name="options">The assembler options for every file.</param>
+	/// <returns>The results of every file.</returns>
+	template <Abi Arch = Abi::X86_64>
+	[[nodiscard]] inline auto AssembleBatch(const std::span<const BatchJob> jobs, WorkStealingPool& pool, const AssembleOptions& options = {}) -> BatchStats
+	{
+		ValidateBatchOutputs(jobs);
+		const auto batchBegin = std::chrono::steady_clock::now();
+		BatchStats stats = {};
+		stats.Files.resize(jobs.size());
+
+		std::vector<std::uint64_t> weights(jobs.size());
+		for (std::size_t i = 0; i < jobs.size(); ++i)
+		{
+			std::error_code error = {};
+			const auto size = std::filesystem::file_size(jobs[i].Input, error);
+			weights[i] = error ? 0 : static_cast<std::uint64_t>(size);
+		}
+
+		AssembleOptions fileOptions = options;
+		fileOptions.Listing = nullptr;
+		fileOptions.PeepholeResult = nullptr;
+		pool.Run(weights, [&](const std::size_t index, const std::size_t worker)
+		{
+			BatchFileResult& result = stats.Files[index];
+			result.Worker = worker;
+			try
+			{
+				auto begin = std::chrono::steady_clock::now();
+				const MappedSourceFile input(jobs[index].Input);
+				result.SourceBytes = input.Size();
+				auto end = std::chrono::steady_clock::now();
+				result.ReadTime = end - begin;
+
+				begin = end;
+				MachineStream<Arch> stream = {};
+				Assemble<Arch>(input.Text(), stream, fileOptions);
+				stream.Finalize();
+				result.CodeBytes = stream.Size();
+				end = std::chrono::steady_clock::now();
+				result.EncodeTime = end - begin;
+
+				begin = end;
+				if (!stream(jobs[index].Output)) [[unlikely]]
+				{
+					throw std::runtime_error("Failed to write " + jobs[index].Output.string());
+				}
+				result.WriteTime = std::chrono::steady_clock::now() - begin;
+			}
+			catch (const std::exception& ex)
+			{
+				result.Error = ex.what();
+			}
+		});
+		stats.Steals = pool.Steals();
+
+		for (const auto& result : stats.Files)
+		{
+			stats.Failed += result.Succeeded() ? 0 : 1;
+			stats.SourceBytes += result.SourceBytes;
+			stats.CodeBytes += result.CodeBytes;
+			stats.ReadTime += result.ReadTime;
+			stats.EncodeTime += result.EncodeTime;
+			stats.WriteTime += result.WriteTime;
+		}
+		stats.WallTime = std::chrono::steady_clock::now() - batchBegin;
+		return stats;
+	}
+}
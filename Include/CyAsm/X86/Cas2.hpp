@@ -1,71 +1,204 @@
 #pragma once
 
+#include <cstring>
+#include <limits>
+#include <span>
+
 #include "../ByteChunk.hpp"
 #include "../Immediate.hpp"
+#include "../InstructionBuffer.hpp"
+#include "../MachineStream.hpp"
+#include "../Result.hpp"
 
 #include "MachineLanguage.hpp"
+#include "EncodingSelector.hpp"
 #include "Instructions.hpp"
 #include "Registers.hpp"
+#include "Operand.hpp"
 
 namespace CyberAsm::X86
 {
-	template <Abi Arch = Abi::X86_64>
+	/// <summary>
+	/// Encodes a register, immediate instruction such as 'adc rax, 5' with the shortest legal encoding.
+	/// </summary>
+	/// <param name="instruction">The instruction to encode.</param>
+	/// <param name="reg">The destination register.</param>
+	/// <param name="immediate">The immediate, negative values are stored as two's complement.</param>
+	/// <param name="result">The sink which receives the machine code.</param>
+	/// <returns>The number of bytes written or the diagnostic.</returns>
+	template <Abi Arch = Abi::X86_64, MachineCodeSink Out>
 	[[nodiscard]]
-	constexpr auto Cas2Encode(const Instruction instruction, const Register reg, const Immediate& immediate) -> ByteChunk
+	constexpr auto TryCas2EncodeTo(Out& result, const Instruction instruction, const Register reg, const Immediate& immediate) noexcept -> Result<std::size_t>
 	{
-		const WordSize registerSize = LookupRegisterSize(reg);
-		WordSize immediateSize = ComputeRequiredBytes(immediate.UValue);
+		const Result<ImmediateEncoding> encodingResult = TrySelectImmediateEncoding(instruction, reg, immediate);
+		if (!encodingResult) [[unlikely]]
+		{
+			return encodingResult.Error();
+		}
+
+		const ImmediateEncoding& encoding = *encodingResult;
+		const std::size_t variation = encoding.Variation;
 
-		if (immediateSize < registerSize) [[likely]]
+		// 16-bit operands require the operand size override prefix:
+		if (encoding.OperandSize == WordSize::Word) [[unlikely]]
 		{
-			// Extend to 32 bit size (only mov allows imm64)
-			// TODO: Check if instruction is mov!
-			immediateSize = registerSize == WordSize::QWord ? WordSize::DWord : registerSize;
+			result << OperandSizeOverride;
 		}
-		else if (immediateSize > registerSize) [[unlikely]]
+
+		// REX
+		if (encoding.RequiresRex)
 		{
-			throw std::runtime_error("Immediate value is too large for destination register!");
+			// The high 8-bit registers (AH, CH, DH, BH ) are not addressable when a REX prefix is used.
+			if (IsHighByteRegister(encoding.Reg)) [[unlikely]]
+			{
+				return Fail(ErrorCode::HighByteRegisterWithRex, 0, static_cast<std::uint64_t>(encoding.Reg));
+			}
+
+			// Write REX prefix:
+			result << PackByteRexPrefix(Is64BitOrLarger(encoding.OperandSize), false, false, IsExtendedRegister(encoding.Reg));
 		}
-		
-		const std::optional<std::size_t> variationOpt = AutoLookupInstruction(instruction, reg, immediateSize);
-		if (!variationOpt) [[unlikely]]
+
+		// Opcode
+		if (RequiresTwoByteOpCode(instruction, variation)) [[unlikely]]
 		{
-			throw std::runtime_error("Found no corresponding instruction for operand types!");
+			result << TwoByteOpCodePrefix;
 		}
 
-		const std::size_t variation = *variationOpt;
+		// Opcode, +r forms encode the register in the low 3 bits:
+		const auto registerId = LookupRegisterId(encoding.Reg);
+		result << static_cast<std::uint8_t>(FetchMachineByte(instruction, variation) + (IsRegisterInOpCode(instruction, variation) ? registerId & 0b111 : 0));
 
-		ByteChunk result = {};
+		// ModR/M:
+		if (encoding.HasModRm) [[likely]]
+		{
+			const auto modField = ModBitsRegisterAddressing;
+			const auto regField = LookupOpCodeExtension(instruction, variation).value_or(0);
+			const auto rmField = registerId;
+			result << PackByteBitsModRmSib(modField, regField, rmField);
+		}
+
+		// SIB:
+		// None
 
-		const bool isAnyOperand64Bit = IsMin64BitRegister(reg) || Is64BitOrLarger(immediateSize);
+		// Displacement:
+		// None
 
-		// Using 64-bit operand size and the instruction does not default to 64-bit operand size?
-		bool requiresRex = isAnyOperand64Bit;
+		// Immediate, smaller immediates are sign extended by the CPU:
+		result.WriteFixedImmediate(immediate, encoding.ImmediateSize);
+
+		return result.Size();
+	}
+
+	/// <summary>
+	/// Encodes a register to register instruction such as 'adc al, bl'.
+	/// </summary>
+	/// <param name="instruction">The instruction to encode.</param>
+	/// <param name="destination">The destination register (ModR/M r/m field).</param>
+	/// <param name="source">The source register (ModR/M reg field).</param>
+	/// <param name="result">The sink which receives the machine code.</param>
+	/// <returns>The number of bytes written or the diagnostic.</returns>
+	template <Abi Arch = Abi::X86_64, MachineCodeSink Out>
+	[[nodiscard]]
+	constexpr auto TryCas2EncodeTo(Out& result, const Instruction instruction, const Register destination, const Register source) noexcept -> Result<std::size_t>
+	{
+		if (destination >= Register::Count || source >= Register::Count) [[unlikely]]
+		{
+			return Fail(ErrorCode::InvalidRegister, destination >= Register::Count ? 0 : 1);
+		}
+
+		const WordSize registerSize = LookupRegisterSize(destination);
+		if (registerSize != LookupRegisterSize(source)) [[unlikely]]
+		{
+			return Fail(ErrorCode::OperandSizeMismatch, 1, static_cast<std::uint64_t>(source));
+		}
 
-		// Using one of the extended registers (R8 to R15, XMM8 to XMM15, YMM8 to YMM15, CR8 to CR15 and DR8 to DR15)?
-		requiresRex |= IsExtendedRegister(reg);
+		const Result<std::size_t> variationResult = TryAutoLookupInstruction(instruction, destination, source);
+		if (!variationResult) [[unlikely]]
+		{
+			return variationResult.Error();
+		}
 
-		// Using one of the uniform byte registers SPL, BPL, SIL or DIL ?
-		requiresRex |= IsUniformByteRegister(reg);
+		const std::size_t variation = *variationResult;
 
-		// A REX prefix must not be encoded when using one of the high byte registers AH, CH, BH or DH:
-		requiresRex &= !IsHighByteRegister(reg);
+		// 16-bit operands require the operand size override prefix:
+		if (registerSize == WordSize::Word) [[unlikely]]
+		{
+			result << OperandSizeOverride;
+		}
+
+		const bool isAnyOperand64Bit = Is64BitOrLarger(registerSize);
+
+		bool requiresRex = isAnyOperand64Bit;
+		requiresRex |= IsExtendedRegister(destination) || IsExtendedRegister(source);
+		requiresRex |= IsUniformByteRegister(destination) || IsUniformByteRegister(source);
 
 		// REX
 		if (requiresRex) [[likely]]
 		{
 			// The high 8-bit registers (AH, CH, DH, BH ) are not addressable when a REX prefix is used.
-			if (IsHighByteRegister(reg)) [[unlikely]]
+			if (IsHighByteRegister(destination) || IsHighByteRegister(source)) [[unlikely]]
 			{
-				throw std::runtime_error("The high byte registers 'ah', 'bh', 'ch' and 'dh' are not addressable when a REX prefix is used!");
+				return Fail(ErrorCode::HighByteRegisterWithRex, IsHighByteRegister(destination) ? 0 : 1, static_cast<std::uint64_t>(IsHighByteRegister(destination) ? destination : source));
 			}
 
-			// Write REX prefix:
-			result << PackByteRexPrefix(isAnyOperand64Bit, false, false, false);
+			// Write REX prefix, the source extends ModR/M.reg and the destination ModR/M.rm:
+			result << PackByteRexPrefix(isAnyOperand64Bit, IsExtendedRegister(source), false, IsExtendedRegister(destination));
+		}
+
+		// Opcode
+		if (RequiresTwoByteOpCode(instruction, variation)) [[unlikely]]
+		{
+			result << TwoByteOpCodePrefix;
+		}
+
+		// Opcode
+		result << FetchMachineByte(instruction, variation);
+
+		// ModR/M:
+		result << PackByteBitsModRmSib(ModBitsRegisterAddressing, LookupRegisterId(source), LookupRegisterId(destination));
+
+		return result.Size();
+	}
+
+	/// <summary>
+	/// Encodes a single register instruction such as 'inc eax'.
+	/// </summary>
+	/// <param name="instruction">The instruction to encode.</param>
+	/// <param name="reg">The register operand (ModR/M r/m field).</param>
+	/// <param name="result">The sink which receives the machine code.</param>
+	/// <returns>The number of bytes written or the diagnostic.</returns>
+	template <Abi Arch = Abi::X86_64, MachineCodeSink Out>
+	[[nodiscard]]
+	constexpr auto TryCas2EncodeTo(Out& result, const Instruction instruction, const Register reg) noexcept -> Result<std::size_t>
+	{
+		const Result<std::size_t> variationResult = TryAutoLookupInstruction(instruction, reg);
+		if (!variationResult) [[unlikely]]
+		{
+			return variationResult.Error();
+		}
+
+		const std::size_t variation = *variationResult;
+		const WordSize registerSize = LookupRegisterSize(reg);
+
+		// 16-bit operands require the operand size override prefix:
+		if (registerSize == WordSize::Word) [[unlikely]]
+		{
+			result << OperandSizeOverride;
+		}
+
+		// REX
+		const bool isAnyOperand64Bit = Is64BitOrLarger(registerSize);
+		if (isAnyOperand64Bit || IsExtendedRegister(reg) || IsUniformByteRegister(reg))
+		{
+			if (IsHighByteRegister(reg)) [[unlikely]]
+			{
+				return Fail(ErrorCode::HighByteRegisterWithRex, 0, static_cast<std::uint64_t>(reg));
+			}
+			result << PackByteRexPrefix(isAnyOperand64Bit, false, false, IsExtendedRegister(reg));
 		}
 
 		// Opcode
-		if (RequiresTwoByteOpCode(instruction, variation)) [[likely]]
+		if (RequiresTwoByteOpCode(instruction, variation)) [[unlikely]]
 		{
 			result << TwoByteOpCodePrefix;
 		}
@@ -74,23 +207,323 @@ namespace CyberAsm::X86
 		result << FetchMachineByte(instruction, variation);
 
 		// ModR/M:
-		if (!IsAccumulator(reg)) [[likely]]
+		result << PackByteBitsModRmSib(ModBitsRegisterAddressing, LookupOpCodeExtension(instruction, variation).value_or(0), LookupRegisterId(reg));
+
+		return result.Size();
+	}
+
+	/// <summary>
+	/// Encodes 'lea destination, [base + index + displacement]'.
+	/// The address registers must be 64-bit GPRs, the index must not be rsp.
+	/// </summary>
+	/// <param name="destination">The destination register (ModR/M reg field).</param>
+	/// <param name="address">The memory operand.</param>
+	/// <param name="result">The sink which receives the machine code.</param>
+	/// <returns>The number of bytes written or the diagnostic.</returns>
+	template <Abi Arch = Abi::X86_64, MachineCodeSink Out>
+	[[nodiscard]]
+	constexpr auto TryCas2EncodeLeaTo(Out& result, const Register destination, const Operand& address) noexcept -> Result<std::size_t>
+	{
+		const bool hasIndex = address.Index != Register::Count;
+		const auto isAddressRegister = [](const Register reg)
 		{
-			const auto modField = ModBitsRegisterAddressing;
-			const auto regField = LookupOpCodeExtension(instruction, variation).value_or(0);
-			const auto rmField = LookupRegisterId(reg);
-			result << PackByteBitsModRmSib(modField, regField, rmField);
+			return LookupQWordAlias(reg) == reg;
+		};
+		if (!address.IsMemory() || !isAddressRegister(address.Base) || (hasIndex && (!isAddressRegister(address.Index) || address.Index == Register::Rsp))) [[unlikely]]
+		{
+			return Fail(ErrorCode::InvalidAddress, 1);
+		}
+		if (destination >= Register::Count) [[unlikely]]
+		{
+			return Fail(ErrorCode::InvalidRegister, 0, static_cast<std::uint64_t>(destination));
 		}
 
-		// SIB:
-		// None
+		constexpr std::array<OperandFlags::Flags, 2> operands = {OperandFlags::Reg64, OperandFlags::Mem64};
+		const Result<std::size_t> variationResult = TryLookupInstructionVariation(Instruction::Lea, operands);
+		const WordSize registerSize = LookupRegisterSize(destination);
+		if (!variationResult || registerSize == WordSize::HWord || !LookupQWordAlias(destination)) [[unlikely]]
+		{
+			return Fail(ErrorCode::NoMatchingVariation, 0, static_cast<std::uint64_t>(destination));
+		}
+
+		// 16-bit operands require the operand size override prefix:
+		if (registerSize == WordSize::Word) [[unlikely]]
+		{
+			result << OperandSizeOverride;
+		}
+
+		// REX
+		const bool isAnyOperand64Bit = Is64BitOrLarger(registerSize);
+		const bool extendedIndex = hasIndex && IsExtendedRegister(address.Index);
+		if (isAnyOperand64Bit || IsExtendedRegister(destination) || extendedIndex || IsExtendedRegister(address.Base))
+		{
+			result << PackByteRexPrefix(isAnyOperand64Bit, IsExtendedRegister(destination), extendedIndex, IsExtendedRegister(address.Base));
+		}
+
+		// Opcode
+		result << FetchMachineByte(Instruction::Lea, *variationResult);
+
+		// ModR/M, rbp and r13 as base can only be encoded with a displacement:
+		const auto baseId = LookupRegisterId(address.Base);
+		const bool isDisplacement8 = address.Displacement >= std::numeric_limits<std::int8_t>::min() && address.Displacement <= std::numeric_limits<std::int8_t>::max();
+		std::uint8_t modField = ModBitsFourByteSignedDisplace;
+		if (address.Displacement == 0 && baseId != LookupRegisterId(Register::Rbp))
+		{
+			modField = ModBitsRegisterIndirect;
+		}
+		else if (isDisplacement8)
+		{
+			modField = ModBitsOneByteSignedDisplace;
+		}
+
+		// SIB, required for an index and for rsp and r12 as base:
+		constexpr auto sibEscape = 0b100;
+		if (hasIndex || baseId == sibEscape)
+		{
+			result << PackByteBitsModRmSib(modField, LookupRegisterId(destination), sibEscape);
+			result << PackByteBitsModRmSib(SibScaleFactor1, hasIndex ? LookupRegisterId(address.Index) : sibEscape, baseId);
+		}
+		else
+		{
+			result << PackByteBitsModRmSib(modField, LookupRegisterId(destination), baseId);
+		}
 
 		// Displacement:
-		// None
+		if (modField == ModBitsOneByteSignedDisplace)
+		{
+			result << static_cast<std::uint8_t>(address.Displacement);
+		}
+		else if (modField == ModBitsFourByteSignedDisplace)
+		{
+			result.WriteFixedImmediate(Immediate(static_cast<std::uint64_t>(static_cast<std::int64_t>(address.Displacement))), WordSize::DWord);
+		}
+
+		return result.Size();
+	}
+
+	/// <summary>
+	/// Encodes a parsed instruction by dispatching on its operand kinds.
+	/// </summary>
+	/// <param name="node">The instruction with operands in Intel order.</param>
+	/// <param name="result">The sink which receives the machine code.</param>
+	/// <returns>The number of bytes written or the diagnostic.</returns>
+	template <Abi Arch = Abi::X86_64, MachineCodeSink Out>
+	[[nodiscard]]
+	constexpr auto TryCas2EncodeTo(Out& result, const InstructionNode& node) noexcept -> Result<std::size_t>
+	{
+		if (node.OperandCount == 2 && node.Operands[0].IsRegister()) [[likely]]
+		{
+			if (node.Operands[1].IsImmediate())
+			{
+				return TryCas2EncodeTo<Arch>(result, node.Instr, node.Operands[0].Reg, node.Operands[1].Imm);
+			}
+			if (node.Operands[1].IsRegister())
+			{
+				return TryCas2EncodeTo<Arch>(result, node.Instr, node.Operands[0].Reg, node.Operands[1].Reg);
+			}
+			if (node.Operands[1].IsMemory() && node.Instr == Instruction::Lea)
+			{
+				return TryCas2EncodeLeaTo<Arch>(result, node.Operands[0].Reg, node.Operands[1]);
+			}
+		}
+		if (node.OperandCount == 1 && node.Operands[0].IsRegister())
+		{
+			return TryCas2EncodeTo<Arch>(result, node.Instr, node.Operands[0].Reg);
+		}
+		return Fail(ErrorCode::UnsupportedOperands);
+	}
 
-		// Immediate:
-		result.WriteFixedImmediate(immediate, immediateSize);
+	/// <summary>
+	/// Encodes an instruction into a new ByteChunk, the operands are forwarded to TryCas2EncodeTo().
+	/// </summary>
+	/// <returns>The machine code or the diagnostic.</returns>
+	template <Abi Arch = Abi::X86_64, typename... Ts>
+	[[nodiscard]]
+	constexpr auto TryCas2Encode(const Ts&... operands) noexcept -> Result<ByteChunk>
+	{
+		ByteChunk result = {};
+		const Result<std::size_t> size = TryCas2EncodeTo<Arch>(result, operands...);
+		if (!size) [[unlikely]]
+		{
+			return size.Error();
+		}
+		return result;
+	}
 
+	/// <summary>
+	/// Encodes 'lea destination, [base + index + displacement]' into a new ByteChunk.
+	/// </summary>
+	/// <returns>The machine code or the diagnostic.</returns>
+	template <Abi Arch = Abi::X86_64>
+	[[nodiscard]]
+	constexpr auto TryCas2EncodeLea(const Register destination, const Operand& address) noexcept -> Result<ByteChunk>
+	{
+		ByteChunk result = {};
+		const Result<std::size_t> size = TryCas2EncodeLeaTo<Arch>(result, destination, address);
+		if (!size) [[unlikely]]
+		{
+			return size.Error();
+		}
 		return result;
 	}
+
+	/// <summary>
+	/// Encodes an instruction directly into caller provided memory, the operands are forwarded to TryCas2EncodeTo().
+	/// The instruction is assembled in an InstructionBuffer and copied with a single 16-byte store
+	/// if the memory has room for it, else with a copy of the exact length.
+	/// </summary>
+	/// <param name="out">The memory which receives the machine code.</param>
+	/// <returns>The number of bytes written or the diagnostic.</returns>
+	template <Abi Arch = Abi::X86_64, typename... Ts>
+	[[nodiscard]]
+	inline auto TryCas2EncodeInto(const std::span<std::uint8_t> out, const Ts&... operands) noexcept -> Result<std::size_t>
+	{
+		InstructionBuffer buffer = {};
+		const Result<std::size_t> size = TryCas2EncodeTo<Arch>(buffer, operands...);
+		if (!size) [[unlikely]]
+		{
+			return size;
+		}
+		if (out.size() >= InstructionBuffer::Capacity) [[likely]]
+		{
+			std::memcpy(out.data(), buffer.Data(), InstructionBuffer::Capacity);
+		}
+		else if (out.size() >= *size)
+		{
+			std::memcpy(out.data(), buffer.Data(), *size);
+		}
+		else
+		{
+			return Fail(ErrorCode::BufferTooSmall, Diagnostic::NoOperand, *size);
+		}
+		return size;
+	}
+
+	/// <summary>
+	/// Encodes an instruction directly behind the cursor and advances it.
+	/// </summary>
+	/// <param name="cursor">The cursor of the stream which receives the machine code.</param>
+	/// <returns>The number of bytes written or the diagnostic.</returns>
+	template <Abi Arch = Abi::X86_64, typename... Ts>
+	[[nodiscard]]
+	inline auto TryCas2EncodeInto(EmitCursor& cursor, const Ts&... operands) -> Result<std::size_t>
+	{
+		cursor.Ensure(InstructionBuffer::Capacity);
+		const Result<std::size_t> size = TryCas2EncodeInto<Arch>(std::span<std::uint8_t>(cursor.Position(), cursor.Remaining()), operands...);
+		if (size) [[likely]]
+		{
+			cursor.Advance(*size);
+		}
+		return size;
+	}
+
+	/// <summary>
+	/// Encodes an instruction directly into the tail of the stream.
+	/// Use an EmitCursor when appending many instructions.
+	/// </summary>
+	/// <param name="out">The stream which receives the machine code.</param>
+	/// <returns>The number of bytes written or the diagnostic.</returns>
+	template <Abi Arch = Abi::X86_64, typename... Ts>
+	[[nodiscard]]
+	inline auto TryCas2EncodeInto(MachineStream<Arch>& out, const Ts&... operands) -> Result<std::size_t>
+	{
+		EmitCursor cursor = out.BeginEmit(0);
+		return TryCas2EncodeInto<Arch>(cursor, operands...);
+	}
+
+	/// <summary>
+	/// Encodes a register, immediate instruction, see TryCas2Encode().
+	/// Throws std::runtime_error on failure.
+	/// </summary>
+	template <Abi Arch = Abi::X86_64>
+	[[nodiscard]]
+	constexpr auto Cas2Encode(const Instruction instruction, const Register reg, const Immediate& immediate) -> ByteChunk
+	{
+		return TryCas2Encode<Arch>(instruction, reg, immediate).ValueOrThrow();
+	}
+
+	/// <summary>
+	/// Encodes a register to register instruction, see TryCas2Encode().
+	/// Throws std::runtime_error on failure.
+	/// </summary>
+	template <Abi Arch = Abi::X86_64>
+	[[nodiscard]]
+	constexpr auto Cas2Encode(const Instruction instruction, const Register destination, const Register source) -> ByteChunk
+	{
+		return TryCas2Encode<Arch>(instruction, destination, source).ValueOrThrow();
+	}
+
+	/// <summary>
+	/// Encodes a single register instruction, see TryCas2Encode().
+	/// Throws std::runtime_error on failure.
+	/// </summary>
+	template <Abi Arch = Abi::X86_64>
+	[[nodiscard]]
+	constexpr auto Cas2Encode(const Instruction instruction, const Register reg) -> ByteChunk
+	{
+		return TryCas2Encode<Arch>(instruction, reg).ValueOrThrow();
+	}
+
+	/// <summary>
+	/// Encodes 'lea destination, [base + index + displacement]', see TryCas2EncodeLea().
+	/// Throws std::runtime_error on failure.
+	/// </summary>
+	template <Abi Arch = Abi::X86_64>
+	[[nodiscard]]
+	constexpr auto Cas2EncodeLea(const Register destination, const Operand& address) -> ByteChunk
+	{
+		return TryCas2EncodeLea<Arch>(destination, address).ValueOrThrow();
+	}
+
+	/// <summary>
+	/// Encodes a parsed instruction, see TryCas2Encode().
+	/// Throws std::runtime_error on failure.
+	/// </summary>
+	template <Abi Arch = Abi::X86_64>
+	[[nodiscard]]
+	constexpr auto Cas2Encode(const InstructionNode& node) -> ByteChunk
+	{
+		return TryCas2Encode<Arch>(node).ValueOrThrow();
+	}
+
+
+	/// <summary>
+	/// Encodes a relative branch such as 'jne label' into the stream.
+	/// Branches with a rel8 form are emitted short and widened to rel32 by MachineStream::Finalize() if required,
+	/// branches without one (call) are emitted as rel32 with a fixup.
+	/// The target may be bound before or after the branch.
+	/// </summary>
+	/// <param name="out">The stream which receives the machine code.</param>
+	/// <param name="instruction">The branch instruction.</param>
+	/// <param name="target">The branch target.</param>
+	template <Abi Arch = Abi::X86_64>
+	inline void Cas2EncodeBranch(MachineStream<Arch>& out, const Instruction instruction, const Label target)
+	{
+		constexpr std::array<OperandFlags::Flags, 1> longOperands = {OperandFlags::Rel32};
+		const std::optional<std::size_t> longVariation = LookupInstructionVariation(instruction, longOperands);
+		if (!longVariation) [[unlikely]]
+		{
+			throw std::runtime_error("Instruction does not accept a label operand!");
+		}
+
+		// Opcode of the rel32 form:
+		std::array<std::uint8_t, RelaxableBranch::MaxLongOpCodeSize> longOpCode = {};
+		std::size_t longOpCodeSize = 0;
+		if (RequiresTwoByteOpCode(instruction, *longVariation))
+		{
+			longOpCode[longOpCodeSize++] = TwoByteOpCodePrefix;
+		}
+		longOpCode[longOpCodeSize++] = FetchMachineByte(instruction, *longVariation);
+
+		constexpr std::array<OperandFlags::Flags, 1> shortOperands = {OperandFlags::Rel8};
+		const std::optional<std::size_t> shortVariation = LookupInstructionVariation(instruction, shortOperands);
+		if (shortVariation) [[likely]]
+		{
+			out.InsertBranch(target, FetchMachineByte(instruction, *shortVariation), std::span<const std::uint8_t>(longOpCode.data(), longOpCodeSize));
+			return;
+		}
+
+		out << std::span<std::uint8_t>(longOpCode.data(), longOpCodeSize);
+		out.InsertFixup(target, FixupKind::Relative32);
+	}
 }
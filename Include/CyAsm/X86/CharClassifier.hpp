@@ -0,0 +1,648 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <string_view>
+
+#include "Lexer.hpp"
+#include "Syntax.h"
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#	define CYBERASM_CLASSIFIER_X86 1
+#	include <immintrin.h>
+#	if defined(_MSC_VER)
+#		include <intrin.h>
+#	endif
+#	if defined(__GNUC__)
+#		define CYBERASM_TARGET_AVX2 __attribute__((target("avx2")))
+#	else
+#		define CYBERASM_TARGET_AVX2
+#	endif
+#endif
+
+namespace CyberAsm::X86
+{
+	/// <summary>
+	/// The instruction set a CharClassifier runs on.
+	/// </summary>
+	enum class SimdLevel : std::uint8_t
+	{
+		Scalar,
+		Sse2,
+		Avx2
+	};
+
+	/// <summary>
+	/// Returns the best level the processor supports, detected once at runtime.
+	/// </summary>
+	[[nodiscard]] auto DetectSimdLevel() noexcept -> SimdLevel;
+
+	/// <summary>
+	/// One bit per byte of a 64 byte block, bit i belongs to byte i.
+	/// Everything inside a comment is only set in Comment.
+	/// </summary>
+	struct CharMasks final
+	{
+		std::uint64_t Separator = 0;
+		std::uint64_t LabelTerminator = 0;
+		std::uint64_t RegisterPrefix = 0;
+		std::uint64_t ImmediatePrefix = 0;
+		std::uint64_t AbsoluteJumpPrefix = 0;
+		std::uint64_t NegativeSign = 0;
+
+		/// <summary>
+		/// From the comment character up to, but not including, the line break.
+		/// </summary>
+		std::uint64_t Comment = 0;
+
+		std::uint64_t Whitespace = 0;
+		std::uint64_t NewLine = 0;
+
+		/// <summary>
+		/// Letters, digits, '_' and '.', the characters of identifiers, registers and numbers.
+		/// </summary>
+		std::uint64_t Identifier = 0;
+
+		/// <summary>
+		/// The first byte of every token the Lexer yields, bytes of no class are Invalid tokens of their own.
+		/// </summary>
+		std::uint64_t TokenStarts = 0;
+	};
+
+	/// <summary>
+	/// Structural pass of the AT&T lexer: classifies 64 bytes at a time into bitmasks, so tokens can be found by
+	/// scanning bits instead of branching per byte.
+	/// Comment regions are masked out with one subtraction per comment, the comment and token state carries over
+	/// from block to block, so a source is classified by calling Classify() on consecutive blocks.
+	/// </summary>
+	class CharClassifier final
+	{
+	public:
+		static constexpr std::size_t BlockSize = 64;
+
+		/// <param name="level">The instruction set to use, must be supported by the processor.</param>
+		explicit CharClassifier(SimdLevel level = DetectSimdLevel()) noexcept;
+
+		/// <summary>
+		/// Classifies the next BlockSize bytes.
+		/// </summary>
+		[[nodiscard]] auto Classify(const char* block) noexcept -> CharMasks;
+
+		/// <summary>
+		/// Classifies the last, shorter block, the bits past its end are clear.
+		/// </summary>
+		[[nodiscard]] auto ClassifyTail(std::string_view tail) noexcept -> CharMasks;
+
+		/// <summary>
+		/// Classifies a whole source into NewLine and Comment only, for consumers of the line structure,
+		/// and calls sink(offset, masks) for every block. The level is dispatched by a predictable branch
+		/// instead of the indirect call, so the raw classification is inlined into the loop.
+		/// </summary>
+		template <typename Sink>
+		void ClassifyLines(std::string_view source, Sink&& sink);
+
+		/// <summary>
+		/// Forgets the state carried over from the previous block.
+		/// </summary>
+		void Reset() noexcept;
+
+		[[nodiscard]] auto Level() const noexcept -> SimdLevel;
+
+	private:
+		using ClassifyFunction = void (*)(const char* block, CharMasks& out) noexcept;
+
+		/// <summary>
+		/// Spreads the comment characters to whole comments and returns the mask of all code bytes.
+		/// </summary>
+		[[nodiscard]] auto MaskComments(CharMasks& masks) noexcept -> std::uint64_t;
+
+		/// <summary>
+		/// Fills the raw NewLine and Comment masks with the classifier's level.
+		/// </summary>
+		void ClassifyLinesRaw(const char* block, CharMasks& out) const noexcept;
+
+		SimdLevel level = SimdLevel::Scalar;
+		ClassifyFunction classify = nullptr;
+		bool inComment = false;
+		bool continuesToken = false;
+		bool afterImmediatePrefix = false;
+	};
+
+	/// <summary>
+	/// Classifies the whole source and calls sink(offset, masks) for every block.
+	/// </summary>
+	template <typename Sink>
+	void ClassifySource(std::string_view source, Sink&& sink, SimdLevel level = DetectSimdLevel());
+
+	/// <summary>
+	/// Classifies the whole source into NewLine and Comment only and calls sink(offset, masks) for every block.
+	/// </summary>
+	template <typename Sink>
+	void ClassifySourceLines(std::string_view source, Sink&& sink, SimdLevel level = DetectSimdLevel());
+
+	/// <summary>
+	/// Runtime fast path of the Lexer, yielding the same tokens.
+	/// Jumps from token to token along the TokenStarts of each block and ends every token at the next token start,
+	/// whitespace or comment, so no byte is visited one by one.
+	/// </summary>
+	class ClassifiedLexer final
+	{
+	public:
+		/// <param name="source">The source code.</param>
+		/// <param name="level">The instruction set to use, must be supported by the processor.</param>
+		explicit ClassifiedLexer(std::string_view source, SimdLevel level = DetectSimdLevel()) noexcept;
+
+		[[nodiscard]] auto Next() noexcept -> Token;
+		[[nodiscard]] auto Offset() const noexcept -> std::size_t;
+		[[nodiscard]] auto Source() const noexcept -> std::string_view;
+
+	private:
+		/// <summary>
+		/// Classifies the next block, returns false at the end of the source.
+		/// </summary>
+		[[nodiscard]] auto NextBlock() noexcept -> bool;
+
+		CharClassifier classifier;
+		std::string_view source;
+
+		/// <summary>
+		/// The offset of the next block to classify.
+		/// </summary>
+		std::size_t block = 0;
+
+		/// <summary>
+		/// The token starts of the current block which were not yielded yet, bit i belongs to offset block - BlockSize + i.
+		/// </summary>
+		std::uint64_t starts = 0;
+
+		/// <summary>
+		/// The bytes of the current block which end a token.
+		/// </summary>
+		std::uint64_t stops = 0;
+
+		std::size_t cursor = 0;
+	};
+
+	namespace CharClassifierDetail
+	{
+		struct ByteClass final
+		{
+			enum Enum : std::uint16_t
+			{
+				None = 0,
+				Separator = 1 << 0,
+				LabelTerminator = 1 << 1,
+				RegisterPrefix = 1 << 2,
+				ImmediatePrefix = 1 << 3,
+				AbsoluteJumpPrefix = 1 << 4,
+				NegativeSign = 1 << 5,
+				Comment = 1 << 6,
+				Whitespace = 1 << 7,
+				NewLine = 1 << 8,
+				Identifier = 1 << 9
+			};
+		};
+
+		constexpr std::array<std::uint16_t, 256> ByteClassTable = []() consteval
+		{
+			std::array<std::uint16_t, 256> table = {};
+			table[static_cast<std::uint8_t>(X64::Separator)] = ByteClass::Separator;
+			table[static_cast<std::uint8_t>(X64::LabelTerminator)] = ByteClass::LabelTerminator;
+			table[static_cast<std::uint8_t>(X64::RegisterPrefix)] = ByteClass::RegisterPrefix;
+			table[static_cast<std::uint8_t>(X64::ImmediatePrefix)] = ByteClass::ImmediatePrefix;
+			table[static_cast<std::uint8_t>(X64::AbsoluteJumpPrefix)] = ByteClass::AbsoluteJumpPrefix;
+			table[static_cast<std::uint8_t>(X64::NegativeSign)] = ByteClass::NegativeSign;
+			table[static_cast<std::uint8_t>(X64::Comment)] = ByteClass::Comment;
+			table[' '] = table['\t'] = table['\r'] = table['\v'] = table['\f'] = ByteClass::Whitespace;
+			table['\n'] = ByteClass::NewLine;
+			for (std::size_t c = 0; c < 256; ++c)
+			{
+				if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_' || c == '.')
+				{
+					table[c] = ByteClass::Identifier;
+				}
+			}
+			return table;
+		}();
+
+		/// <summary>
+		/// Maps the first byte of a token to the kind the Lexer yields for it.
+		/// </summary>
+		constexpr std::array<TokenKind, 256> TokenKindTable = []() consteval
+		{
+			std::array<TokenKind, 256> table = {};
+			for (std::size_t c = 0; c < 256; ++c)
+			{
+				const auto value = static_cast<char>(c);
+				table[c] = IsCharClass(value, CharClass::IdentifierStart) ? TokenKind::Identifier
+					: IsCharClass(value, CharClass::NumberStart) ? TokenKind::Number
+					: TokenKind::Invalid;
+			}
+			table['\n'] = TokenKind::NewLine;
+			table[static_cast<std::uint8_t>(X64::Separator)] = TokenKind::Separator;
+			table[static_cast<std::uint8_t>(X64::LabelTerminator)] = TokenKind::LabelTerminator;
+			table[static_cast<std::uint8_t>(X64::AbsoluteJumpPrefix)] = TokenKind::AbsoluteJump;
+			table[static_cast<std::uint8_t>(X64::RegisterPrefix)] = TokenKind::Register;
+			table[static_cast<std::uint8_t>(X64::ImmediatePrefix)] = TokenKind::Immediate;
+			return table;
+		}();
+
+		/// <summary>
+		/// Copies the last, shorter block, padded with spaces which end every token and cannot start one.
+		/// </summary>
+		[[nodiscard]] inline auto PadTail(const std::string_view tail) noexcept -> std::array<char, CharClassifier::BlockSize>
+		{
+			std::array<char, CharClassifier::BlockSize> block = {};
+			block.fill(' ');
+			std::memcpy(block.data(), tail.data(), std::min(tail.size(), CharClassifier::BlockSize));
+			return block;
+		}
+
+		/// <summary>
+		/// Clears the bits of the padding.
+		/// </summary>
+		inline void ClearPastEnd(CharMasks& masks, const std::size_t size) noexcept
+		{
+			if (size >= CharClassifier::BlockSize)
+			{
+				return;
+			}
+			const std::uint64_t valid = (std::uint64_t{1} << size) - 1;
+			for (std::uint64_t* mask : {&masks.Separator, &masks.LabelTerminator, &masks.RegisterPrefix, &masks.ImmediatePrefix, &masks.AbsoluteJumpPrefix,
+				&masks.NegativeSign, &masks.Comment, &masks.Whitespace, &masks.NewLine, &masks.Identifier, &masks.TokenStarts})
+			{
+				*mask &= valid;
+			}
+		}
+
+		/// <summary>
+		/// Fills the raw masks, Comment only holds the comment characters themselves.
+		/// </summary>
+		inline void ClassifyScalar(const char* const block, CharMasks& out) noexcept
+		{
+			out = {};
+			for (std::size_t i = 0; i < CharClassifier::BlockSize; ++i)
+			{
+				const std::uint16_t bits = ByteClassTable[static_cast<std::uint8_t>(block[i])];
+				const auto bit = [&](const std::uint16_t mask) noexcept -> std::uint64_t
+				{
+					return static_cast<std::uint64_t>((bits & mask) != 0) << i;
+				};
+				out.Separator |= bit(ByteClass::Separator);
+				out.LabelTerminator |= bit(ByteClass::LabelTerminator);
+				out.RegisterPrefix |= bit(ByteClass::RegisterPrefix);
+				out.ImmediatePrefix |= bit(ByteClass::ImmediatePrefix);
+				out.AbsoluteJumpPrefix |= bit(ByteClass::AbsoluteJumpPrefix);
+				out.NegativeSign |= bit(ByteClass::NegativeSign);
+				out.Comment |= bit(ByteClass::Comment);
+				out.Whitespace |= bit(ByteClass::Whitespace);
+				out.NewLine |= bit(ByteClass::NewLine);
+				out.Identifier |= bit(ByteClass::Identifier);
+			}
+		}
+
+		/// <summary>
+		/// Fills the raw NewLine and Comment masks only.
+		/// </summary>
+		inline void ClassifyLinesScalar(const char* const block, CharMasks& out) noexcept
+		{
+			out = {};
+			for (std::size_t i = 0; i < CharClassifier::BlockSize; ++i)
+			{
+				out.Comment |= static_cast<std::uint64_t>(block[i] == X64::Comment) << i;
+				out.NewLine |= static_cast<std::uint64_t>(block[i] == '\n') << i;
+			}
+		}
+
+#if defined(CYBERASM_CLASSIFIER_X86)
+		[[nodiscard]] inline auto Sse2Equal(const __m128i value, const char c) noexcept -> std::uint64_t
+		{
+			return static_cast<std::uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(value, _mm_set1_epi8(c))));
+		}
+
+		/// <summary>
+		/// Bytes in [low, high], compared unsigned.
+		/// </summary>
+		[[nodiscard]] inline auto Sse2Range(const __m128i value, const char low, const char high) noexcept -> std::uint64_t
+		{
+			const __m128i offset = _mm_sub_epi8(value, _mm_set1_epi8(low));
+			return static_cast<std::uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_min_epu8(offset, _mm_set1_epi8(static_cast<char>(high - low))), offset)));
+		}
+
+		inline void ClassifySse2(const char* const block, CharMasks& out) noexcept
+		{
+			out = {};
+			for (std::size_t i = 0; i < CharClassifier::BlockSize; i += 16)
+			{
+				const __m128i value = _mm_loadu_si128(reinterpret_cast<const __m128i*>(block + i));
+				const __m128i lower = _mm_or_si128(value, _mm_set1_epi8(0x20));
+				const std::uint64_t newLine = Sse2Equal(value, '\n');
+				out.Separator |= Sse2Equal(value, X64::Separator) << i;
+				out.LabelTerminator |= Sse2Equal(value, X64::LabelTerminator) << i;
+				out.RegisterPrefix |= Sse2Equal(value, X64::RegisterPrefix) << i;
+				out.ImmediatePrefix |= Sse2Equal(value, X64::ImmediatePrefix) << i;
+				out.AbsoluteJumpPrefix |= Sse2Equal(value, X64::AbsoluteJumpPrefix) << i;
+				out.NegativeSign |= Sse2Equal(value, X64::NegativeSign) << i;
+				out.Comment |= Sse2Equal(value, X64::Comment) << i;
+				out.Whitespace |= ((Sse2Equal(value, ' ') | Sse2Range(value, '\t', '\r')) & ~newLine) << i;
+				out.NewLine |= newLine << i;
+				out.Identifier |= (Sse2Range(lower, 'a', 'z') | Sse2Range(value, '0', '9') | Sse2Equal(value, '_') | Sse2Equal(value, '.')) << i;
+			}
+		}
+
+		inline void ClassifyLinesSse2(const char* const block, CharMasks& out) noexcept
+		{
+			out = {};
+			for (std::size_t i = 0; i < CharClassifier::BlockSize; i += 16)
+			{
+				const __m128i value = _mm_loadu_si128(reinterpret_cast<const __m128i*>(block + i));
+				out.Comment |= Sse2Equal(value, X64::Comment) << i;
+				out.NewLine |= Sse2Equal(value, '\n') << i;
+			}
+		}
+
+		[[nodiscard]] CYBERASM_TARGET_AVX2 inline auto Avx2Equal(const __m256i value, const char c) noexcept -> std::uint64_t
+		{
+			return static_cast<std::uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(value, _mm256_set1_epi8(c))));
+		}
+
+		[[nodiscard]] CYBERASM_TARGET_AVX2 inline auto Avx2Range(const __m256i value, const char low, const char high) noexcept -> std::uint64_t
+		{
+			const __m256i offset = _mm256_sub_epi8(value, _mm256_set1_epi8(low));
+			return static_cast<std::uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_min_epu8(offset, _mm256_set1_epi8(static_cast<char>(high - low))), offset)));
+		}
+
+		CYBERASM_TARGET_AVX2 inline void ClassifyAvx2(const char* const block, CharMasks& out) noexcept
+		{
+			out = {};
+			for (std::size_t i = 0; i < CharClassifier::BlockSize; i += 32)
+			{
+				const __m256i value = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block + i));
+				const __m256i lower = _mm256_or_si256(value, _mm256_set1_epi8(0x20));
+				const std::uint64_t newLine = Avx2Equal(value, '\n');
+				out.Separator |= Avx2Equal(value, X64::Separator) << i;
+				out.LabelTerminator |= Avx2Equal(value, X64::LabelTerminator) << i;
+				out.RegisterPrefix |= Avx2Equal(value, X64::RegisterPrefix) << i;
+				out.ImmediatePrefix |= Avx2Equal(value, X64::ImmediatePrefix) << i;
+				out.AbsoluteJumpPrefix |= Avx2Equal(value, X64::AbsoluteJumpPrefix) << i;
+				out.NegativeSign |= Avx2Equal(value, X64::NegativeSign) << i;
+				out.Comment |= Avx2Equal(value, X64::Comment) << i;
+				out.Whitespace |= ((Avx2Equal(value, ' ') | Avx2Range(value, '\t', '\r')) & ~newLine) << i;
+				out.NewLine |= newLine << i;
+				out.Identifier |= (Avx2Range(lower, 'a', 'z') | Avx2Range(value, '0', '9') | Avx2Equal(value, '_') | Avx2Equal(value, '.')) << i;
+			}
+		}
+
+		CYBERASM_TARGET_AVX2 inline void ClassifyLinesAvx2(const char* const block, CharMasks& out) noexcept
+		{
+			out = {};
+			for (std::size_t i = 0; i < CharClassifier::BlockSize; i += 32)
+			{
+				const __m256i value = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block + i));
+				out.Comment |= Avx2Equal(value, X64::Comment) << i;
+				out.NewLine |= Avx2Equal(value, '\n') << i;
+			}
+		}
+
+		[[nodiscard]] inline auto SupportsAvx2() noexcept -> bool
+		{
+#	if defined(_MSC_VER) && !defined(__clang__)
+			std::array<int, 4> registers = {};
+			__cpuid(registers.data(), 0);
+			if (registers[0] < 7)
+			{
+				return false;
+			}
+			__cpuid(registers.data(), 1);
+			constexpr int osXsave = 1 << 27;
+			constexpr int avx = 1 << 28;
+			if ((registers[2] & (osXsave | avx)) != (osXsave | avx) || (_xgetbv(0) & 0x6) != 0x6)
+			{
+				return false;
+			}
+			__cpuidex(registers.data(), 7, 0);
+			return (registers[1] & (1 << 5)) != 0;
+#	else
+			return __builtin_cpu_supports("avx2");
+#	endif
+		}
+#endif
+	}
+
+	inline auto DetectSimdLevel() noexcept -> SimdLevel
+	{
+#if defined(CYBERASM_CLASSIFIER_X86)
+		static const SimdLevel level = CharClassifierDetail::SupportsAvx2() ? SimdLevel::Avx2 : SimdLevel::Sse2;
+		return level;
+#else
+		return SimdLevel::Scalar;
+#endif
+	}
+
+	inline CharClassifier::CharClassifier(const SimdLevel level) noexcept : level(level)
+	{
+		switch (level)
+		{
+#if defined(CYBERASM_CLASSIFIER_X86)
+			case SimdLevel::Avx2:
+				this->classify = &CharClassifierDetail::ClassifyAvx2;
+				break;
+			case SimdLevel::Sse2:
+				this->classify = &CharClassifierDetail::ClassifySse2;
+				break;
+#endif
+			default:
+				this->level = SimdLevel::Scalar;
+				this->classify = &CharClassifierDetail::ClassifyScalar;
+				break;
+		}
+	}
+
+	inline auto CharClassifier::MaskComments(CharMasks& masks) noexcept -> std::uint64_t
+	{
+		// Each comment covers the bits from its first character up to the next line break, found with one subtraction.
+		// Comment characters inside a comment are already covered, so only one iteration per comment is taken:
+		std::uint64_t comment = 0;
+		if (this->inComment)
+		{
+			const std::uint64_t end = masks.NewLine & (0 - masks.NewLine);
+			comment = end ? end - 1 : ~std::uint64_t{0};
+		}
+		for (std::uint64_t pending = masks.Comment & ~comment; pending != 0; pending &= ~comment)
+		{
+			const std::uint64_t start = pending & (0 - pending);
+			const std::uint64_t later = masks.NewLine & ~(start | (start - 1));
+			const std::uint64_t end = later & (0 - later);
+			comment |= end ? end - start : 0 - start;
+		}
+		this->inComment = (comment >> 63) != 0;
+		masks.Comment = comment;
+		return ~comment;
+	}
+
+	inline auto CharClassifier::Classify(const char* const block) noexcept -> CharMasks
+	{
+		CharMasks masks;
+		this->classify(block, masks);
+
+		const std::uint64_t code = this->MaskComments(masks);
+		masks.Separator &= code;
+		masks.LabelTerminator &= code;
+		masks.RegisterPrefix &= code;
+		masks.ImmediatePrefix &= code;
+		masks.AbsoluteJumpPrefix &= code;
+		masks.NegativeSign &= code;
+		masks.Whitespace &= code;
+		masks.Identifier &= code;
+
+		// An identifier run continues the token of a preceding identifier character, prefix or sign,
+		// and a sign continues the token of a preceding immediate prefix:
+		const std::uint64_t continuing = masks.Identifier | masks.RegisterPrefix | masks.ImmediatePrefix | masks.NegativeSign;
+		const std::uint64_t identifierStarts = masks.Identifier & ~(continuing << 1 | static_cast<std::uint64_t>(this->continuesToken));
+		const std::uint64_t signStarts = masks.NegativeSign & ~(masks.ImmediatePrefix << 1 | static_cast<std::uint64_t>(this->afterImmediatePrefix));
+		const std::uint64_t invalid = code & ~(masks.Separator | masks.LabelTerminator | masks.RegisterPrefix | masks.ImmediatePrefix
+			| masks.AbsoluteJumpPrefix | masks.NegativeSign | masks.Whitespace | masks.NewLine | masks.Identifier);
+		masks.TokenStarts = masks.Separator | masks.LabelTerminator | masks.RegisterPrefix | masks.ImmediatePrefix
+			| masks.AbsoluteJumpPrefix | masks.NewLine | identifierStarts | signStarts | invalid;
+		this->continuesToken = (continuing >> 63) != 0;
+		this->afterImmediatePrefix = (masks.ImmediatePrefix >> 63) != 0;
+		return masks;
+	}
+
+	inline auto CharClassifier::ClassifyTail(const std::string_view tail) noexcept -> CharMasks
+	{
+		const auto block = CharClassifierDetail::PadTail(tail);
+		CharMasks masks = this->Classify(block.data());
+		CharClassifierDetail::ClearPastEnd(masks, tail.size());
+		return masks;
+	}
+
+	inline void CharClassifier::Reset() noexcept
+	{
+		this->inComment = false;
+		this->continuesToken = false;
+		this->afterImmediatePrefix = false;
+	}
+
+	inline auto CharClassifier::Level() const noexcept -> SimdLevel
+	{
+		return this->level;
+	}
+
+	template <typename Sink>
+	inline void ClassifySource(const std::string_view source, Sink&& sink, const SimdLevel level)
+	{
+		CharClassifier classifier(level);
+		std::size_t offset = 0;
+		for (; offset + CharClassifier::BlockSize <= source.size(); offset += CharClassifier::BlockSize)
+		{
+			sink(offset, classifier.Classify(source.data() + offset));
+		}
+		if (offset < source.size())
+		{
+			sink(offset, classifier.ClassifyTail(source.substr(offset)));
+		}
+	}
+
+	inline void CharClassifier::ClassifyLinesRaw(const char* const block, CharMasks& out) const noexcept
+	{
+		switch (this->level)
+		{
+#if defined(CYBERASM_CLASSIFIER_X86)
+			case SimdLevel::Avx2: CharClassifierDetail::ClassifyLinesAvx2(block, out); break;
+			case SimdLevel::Sse2: CharClassifierDetail::ClassifyLinesSse2(block, out); break;
+#endif
+			default: CharClassifierDetail::ClassifyLinesScalar(block, out); break;
+		}
+	}
+
+	template <typename Sink>
+	inline void CharClassifier::ClassifyLines(const std::string_view source, Sink&& sink)
+	{
+		CharMasks masks = {};
+		std::size_t offset = 0;
+		for (; offset + BlockSize <= source.size(); offset += BlockSize)
+		{
+			this->ClassifyLinesRaw(source.data() + offset, masks);
+			static_cast<void>(this->MaskComments(masks));
+			sink(offset, static_cast<const CharMasks&>(masks));
+		}
+		if (offset < source.size())
+		{
+			const auto block = CharClassifierDetail::PadTail(source.substr(offset));
+			this->ClassifyLinesRaw(block.data(), masks);
+			static_cast<void>(this->MaskComments(masks));
+			CharClassifierDetail::ClearPastEnd(masks, source.size() - offset);
+			sink(offset, static_cast<const CharMasks&>(masks));
+		}
+	}
+
+	template <typename Sink>
+	inline void ClassifySourceLines(const std::string_view source, Sink&& sink, const SimdLevel level)
+	{
+		CharClassifier classifier(level);
+		classifier.ClassifyLines(source, sink);
+	}
+
+	inline ClassifiedLexer::ClassifiedLexer(const std::string_view source, const SimdLevel level) noexcept : classifier(level), source(source) { }
+
+	inline auto ClassifiedLexer::NextBlock() noexcept -> bool
+	{
+		if (this->block >= this->source.size())
+		{
+			return false;
+		}
+		const bool whole = this->block + CharClassifier::BlockSize <= this->source.size();
+		const CharMasks masks = whole ? this->classifier.Classify(this->source.data() + this->block) : this->classifier.ClassifyTail(this->source.substr(this->block));
+		this->starts = masks.TokenStarts;
+		this->stops = masks.TokenStarts | masks.Whitespace | masks.Comment;
+		this->block += CharClassifier::BlockSize;
+		return true;
+	}
+
+	inline auto ClassifiedLexer::Next() noexcept -> Token
+	{
+		while (this->starts == 0)
+		{
+			if (!this->NextBlock()) [[unlikely]]
+			{
+				this->cursor = this->source.size();
+				return {TokenKind::EndOfFile, {}};
+			}
+		}
+		const auto bit = static_cast<std::size_t>(std::countr_zero(this->starts));
+		const std::size_t first = this->block - CharClassifier::BlockSize + bit;
+		this->starts &= this->starts - 1;
+
+		// The token ends at the next stop, a token without one in its block continues into the next block,
+		// which holds no token start in front of the end either:
+		std::uint64_t later = this->stops & (~std::uint64_t{1} << bit);
+		while (later == 0) [[unlikely]]
+		{
+			if (!this->NextBlock())
+			{
+				break;
+			}
+			later = this->stops;
+		}
+		this->cursor = later == 0 ? this->source.size() : this->block - CharClassifier::BlockSize + static_cast<std::size_t>(std::countr_zero(later));
+
+		// The kind follows from the first byte, prefixes are not part of the lexeme:
+		const auto kind = CharClassifierDetail::TokenKindTable[static_cast<std::uint8_t>(this->source[first])];
+		const std::size_t from = first + (kind == TokenKind::Register || kind == TokenKind::Immediate);
+		return {kind, std::string_view(this->source.data() + from, this->cursor - from)};
+	}
+
+	inline auto ClassifiedLexer::Offset() const noexcept -> std::size_t
+	{
+		return this->cursor;
+	}
+
+	inline auto ClassifiedLexer::Source() const noexcept -> std::string_view
+	{
+		return this->source;
+	}
+}
@@ -0,0 +1,812 @@
+#pragma once
+
+#include <cstdint>
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "../Immediate.hpp"
+#include "../Result.hpp"
+#include "MachineLanguage.hpp"
+#include "Instructions.hpp"
+#include "Operand.hpp"
+#include "OperandFlags.hpp"
+#include "Registers.hpp"
+
+namespace CyberAsm::X86
+{
+	/// <summary>
+	/// Architectural limit of one instruction including all prefixes.
+	/// </summary>
+	constexpr std::size_t MaxInstructionLength = 15;
+
+	/// <summary>
+	/// One instruction read back from machine code.
+	/// </summary>
+	struct DecodedInstruction final
+	{
+		/// <summary>
+		/// The instruction with its operands in Intel order, so it can be passed to TryCas2EncodeTo() again.
+		/// Immediates hold the value the operand sees: sign extended from the immediate field and truncated to the operand size.
+		/// Relative branch operands are labels without target, Displacement holds the distance from the end of the instruction.
+		/// </summary>
+		InstructionNode Node = {};
+
+		/// <summary>
+		/// The OperandTable variation the op code belongs to.
+		/// </summary>
+		std::size_t Variation = 0;
+
+		std::size_t Length = 0;
+
+		/// <summary>
+		/// The size of the register and memory operands.
+		/// </summary>
+		WordSize OperandSize = WordSize::DWord;
+
+		/// <summary>
+		/// Returns the target of a relative branch located at the address.
+		/// </summary>
+		/// <returns>The target or std::nullopt if the instruction is no relative branch.</returns>
+		[[nodiscard]] constexpr auto BranchTarget(std::size_t address) const noexcept -> std::optional<std::size_t>;
+	};
+
+	/// <summary>
+	/// Computes the length of the instruction at the start of the code without decoding its operands.
+	/// Only prefixes, the op code, ModR/M and SIB are inspected, op code extensions are not validated.
+	/// </summary>
+	/// <param name="code">The machine code, may be longer than the instruction.</param>
+	/// <returns>The length in bytes or the diagnostic, Value is the offset of the offending byte.</returns>
+	[[nodiscard]] constexpr auto TryDecodeLength(std::span<const std::uint8_t> code) noexcept -> Result<std::size_t>;
+
+	/// <summary>
+	/// Decodes the instruction at the start of the code into the instruction and its registers, immediates and addresses.
+	/// Addresses with a scaled index or without base register cannot be represented by an Operand and fail with UnsupportedOperands,
+	/// TryDecodeLength() still measures them.
+	/// </summary>
+	/// <param name="code">The machine code, may be longer than the instruction.</param>
+	/// <returns>The instruction or the diagnostic.</returns>
+	[[nodiscard]] constexpr auto TryDecode(std::span<const std::uint8_t> code) noexcept -> Result<DecodedInstruction>;
+
+	/// <summary>
+	/// Returns the offset of every instruction in the code, for patching and for splitting code into blocks.
+	/// Throws std::runtime_error if the code contains an unknown instruction.
+	/// </summary>
+	[[nodiscard]] auto DecodeBoundaries(std::span<const std::uint8_t> code) -> std::vector<std::size_t>;
+
+	/// <summary>
+	/// Decodes all instructions of the code.
+	/// Throws std::runtime_error if the code contains an unknown instruction.
+	/// </summary>
+	[[nodiscard]] auto Disassemble(std::span<const std::uint8_t> code) -> std::vector<DecodedInstruction>;
+
+	/// <summary>
+	/// Formats the instruction in Intel syntax, such as 'adc rax, 0x5', 'inc dword ptr [rbx + 0x8]' or 'jne 0x40'.
+	/// </summary>
+	/// <param name="instruction">The decoded instruction.</param>
+	/// <param name="address">The address of the instruction, used to print branch targets.</param>
+	[[nodiscard]] auto FormatInstruction(const DecodedInstruction& instruction, std::size_t address = 0) -> std::string;
+
+	namespace DecoderDetail
+	{
+		/// <summary>
+		/// Size of an immediate field, Z and V follow the Intel notation iz and iv.
+		/// </summary>
+		enum class ImmediateClass : std::uint8_t
+		{
+			None,
+			Byte,
+			DWord,
+
+			/// <summary>
+			/// 16 bit with the operand size override, else 32 bit.
+			/// </summary>
+			Z,
+
+			/// <summary>
+			/// Like Z, but 64 bit with REX.W.
+			/// </summary>
+			V
+		};
+
+		/// <summary>
+		/// Where an operand is stored in the machine code.
+		/// </summary>
+		enum class OperandRole : std::uint8_t
+		{
+			None,
+			ModRmReg,
+			ModRmRm,
+			OpCodeReg,
+			Accumulator,
+			Immediate,
+			Relative
+		};
+
+		/// <summary>
+		/// The decoding properties of one OperandTable variation.
+		/// </summary>
+		struct VariationTraits final
+		{
+			std::array<OperandRole, InstructionNode::MaxOperands> Roles = {};
+			std::uint8_t OperandCount = 0;
+			bool HasModRm = false;
+
+			/// <summary>
+			/// All register and memory operands are 8 bit, so the size prefixes do not apply.
+			/// </summary>
+			bool ByteOperands = false;
+
+			ImmediateClass Immediate = ImmediateClass::None;
+		};
+
+		[[nodiscard]] consteval auto ComputeVariationTraits(const Instruction instruction, const std::size_t variation) -> VariationTraits
+		{
+			const auto& operands = *(OperandTable[static_cast<std::size_t>(instruction)].begin() + variation);
+			VariationTraits traits = {};
+			traits.OperandCount = static_cast<std::uint8_t>(operands.size());
+
+			// The first operand accepting memory is encoded in ModR/M.rm, another explicit register in ModR/M.reg:
+			OperandFlags::Flags all = OperandFlags::None;
+			std::size_t rm = InstructionNode::MaxOperands;
+			for (std::size_t i = 0; i < operands.size(); ++i)
+			{
+				const auto flags = *(operands.begin() + i);
+				all |= flags;
+				if (rm == InstructionNode::MaxOperands && (flags & OperandFlags::AnyMem) != OperandFlags::None)
+				{
+					rm = i;
+				}
+			}
+
+			// Without memory operand, the first explicit register is the r/m operand:
+			for (std::size_t i = 0; i < operands.size() && rm == InstructionNode::MaxOperands; ++i)
+			{
+				if ((*(operands.begin() + i) & (OperandFlags::AnyGpr & ~OperandFlags::AnyImplicitAkkuGpr)) != OperandFlags::None)
+				{
+					rm = i;
+				}
+			}
+
+			const bool registerInOpCode = IsRegisterInOpCode(instruction, variation);
+			for (std::size_t i = 0; i < operands.size(); ++i)
+			{
+				const auto flags = *(operands.begin() + i);
+				auto& role = traits.Roles[i];
+				if ((flags & OperandFlags::AnyImm) != OperandFlags::None)
+				{
+					role = OperandRole::Immediate;
+					traits.Immediate = flags & OperandFlags::Imm64 ? ImmediateClass::V : flags & (OperandFlags::Imm16 | OperandFlags::Imm32) ? ImmediateClass::Z : ImmediateClass::Byte;
+				}
+				else if ((flags & OperandFlags::AnyRel) != OperandFlags::None)
+				{
+					role = OperandRole::Relative;
+					traits.Immediate = flags & OperandFlags::Rel32 ? ImmediateClass::DWord : ImmediateClass::Byte;
+				}
+				else if ((flags & ~OperandFlags::AnyImplicitAkkuGpr) == OperandFlags::None)
+				{
+					role = OperandRole::Accumulator;
+				}
+				else if (registerInOpCode)
+				{
+					role = OperandRole::OpCodeReg;
+				}
+				else
+				{
+					role = i == rm ? OperandRole::ModRmRm : OperandRole::ModRmReg;
+				}
+				traits.HasModRm |= role == OperandRole::ModRmRm || role == OperandRole::ModRmReg;
+			}
+			traits.ByteOperands = (all & (OperandFlags::AnyGpr16To64 | OperandFlags::AnyMem16To64)) == OperandFlags::None;
+			return traits;
+		}
+
+		constexpr std::size_t MaxVariations = []() consteval
+		{
+			std::size_t count = 0;
+			for (const auto& variations : OperandTable)
+			{
+				count = std::max(count, variations.size());
+			}
+			return count;
+		}();
+
+		constexpr auto VariationTraitsTable = []() consteval
+		{
+			std::array<std::array<VariationTraits, MaxVariations>, static_cast<std::size_t>(Instruction::Count)> table = {};
+			for (std::size_t instruction = 0; instruction < table.size(); ++instruction)
+			{
+				for (std::size_t variation = 0; variation < OperandTable[instruction].size(); ++variation)
+				{
+					table[instruction][variation] = ComputeVariationTraits(static_cast<Instruction>(instruction), variation);
+				}
+			}
+			return table;
+		}();
+
+		/// <summary>
+		/// The one byte op code map followed by the 0F escaped map.
+		/// </summary>
+		constexpr std::size_t OpCodeMapSize = 2 * 256;
+
+		/// <summary>
+		/// Slots per op code, one for every ModR/M.reg op code extension.
+		/// </summary>
+		constexpr std::size_t ExtensionSlots = 8;
+
+		struct OpCodeEntry final
+		{
+			Instruction Instr = Instruction::Count;
+			std::uint8_t Variation = 0;
+
+			/// <summary>
+			/// The variation selected by REX.W, which differs for the forms taking a 64-bit immediate.
+			/// </summary>
+			std::uint8_t WideVariation = 0;
+		};
+
+		/// <summary>
+		/// Maps op code and ModR/M.reg to the instruction variation, generated from the MachineCodeTable.
+		/// Op codes without extension occupy all slots. If several variations share an op code,
+		/// they only differ in the accepted operands and the first one listed is decoded.
+		/// </summary>
+		constexpr auto OpCodeMap = []() consteval
+		{
+			std::array<std::array<OpCodeEntry, ExtensionSlots>, OpCodeMapSize> map = {};
+			for (std::size_t instruction = 0; instruction < static_cast<std::size_t>(Instruction::Count); ++instruction)
+			{
+				const auto instr = static_cast<Instruction>(instruction);
+				for (std::size_t variation = 0; variation < OperandTable[instruction].size(); ++variation)
+				{
+					const bool wide = VariationTraitsTable[instruction][variation].Immediate == ImmediateClass::V;
+					const std::size_t base = (RequiresTwoByteOpCode(instr, variation) ? 256 : 0) + FetchMachineByte(instr, variation);
+					const std::size_t registers = IsRegisterInOpCode(instr, variation) ? 8 : 1;
+					for (std::size_t opCode = base; opCode < base + registers; ++opCode)
+					{
+						for (std::size_t slot = 0; slot < ExtensionSlots; ++slot)
+						{
+							if (RequiresOpCodeExtension(instr, variation) && slot != LookupOpCodeExtension(instr, variation))
+							{
+								continue;
+							}
+							auto& entry = map[opCode][slot];
+							if (entry.Instr == Instruction::Count)
+							{
+								entry = OpCodeEntry{instr, static_cast<std::uint8_t>(variation), static_cast<std::uint8_t>(variation)};
+							}
+							else if (entry.Instr == instr && wide)
+							{
+								entry.WideVariation = static_cast<std::uint8_t>(variation);
+							}
+						}
+					}
+				}
+			}
+			return map;
+		}();
+
+		[[nodiscard]] constexpr auto ImmediateSize(const ImmediateClass immediate, const bool operandSize16, const bool rexW) noexcept -> std::size_t
+		{
+			switch (immediate)
+			{
+				case ImmediateClass::Byte: return 1;
+				case ImmediateClass::DWord: return 4;
+				case ImmediateClass::Z: return operandSize16 && !rexW ? 2 : 4;
+				case ImmediateClass::V: return rexW ? 8 : operandSize16 ? 2 : 4;
+				default: return 0;
+			}
+		}
+
+		/// <summary>
+		/// Everything the length decoder needs to know about an op code.
+		/// </summary>
+		struct LengthTraits final
+		{
+			bool Known = false;
+			bool HasModRm = false;
+			ImmediateClass Immediate = ImmediateClass::None;
+
+			/// <summary>
+			/// The immediate size for each combination of operand size override (bit 0) and REX.W (bit 1).
+			/// </summary>
+			std::array<std::uint8_t, 4> ImmediateSizes = {};
+		};
+
+		constexpr auto LengthTable = []() consteval
+		{
+			std::array<LengthTraits, OpCodeMapSize> table = {};
+			for (std::size_t opCode = 0; opCode < OpCodeMapSize; ++opCode)
+			{
+				for (const OpCodeEntry& entry : OpCodeMap[opCode])
+				{
+					if (entry.Instr == Instruction::Count)
+					{
+						continue;
+					}
+					const auto& traits = VariationTraitsTable[static_cast<std::size_t>(entry.Instr)][entry.WideVariation];
+					table[opCode].Known = true;
+					table[opCode].HasModRm = traits.HasModRm;
+					table[opCode].Immediate = std::max(table[opCode].Immediate, traits.Immediate);
+				}
+				for (std::size_t prefixes = 0; prefixes < table[opCode].ImmediateSizes.size(); ++prefixes)
+				{
+					table[opCode].ImmediateSizes[prefixes] = static_cast<std::uint8_t>(ImmediateSize(table[opCode].Immediate, prefixes & 1, prefixes & 2));
+				}
+			}
+			return table;
+		}();
+
+		/// <summary>
+		/// The variations sharing an op code must agree on the instruction layout, else the length cannot be derived from the op code.
+		/// </summary>
+		consteval auto ValidateOpCodeMap() noexcept -> bool
+		{
+			for (std::size_t opCode = 0; opCode < OpCodeMapSize; ++opCode)
+			{
+				for (const OpCodeEntry& entry : OpCodeMap[opCode])
+				{
+					if (entry.Instr == Instruction::Count)
+					{
+						continue;
+					}
+					for (const std::size_t variation : {entry.Variation, entry.WideVariation})
+					{
+						const auto& traits = VariationTraitsTable[static_cast<std::size_t>(entry.Instr)][variation];
+						const bool sameImmediate = traits.Immediate == LengthTable[opCode].Immediate || (traits.Immediate == ImmediateClass::Z && LengthTable[opCode].Immediate == ImmediateClass::V);
+						if (traits.HasModRm != LengthTable[opCode].HasModRm || !sameImmediate) [[unlikely]]
+						{
+							return false;
+						}
+					}
+				}
+			}
+			return true;
+		}
+
+		static_assert(ValidateOpCodeMap());
+
+		constexpr auto LegacyPrefixTable = []() consteval
+		{
+			std::array<bool, 256> table = {};
+			for (const std::uint8_t prefix : {Lock, RepNeRepNz, RepRepeRepz, SegmentOverrideCs, SegmentOverrideSs, SegmentOverrideDs, SegmentOverrideEs, SegmentOverrideFs, SegmentOverrideGs, OperandSizeOverride, AddressSizeOverride})
+			{
+				table[prefix] = true;
+			}
+			return table;
+		}();
+
+		/// <summary>
+		/// Number of SIB and displacement bytes following each ModR/M byte,
+		/// except the 4 byte displacement of a SIB byte without base (mod 00, base 101).
+		/// </summary>
+		constexpr auto ModRmTailTable = []() consteval
+		{
+			std::array<std::uint8_t, 256> table = {};
+			for (std::size_t modRm = 0; modRm < table.size(); ++modRm)
+			{
+				const std::size_t mod = modRm >> 6;
+				const std::size_t rm = modRm & 0b111;
+				if (mod == ModBitsRegisterAddressing)
+				{
+					continue;
+				}
+				const std::size_t sib = rm == 0b100;
+				const std::size_t displacement = mod == ModBitsOneByteSignedDisplace ? 1 : mod == ModBitsFourByteSignedDisplace || rm == 0b101 ? 4 : 0;
+				table[modRm] = static_cast<std::uint8_t>(sib + displacement);
+			}
+			return table;
+		}();
+
+		struct Prefixes final
+		{
+			std::size_t Length = 0;
+			bool OperandSize16 = false;
+			bool AddressSize32 = false;
+			std::uint8_t Rex = 0;
+		};
+
+		[[nodiscard]] constexpr auto ReadPrefixes(const std::span<const std::uint8_t> code, const std::size_t limit) noexcept -> Prefixes
+		{
+			Prefixes prefixes = {};
+			while (prefixes.Length < limit && LegacyPrefixTable[code[prefixes.Length]])
+			{
+				prefixes.OperandSize16 |= code[prefixes.Length] == OperandSizeOverride;
+				prefixes.AddressSize32 |= code[prefixes.Length] == AddressSizeOverride;
+				++prefixes.Length;
+			}
+
+			// REX is only effective directly in front of the op code:
+			if (prefixes.Length < limit && (code[prefixes.Length] & 0xF0) == 0x40)
+			{
+				prefixes.Rex = code[prefixes.Length++];
+			}
+			return prefixes;
+		}
+
+		/// <summary>
+		/// Bytes Measure() may read: a maximum run of prefixes followed by REX, escape, op code, ModR/M and SIB.
+		/// </summary>
+		constexpr std::size_t DecodeWindow = 32;
+
+		struct Measurement final
+		{
+			std::size_t Length = 0;
+			std::size_t OpCode = 0;
+			bool Known = false;
+		};
+
+		/// <summary>
+		/// Measures the instruction without bounds checks, the fields are selected with table lookups instead of branches.
+		/// DecodeWindow bytes must be readable, the caller checks the result against the real size.
+		/// </summary>
+		[[nodiscard]] constexpr auto Measure(const std::uint8_t* const code) noexcept -> Measurement
+		{
+			std::size_t position = 0;
+			std::size_t operandSize16 = 0;
+			while (position < MaxInstructionLength && LegacyPrefixTable[code[position]])
+			{
+				operandSize16 |= code[position] == OperandSizeOverride;
+				++position;
+			}
+			std::uint8_t rex = 0;
+			if ((code[position] & 0xF0) == 0x40)
+			{
+				rex = code[position++];
+			}
+
+			// Branches instead of selects, so the op code load does not wait for the escape byte:
+			std::size_t map = 0;
+			if (code[position] == TwoByteOpCodePrefix) [[unlikely]]
+			{
+				map = 256;
+				++position;
+			}
+
+			Measurement measurement = {};
+			const LengthTraits& traits = LengthTable[map + code[position]];
+			measurement.OpCode = position++;
+			measurement.Known = traits.Known;
+
+			// A SIB byte without base register (mod 00, base 101) adds a 4 byte displacement:
+			const std::uint8_t modRm = code[position];
+			const bool noBase = (modRm & 0b1100'0111) == 0b0000'0100 && (code[position + 1] & 0b111) == 0b101;
+			const std::size_t modRmSize = traits.HasModRm ? 1 + ModRmTailTable[modRm] + (noBase ? 4 : 0) : 0;
+			measurement.Length = position + modRmSize + traits.ImmediateSizes[operandSize16 | ((rex >> 2) & 0b10)];
+			return measurement;
+		}
+
+		/// <summary>
+		/// Maps register id (including the REX extension bit) and size to the register.
+		/// Row 4 holds the byte registers addressable without REX, where ids 4 to 7 are ah, ch, dh and bh.
+		/// </summary>
+		constexpr auto GprTable = []() consteval
+		{
+			std::array<std::array<Register, 16>, 5> table = {};
+			for (auto& row : table)
+			{
+				row.fill(Register::Count);
+			}
+			for (std::size_t index = 0; index <= static_cast<std::size_t>(Register::R15B); ++index)
+			{
+				const auto reg = static_cast<Register>(index);
+				const std::size_t id = LookupRegisterId(reg) | (IsExtendedRegister(reg) ? 8 : 0);
+				const std::size_t size = static_cast<std::size_t>(std::countr_zero(static_cast<unsigned>(LookupRegisterSize(reg))));
+				if (!IsHighByteRegister(reg))
+				{
+					table[size][id] = reg;
+				}
+				if (LookupRegisterSize(reg) == WordSize::HWord && id < 8 && !IsUniformByteRegister(reg))
+				{
+					table[4][id] = reg;
+				}
+			}
+			return table;
+		}();
+
+		[[nodiscard]] constexpr auto DecodeGpr(const std::size_t id, const WordSize size, const bool hasRex) noexcept -> Register
+		{
+			const bool legacyByte = size == WordSize::HWord && !hasRex;
+			return GprTable[legacyByte ? 4 : static_cast<std::size_t>(std::countr_zero(static_cast<unsigned>(size)))][id];
+		}
+
+		[[nodiscard]] constexpr auto ReadLittle(const std::span<const std::uint8_t> code, const std::size_t position, const std::size_t size) noexcept -> std::uint64_t
+		{
+			std::uint64_t value = 0;
+			for (std::size_t i = 0; i < size; ++i)
+			{
+				value |= std::uint64_t{code[position + i]} << (8 * i);
+			}
+			return value;
+		}
+
+		[[nodiscard]] constexpr auto SignExtend(const std::uint64_t value, const std::size_t size) noexcept -> std::int64_t
+		{
+			const auto shift = 64 - 8 * size;
+			return static_cast<std::int64_t>(value << shift) >> shift;
+		}
+
+		/// <summary>
+		/// Decodes the memory operand behind the ModR/M byte at position.
+		/// </summary>
+		[[nodiscard]] constexpr auto DecodeAddress(const std::span<const std::uint8_t> code, std::size_t position, const Prefixes& prefixes, const std::uint8_t operandIndex) noexcept -> Result<Operand>
+		{
+			const std::uint8_t modRm = code[position++];
+			const std::size_t mod = modRm >> 6;
+			const WordSize addressSize = prefixes.AddressSize32 ? WordSize::DWord : WordSize::QWord;
+			const bool rexX = prefixes.Rex & 0b0010;
+			const bool rexB = prefixes.Rex & 0b0001;
+
+			Register base = Register::Count;
+			Register index = Register::Count;
+			std::size_t displacementSize = mod == ModBitsOneByteSignedDisplace ? 1 : mod == ModBitsFourByteSignedDisplace ? 4 : 0;
+			if ((modRm & 0b111) == 0b100)
+			{
+				const std::uint8_t sib = code[position++];
+				const std::size_t indexId = ((sib >> 3) & 0b111) | (rexX ? 8 : 0);
+				if (indexId != 0b100)
+				{
+					index = DecodeGpr(indexId, addressSize, true);
+				}
+				if ((index != Register::Count && sib >> 6 != SibScaleFactor1) || (mod == ModBitsRegisterIndirect && (sib & 0b111) == 0b101)) [[unlikely]]
+				{
+					return Fail(ErrorCode::UnsupportedOperands, operandIndex, sib);
+				}
+				base = DecodeGpr((sib & 0b111) | (rexB ? 8 : 0), addressSize, true);
+			}
+			else if (mod == ModBitsRegisterIndirect && (modRm & 0b111) == 0b101)
+			{
+				base = prefixes.AddressSize32 ? Register::Eip : Register::Rip;
+				displacementSize = 4;
+			}
+			else
+			{
+				base = DecodeGpr((modRm & 0b111) | (rexB ? 8 : 0), addressSize, true);
+			}
+			const auto displacement = static_cast<std::int32_t>(SignExtend(ReadLittle(code, position, displacementSize), std::max<std::size_t>(displacementSize, 1)));
+			return Operand::FromMemory(base, index, displacementSize ? displacement : 0);
+		}
+	}
+
+	constexpr auto DecodedInstruction::BranchTarget(const std::size_t address) const noexcept -> std::optional<std::size_t>
+	{
+		if (this->Node.OperandCount != 1 || !this->Node.Operands[0].IsLabel())
+		{
+			return std::nullopt;
+		}
+		return address + this->Length + static_cast<std::size_t>(static_cast<std::int64_t>(this->Node.Operands[0].Displacement));
+	}
+
+	constexpr auto TryDecodeLength(const std::span<const std::uint8_t> code) noexcept -> Result<std::size_t>
+	{
+		using namespace DecoderDetail;
+
+		// Only the last instructions of the code are measured in a padded copy:
+		std::array<std::uint8_t, DecodeWindow> padded = {};
+		const std::uint8_t* window = code.data();
+		if (code.size() < DecodeWindow) [[unlikely]]
+		{
+			std::copy(code.begin(), code.end(), padded.begin());
+			window = padded.data();
+		}
+
+		const Measurement measurement = Measure(window);
+		const std::size_t limit = std::min(code.size(), MaxInstructionLength);
+		const auto overrun = [&code](const std::size_t position)
+		{
+			return Fail(code.size() > MaxInstructionLength ? ErrorCode::InstructionTooLong : ErrorCode::TruncatedInstruction, Diagnostic::NoOperand, position);
+		};
+		if (measurement.OpCode >= limit) [[unlikely]]
+		{
+			return overrun(measurement.OpCode);
+		}
+		if (!measurement.Known) [[unlikely]]
+		{
+			return Fail(ErrorCode::UnknownOpCode, Diagnostic::NoOperand, measurement.OpCode);
+		}
+		if (measurement.Length > limit) [[unlikely]]
+		{
+			return overrun(limit);
+		}
+		return measurement.Length;
+	}
+
+	constexpr auto TryDecode(const std::span<const std::uint8_t> code) noexcept -> Result<DecodedInstruction>
+	{
+		using namespace DecoderDetail;
+
+		const Result<std::size_t> length = TryDecodeLength(code);
+		if (!length) [[unlikely]]
+		{
+			return length.Error();
+		}
+
+		// The length decoder checked all bounds:
+		const Prefixes prefixes = ReadPrefixes(code, *length);
+		std::size_t position = prefixes.Length;
+		std::size_t map = 0;
+		if (code[position] == TwoByteOpCodePrefix)
+		{
+			map = 256;
+			++position;
+		}
+		const std::size_t opCodePosition = position++;
+		const std::uint8_t opCode = code[opCodePosition];
+		const bool hasModRm = LengthTable[map + opCode].HasModRm;
+		const std::uint8_t modRm = hasModRm ? code[position] : 0;
+		const OpCodeEntry& entry = OpCodeMap[map + opCode][(modRm >> 3) & 0b111];
+		if (entry.Instr == Instruction::Count) [[unlikely]]
+		{
+			return Fail(ErrorCode::UnknownOpCode, Diagnostic::NoOperand, opCodePosition);
+		}
+
+		const bool hasRex = prefixes.Rex != 0;
+		const bool rexW = prefixes.Rex & 0b1000;
+		const bool rexR = prefixes.Rex & 0b0100;
+		const bool rexB = prefixes.Rex & 0b0001;
+		const std::size_t variation = rexW ? entry.WideVariation : entry.Variation;
+		const VariationTraits& traits = VariationTraitsTable[static_cast<std::size_t>(entry.Instr)][variation];
+		const auto& flags = *(OperandTable[static_cast<std::size_t>(entry.Instr)].begin() + variation);
+		const WordSize operandSize = traits.ByteOperands ? WordSize::HWord : rexW ? WordSize::QWord : prefixes.OperandSize16 ? WordSize::Word : WordSize::DWord;
+
+		// The immediate is the last field of the instruction:
+		const std::size_t immediateSize = ImmediateSize(traits.Immediate, prefixes.OperandSize16, rexW);
+		const std::size_t immediatePosition = *length - immediateSize;
+
+		DecodedInstruction result = {};
+		result.Node.Instr = entry.Instr;
+		result.Node.OperandCount = traits.OperandCount;
+		result.Variation = variation;
+		result.Length = *length;
+		result.OperandSize = operandSize;
+		for (std::size_t i = 0; i < traits.OperandCount; ++i)
+		{
+			const auto operandIndex = static_cast<std::uint8_t>(i);
+			const auto accepted = *(flags.begin() + i);
+			Operand& operand = result.Node.Operands[i];
+			switch (traits.Roles[i])
+			{
+				case OperandRole::ModRmReg:
+					operand = Operand::FromRegister(DecodeGpr(((modRm >> 3) & 0b111) | (rexR ? 8 : 0), operandSize, hasRex));
+					break;
+				case OperandRole::ModRmRm:
+					if (modRm >> 6 != ModBitsRegisterAddressing)
+					{
+						if ((accepted & OperandFlags::AnyMem) == OperandFlags::None) [[unlikely]]
+						{
+							return Fail(ErrorCode::UnsupportedOperands, operandIndex, modRm);
+						}
+						const Result<Operand> address = DecodeAddress(code, position, prefixes, operandIndex);
+						if (!address) [[unlikely]]
+						{
+							return address.Error();
+						}
+						operand = *address;
+						break;
+					}
+					if ((accepted & OperandFlags::AnyGpr) == OperandFlags::None) [[unlikely]]
+					{
+						return Fail(ErrorCode::UnsupportedOperands, operandIndex, modRm);
+					}
+					operand = Operand::FromRegister(DecodeGpr((modRm & 0b111) | (rexB ? 8 : 0), operandSize, hasRex));
+					break;
+				case OperandRole::OpCodeReg:
+					operand = Operand::FromRegister(DecodeGpr((opCode & 0b111) | (rexB ? 8 : 0), operandSize, hasRex));
+					break;
+				case OperandRole::Accumulator:
+					operand = Operand::FromRegister(DecodeGpr(0, operandSize, hasRex));
+					break;
+				case OperandRole::Immediate:
+				{
+					const auto value = static_cast<std::uint64_t>(SignExtend(ReadLittle(code, immediatePosition, immediateSize), immediateSize));
+					const auto bits = 8 * static_cast<std::size_t>(operandSize);
+					operand = Operand::FromImmediate(Immediate(bits < 64 ? value & ((std::uint64_t{1} << bits) - 1) : value));
+					break;
+				}
+				case OperandRole::Relative:
+					operand.Kind = OperandKind::Label;
+					operand.Displacement = static_cast<std::int32_t>(SignExtend(ReadLittle(code, immediatePosition, immediateSize), immediateSize));
+					break;
+				default:
+					break;
+			}
+		}
+		return result;
+	}
+
+	inline auto DecodeBoundaries(const std::span<const std::uint8_t> code) -> std::vector<std::size_t>
+	{
+		std::vector<std::size_t> boundaries = {};
+		boundaries.reserve(code.size() / 4);
+		for (std::size_t offset = 0; offset < code.size();)
+		{
+			const Result<std::size_t> length = TryDecodeLength(code.subspan(offset));
+			if (!length) [[unlikely]]
+			{
+				throw std::runtime_error("Failed to decode the instruction at offset " + std::to_string(offset) + ": " + std::string(length.Error().Message()));
+			}
+			boundaries.push_back(offset);
+			offset += *length;
+		}
+		return boundaries;
+	}
+
+	inline auto Disassemble(const std::span<const std::uint8_t> code) -> std::vector<DecodedInstruction>
+	{
+		std::vector<DecodedInstruction> instructions = {};
+		for (std::size_t offset = 0; offset < code.size();)
+		{
+			const Result<DecodedInstruction> instruction = TryDecode(code.subspan(offset));
+			if (!instruction) [[unlikely]]
+			{
+				throw std::runtime_error("Failed to decode the instruction at offset " + std::to_string(offset) + ": " + std::string(instruction.Error().Message()));
+			}
+			instructions.push_back(*instruction);
+			offset += instruction->Length;
+		}
+		return instructions;
+	}
+
+	inline auto FormatInstruction(const DecodedInstruction& instruction, const std::size_t address) -> std::string
+	{
+		const auto hex = [](const std::uint64_t value)
+		{
+			constexpr std::string_view digits = "0123456789ABCDEF";
+			std::string text = "0x";
+			const int width = std::max(1, static_cast<int>((std::bit_width(value) + 3) / 4));
+			for (int i = width - 1; i >= 0; --i)
+			{
+				text += digits[(value >> (4 * i)) & 0x0F];
+			}
+			return text;
+		};
+
+		const InstructionNode& node = instruction.Node;
+		std::string text(MnemonicTable[static_cast<std::size_t>(node.Instr)]);
+		for (std::size_t i = 0; i < node.OperandCount; ++i)
+		{
+			const Operand& operand = node.Operands[i];
+			text += i == 0 ? " " : ", ";
+			switch (operand.Kind)
+			{
+				case OperandKind::Register:
+					text += RegisterMnemonicTable[static_cast<std::size_t>(operand.Reg)];
+					break;
+				case OperandKind::Immediate:
+					text += hex(operand.Imm.UValue);
+					break;
+				case OperandKind::Label:
+					text += hex(*instruction.BranchTarget(address));
+					break;
+				case OperandKind::Memory:
+					if (node.Instr != Instruction::Lea)
+					{
+						constexpr std::array<std::string_view, 4> sizes = {"byte ptr ", "word ptr ", "dword ptr ", "qword ptr "};
+						text += sizes[static_cast<std::size_t>(std::countr_zero(static_cast<unsigned>(instruction.OperandSize))) & 0b11];
+					}
+					text += '[';
+					text += RegisterMnemonicTable[static_cast<std::size_t>(operand.Base)];
+					if (operand.Index != Register::Count)
+					{
+						text += " + ";
+						text += RegisterMnemonicTable[static_cast<std::size_t>(operand.Index)];
+					}
+					if (operand.Displacement != 0)
+					{
+						text += operand.Displacement < 0 ? " - " : " + ";
+						text += hex(operand.Displacement < 0 ? 0 - static_cast<std::uint64_t>(static_cast<std::int64_t>(operand.Displacement)) : static_cast<std::uint64_t>(operand.Displacement));
+					}
+					text += ']';
+					break;
+				default:
+					break;
+			}
+		}
+		return text;
+	}
+}
@@ -0,0 +1,384 @@
+#pragma once
+
+#include <cstdint>
+#include <array>
+#include <limits>
+#include <optional>
+
+#include "../Immediate.hpp"
+#include "../Result.hpp"
+#include "MachineLanguage.hpp"
+#include "Instructions.hpp"
+#include "Mapper.hpp"
+#include "OperandFlags.hpp"
+#include "Registers.hpp"
+
+namespace CyberAsm::X86
+{
+	/// <summary>
+	/// The shortest encoding of a register, immediate instruction.
+	/// </summary>
+	struct ImmediateEncoding final
+	{
+		std::size_t Variation = 0;
+
+		/// <summary>
+		/// The register to encode, which is the 32-bit alias for zero extending 64-bit moves.
+		/// </summary>
+		Register Reg = Register::Count;
+
+		WordSize OperandSize = WordSize::HWord;
+		WordSize ImmediateSize = WordSize::HWord;
+		bool HasModRm = false;
+		bool RequiresRex = false;
+		std::uint8_t Length = 0;
+	};
+
+	/// <summary>
+	/// Checks if the value fits into the operand, either as unsigned or as two's complement signed value.
+	/// </summary>
+	[[nodiscard]] constexpr auto FitsOperandSize(const Immediate& immediate, const WordSize operandSize) noexcept -> bool
+	{
+		const auto bits = static_cast<std::uint64_t>(operandSize) * 8;
+		if (bits >= 64)
+		{
+			return true;
+		}
+		const auto signedMin = -(std::int64_t{1} << (bits - 1));
+		const auto signedValue = static_cast<std::int64_t>(immediate.UValue);
+		return immediate.UValue < (std::uint64_t{1} << bits) || (signedValue >= signedMin && signedValue < 0);
+	}
+
+	/// <summary>
+	/// Returns the value as the operand sees it: truncated to the operand size and sign extended to 64 bit.
+	/// </summary>
+	[[nodiscard]] constexpr auto SignExtendToOperand(const Immediate& immediate, const WordSize operandSize) noexcept -> std::int64_t
+	{
+		const auto shift = 64 - static_cast<std::uint64_t>(operandSize) * 8;
+		return static_cast<std::int64_t>(immediate.UValue << shift) >> shift;
+	}
+
+	/// <summary>
+	/// Checks if an immediate field of the given kind reproduces the operand value.
+	/// Immediates smaller than the operand are sign extended by the CPU, so the signed value must fit the field.
+	/// </summary>
+	/// <param name="immediate">The immediate, which must fit the operand size.</param>
+	/// <param name="operandSize">The operand size of the instruction.</param>
+	/// <param name="immediateKind">Imm8, Imm16, Imm32 or Imm64.</param>
+	[[nodiscard]] constexpr auto IsImmediateEncodable(const Immediate& immediate, const WordSize operandSize, const OperandFlags::Flags immediateKind) noexcept -> bool
+	{
+		const auto immediateSize = OperandFlags::OperandByteSize(immediateKind);
+		if (immediateSize > operandSize) [[unlikely]]
+		{
+			return false;
+		}
+		if (immediateSize == operandSize)
+		{
+			return true;
+		}
+		const auto value = SignExtendToOperand(immediate, operandSize);
+		switch (immediateSize)
+		{
+			case WordSize::HWord: return value >= std::numeric_limits<std::int8_t>::min() && value <= std::numeric_limits<std::int8_t>::max();
+			case WordSize::Word: return value >= std::numeric_limits<std::int16_t>::min() && value <= std::numeric_limits<std::int16_t>::max();
+			case WordSize::DWord: return value >= std::numeric_limits<std::int32_t>::min() && value <= std::numeric_limits<std::int32_t>::max();
+			default: return true;
+		}
+	}
+
+	/// <summary>
+	/// Computes the encoding of one variation, if the variation accepts the operands.
+	/// </summary>
+	[[nodiscard]] constexpr auto ComputeImmediateEncoding(const Instruction instruction, const std::size_t variation, const Register reg, const Immediate& immediate) noexcept -> std::optional<ImmediateEncoding>
+	{
+		const auto& operands = *(OperandTable[static_cast<std::size_t>(instruction)].begin() + variation);
+		if (operands.size() != 2) [[unlikely]]
+		{
+			return std::nullopt;
+		}
+		const auto destination = *operands.begin();
+		const auto source = *(operands.begin() + 1);
+		if ((OperandFlags::WithExplicitRegister(Mapper::TryMapFlags(reg).ValueOr(OperandFlags::None)) & destination) == OperandFlags::None)
+		{
+			return std::nullopt;
+		}
+
+		const WordSize operandSize = LookupRegisterSize(reg);
+		constexpr std::array<OperandFlags::Flags, 4> immediateKinds = {OperandFlags::Imm8, OperandFlags::Imm16, OperandFlags::Imm32, OperandFlags::Imm64};
+		for (const auto kind : immediateKinds)
+		{
+			// Every variation supports exactly one immediate size per operand size:
+			if ((source & kind) == OperandFlags::None || !IsImmediateEncodable(immediate, operandSize, kind))
+			{
+				continue;
+			}
+			const auto immediateSize = OperandFlags::OperandByteSize(kind);
+			if (immediateSize != operandSize && immediateSize != WordSize::HWord && !(operandSize == WordSize::QWord && immediateSize == WordSize::DWord))
+			{
+				continue;
+			}
+
+			ImmediateEncoding encoding = {};
+			encoding.Variation = variation;
+			encoding.Reg = reg;
+			encoding.OperandSize = operandSize;
+			encoding.ImmediateSize = immediateSize;
+
+			// Implicit accumulator forms and +r forms have no ModR/M byte:
+			encoding.HasModRm = !IsRegisterInOpCode(instruction, variation) && (destination & ~OperandFlags::AnyImplicitAkkuGpr) != OperandFlags::None;
+			encoding.RequiresRex = Is64BitOrLarger(operandSize) || IsExtendedRegister(reg) || IsUniformByteRegister(reg);
+			encoding.Length = static_cast<std::uint8_t>(
+				(operandSize == WordSize::Word)
+				+ encoding.RequiresRex
+				+ RequiresTwoByteOpCode(instruction, variation)
+				+ 1
+				+ encoding.HasModRm
+				+ static_cast<std::uint8_t>(immediateSize));
+			return encoding;
+		}
+		return std::nullopt;
+	}
+
+	/// <summary>
+	/// Enumerates all variations accepting the operands and selects the shortest encoding.
+	/// Ties are resolved in favor of the smaller immediate (as GNU as does), then the variation listed first in the OperandTable.
+	/// This is the reference scan from which the ImmediateEncodingIndex is generated, it does not apply the 32-bit move alias.
+	/// </summary>
+	/// <returns>The shortest encoding or std::nullopt if no variation accepts the operands.</returns>
+	[[nodiscard]] constexpr auto ScanImmediateEncoding(const Instruction instruction, const Register reg, const Immediate& immediate) noexcept -> std::optional<ImmediateEncoding>
+	{
+		std::optional<ImmediateEncoding> best = std::nullopt;
+		const auto variations = OperandTable[static_cast<std::size_t>(instruction)].size();
+		for (std::size_t variation = 0; variation < variations; ++variation)
+		{
+			const auto encoding = ComputeImmediateEncoding(instruction, variation, reg, immediate);
+			if (!encoding)
+			{
+				continue;
+			}
+			if (!best || encoding->Length < best->Length || (encoding->Length == best->Length && encoding->ImmediateSize < best->ImmediateSize))
+			{
+				best = encoding;
+			}
+		}
+		return best;
+	}
+
+	/// <summary>
+	/// Register classes are the operand size combined with the register kind, because only these affect the encoding.
+	/// </summary>
+	enum class ImmediateRegisterKind : std::uint8_t
+	{
+		General,
+		Accumulator,
+		Extended,
+		UniformByte,
+		Count
+	};
+
+	constexpr std::size_t ImmediateRegisterClassCount = 4 * static_cast<std::size_t>(ImmediateRegisterKind::Count) + 1;
+
+	/// <summary>
+	/// The class of registers which are no general purpose registers and never accept an immediate.
+	/// </summary>
+	constexpr std::uint8_t NoImmediateRegisterClass = ImmediateRegisterClassCount - 1;
+
+	/// <summary>
+	/// The immediate fit classes: imm8s, imm16s, imm32s, imm32u (only reachable for 64-bit operands) and imm64.
+	/// </summary>
+	constexpr std::size_t ImmediateFitClassCount = 5;
+
+	/// <summary>
+	/// Computes the register class used as index into the ImmediateEncodingIndex.
+	/// </summary>
+	[[nodiscard]] constexpr auto ComputeImmediateRegisterClass(const Register reg) noexcept -> std::uint8_t
+	{
+		std::size_t size = 0;
+		switch (LookupRegisterSize(reg))
+		{
+			case WordSize::HWord: size = 0; break;
+			case WordSize::Word: size = 1; break;
+			case WordSize::DWord: size = 2; break;
+			case WordSize::QWord: size = 3; break;
+			default: return NoImmediateRegisterClass;
+		}
+		ImmediateRegisterKind kind = ImmediateRegisterKind::General;
+		if (IsAccumulator(reg))
+		{
+			kind = ImmediateRegisterKind::Accumulator;
+		}
+		else if (IsExtendedRegister(reg))
+		{
+			kind = ImmediateRegisterKind::Extended;
+		}
+		else if (IsUniformByteRegister(reg))
+		{
+			kind = ImmediateRegisterKind::UniformByte;
+		}
+		return static_cast<std::uint8_t>(size * static_cast<std::size_t>(ImmediateRegisterKind::Count) + static_cast<std::size_t>(kind));
+	}
+
+	/// <summary>
+	/// Contains the register class of all registers.
+	/// </summary>
+	constexpr std::array<std::uint8_t, static_cast<std::size_t>(Register::Count)> ImmediateRegisterClassTable = []() consteval
+	{
+		std::array<std::uint8_t, static_cast<std::size_t>(Register::Count)> table = {};
+		for (std::size_t i = 0; i < table.size(); ++i)
+		{
+			table[i] = ComputeImmediateRegisterClass(static_cast<Register>(i));
+		}
+		return table;
+	}();
+
+	/// <summary>
+	/// Computes the fit class of an immediate, which must fit the operand size.
+	/// </summary>
+	[[nodiscard]] constexpr auto ComputeImmediateFitClass(const Immediate& immediate, const WordSize operandSize) noexcept -> std::size_t
+	{
+		const auto value = SignExtendToOperand(immediate, operandSize);
+		if (value >= std::numeric_limits<std::int8_t>::min() && value <= std::numeric_limits<std::int8_t>::max())
+		{
+			return 0;
+		}
+		if (value >= std::numeric_limits<std::int16_t>::min() && value <= std::numeric_limits<std::int16_t>::max())
+		{
+			return 1;
+		}
+		if (value >= std::numeric_limits<std::int32_t>::min() && value <= std::numeric_limits<std::int32_t>::max())
+		{
+			return 2;
+		}
+		if (value >= 0 && value <= std::int64_t{std::numeric_limits<std::uint32_t>::max()})
+		{
+			return 3;
+		}
+		return 4;
+	}
+
+	/// <summary>
+	/// The precomputed winner of ScanImmediateEncoding() for one instruction, register class and fit class.
+	/// </summary>
+	struct ImmediateEncodingSlot final
+	{
+		std::uint8_t Variation = NoVariation;
+		WordSize ImmediateSize = WordSize::HWord;
+		bool HasModRm = false;
+		bool RequiresRex = false;
+		std::uint8_t Length = 0;
+	};
+
+	using ImmediateEncodingSlots = std::array<std::array<ImmediateEncodingSlot, ImmediateFitClassCount>, ImmediateRegisterClassCount>;
+
+	/// <summary>
+	/// Precomputed result of ScanImmediateEncoding() for every instruction, register class and immediate fit class.
+	/// Generated at compile time from the first register of each class and one representative immediate per fit class,
+	/// so the selection is a single load instead of a variation scan.
+	/// </summary>
+	constexpr std::array<ImmediateEncodingSlots, static_cast<std::size_t>(Instruction::Count)> ImmediateEncodingIndex = []() consteval
+	{
+		constexpr std::array<std::uint64_t, ImmediateFitClassCount> representatives = {0x1, 0x100, 0x1'0000, 0x8000'0000, 0x1'0000'0000};
+		std::array<ImmediateEncodingSlots, static_cast<std::size_t>(Instruction::Count)> index = {};
+		for (auto& slots : index)
+		{
+			for (auto& fits : slots)
+			{
+				fits.fill(ImmediateEncodingSlot{});
+			}
+		}
+		std::array<bool, ImmediateRegisterClassCount> seen = {};
+		for (std::size_t i = 0; i < static_cast<std::size_t>(Register::Count); ++i)
+		{
+			const auto reg = static_cast<Register>(i);
+			const auto registerClass = ImmediateRegisterClassTable[i];
+			if (registerClass == NoImmediateRegisterClass || seen[registerClass])
+			{
+				continue;
+			}
+			seen[registerClass] = true;
+			const WordSize operandSize = LookupRegisterSize(reg);
+			for (std::size_t fit = 0; fit < ImmediateFitClassCount; ++fit)
+			{
+				const Immediate immediate(representatives[fit]);
+				if (!FitsOperandSize(immediate, operandSize) || ComputeImmediateFitClass(immediate, operandSize) != fit)
+				{
+					continue;
+				}
+				for (std::size_t instr = 0; instr < index.size(); ++instr)
+				{
+					const auto encoding = ScanImmediateEncoding(static_cast<Instruction>(instr), reg, immediate);
+					if (!encoding)
+					{
+						continue;
+					}
+					ImmediateEncodingSlot& slot = index[instr][registerClass][fit];
+					slot.Variation = static_cast<std::uint8_t>(encoding->Variation);
+					slot.ImmediateSize = encoding->ImmediateSize;
+					slot.HasModRm = encoding->HasModRm;
+					slot.RequiresRex = encoding->RequiresRex;
+					slot.Length = encoding->Length;
+				}
+			}
+		}
+		return index;
+	}();
+
+	/// <summary>
+	/// Selects the shortest encoding through the precomputed ImmediateEncodingIndex.
+	/// Ties are resolved in favor of the smaller immediate (as GNU as does), then the variation listed first in the OperandTable.
+	/// 64-bit moves of values without the upper 32 bits set are encoded as 32-bit moves, which zero extend and need no REX.W.
+	/// </summary>
+	/// <param name="instruction">The instruction.</param>
+	/// <param name="reg">The destination register.</param>
+	/// <param name="immediate">The immediate, negative values are stored as two's complement.</param>
+	/// <returns>The shortest encoding or the diagnostic.</returns>
+	[[nodiscard]] constexpr auto TrySelectImmediateEncoding(const Instruction instruction, Register reg, const Immediate& immediate) noexcept -> Result<ImmediateEncoding>
+	{
+		if (reg >= Register::Count) [[unlikely]]
+		{
+			return Fail(ErrorCode::InvalidRegister, 0, static_cast<std::uint64_t>(reg));
+		}
+		if (!FitsOperandSize(immediate, LookupRegisterSize(reg))) [[unlikely]]
+		{
+			return Fail(ErrorCode::ImmediateTooLarge, 1, immediate.UValue);
+		}
+
+		if (instruction == Instruction::Mov && immediate.UValue <= std::numeric_limits<std::uint32_t>::max())
+		{
+			reg = LookupDWordAlias(reg).value_or(reg);
+		}
+
+		const WordSize operandSize = LookupRegisterSize(reg);
+		const auto registerClass = ImmediateRegisterClassTable[static_cast<std::size_t>(reg)];
+		const auto& slot = ImmediateEncodingIndex[static_cast<std::size_t>(instruction)][registerClass][ComputeImmediateFitClass(immediate, operandSize)];
+		if (slot.Variation == NoVariation) [[unlikely]]
+		{
+			return Fail(ErrorCode::NoMatchingVariation);
+		}
+
+		ImmediateEncoding encoding = {};
+		encoding.Variation = slot.Variation;
+		encoding.Reg = reg;
+		encoding.OperandSize = operandSize;
+		encoding.ImmediateSize = slot.ImmediateSize;
+		encoding.HasModRm = slot.HasModRm;
+		encoding.RequiresRex = slot.RequiresRex;
+		encoding.Length = slot.Length;
+		return encoding;
+	}
+
+	/// <summary>
+	/// Selects the shortest encoding, see TrySelectImmediateEncoding().
+	/// Throws if the immediate does not fit the register.
+	/// </summary>
+	/// <returns>The shortest encoding or std::nullopt if no variation accepts the operands.</returns>
+	[[nodiscard]] constexpr auto SelectImmediateEncoding(const Instruction instruction, const Register reg, const Immediate& immediate) -> std::optional<ImmediateEncoding>
+	{
+		const auto result = TrySelectImmediateEncoding(instruction, reg, immediate);
+		if (!result && result.Error().Code == ErrorCode::NoMatchingVariation)
+		{
+			return std::nullopt;
+		}
+		return result.ValueOrThrow();
+	}
+}
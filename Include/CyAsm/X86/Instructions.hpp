@@ -8,9 +8,12 @@
 #include <stdexcept>
 
 #include "../MachineLanguage.hpp"
+#include "../PerfectHash.hpp"
+#include "../Result.hpp"
 #include "MachineLanguage.hpp"
 #include "OperandFlags.hpp"
 #include "Mapper.hpp"
+#include "Syntax.h"
 
 namespace CyberAsm::X86
 {
@@ -18,6 +21,28 @@ namespace CyberAsm::X86
 	{
 		Adc,
 		Add,
+		Jmp,
+		Call,
+		Jo,
+		Jno,
+		Jb,
+		Jae,
+		Je,
+		Jne,
+		Jbe,
+		Ja,
+		Js,
+		Jns,
+		Jp,
+		Jnp,
+		Jl,
+		Jge,
+		Jle,
+		Jg,
+		Mov,
+		Xor,
+		Inc,
+		Lea,
 
 		Count
 	};
@@ -38,6 +63,7 @@ namespace CyberAsm::X86
 	/// <summary>
 	/// Contains op code extensions and two byte escapes.
 	/// FF = no extension
+	/// FE = the register id is added to the op code (+r), there is no mod/rm byte
 	/// 0F = requires to byte op code escape
 	/// * = the extension between 0-7 (3 bits for mod/rm byte)
 	/// </summary>
@@ -64,7 +90,12 @@ namespace CyberAsm::X86
 	constexpr auto RequiresOpCodeExtension(const Instruction instr, const std::size_t variation) -> bool
 	{
 		const auto val = MachineCodeExtensionTable[static_cast<std::size_t>(instr)][variation];
-		return val != TwoByteOpCodePrefix && variation != 0xFF;
+		return val != TwoByteOpCodePrefix && val != NoOpCodeExtension && val != RegisterInOpCode;
+	}
+
+	constexpr auto IsRegisterInOpCode(const Instruction instr, const std::size_t variation) -> bool
+	{
+		return MachineCodeExtensionTable[static_cast<std::size_t>(instr)][variation] == RegisterInOpCode;
 	}
 
 	constexpr auto LookupOpCodeExtension(const Instruction instr, const std::size_t variation) -> std::optional<std::uint8_t>
@@ -72,7 +103,13 @@ namespace CyberAsm::X86
 		return RequiresOpCodeExtension(instr, variation) ? MachineCodeExtensionTable[static_cast<std::size_t>(instr)][variation] : 0;
 	}
 
-	[[nodiscard]] constexpr auto LookupOptimalInstructionVariation(const Instruction instr, const std::span<const OperandFlags::Flags> operands) -> std::optional<std::size_t>
+	/// <summary>
+	/// Scans the OperandTable for the first variation accepting the operands.
+	/// </summary>
+	/// <param name="instr">The instruction.</param>
+	/// <param name="operands">The operand flags in Intel order.</param>
+	/// <returns>The variation or the diagnostic.</returns>
+	[[nodiscard]] constexpr auto TryLookupOptimalInstructionVariation(const Instruction instr, const std::span<const OperandFlags::Flags> operands) noexcept -> Result<std::size_t>
 	{
 		// @formatter:off
 		const auto index = static_cast<std::size_t>(instr);
@@ -96,7 +133,7 @@ namespace CyberAsm::X86
 						[[unlikely]] case OperandFlags::Reg16Ax:  requested |= OperandFlags::Reg16; break;
 						[[likely]]	 case OperandFlags::Reg32Eax: requested |= OperandFlags::Reg32; break;
 						[[likely]]	 case OperandFlags::Reg64Rax: requested |= OperandFlags::Reg64; break;
-						[[unlikely]] default: throw std::runtime_error("Invalid implicit GPR! Must be 'al', 'ax', 'eax' or 'rax'!");
+						[[unlikely]] default: return Fail(ErrorCode::InvalidImplicitRegister, static_cast<std::uint8_t>(j), requested);
 					}
 				}
 				const auto required = *(variation.begin() + j);
@@ -107,10 +144,20 @@ namespace CyberAsm::X86
 				return i;
 			}
 		}
-		return std::nullopt;
+		return Fail(ErrorCode::NoMatchingVariation);
 		// @formatter:on
 	}
 
+	[[nodiscard]] constexpr auto LookupOptimalInstructionVariation(const Instruction instr, const std::span<const OperandFlags::Flags> operands) -> std::optional<std::size_t>
+	{
+		const auto result = TryLookupOptimalInstructionVariation(instr, operands);
+		if (!result && result.Error().Code == ErrorCode::NoMatchingVariation)
+		{
+			return std::nullopt;
+		}
+		return result.ValueOrThrow();
+	}
+
 	template <OperandFlags::Flags... F>
 	[[nodiscard]] constexpr auto LookupOptimalInstructionVariation(const Instruction instr) -> std::optional<std::size_t>
 	{
@@ -118,11 +165,207 @@ namespace CyberAsm::X86
 		return LookupOptimalInstructionVariation(instr, collection);
 	}
 
+	/// <summary>
+	/// Maximum number of operands covered by the variation index.
+	/// </summary>
+	constexpr std::size_t MaxIndexedOperands = 2;
+
+	/// <summary>
+	/// Number of index slots per instruction, one for each tuple of canonical operand kinds.
+	/// </summary>
+	constexpr std::size_t VariationIndexSlots = OperandFlags::KindCount * OperandFlags::KindCount;
+
+	/// <summary>
+	/// Marks an index slot without a matching variation.
+	/// </summary>
+	constexpr std::uint8_t NoVariation = 0xFF;
+
+	/// <summary>
+	/// Computes the variation index slot of a canonical operand kind tuple.
+	/// Missing operands use kind 0.
+	/// </summary>
+	[[nodiscard]] constexpr auto ComputeVariationIndexSlot(const std::size_t kind0, const std::size_t kind1) noexcept -> std::size_t
+	{
+		return kind0 * OperandFlags::KindCount + kind1;
+	}
+
+	/// <summary>
+	/// Precomputed result of LookupOptimalInstructionVariation for every instruction and canonical operand kind tuple.
+	/// Generated at compile time from the OperandTable, so a lookup is a single load instead of a table scan.
+	/// </summary>
+	constexpr std::array<std::array<std::uint8_t, VariationIndexSlots>, static_cast<std::size_t>(Instruction::Count)> VariationIndex = []() consteval
+	{
+		std::array<std::array<std::uint8_t, VariationIndexSlots>, static_cast<std::size_t>(Instruction::Count)> index = {};
+		for (std::size_t instr = 0; instr < index.size(); ++instr)
+		{
+			index[instr].fill(NoVariation);
+			for (std::size_t kind0 = 0; kind0 < OperandFlags::KindCount; ++kind0)
+			{
+				for (std::size_t kind1 = 0; kind1 < OperandFlags::KindCount; ++kind1)
+				{
+					// Missing operands are only allowed at the end:
+					if (kind0 == 0 && kind1 != 0)
+					{
+						continue;
+					}
+					std::array<OperandFlags::Flags, MaxIndexedOperands> operands = {};
+					std::size_t count = 0;
+					if (kind0 != 0)
+					{
+						operands[count++] = OperandFlags::Flags{1} << kind0;
+					}
+					if (kind1 != 0)
+					{
+						operands[count++] = OperandFlags::Flags{1} << kind1;
+					}
+					const auto variation = TryLookupOptimalInstructionVariation(static_cast<Instruction>(instr), std::span<const OperandFlags::Flags>(operands.data(), count));
+					if (variation)
+					{
+						index[instr][ComputeVariationIndexSlot(kind0, kind1)] = static_cast<std::uint8_t>(*variation);
+					}
+				}
+			}
+		}
+		return index;
+	}();
+
+	/// <summary>
+	/// Looks up the instruction variation through the precomputed VariationIndex.
+	/// Falls back to the linear scan for operand flags which are not canonical (more than one bit set) or too many operands.
+	/// </summary>
+	/// <param name="instr">The instruction.</param>
+	/// <param name="operands">The operand flags in Intel order.</param>
+	/// <returns>The variation or the diagnostic.</returns>
+	[[nodiscard]] constexpr auto TryLookupInstructionVariation(const Instruction instr, const std::span<const OperandFlags::Flags> operands) noexcept -> Result<std::size_t>
+	{
+		const OperandFlags::Flags first = operands.size() > 0 ? operands[0] : OperandFlags::None;
+		const OperandFlags::Flags second = operands.size() > 1 ? operands[1] : OperandFlags::None;
+		if (operands.size() > MaxIndexedOperands || !OperandFlags::IsCanonical(first) || !OperandFlags::IsCanonical(second)) [[unlikely]]
+		{
+			return TryLookupOptimalInstructionVariation(instr, operands);
+		}
+		const auto slot = ComputeVariationIndexSlot(OperandFlags::CanonicalKind(first), OperandFlags::CanonicalKind(second));
+		const auto variation = VariationIndex[static_cast<std::size_t>(instr)][slot];
+		if (variation == NoVariation) [[unlikely]]
+		{
+			return Fail(ErrorCode::NoMatchingVariation);
+		}
+		return std::size_t{variation};
+	}
+
+	/// <summary>
+	/// Looks up the instruction variation, see TryLookupInstructionVariation().
+	/// </summary>
+	/// <returns>The variation or std::nullopt if no variation matches.</returns>
+	[[nodiscard]] constexpr auto LookupInstructionVariation(const Instruction instr, const std::span<const OperandFlags::Flags> operands) -> std::optional<std::size_t>
+	{
+		const auto result = TryLookupInstructionVariation(instr, operands);
+		if (!result && result.Error().Code == ErrorCode::NoMatchingVariation)
+		{
+			return std::nullopt;
+		}
+		return result.ValueOrThrow();
+	}
+
+	/// <summary>
+	/// Maps the operands to their flags and looks up the instruction variation.
+	/// </summary>
+	template <typename... Ts>
+	[[nodiscard]] constexpr auto TryAutoLookupInstruction(const Instruction instr, const Ts&... args) noexcept -> Result<std::size_t>
+	{
+		std::array<OperandFlags::Flags, sizeof...(Ts)> collection = {};
+		std::size_t i = 0;
+		Diagnostic error = {};
+		const auto map = [&](const auto& arg)
+		{
+			const auto flags = Mapper::TryMapFlags(arg);
+			if (!flags && error.Code == ErrorCode::None) [[unlikely]]
+			{
+				error = flags.Error();
+				error.OperandIndex = static_cast<std::uint8_t>(i);
+			}
+			collection[i++] = flags.ValueOr(OperandFlags::None);
+		};
+		(map(args), ...);
+		if (error.Code != ErrorCode::None) [[unlikely]]
+		{
+			return error;
+		}
+		return TryLookupInstructionVariation(instr, collection);
+	}
+
 	template <typename... Ts>
 	[[nodiscard]] constexpr auto AutoLookupInstruction(const Instruction instr, Ts&&... args) -> std::optional<std::size_t>
 	{
-		const std::initializer_list<const OperandFlags::Flags> collection{Mapper::MapFlags(args)...};
-		return LookupOptimalInstructionVariation(instr, collection);
+		const auto result = TryAutoLookupInstruction(instr, args...);
+		if (!result && result.Error().Code == ErrorCode::NoMatchingVariation)
+		{
+			return std::nullopt;
+		}
+		return result.ValueOrThrow();
+	}
+
+	/// <summary>
+	/// The result of a mnemonic lookup.
+	/// </summary>
+	struct MnemonicLookupResult final
+	{
+		Instruction Instr = Instruction::Count;
+
+		/// <summary>
+		/// The operand size requested by an AT&T suffix such as 'adcq', if any.
+		/// </summary>
+		std::optional<WordSize> SizeSuffix = std::nullopt;
+	};
+
+	/// <summary>
+	/// Maps an AT&T size suffix character to the operand size.
+	/// </summary>
+	/// <param name="suffix">The suffix character (b, w, l or q).</param>
+	/// <returns>The operand size or std::nullopt if the character is no size suffix.</returns>
+	[[nodiscard]] constexpr auto MapSizeSuffix(const char suffix) noexcept -> std::optional<WordSize>
+	{
+		switch (suffix)
+		{
+			case X64::ByteSuffix: return WordSize::HWord;
+			case X64::WordSuffix: return WordSize::Word;
+			case X64::LongSuffix: return WordSize::DWord;
+			case X64::QuadSuffix: return WordSize::QWord;
+			default: return std::nullopt;
+		}
+	}
+
+	/// <summary>
+	/// Compile time perfect hash over all instruction mnemonics.
+	/// </summary>
+	constexpr PerfectHashTable<MnemonicTable.size()> MnemonicHashTable(MnemonicTable);
+
+	/// <summary>
+	/// Looks up an instruction by its case insensitive mnemonic in constant time.
+	/// If the mnemonic is unknown, the last character is treated as an AT&T size suffix and the lookup is retried.
+	/// </summary>
+	/// <param name="mnemonic">The mnemonic, for example 'adc', 'adcq' or 'ADCQ'.</param>
+	/// <returns>The instruction and the optional size suffix or std::nullopt if the mnemonic is unknown.</returns>
+	[[nodiscard]] constexpr auto LookupMnemonic(const std::string_view mnemonic) noexcept -> std::optional<MnemonicLookupResult>
+	{
+		if (const auto index = MnemonicHashTable.Find(mnemonic)) [[likely]]
+		{
+			return MnemonicLookupResult{static_cast<Instruction>(*index), std::nullopt};
+		}
+		if (mnemonic.size() < 2) [[unlikely]]
+		{
+			return std::nullopt;
+		}
+		const auto suffix = MapSizeSuffix(FoldCase(mnemonic.back()));
+		if (!suffix) [[unlikely]]
+		{
+			return std::nullopt;
+		}
+		if (const auto index = MnemonicHashTable.Find(mnemonic.substr(0, mnemonic.size() - 1))) [[likely]]
+		{
+			return MnemonicLookupResult{static_cast<Instruction>(*index), suffix};
+		}
+		return std::nullopt;
 	}
 
 	consteval auto ValidateTables() noexcept -> bool
@@ -133,6 +376,12 @@ namespace CyberAsm::X86
 			{
 				return false;
 			}
+
+			// The variation index stores variations as bytes:
+			if (OperandTable[i].size() >= NoVariation) [[unlikely]]
+			{
+				return false;
+			}
 		}
 		return true;
 	}
@@ -0,0 +1,194 @@
+#pragma once
+
+#include <cstdint>
+#include <array>
+#include <string_view>
+
+#include "Syntax.h"
+
+namespace CyberAsm::X86
+{
+	enum class TokenKind : std::uint8_t
+	{
+		EndOfFile,
+		NewLine,
+		Identifier,
+		Register,
+		Immediate,
+		Number,
+		Separator,
+		LabelTerminator,
+		AbsoluteJump,
+		Invalid
+	};
+
+	/// <summary>
+	/// A single token.
+	/// The lexeme is a slice of the source buffer, so no memory is allocated per token.
+	/// Prefixes such as '%' and '$' are not part of the lexeme.
+	/// </summary>
+	struct Token final
+	{
+		TokenKind Kind = TokenKind::EndOfFile;
+		std::string_view Lexeme = {};
+	};
+
+	/// <summary>
+	/// Character classes used by the lexer.
+	/// </summary>
+	struct CharClass final
+	{
+		enum Enum : std::uint8_t
+		{
+			None = 0,
+			Whitespace = 1 << 0,
+			NewLine = 1 << 1,
+			IdentifierStart = 1 << 2,
+			IdentifierBody = 1 << 3,
+			NumberStart = 1 << 4
+		};
+	};
+
+	/// <summary>
+	/// Maps every byte to its CharClass bits, so classifying a character is a single load.
+	/// </summary>
+	constexpr std::array<std::uint8_t, 256> CharClassTable = []() consteval
+	{
+		std::array<std::uint8_t, 256> table = {};
+		table[' '] = table['\t'] = table['\r'] = table['\v'] = table['\f'] = CharClass::Whitespace;
+		table['\n'] = CharClass::NewLine;
+		for (auto c = 'a'; c <= 'z'; ++c)
+		{
+			table[static_cast<std::uint8_t>(c)] = CharClass::IdentifierStart | CharClass::IdentifierBody;
+		}
+		for (auto c = 'A'; c <= 'Z'; ++c)
+		{
+			table[static_cast<std::uint8_t>(c)] = CharClass::IdentifierStart | CharClass::IdentifierBody;
+		}
+		for (auto c = '0'; c <= '9'; ++c)
+		{
+			table[static_cast<std::uint8_t>(c)] = CharClass::NumberStart | CharClass::IdentifierBody;
+		}
+		table['_'] = table['.'] = CharClass::IdentifierStart | CharClass::IdentifierBody;
+		table[static_cast<std::uint8_t>(X64::NegativeSign)] = CharClass::NumberStart;
+		return table;
+	}();
+
+	[[nodiscard]] constexpr auto IsCharClass(const char c, const std::uint8_t mask) noexcept -> bool
+	{
+		return (CharClassTable[static_cast<std::uint8_t>(c)] & mask) != 0;
+	}
+
+	/// <summary>
+	/// Zero-copy AT&T lexer.
+	/// Walks the source buffer with a raw cursor and yields string_view slices of it.
+	/// Comments are skipped, new lines are reported as tokens because they terminate statements.
+	/// </summary>
+	class Lexer final
+	{
+	public:
+		explicit constexpr Lexer(std::string_view source) noexcept;
+
+		[[nodiscard]] constexpr auto Next() noexcept -> Token;
+		[[nodiscard]] constexpr auto Offset() const noexcept -> std::size_t;
+		[[nodiscard]] constexpr auto Source() const noexcept -> std::string_view;
+
+	private:
+		[[nodiscard]] constexpr auto ScanWhile(const char* from, std::uint8_t mask) const noexcept -> const char*;
+
+		const char* begin;
+		const char* cursor;
+		const char* end;
+	};
+
+	constexpr Lexer::Lexer(const std::string_view source) noexcept : begin(source.data()), cursor(source.data()), end(source.data() + source.size()) { }
+
+	constexpr auto Lexer::ScanWhile(const char* from, const std::uint8_t mask) const noexcept -> const char*
+	{
+		while (from != this->end && IsCharClass(*from, mask)) [[likely]]
+		{
+			++from;
+		}
+		return from;
+	}
+
+	constexpr auto Lexer::Next() noexcept -> Token
+	{
+		this->cursor = this->ScanWhile(this->cursor, CharClass::Whitespace);
+		if (this->cursor == this->end) [[unlikely]]
+		{
+			return {TokenKind::EndOfFile, {}};
+		}
+
+		const char* const first = this->cursor;
+		constexpr auto slice = [](const char* const from, const char* const to) noexcept -> std::string_view
+		{
+			return {from, static_cast<std::size_t>(to - from)};
+		};
+
+		switch (*first)
+		{
+			case '\n':
+				++this->cursor;
+				return {TokenKind::NewLine, slice(first, this->cursor)};
+
+			case X64::Comment:
+				while (this->cursor != this->end && *this->cursor != '\n')
+				{
+					++this->cursor;
+				}
+				return this->Next();
+
+			case X64::Separator:
+				++this->cursor;
+				return {TokenKind::Separator, slice(first, this->cursor)};
+
+			case X64::LabelTerminator:
+				++this->cursor;
+				return {TokenKind::LabelTerminator, slice(first, this->cursor)};
+
+			case X64::AbsoluteJumpPrefix:
+				++this->cursor;
+				return {TokenKind::AbsoluteJump, slice(first, this->cursor)};
+
+			case X64::RegisterPrefix:
+				this->cursor = this->ScanWhile(first + 1, CharClass::IdentifierBody);
+				return {TokenKind::Register, slice(first + 1, this->cursor)};
+
+			case X64::ImmediatePrefix:
+			{
+				const char* from = first + 1;
+				if (from != this->end && *from == X64::NegativeSign)
+				{
+					++from;
+				}
+				this->cursor = this->ScanWhile(from, CharClass::IdentifierBody);
+				return {TokenKind::Immediate, slice(first + 1, this->cursor)};
+			}
+
+			default:
+				if (IsCharClass(*first, CharClass::IdentifierStart)) [[likely]]
+				{
+					this->cursor = this->ScanWhile(first + 1, CharClass::IdentifierBody);
+					return {TokenKind::Identifier, slice(first, this->cursor)};
+				}
+				if (IsCharClass(*first, CharClass::NumberStart))
+				{
+					this->cursor = this->ScanWhile(first + 1, CharClass::IdentifierBody);
+					return {TokenKind::Number, slice(first, this->cursor)};
+				}
+				++this->cursor;
+				return {TokenKind::Invalid, slice(first, this->cursor)};
+		}
+	}
+
+	constexpr auto Lexer::Offset() const noexcept -> std::size_t
+	{
+		return static_cast<std::size_t>(this->cursor - this->begin);
+	}
+
+	constexpr auto Lexer::Source() const noexcept -> std::string_view
+	{
+		return {this->begin, static_cast<std::size_t>(this->end - this->begin)};
+	}
+}
@@ -1,2 +1,24 @@
 u8"\xFF\xFF\xFF\xFF\xFF\xFF\x02\x02\x02"_mach, // adc
 u8"\xFF\xFF\xFF\xFF\xFF\xFF\x00\x00\x00"_mach, // add
+u8"\xFF\xFF"_mach, // jmp
+u8"\xFF"_mach, // call
+u8"\xFF\x0F"_mach, // jo
+u8"\xFF\x0F"_mach, // jno
+u8"\xFF\x0F"_mach, // jb
+u8"\xFF\x0F"_mach, // jae
+u8"\xFF\x0F"_mach, // je
+u8"\xFF\x0F"_mach, // jne
+u8"\xFF\x0F"_mach, // jbe
+u8"\xFF\x0F"_mach, // ja
+u8"\xFF\x0F"_mach, // js
+u8"\xFF\x0F"_mach, // jns
+u8"\xFF\x0F"_mach, // jp
+u8"\xFF\x0F"_mach, // jnp
+u8"\xFF\x0F"_mach, // jl
+u8"\xFF\x0F"_mach, // jge
+u8"\xFF\x0F"_mach, // jle
+u8"\xFF\x0F"_mach, // jg
+u8"\xFF\xFF\xFF\xFF\xFE\xFE\xFE\x00\x00"_mach, // mov
+u8"\xFF\xFF\xFF\xFF\xFF\xFF\x06\x06\x06"_mach, // xor
+u8"\x00\x00"_mach, // inc
+u8"\xFF"_mach, // lea
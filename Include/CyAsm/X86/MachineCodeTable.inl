@@ -1,2 +1,24 @@
 u8"\x10\x11\x12\x13\x14\x15\x80\x81\x83"_mach, // adc
 u8"\x00\x01\x02\x03\x04\x05\x80\x81\x83"_mach, // add
+u8"\xEB\xE9"_mach, // jmp
+u8"\xE8"_mach, // call
+u8"\x70\x80"_mach, // jo
+u8"\x71\x81"_mach, // jno
+u8"\x72\x82"_mach, // jb
+u8"\x73\x83"_mach, // jae
+u8"\x74\x84"_mach, // je
+u8"\x75\x85"_mach, // jne
+u8"\x76\x86"_mach, // jbe
+u8"\x77\x87"_mach, // ja
+u8"\x78\x88"_mach, // js
+u8"\x79\x89"_mach, // jns
+u8"\x7A\x8A"_mach, // jp
+u8"\x7B\x8B"_mach, // jnp
+u8"\x7C\x8C"_mach, // jl
+u8"\x7D\x8D"_mach, // jge
+u8"\x7E\x8E"_mach, // jle
+u8"\x7F\x8F"_mach, // jg
+u8"\x88\x89\x8A\x8B\xB0\xB8\xB8\xC6\xC7"_mach, // mov
+u8"\x30\x31\x32\x33\x34\x35\x80\x81\x83"_mach, // xor
+u8"\xFE\xFF"_mach, // inc
+u8"\x8D"_mach, // lea
@@ -29,6 +29,8 @@ namespace CyberAsm::X86
 	constexpr std::uint8_t SibScaleFactor2						= 0b0000'0001;
 	constexpr std::uint8_t SibScaleFactor4						= 0b0000'0010;
 	constexpr std::uint8_t SibScaleFactor8						= 0b0000'0011;
+	constexpr std::uint8_t NoOpCodeExtension					= 0xFF;
+	constexpr std::uint8_t RegisterInOpCode						= 0xFE;
 
 	// @formatter:on
 
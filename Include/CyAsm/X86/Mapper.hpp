@@ -1,40 +1,37 @@
 #pragma once
 
-#include <stdexcept>
-
 #include "../Immediate.hpp"
 #include "../MachineLanguage.hpp"
+#include "../Result.hpp"
 #include "OperandFlags.hpp"
 #include "Registers.hpp"
 
 namespace CyberAsm::X86::Mapper
 {
-	constexpr auto MapFlags(const Immediate& imm) -> OperandFlags::Flags
+	[[nodiscard]] constexpr auto TryMapFlags(const WordSize immSize) noexcept -> Result<OperandFlags::Flags>
 	{
-		switch (ComputeRequiredBytes(imm.UValue))
+		switch (immSize)
 		{
 				[[unlikely]] case WordSize::HWord: return OperandFlags::Imm8;
 				[[unlikely]] case WordSize::Word: return OperandFlags::Imm16;
 				[[likely]] case WordSize::DWord: return OperandFlags::Imm32;
 				[[likely]] case WordSize::QWord: return OperandFlags::Imm64;
-				[[unlikely]] default: throw std::runtime_error("not implemented");
+				[[unlikely]] default: return Fail(ErrorCode::UnsupportedOperands, Diagnostic::NoOperand, static_cast<std::uint64_t>(immSize));
 		}
 	}
 
-	constexpr auto MapFlags(const WordSize immSize) -> OperandFlags::Flags
+	[[nodiscard]] constexpr auto TryMapFlags(const Immediate& imm) noexcept -> Result<OperandFlags::Flags>
 	{
-		switch (immSize)
-		{
-				[[unlikely]] case WordSize::HWord: return OperandFlags::Imm8;
-				[[unlikely]] case WordSize::Word: return OperandFlags::Imm16;
-				[[likely]] case WordSize::DWord: return OperandFlags::Imm32;
-				[[likely]] case WordSize::QWord: return OperandFlags::Imm64;
-				[[unlikely]] default: throw std::runtime_error("not implemented");
-		}
+		return TryMapFlags(ComputeRequiredBytes(imm.UValue));
 	}
 
-	constexpr auto MapFlags(const Register register_) -> OperandFlags::Flags
+	[[nodiscard]] constexpr auto TryMapFlags(const Register register_) noexcept -> Result<OperandFlags::Flags>
 	{
+		if (register_ >= Register::Count) [[unlikely]]
+		{
+			return Fail(ErrorCode::InvalidRegister, Diagnostic::NoOperand, static_cast<std::uint64_t>(register_));
+		}
+
 		// @formatter:off
 		// Check if register is accumulator:
 		if(IsAccumulator(register_)) [[unlikely]]
@@ -45,7 +42,7 @@ namespace CyberAsm::X86::Mapper
 				[[unlikely]] case WordSize::Word:  return OperandFlags::Reg16Ax;
 				[[likely]]	 case WordSize::DWord: return OperandFlags::Reg32Eax;
 				[[likely]]   case WordSize::QWord: return OperandFlags::Reg64Rax;
-				[[unlikely]] default: throw std::runtime_error("not implemented");
+				[[unlikely]] default: break;
 			}
 		}
 
@@ -56,8 +53,23 @@ namespace CyberAsm::X86::Mapper
 				[[unlikely]] case WordSize::Word:  return OperandFlags::Reg16;
 				[[likely]]   case WordSize::DWord: return OperandFlags::Reg32;
 				[[likely]]   case WordSize::QWord: return OperandFlags::Reg64;
-				[[unlikely]] default: throw std::runtime_error("not implemented");
+				[[unlikely]] default: return Fail(ErrorCode::UnsupportedRegister, Diagnostic::NoOperand, static_cast<std::uint64_t>(register_));
 		}
 		// @formatter:on
 	}
+
+	constexpr auto MapFlags(const Immediate& imm) -> OperandFlags::Flags
+	{
+		return TryMapFlags(imm).ValueOrThrow();
+	}
+
+	constexpr auto MapFlags(const WordSize immSize) -> OperandFlags::Flags
+	{
+		return TryMapFlags(immSize).ValueOrThrow();
+	}
+
+	constexpr auto MapFlags(const Register register_) -> OperandFlags::Flags
+	{
+		return TryMapFlags(register_).ValueOrThrow();
+	}
 }
@@ -1,2 +1,24 @@
 "adc",
 "add",
+"jmp",
+"call",
+"jo",
+"jno",
+"jb",
+"jae",
+"je",
+"jne",
+"jbe",
+"ja",
+"js",
+"jns",
+"jp",
+"jnp",
+"jl",
+"jge",
+"jle",
+"jg",
+"mov",
+"xor",
+"inc",
+"lea",
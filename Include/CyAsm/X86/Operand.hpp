@@ -0,0 +1,162 @@
+#pragma once
+
+#include <cstdint>
+#include <array>
+#include <optional>
+#include <string_view>
+
+#include "../Immediate.hpp"
+#include "../Label.hpp"
+#include "../Utils.hpp"
+#include "Instructions.hpp"
+#include "Registers.hpp"
+
+namespace CyberAsm::X86
+{
+	enum class OperandKind : std::uint8_t
+	{
+		None,
+		Register,
+		Immediate,
+		Label,
+		Memory
+	};
+
+	/// <summary>
+	/// Represents a single instruction operand.
+	/// The active member is selected by Kind.
+	/// </summary>
+	struct Operand final
+	{
+		OperandKind Kind = OperandKind::None;
+		Register Reg = Register::Count;
+		Immediate Imm = Immediate(0);
+
+		/// <summary>
+		/// The branch target of a label operand.
+		/// </summary>
+		CyberAsm::Label Target = {};
+
+		/// <summary>
+		/// The source name of a label operand which has not been resolved into a Target yet.
+		/// </summary>
+		std::string_view Symbol = {};
+
+		/// <summary>
+		/// The address [Base + Index + Displacement] of a memory operand, Index is Register::Count if unused.
+		/// </summary>
+		Register Base = Register::Count;
+		Register Index = Register::Count;
+		std::int32_t Displacement = 0;
+
+		[[nodiscard]] static constexpr auto FromRegister(Register reg) noexcept -> Operand;
+		[[nodiscard]] static constexpr auto FromImmediate(const Immediate& imm) noexcept -> Operand;
+		[[nodiscard]] static constexpr auto FromLabel(CyberAsm::Label label) noexcept -> Operand;
+		[[nodiscard]] static constexpr auto FromSymbol(std::string_view symbol) noexcept -> Operand;
+		[[nodiscard]] static constexpr auto FromMemory(Register base, Register index = Register::Count, std::int32_t displacement = 0) noexcept -> Operand;
+
+		[[nodiscard]] constexpr auto IsRegister() const noexcept -> bool;
+		[[nodiscard]] constexpr auto IsImmediate() const noexcept -> bool;
+		[[nodiscard]] constexpr auto IsLabel() const noexcept -> bool;
+		[[nodiscard]] constexpr auto IsMemory() const noexcept -> bool;
+	};
+
+	constexpr auto Operand::FromRegister(const Register reg) noexcept -> Operand
+	{
+		Operand result = {};
+		result.Kind = OperandKind::Register;
+		result.Reg = reg;
+		return result;
+	}
+
+	constexpr auto Operand::FromImmediate(const Immediate& imm) noexcept -> Operand
+	{
+		Operand result = {};
+		result.Kind = OperandKind::Immediate;
+		result.Imm = imm;
+		return result;
+	}
+
+	constexpr auto Operand::FromLabel(const CyberAsm::Label label) noexcept -> Operand
+	{
+		Operand result = {};
+		result.Kind = OperandKind::Label;
+		result.Target = label;
+		return result;
+	}
+
+	constexpr auto Operand::FromSymbol(const std::string_view symbol) noexcept -> Operand
+	{
+		Operand result = {};
+		result.Kind = OperandKind::Label;
+		result.Symbol = symbol;
+		return result;
+	}
+
+	constexpr auto Operand::FromMemory(const Register base, const Register index, const std::int32_t displacement) noexcept -> Operand
+	{
+		Operand result = {};
+		result.Kind = OperandKind::Memory;
+		result.Base = base;
+		result.Index = index;
+		result.Displacement = displacement;
+		return result;
+	}
+
+	constexpr auto Operand::IsRegister() const noexcept -> bool
+	{
+		return this->Kind == OperandKind::Register;
+	}
+
+	constexpr auto Operand::IsImmediate() const noexcept -> bool
+	{
+		return this->Kind == OperandKind::Immediate;
+	}
+
+	constexpr auto Operand::IsLabel() const noexcept -> bool
+	{
+		return this->Kind == OperandKind::Label;
+	}
+
+	constexpr auto Operand::IsMemory() const noexcept -> bool
+	{
+		return this->Kind == OperandKind::Memory;
+	}
+
+	enum class StatementKind : std::uint8_t
+	{
+		Instruction,
+		LabelDefinition
+	};
+
+	/// <summary>
+	/// Represents one decoded source statement, which is either an instruction or a label definition.
+	/// Operands are stored in Intel order (destination first),
+	/// so they can be forwarded to the encoder unchanged.
+	/// </summary>
+	struct InstructionNode final
+	{
+		static constexpr std::size_t MaxOperands = 2;
+
+		StatementKind Kind = StatementKind::Instruction;
+
+		/// <summary>
+		/// The label name of a label definition.
+		/// </summary>
+		std::string_view Symbol = {};
+
+		Instruction Instr = Instruction::Count;
+		std::uint8_t OperandCount = 0;
+		std::array<Operand, MaxOperands> Operands = {};
+
+		/// <summary>
+		/// The explicit AT&T size suffix (b, w, l, q) if one was specified.
+		/// </summary>
+		std::optional<WordSize> SizeSuffix = std::nullopt;
+
+		/// <summary>
+		/// The 1-based source line this instruction was parsed from.
+		/// </summary>
+		std::size_t Line = 0;
+	};
+}
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <cstdint>
+#include <bit>
 #include <type_traits>
 
 #include "../Utils.hpp"
@@ -33,9 +34,13 @@ namespace CyberAsm::X86
 			Imm32 = 1 << 15,
 			Imm64 = 1 << 16,
 
+			Rel8 = 1 << 17,
+			Rel32 = 1 << 18,
+
 			AnyGpr = Reg8 | Reg8Al | Reg16 | Reg16Ax | Reg32 | Reg32Eax | Reg64 | Reg64Rax,
 			AnyMem = Mem8 | Mem16 | Mem32 | Mem64,
 			AnyImm = Imm8 | Imm16 | Imm32 | Imm64,
+			AnyRel = Rel8 | Rel32,
 			AnyImplicitAkkuGpr = Reg8Al | Reg16Ax | Reg32Eax | Reg64Rax,
 			AnyGpr16To64 = Reg16 | Reg16Ax | Reg32 | Reg32Eax | Reg64 | Reg64Rax,
 			AnyMem16To64 = Mem16 | Mem32 | Mem64,
@@ -45,11 +50,21 @@ namespace CyberAsm::X86
 
 		using Flags = std::underlying_type<Enum>::type;
 
+		/// <summary>
+		/// Every single operand flag bit is a canonical operand kind, kind 0 means no operand.
+		/// Must be updated when a new flag bit is added above.
+		/// </summary>
+		static constexpr std::size_t KindCount = std::bit_width(static_cast<std::uint32_t>(Rel32));
+
 		[[nodiscard]] static constexpr auto IsExplicitRegister(Flags flags) noexcept -> bool;
 		[[nodiscard]] static constexpr auto IsImplicitRegister(Flags flags) noexcept -> bool;
 		[[nodiscard]] static constexpr auto IsImmediate(Flags flags) noexcept -> bool;
 		[[nodiscard]] static constexpr auto IsMemory(Flags flags) noexcept -> bool;
+		[[nodiscard]] static constexpr auto IsRelative(Flags flags) noexcept -> bool;
 		[[nodiscard]] static constexpr auto OperandByteSize(Flags flags) noexcept -> WordSize;
+		[[nodiscard]] static constexpr auto WithExplicitRegister(Flags flags) noexcept -> Flags;
+		[[nodiscard]] static constexpr auto IsCanonical(Flags flags) noexcept -> bool;
+		[[nodiscard]] static constexpr auto CanonicalKind(Flags flags) noexcept -> std::size_t;
 	};
 
 	constexpr auto OperandFlags::IsExplicitRegister(const Flags flags) noexcept -> bool
@@ -72,6 +87,11 @@ namespace CyberAsm::X86
 		return flags >= Mem8 && flags <= Mem64;
 	}
 
+	constexpr auto OperandFlags::IsRelative(const Flags flags) noexcept -> bool
+	{
+		return flags >= Rel8 && flags <= Rel32;
+	}
+
 	constexpr auto OperandFlags::OperandByteSize(const Flags flags) noexcept -> WordSize
 	{
 		if (flags == Reg64Rax || flags & Reg64 || flags & Mem64 || flags & Imm64) [[likely]]
@@ -88,4 +108,30 @@ namespace CyberAsm::X86
 		}
 		return WordSize::HWord;
 	}
+
+	/// <summary>
+	/// Adds the explicit register flag of the same size to an implicit accumulator flag,
+	/// because an accumulator can be encoded by every form taking a general purpose register.
+	/// </summary>
+	constexpr auto OperandFlags::WithExplicitRegister(const Flags flags) noexcept -> Flags
+	{
+		switch (flags)
+		{
+			case Reg8Al: return flags | Reg8;
+			case Reg16Ax: return flags | Reg16;
+			case Reg32Eax: return flags | Reg32;
+			case Reg64Rax: return flags | Reg64;
+			default: return flags;
+		}
+	}
+
+	constexpr auto OperandFlags::IsCanonical(const Flags flags) noexcept -> bool
+	{
+		return flags == None || (std::has_single_bit(flags) && std::bit_width(flags) <= KindCount);
+	}
+
+	constexpr auto OperandFlags::CanonicalKind(const Flags flags) noexcept -> std::size_t
+	{
+		return flags == None ? 0 : static_cast<std::size_t>(std::countr_zero(flags));
+	}
 }
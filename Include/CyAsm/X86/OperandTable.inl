@@ -23,4 +23,148 @@ std::initializer_list<std::initializer_list<OperandFlags::Flags>>
 	{ OperandFlags::Reg8 | OperandFlags::Mem8, OperandFlags::Imm8 },
 	{ OperandFlags::AnyGprOrMem16To64, OperandFlags::Imm16 | OperandFlags::Imm32 },
 	{ OperandFlags::AnyGprOrMem16To64, OperandFlags::Imm8 },
-}
+},
+// jmp
+std::initializer_list<std::initializer_list<OperandFlags::Flags>>
+{
+	{ OperandFlags::Rel8 },
+	{ OperandFlags::Rel32 },
+},
+// call
+std::initializer_list<std::initializer_list<OperandFlags::Flags>>
+{
+	{ OperandFlags::Rel32 },
+},
+// jo
+std::initializer_list<std::initializer_list<OperandFlags::Flags>>
+{
+	{ OperandFlags::Rel8 },
+	{ OperandFlags::Rel32 },
+},
+// jno
+std::initializer_list<std::initializer_list<OperandFlags::Flags>>
+{
+	{ OperandFlags::Rel8 },
+	{ OperandFlags::Rel32 },
+},
+// jb
+std::initializer_list<std::initializer_list<OperandFlags::Flags>>
+{
+	{ OperandFlags::Rel8 },
+	{ OperandFlags::Rel32 },
+},
+// jae
+std::initializer_list<std::initializer_list<OperandFlags::Flags>>
+{
+	{ OperandFlags::Rel8 },
+	{ OperandFlags::Rel32 },
+},
+// je
+std::initializer_list<std::initializer_list<OperandFlags::Flags>>
+{
+	{ OperandFlags::Rel8 },
+	{ OperandFlags::Rel32 },
+},
+// jne
+std::initializer_list<std::initializer_list<OperandFlags::Flags>>
+{
+	{ OperandFlags::Rel8 },
+	{ OperandFlags::Rel32 },
+},
+// jbe
+std::initializer_list<std::initializer_list<OperandFlags::Flags>>
+{
+	{ OperandFlags::Rel8 },
+	{ OperandFlags::Rel32 },
+},
+// ja
+std::initializer_list<std::initializer_list<OperandFlags::Flags>>
+{
+	{ OperandFlags::Rel8 },
+	{ OperandFlags::Rel32 },
+},
+// js
+std::initializer_list<std::initializer_list<OperandFlags::Flags>>
+{
+	{ OperandFlags::Rel8 },
+	{ OperandFlags::Rel32 },
+},
+// jns
+std::initializer_list<std::initializer_list<OperandFlags::Flags>>
+{
+	{ OperandFlags::Rel8 },
+	{ OperandFlags::Rel32 },
+},
+// jp
+std::initializer_list<std::initializer_list<OperandFlags::Flags>>
+{
+	{ OperandFlags::Rel8 },
+	{ OperandFlags::Rel32 },
+},
+// jnp
+std::initializer_list<std::initializer_list<OperandFlags::Flags>>
+{
+	{ OperandFlags::Rel8 },
+	{ OperandFlags::Rel32 },
+},
+// jl
+std::initializer_list<std::initializer_list<OperandFlags::Flags>>
+{
+	{ OperandFlags::Rel8 },
+	{ OperandFlags::Rel32 },
+},
+// jge
+std::initializer_list<std::initializer_list<OperandFlags::Flags>>
+{
+	{ OperandFlags::Rel8 },
+	{ OperandFlags::Rel32 },
+},
+// jle
+std::initializer_list<std::initializer_list<OperandFlags::Flags>>
+{
+	{ OperandFlags::Rel8 },
+	{ OperandFlags::Rel32 },
+},
+// jg
+std::initializer_list<std::initializer_list<OperandFlags::Flags>>
+{
+	{ OperandFlags::Rel8 },
+	{ OperandFlags::Rel32 },
+},
+// mov
+std::initializer_list<std::initializer_list<OperandFlags::Flags>>
+{
+	{ OperandFlags::Reg8 | OperandFlags::Mem8, OperandFlags::Reg8 },
+	{ OperandFlags::AnyGprOrMem16To64, OperandFlags::AnyGpr16To64 },
+	{ OperandFlags::Reg8, OperandFlags::Reg8 | OperandFlags::Mem8 },
+	{ OperandFlags::AnyGpr16To64, OperandFlags::AnyGprOrMem16To64 },
+	{ OperandFlags::Reg8, OperandFlags::Imm8 },
+	{ OperandFlags::Reg16 | OperandFlags::Reg32, OperandFlags::Imm16 | OperandFlags::Imm32 },
+	{ OperandFlags::Reg64, OperandFlags::Imm64 },
+	{ OperandFlags::Reg8 | OperandFlags::Mem8, OperandFlags::Imm8 },
+	{ OperandFlags::AnyGprOrMem16To64, OperandFlags::Imm16 | OperandFlags::Imm32 },
+},
+// xor
+std::initializer_list<std::initializer_list<OperandFlags::Flags>>
+{
+	{ OperandFlags::Reg8 | OperandFlags::Mem8, OperandFlags::Reg8 },
+	{ OperandFlags::AnyGprOrMem16To64, OperandFlags::AnyGpr16To64 },
+	{ OperandFlags::Reg8, OperandFlags::Reg8 | OperandFlags::Mem8 },
+	{ OperandFlags::AnyGpr16To64, OperandFlags::AnyGprOrMem16To64 },
+	{ OperandFlags::Reg8Al, OperandFlags::Imm8 },
+	{ OperandFlags::ImplicitAkkuGpr16To64, OperandFlags::Imm16 | OperandFlags::Imm32 },
+	{ OperandFlags::Reg8 | OperandFlags::Mem8, OperandFlags::Imm8 },
+	{ OperandFlags::AnyGprOrMem16To64, OperandFlags::Imm16 | OperandFlags::Imm32 },
+	{ OperandFlags::AnyGprOrMem16To64, OperandFlags::Imm8 },
+},
+// inc
+std::initializer_list<std::initializer_list<OperandFlags::Flags>>
+{
+	{ OperandFlags::Reg8 | OperandFlags::Mem8 },
+	{ OperandFlags::AnyGprOrMem16To64 },
+},
+// lea
+std::initializer_list<std::initializer_list<OperandFlags::Flags>>
+{
+	{ OperandFlags::AnyGpr16To64, OperandFlags::AnyMem },
+}
\ No newline at end of file
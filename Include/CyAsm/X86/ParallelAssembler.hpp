@@ -0,0 +1,344 @@
+#pragma once
+
+#include <cstring>
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include "Assembler.hpp"
+
+namespace CyberAsm::X86
+{
+	struct ParallelAssembleOptions final
+	{
+		/// <summary>
+		/// The number of threads assembling chunks, 0 uses every hardware thread.
+		/// </summary>
+		std::size_t Threads = 0;
+
+		/// <summary>
+		/// The smallest chunk in bytes, sources shorter than two chunks are assembled serially.
+		/// </summary>
+		std::size_t MinChunkSize = 64 * 1024;
+	};
+
+	namespace ParallelAssemblerDetail
+	{
+		/// <summary>
+		/// More chunks than threads, so a thread which finished early picks up the remaining work.
+		/// </summary>
+		inline constexpr std::size_t ChunksPerThread = 4;
+
+		/// <summary>
+		/// One piece of the source and the unfinalized code assembled from it.
+		/// </summary>
+		template <Abi Arch>
+		struct Chunk final
+		{
+			std::string_view Source = {};
+			std::size_t LineCount = 0;
+			MachineStream<Arch> Code = {};
+			AssemblyListing Listing = {};
+			typename SymbolScope<Arch>::LocalLabels Forward = {};
+			typename SymbolScope<Arch>::LocalLabels Backward = {};
+			typename SymbolScope<Arch>::LocalLabels Imports = {};
+			typename SymbolScope<Arch>::LocalLabels FirstDefinitions = {};
+		};
+
+		/// <summary>
+		/// Splits the source into pieces of about the same size, each ending behind a line break.
+		/// </summary>
+		[[nodiscard]] inline auto SplitSource(const std::string_view source, const std::size_t count, const std::size_t minSize) -> std::vector<std::string_view>
+		{
+			const std::size_t target = std::max<std::size_t>({source.size() / std::max<std::size_t>(count, 1), minSize, 1});
+			std::vector<std::string_view> pieces = {};
+			pieces.reserve(source.size() / target + 1);
+			std::size_t begin = 0;
+			while (begin < source.size())
+			{
+				std::size_t end = source.size();
+				if (begin + target < source.size())
+				{
+					const auto* newLine = static_cast<const char*>(std::memchr(source.data() + begin + target, '\n', source.size() - begin - target));
+					end = newLine ? static_cast<std::size_t>(newLine - source.data()) + 1 : source.size();
+				}
+				pieces.push_back(source.substr(begin, end - begin));
+				begin = end;
+			}
+			return pieces;
+		}
+
+		/// <summary>
+		/// Keeps the local labels at the borders of a chunk for stitching.
+		/// </summary>
+		template <Abi Arch>
+		inline void TakeBorderLabels(Chunk<Arch>& chunk, const SymbolScope<Arch>& symbols)
+		{
+			chunk.Forward = symbols.Forward();
+			chunk.Backward = symbols.Backward();
+			chunk.Imports = symbols.Imports();
+			chunk.FirstDefinitions = symbols.FirstDefinitions();
+		}
+
+		/// <summary>
+		/// Assembles one chunk like Assemble(), with line numbers relative to the chunk and a deferred symbol scope.
+		/// </summary>
+		template <Abi Arch>
+		inline void AssembleChunk(Chunk<Arch>& chunk, const bool listing)
+		{
+			chunk.LineCount = static_cast<std::size_t>(std::count(chunk.Source.begin(), chunk.Source.end(), '\n'));
+			chunk.Code.Reserve(chunk.Source.size() / 3);
+
+			Parser parser(chunk.Source);
+			SymbolScope<Arch> symbols(chunk.Code, true);
+			EmitCursor cursor = chunk.Code.BeginEmit();
+			InstructionNode node = {};
+			while (parser.Next(node))
+			{
+				if (listing) [[unlikely]]
+				{
+					chunk.Listing.Record(node.Line, cursor.Offset());
+				}
+				EmitStatement<Arch>(node, symbols, cursor, chunk.Code);
+			}
+			cursor.Commit();
+			TakeBorderLabels(chunk, symbols);
+		}
+
+		/// <summary>
+		/// Appends chunks in source order and connects the local labels across chunk borders:
+		/// the pending 'Nf' references of the chunks in front go to the first definition of N in a chunk,
+		/// and the imported 'Nb' references of a chunk go to the last definition of N in front of it.
+		/// Named labels are connected by name when the label tables are merged.
+		/// </summary>
+		template <Abi Arch>
+		class ChunkStitcher final
+		{
+		public:
+			explicit ChunkStitcher(MachineStream<Arch>& out) noexcept;
+
+			/// <summary>
+			/// Appends the code of the next chunk, throws if it refers to a local label which has no previous definition.
+			/// </summary>
+			/// <param name="chunk">The chunk following all chunks appended so far.</param>
+			/// <param name="listing">Receives the listing rows of the chunk if not null.</param>
+			void Append(const Chunk<Arch>& chunk, AssemblyListing* listing);
+
+			/// <summary>
+			/// Throws if a forward local label reference was never defined, see SymbolScope::Validate().
+			/// </summary>
+			void Validate() const;
+
+		private:
+			/// <summary>
+			/// Owns the names, the source text of a chunk may be gone before the following chunks are appended.
+			/// </summary>
+			using LocalLabels = std::map<std::string, Label, std::less<>>;
+
+			MachineStream<Arch>& out;
+			LocalLabels forward = {};
+			LocalLabels backward = {};
+			std::vector<Label> mapping = {};
+			std::size_t lineShift = 0;
+		};
+
+		template <Abi Arch>
+		inline ChunkStitcher<Arch>::ChunkStitcher(MachineStream<Arch>& out) noexcept : out(out) { }
+
+		template <Abi Arch>
+		inline void ChunkStitcher<Arch>::Append(const Chunk<Arch>& chunk, AssemblyListing* const listing)
+		{
+			this->mapping.assign(chunk.Code.Labels().LabelCount(), Label{});
+			for (const auto& [name, label] : chunk.FirstDefinitions)
+			{
+				if (const auto it = this->forward.find(name); it != this->forward.end())
+				{
+					this->mapping[label.Id] = it->second;
+					this->forward.erase(it);
+				}
+			}
+			for (const auto& [name, label] : chunk.Imports)
+			{
+				const auto it = this->backward.find(name);
+				if (it == this->backward.end()) [[unlikely]]
+				{
+					throw std::runtime_error("Local label '" + std::string(name) + X64::BackwardLocalLabel + "' has no previous definition!");
+				}
+				this->mapping[label.Id] = it->second;
+			}
+			for (const auto& [name, label] : chunk.Forward)
+			{
+				if (const auto it = this->forward.find(name); it != this->forward.end())
+				{
+					this->mapping[label.Id] = it->second;
+				}
+				else
+				{
+					this->mapping[label.Id] = this->out.CreateLabel();
+					this->forward.emplace(name, this->mapping[label.Id]);
+				}
+			}
+
+			const std::size_t offset = this->out.Size();
+			this->out.Append(chunk.Code, this->mapping);
+			if (listing)
+			{
+				listing->Append(chunk.Listing, offset, this->lineShift);
+			}
+			this->lineShift += chunk.LineCount;
+			for (const auto& [name, label] : chunk.Backward)
+			{
+				this->backward.insert_or_assign(std::string(name), this->mapping[label.Id]);
+			}
+		}
+
+		template <Abi Arch>
+		inline void ChunkStitcher<Arch>::Validate() const
+		{
+			for (const auto& [name, label] : this->forward)
+			{
+				throw std::runtime_error("Local label '" + name + X64::ForwardLocalLabel + "' has no following definition!");
+			}
+		}
+
+		/// <summary>
+		/// Appends all chunks in source order, see ChunkStitcher.
+		/// </summary>
+		template <Abi Arch>
+		inline void StitchChunks(const std::vector<Chunk<Arch>>& chunks, MachineStream<Arch>& out, AssemblyListing* const listing)
+		{
+			std::size_t size = 0;
+			for (const auto& chunk : chunks)
+			{
+				size += chunk.Code.Size();
+			}
+			out.Reserve(size);
+
+			ChunkStitcher<Arch> stitcher(out);
+			for (const auto& chunk : chunks)
+			{
+				stitcher.Append(chunk, listing);
+			}
+			stitcher.Validate();
+		}
+	}
+
+	/// <summary>
+	/// Assembles AT&T source code on several threads and appends the machine code to the empty stream.
+	/// The source is split behind line breaks into chunks, every chunk is parsed and encoded into its own stream,
+	/// and the streams are appended in source order while label references across chunk borders are connected.
+	/// Branches are relaxed by MachineStream::Finalize() over the whole stream, so the code is byte-identical
+	/// to Assemble() for any number of threads.
+	/// Falls back to Assemble() if the peephole optimizer is enabled, which needs all statements at once,
+	/// if the stream is not empty, or if the source is too short to be split.
+	/// On errors the source is assembled again serially, so the exception is the same as the one of Assemble().
+	/// </summary>
+	/// <param name="source">The source code.</param>
+	/// <param name="out">The stream which receives the machine code.</param>
+	/// <param name="options">The assembler options.</param>
+	/// <param name="parallel">The thread count and chunk size.</param>
+	/// <returns>The number of chunks assembled, 1 if the source was assembled serially.</returns>
+	template <Abi Arch = Abi::X86_64>
+	inline auto AssembleParallel(const std::string_view source, MachineStream<Arch>& out, const AssembleOptions& options = {}, const ParallelAssembleOptions& parallel = {}) -> std::size_t
+	{
+		using namespace ParallelAssemblerDetail;
+
+		const std::size_t threads = parallel.Threads != 0 ? parallel.Threads : std::max<std::size_t>(std::thread::hardware_concurrency(), 1);
+		if (options.Peephole || threads <= 1 || source.size() < 2 * parallel.MinChunkSize || out.Size() != 0 || out.Labels().LabelCount() != 0)
+		{
+			Assemble<Arch>(source, out, options);
+			return 1;
+		}
+
+		const std::vector<std::string_view> pieces = SplitSource(source, threads * ChunksPerThread, parallel.MinChunkSize);
+		std::vector<Chunk<Arch>> chunks(pieces.size());
+		for (std::size_t i = 0; i < pieces.size(); ++i)
+		{
+			chunks[i].Source = pieces[i];
+		}
+
+		// Chunks are taken in order from a shared counter, the first error stops all threads:
+		std::atomic<std::size_t> next = 0;
+		std::atomic<bool> failed = false;
+		const auto work = [&]() noexcept
+		{
+			for (std::size_t i = next++; i < chunks.size() && !failed.load(std::memory_order_relaxed); i = next++)
+			{
+				try
+				{
+					AssembleChunk<Arch>(chunks[i], options.Listing != nullptr);
+				}
+				catch (...)
+				{
+					failed = true;
+				}
+			}
+		};
+		std::vector<std::thread> workers = {};
+		workers.reserve(std::min(threads, chunks.size()) - 1);
+		try
+		{
+			for (std::size_t i = 1; i < std::min(threads, chunks.size()); ++i)
+			{
+				workers.emplace_back(work);
+			}
+		}
+		catch (const std::system_error&)
+		{
+			// Fewer threads than requested, the started ones and this thread do the work.
+		}
+		work();
+		for (auto& worker : workers)
+		{
+			worker.join();
+		}
+
+		if (!failed)
+		{
+			AssemblyListing listing = {};
+			try
+			{
+				StitchChunks<Arch>(chunks, out, options.Listing ? &listing : nullptr);
+				if (options.Listing)
+				{
+					options.Listing->Append(listing, 0, 0);
+				}
+				return chunks.size();
+			}
+			catch (const std::runtime_error&)
+			{
+				// Reported by the serial assembler below.
+			}
+		}
+
+		// The chunks know neither the line numbers of the whole source nor the labels of the other chunks,
+		// so the serial assembler reports the error:
+		out.Clear();
+		Assemble<Arch>(source, out, options);
+		return 1;
+	}
+
+	/// <summary>
+	/// Assembles AT&T source code on several threads into a new stream and resolves all labels, see AssembleParallel().
+	/// The listing of the options, if any, is finalized along with the stream.
+	/// </summary>
+	/// <param name="source">The source code.</param>
+	/// <param name="options">The assembler options.</param>
+	/// <param name="parallel">The thread count and chunk size.</param>
+	/// <returns>The machine code.</returns>
+	template <Abi Arch = Abi::X86_64>
+	[[nodiscard]] inline auto AssembleParallel(const std::string_view source, const AssembleOptions& options = {}, const ParallelAssembleOptions& parallel = {}) -> MachineStream<Arch>
+	{
+		MachineStream<Arch> result = {};
+		AssembleParallel<Arch>(source, result, options, parallel);
+		result.Finalize(0, options.Listing ? options.Listing->Markers() : std::span<std::size_t>{});
+		return result;
+	}
+}
@@ -0,0 +1,310 @@
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#include "Lexer.hpp"
+#include "Operand.hpp"
+#include "Instructions.hpp"
+#include "Registers.hpp"
+
+namespace CyberAsm::X86
+{
+	/// <summary>
+	/// Parses an integer literal.
+	/// Supported forms are decimal, '0x' hexadecimal, '0b' binary and '0c' octal, each with an optional leading '-'.
+	/// Negative values are stored as two's complement.
+	/// </summary>
+	/// <param name="literal">The literal without the '$' prefix.</param>
+	/// <returns>The value or std::nullopt if the literal is malformed or does not fit into 64 bits.</returns>
+	[[nodiscard]] constexpr auto ParseInteger(std::string_view literal) noexcept -> std::optional<std::uint64_t>
+	{
+		const bool negative = !literal.empty() && literal.front() == X64::NegativeSign;
+		if (negative)
+		{
+			literal.remove_prefix(1);
+		}
+
+		std::uint64_t base = 10;
+		if (literal.size() > 2 && literal[0] == '0')
+		{
+			switch (literal[1] | 0x20)
+			{
+				case X64::HexPrefix: base = 16; break;
+				case X64::BinPrefix: base = 2; break;
+				case X64::OctPrefix: base = 8; break;
+				default: break;
+			}
+			if (base != 10)
+			{
+				literal.remove_prefix(2);
+			}
+		}
+
+		if (literal.empty()) [[unlikely]]
+		{
+			return std::nullopt;
+		}
+
+		std::uint64_t value = 0;
+		for (const char c : literal)
+		{
+			std::uint64_t digit;
+			if (c >= '0' && c <= '9') [[likely]]
+			{
+				digit = static_cast<std::uint64_t>(c - '0');
+			}
+			else if ((c | 0x20) >= 'a' && (c | 0x20) <= 'f')
+			{
+				digit = static_cast<std::uint64_t>((c | 0x20) - 'a' + 10);
+			}
+			else [[unlikely]]
+			{
+				return std::nullopt;
+			}
+			if (digit >= base || value > (std::numeric_limits<std::uint64_t>::max() - digit) / base) [[unlikely]]
+			{
+				return std::nullopt;
+			}
+			value = value * base + digit;
+		}
+
+		if (negative)
+		{
+			if (value > static_cast<std::uint64_t>(std::numeric_limits<std::int64_t>::max()) + 1) [[unlikely]]
+			{
+				return std::nullopt;
+			}
+			value = ~value + 1;
+		}
+		return value;
+	}
+
+	/// <summary>
+	/// Checks if the name is a numeric local label such as '1'.
+	/// </summary>
+	[[nodiscard]] constexpr auto IsLocalLabelName(const std::string_view name) noexcept -> bool
+	{
+		if (name.empty()) [[unlikely]]
+		{
+			return false;
+		}
+		for (const char c : name)
+		{
+			if (c < '0' || c > '9')
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+	/// <summary>
+	/// Checks if the symbol is a reference to a numeric local label such as '1f' (next '1') or '1b' (previous '1').
+	/// </summary>
+	[[nodiscard]] constexpr auto IsLocalLabelReference(const std::string_view symbol) noexcept -> bool
+	{
+		return symbol.size() > 1
+			&& (symbol.back() == X64::ForwardLocalLabel || symbol.back() == X64::BackwardLocalLabel)
+			&& IsLocalLabelName(symbol.substr(0, symbol.size() - 1));
+	}
+
+	/// <summary>
+	/// AT&T syntax parser.
+	/// Pulls tokens from the lexer and yields one InstructionNode per source statement.
+	/// A label definition such as 'loop:' is its own statement, label operands are yielded unresolved by name.
+	/// The parser never copies source text, so it can run over memory mapped or very large inputs.
+	/// </summary>
+	class Parser final
+	{
+	public:
+		/// <param name="source">The source code.</param>
+		/// <param name="firstLine">The line number of the first line, for sources which continue a larger file.</param>
+		explicit constexpr Parser(std::string_view source, std::size_t firstLine = 1) noexcept;
+
+		/// <summary>
+		/// Parses the next statement.
+		/// Throws std::runtime_error with the line number on malformed input.
+		/// </summary>
+		/// <param name="out">Receives the parsed statement.</param>
+		/// <returns>False if the end of the source was reached.</returns>
+		[[nodiscard]] auto Next(InstructionNode& out) -> bool;
+		[[nodiscard]] constexpr auto Line() const noexcept -> std::size_t;
+
+	private:
+		[[noreturn]] void Error(std::string_view message, std::string_view lexeme = {}) const;
+		[[nodiscard]] auto ParseOperand(const Token& token) const -> Operand;
+
+		Lexer lexer;
+		std::size_t line = 1;
+	};
+
+	constexpr Parser::Parser(const std::string_view source, const std::size_t firstLine) noexcept : lexer(source), line(firstLine) { }
+
+	constexpr auto Parser::Line() const noexcept -> std::size_t
+	{
+		return this->line;
+	}
+
+	inline void Parser::Error(const std::string_view message, const std::string_view lexeme) const
+	{
+		std::string text = "Line " + std::to_string(this->line) + ": ";
+		text += message;
+		if (!lexeme.empty())
+		{
+			text += " '";
+			text += lexeme;
+			text += '\'';
+		}
+		throw std::runtime_error(text);
+	}
+
+	inline auto Parser::ParseOperand(const Token& token) const -> Operand
+	{
+		switch (token.Kind)
+		{
+			case TokenKind::Register:
+			{
+				const auto reg = LookupRegister(token.Lexeme);
+				if (!reg) [[unlikely]]
+				{
+					this->Error("Unknown register", token.Lexeme);
+				}
+				return Operand::FromRegister(*reg);
+			}
+
+			case TokenKind::Immediate:
+			{
+				const auto value = ParseInteger(token.Lexeme);
+				if (!value) [[unlikely]]
+				{
+					this->Error("Malformed immediate", token.Lexeme);
+				}
+				return Operand::FromImmediate(Immediate(*value));
+			}
+
+			case TokenKind::Identifier:
+				return Operand::FromSymbol(token.Lexeme);
+
+			case TokenKind::Number:
+				if (!IsLocalLabelReference(token.Lexeme)) [[unlikely]]
+				{
+					this->Error("Absolute addresses are not supported", token.Lexeme);
+				}
+				return Operand::FromSymbol(token.Lexeme);
+
+			case TokenKind::AbsoluteJump:
+				this->Error("Indirect jumps are not supported");
+
+			default:
+				this->Error("Expected operand but found", token.Lexeme);
+		}
+	}
+
+	inline auto Parser::Next(InstructionNode& out) -> bool
+	{
+		Token token = this->lexer.Next();
+		while (token.Kind == TokenKind::NewLine)
+		{
+			++this->line;
+			token = this->lexer.Next();
+		}
+		if (token.Kind == TokenKind::EndOfFile) [[unlikely]]
+		{
+			return false;
+		}
+		if (token.Kind != TokenKind::Identifier && token.Kind != TokenKind::Number) [[unlikely]]
+		{
+			this->Error("Expected mnemonic but found", token.Lexeme);
+		}
+
+		const Token head = token;
+		token = this->lexer.Next();
+
+		// Label definition, the line continues with the next statement:
+		if (token.Kind == TokenKind::LabelTerminator)
+		{
+			if (head.Kind == TokenKind::Number && !IsLocalLabelName(head.Lexeme)) [[unlikely]]
+			{
+				this->Error("Malformed local label", head.Lexeme);
+			}
+			out.Kind = StatementKind::LabelDefinition;
+			out.Symbol = head.Lexeme;
+			out.Instr = Instruction::Count;
+			out.SizeSuffix = std::nullopt;
+			out.OperandCount = 0;
+			out.Line = this->line;
+			return true;
+		}
+		if (head.Kind != TokenKind::Identifier) [[unlikely]]
+		{
+			this->Error("Expected mnemonic but found", head.Lexeme);
+		}
+
+		const auto mnemonic = LookupMnemonic(head.Lexeme);
+		if (!mnemonic) [[unlikely]]
+		{
+			this->Error("Unknown mnemonic", head.Lexeme);
+		}
+
+		out.Kind = StatementKind::Instruction;
+		out.Symbol = {};
+		out.Instr = mnemonic->Instr;
+		out.SizeSuffix = mnemonic->SizeSuffix;
+		out.OperandCount = 0;
+		out.Line = this->line;
+
+		// Operands are written in AT&T order (source first):
+		while (token.Kind != TokenKind::NewLine && token.Kind != TokenKind::EndOfFile)
+		{
+			if (out.OperandCount == InstructionNode::MaxOperands) [[unlikely]]
+			{
+				this->Error("Too many operands");
+			}
+			out.Operands[out.OperandCount++] = this->ParseOperand(token);
+			token = this->lexer.Next();
+			if (token.Kind == TokenKind::Separator)
+			{
+				token = this->lexer.Next();
+				if (token.Kind == TokenKind::NewLine || token.Kind == TokenKind::EndOfFile) [[unlikely]]
+				{
+					this->Error("Expected operand after ','");
+				}
+			}
+			else if (token.Kind != TokenKind::NewLine && token.Kind != TokenKind::EndOfFile) [[unlikely]]
+			{
+				this->Error("Expected ',' but found", token.Lexeme);
+			}
+		}
+
+		// Convert into Intel order (destination first):
+		if (out.OperandCount == 2) [[likely]]
+		{
+			std::swap(out.Operands[0], out.Operands[1]);
+		}
+
+		// Validate the size suffix against the register operands:
+		if (out.SizeSuffix) [[likely]]
+		{
+			for (std::uint8_t i = 0; i < out.OperandCount; ++i)
+			{
+				const auto& operand = out.Operands[i];
+				if (operand.IsRegister() && LookupRegisterSize(operand.Reg) != *out.SizeSuffix) [[unlikely]]
+				{
+					this->Error("Operand size does not match instruction suffix", RegisterMnemonicTable[static_cast<std::size_t>(operand.Reg)]);
+				}
+			}
+		}
+
+		if (token.Kind == TokenKind::NewLine) [[likely]]
+		{
+			++this->line;
+		}
+		return true;
+	}
+}
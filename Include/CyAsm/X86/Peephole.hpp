@@ -0,0 +1,429 @@
+#pragma once
+
+#include <cstdint>
+#include <array>
+#include <limits>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "Instructions.hpp"
+#include "Operand.hpp"
+#include "Registers.hpp"
+
+namespace CyberAsm::X86
+{
+	/// <summary>
+	/// Status flags tracked by the peephole optimizer.
+	/// The carry flag is tracked on its own, because inc and dec write all arithmetic flags but CF.
+	/// </summary>
+	struct StatusFlags final
+	{
+		enum Enum : std::uint8_t
+		{
+			None = 0,
+			Carry = 1 << 0,
+
+			/// <summary>
+			/// OF, SF, ZF, AF and PF.
+			/// </summary>
+			Other = 1 << 1,
+
+			All = Carry | Other
+		};
+	};
+
+	/// <summary>
+	/// The status flags an instruction reads and writes.
+	/// </summary>
+	struct FlagEffects final
+	{
+		std::uint8_t Read = StatusFlags::None;
+		std::uint8_t Written = StatusFlags::None;
+	};
+
+	/// <summary>
+	/// Returns the status flag effects of the instruction.
+	/// Unknown instructions conservatively read all flags.
+	/// </summary>
+	[[nodiscard]] constexpr auto LookupFlagEffects(const Instruction instruction) noexcept -> FlagEffects
+	{
+		switch (instruction)
+		{
+			case Instruction::Add:
+			case Instruction::Xor: return {StatusFlags::None, StatusFlags::All};
+			case Instruction::Adc: return {StatusFlags::Carry, StatusFlags::All};
+			case Instruction::Inc: return {StatusFlags::None, StatusFlags::Other};
+			case Instruction::Mov:
+			case Instruction::Lea:
+			case Instruction::Jmp: return {StatusFlags::None, StatusFlags::None};
+			case Instruction::Jb:
+			case Instruction::Jae: return {StatusFlags::Carry, StatusFlags::None};
+			case Instruction::Jbe:
+			case Instruction::Ja: return {StatusFlags::All, StatusFlags::None};
+			case Instruction::Jo:
+			case Instruction::Jno:
+			case Instruction::Je:
+			case Instruction::Jne:
+			case Instruction::Js:
+			case Instruction::Jns:
+			case Instruction::Jp:
+			case Instruction::Jnp:
+			case Instruction::Jl:
+			case Instruction::Jge:
+			case Instruction::Jle:
+			case Instruction::Jg: return {StatusFlags::Other, StatusFlags::None};
+			default: return {StatusFlags::All, StatusFlags::None};
+		}
+	}
+
+	/// <summary>
+	/// Checks if control may leave the straight line code after the statement.
+	/// </summary>
+	[[nodiscard]] constexpr auto IsControlTransfer(const InstructionNode& node) noexcept -> bool
+	{
+		return node.Kind == StatementKind::Instruction && (node.Instr == Instruction::Call || (node.OperandCount == 1 && node.Operands[0].IsLabel()));
+	}
+
+	/// <summary>
+	/// The replacement for a matched window, which is never longer than the window.
+	/// </summary>
+	struct PeepholeRewrite final
+	{
+		static constexpr std::size_t MaxNodes = 2;
+
+		std::uint8_t Count = 0;
+		std::array<InstructionNode, MaxNodes> Nodes = {};
+	};
+
+	/// <summary>
+	/// A peephole rule matching a fixed window of consecutive instructions.
+	/// </summary>
+	struct PeepholeRule final
+	{
+		std::string_view Name = {};
+		std::size_t Window = 1;
+
+		/// <summary>
+		/// Returns the rewrite or std::nullopt if the rule does not match.
+		/// liveFlags are the status flags read after the window before they are written again.
+		/// </summary>
+		auto (*Apply)(std::span<const InstructionNode> window, std::uint8_t liveFlags) -> std::optional<PeepholeRewrite> = nullptr;
+	};
+
+	namespace Peephole
+	{
+		[[nodiscard]] inline auto IsRegisterPair(const InstructionNode& node, const Instruction instruction) noexcept -> bool
+		{
+			return node.Kind == StatementKind::Instruction && node.Instr == instruction && node.OperandCount == 2 && node.Operands[0].IsRegister() && node.Operands[1].IsRegister();
+		}
+
+		[[nodiscard]] inline auto IsRegisterImmediate(const InstructionNode& node, const Instruction instruction) noexcept -> bool
+		{
+			return node.Kind == StatementKind::Instruction && node.Instr == instruction && node.OperandCount == 2 && node.Operands[0].IsRegister() && node.Operands[1].IsImmediate();
+		}
+
+		/// <summary>
+		/// 32-bit writes zero the upper half of the 64-bit register, so they are never redundant.
+		/// </summary>
+		[[nodiscard]] inline auto IsZeroExtendingWrite(const Register reg) noexcept -> bool
+		{
+			return LookupRegisterSize(reg) == WordSize::DWord;
+		}
+
+		[[nodiscard]] inline auto IsDWordOrQWordRegister(const Register reg) noexcept -> bool
+		{
+			const auto size = LookupRegisterSize(reg);
+			return LookupQWordAlias(reg) && (size == WordSize::DWord || size == WordSize::QWord);
+		}
+
+		[[nodiscard]] inline auto MakeNode(const InstructionNode& origin, const Instruction instruction) noexcept -> InstructionNode
+		{
+			InstructionNode node = {};
+			node.Instr = instruction;
+			node.Line = origin.Line;
+			return node;
+		}
+
+		[[nodiscard]] inline auto Single(const InstructionNode& node) noexcept -> PeepholeRewrite
+		{
+			PeepholeRewrite rewrite = {};
+			rewrite.Count = 1;
+			rewrite.Nodes[0] = node;
+			return rewrite;
+		}
+
+		/// <summary>
+		/// mov r, r -> (nothing)
+		/// </summary>
+		inline auto DropSelfMove(const std::span<const InstructionNode> window, std::uint8_t) -> std::optional<PeepholeRewrite>
+		{
+			const auto& mov = window[0];
+			if (!IsRegisterPair(mov, Instruction::Mov) || mov.Operands[0].Reg != mov.Operands[1].Reg || IsZeroExtendingWrite(mov.Operands[0].Reg))
+			{
+				return std::nullopt;
+			}
+			return PeepholeRewrite{};
+		}
+
+		/// <summary>
+		/// mov a, b; mov b, a -> mov a, b
+		/// </summary>
+		inline auto DropReverseMove(const std::span<const InstructionNode> window, std::uint8_t) -> std::optional<PeepholeRewrite>
+		{
+			const auto& first = window[0];
+			const auto& second = window[1];
+			if (!IsRegisterPair(first, Instruction::Mov) || !IsRegisterPair(second, Instruction::Mov)
+				|| first.Operands[0].Reg != second.Operands[1].Reg || first.Operands[1].Reg != second.Operands[0].Reg
+				|| IsZeroExtendingWrite(second.Operands[0].Reg))
+			{
+				return std::nullopt;
+			}
+			return Single(first);
+		}
+
+		/// <summary>
+		/// mov a, x; mov a, y -> mov a, y (if y does not read a)
+		/// </summary>
+		inline auto DropOverwrittenMove(const std::span<const InstructionNode> window, std::uint8_t) -> std::optional<PeepholeRewrite>
+		{
+			const auto& first = window[0];
+			const auto& second = window[1];
+			const auto isMove = [](const InstructionNode& node)
+			{
+				return IsRegisterPair(node, Instruction::Mov) || IsRegisterImmediate(node, Instruction::Mov);
+			};
+			if (!isMove(first) || !isMove(second) || first.Operands[0].Reg != second.Operands[0].Reg
+				|| (second.Operands[1].IsRegister() && IsAliasing(second.Operands[1].Reg, second.Operands[0].Reg)))
+			{
+				return std::nullopt;
+			}
+			return Single(second);
+		}
+
+		/// <summary>
+		/// mov d, s; add d, imm -> lea d, [s + imm]
+		/// mov d, s; add d, r -> lea d, [s + r]
+		/// </summary>
+		inline auto AddWithCopyToLea(const std::span<const InstructionNode> window, const std::uint8_t liveFlags) -> std::optional<PeepholeRewrite>
+		{
+			const auto& mov = window[0];
+			const auto& add = window[1];
+			if (liveFlags != StatusFlags::None || !IsRegisterPair(mov, Instruction::Mov) || add.Instr != Instruction::Add || add.OperandCount != 2
+				|| !add.Operands[0].IsRegister() || add.Operands[0].Reg != mov.Operands[0].Reg)
+			{
+				return std::nullopt;
+			}
+
+			const auto destination = mov.Operands[0].Reg;
+			const auto source = mov.Operands[1].Reg;
+			if (!IsDWordOrQWordRegister(destination) || LookupRegisterSize(source) != LookupRegisterSize(destination) || IsAliasing(source, destination))
+			{
+				return std::nullopt;
+			}
+
+			// The address is computed with the 64-bit registers, the result is truncated to the destination:
+			const auto base = *LookupQWordAlias(source);
+			Operand address = {};
+			if (add.Operands[1].IsImmediate())
+			{
+				const auto value = add.Operands[1].Imm.IValue;
+				const auto fits = LookupRegisterSize(destination) == WordSize::QWord
+					? value >= std::numeric_limits<std::int32_t>::min() && value <= std::numeric_limits<std::int32_t>::max()
+					: add.Operands[1].Imm.UValue <= std::numeric_limits<std::uint32_t>::max() || value >= std::numeric_limits<std::int32_t>::min();
+				if (!fits)
+				{
+					return std::nullopt;
+				}
+				address = Operand::FromMemory(base, Register::Count, static_cast<std::int32_t>(value));
+			}
+			else if (add.Operands[1].IsRegister() && LookupRegisterSize(add.Operands[1].Reg) == LookupRegisterSize(destination))
+			{
+				// add d, d reads the copied value:
+				const auto addend = add.Operands[1].Reg == destination ? source : add.Operands[1].Reg;
+				if (IsAliasing(addend, destination))
+				{
+					return std::nullopt;
+				}
+				auto index = *LookupQWordAlias(addend);
+				auto baseRegister = base;
+				if (index == Register::Rsp)
+				{
+					std::swap(index, baseRegister);
+				}
+				if (index == Register::Rsp)
+				{
+					return std::nullopt;
+				}
+				address = Operand::FromMemory(baseRegister, index);
+			}
+			else
+			{
+				return std::nullopt;
+			}
+
+			InstructionNode lea = MakeNode(mov, Instruction::Lea);
+			lea.OperandCount = 2;
+			lea.Operands[0] = Operand::FromRegister(destination);
+			lea.Operands[1] = address;
+			return Single(lea);
+		}
+
+		/// <summary>
+		/// mov r, 0 -> xor r32, r32 (writing the 32-bit register zero extends)
+		/// </summary>
+		inline auto ZeroIdiom(const std::span<const InstructionNode> window, const std::uint8_t liveFlags) -> std::optional<PeepholeRewrite>
+		{
+			const auto& mov = window[0];
+			if (liveFlags != StatusFlags::None || !IsRegisterImmediate(mov, Instruction::Mov) || mov.Operands[1].Imm.UValue != 0 || !IsDWordOrQWordRegister(mov.Operands[0].Reg))
+			{
+				return std::nullopt;
+			}
+			const auto reg = LookupDWordAlias(mov.Operands[0].Reg).value_or(mov.Operands[0].Reg);
+			InstructionNode xorNode = MakeNode(mov, Instruction::Xor);
+			xorNode.OperandCount = 2;
+			xorNode.Operands[0] = Operand::FromRegister(reg);
+			xorNode.Operands[1] = Operand::FromRegister(reg);
+			return Single(xorNode);
+		}
+
+		/// <summary>
+		/// add r, 1 -> inc r (inc does not write CF)
+		/// </summary>
+		inline auto AddOneToInc(const std::span<const InstructionNode> window, const std::uint8_t liveFlags) -> std::optional<PeepholeRewrite>
+		{
+			const auto& add = window[0];
+			if ((liveFlags & StatusFlags::Carry) != 0 || !IsRegisterImmediate(add, Instruction::Add) || add.Operands[1].Imm.UValue != 1)
+			{
+				return std::nullopt;
+			}
+			InstructionNode inc = MakeNode(add, Instruction::Inc);
+			inc.OperandCount = 1;
+			inc.Operands[0] = add.Operands[0];
+			return Single(inc);
+		}
+	}
+
+	/// <summary>
+	/// The peephole rules, tried in order at every position.
+	/// Longer windows come first where they subsume a shorter rewrite (lea beats mov + inc).
+	/// </summary>
+	inline constexpr std::array PeepholeRules =
+	{
+		PeepholeRule{"drop-self-move", 1, &Peephole::DropSelfMove},
+		PeepholeRule{"drop-reverse-move", 2, &Peephole::DropReverseMove},
+		PeepholeRule{"drop-overwritten-move", 2, &Peephole::DropOverwrittenMove},
+		PeepholeRule{"add-with-copy-to-lea", 2, &Peephole::AddWithCopyToLea},
+		PeepholeRule{"zero-idiom", 1, &Peephole::ZeroIdiom},
+		PeepholeRule{"add-one-to-inc", 1, &Peephole::AddOneToInc},
+	};
+
+	struct PeepholeOptions final
+	{
+		/// <summary>
+		/// The status flags which may be read after the last instruction.
+		/// </summary>
+		std::uint8_t LiveOutFlags = StatusFlags::All;
+
+		/// <summary>
+		/// The maximum number of sweeps, a sweep can expose new matches for the next one.
+		/// </summary>
+		std::size_t MaxPasses = 4;
+	};
+
+	struct PeepholeStats final
+	{
+		std::size_t Passes = 0;
+		std::size_t Removed = 0;
+		std::array<std::size_t, PeepholeRules.size()> Applied = {};
+	};
+
+	/// <summary>
+	/// Computes the status flags live after every statement with one backward sweep.
+	/// Control may leave at branches, so all flags are live there.
+	/// </summary>
+	inline void ComputeLiveFlags(const std::span<const InstructionNode> nodes, const std::uint8_t liveOut, std::vector<std::uint8_t>& liveAfter)
+	{
+		liveAfter.resize(nodes.size());
+		std::uint8_t live = liveOut;
+		for (std::size_t i = nodes.size(); i-- > 0;)
+		{
+			const auto& node = nodes[i];
+			if (node.Kind != StatementKind::Instruction)
+			{
+				liveAfter[i] = live;
+				continue;
+			}
+			if (IsControlTransfer(node))
+			{
+				live = StatusFlags::All;
+			}
+			liveAfter[i] = live;
+			const auto effects = LookupFlagEffects(node.Instr);
+			live = static_cast<std::uint8_t>((live & ~effects.Written) | effects.Read);
+		}
+	}
+
+	/// <summary>
+	/// Applies the peephole rules to the statements in place until nothing changes or MaxPasses is reached.
+	/// Works on the instruction level, before any bytes are emitted.
+	/// Windows never span label definitions, because the definition is a statement itself.
+	/// </summary>
+	/// <param name="nodes">The statements, shrinks when instructions are removed.</param>
+	/// <param name="options">The optimizer options.</param>
+	/// <returns>The optimizer statistics.</returns>
+	inline auto OptimizePeephole(std::vector<InstructionNode>& nodes, const PeepholeOptions& options = {}) -> PeepholeStats
+	{
+		PeepholeStats stats = {};
+		std::vector<std::uint8_t> liveAfter = {};
+		bool changed = true;
+		while (changed && stats.Passes < options.MaxPasses)
+		{
+			changed = false;
+			++stats.Passes;
+			ComputeLiveFlags(nodes, options.LiveOutFlags, liveAfter);
+
+			// Rewrites never grow, so the output is compacted in place behind the read cursor:
+			std::size_t write = 0;
+			std::size_t read = 0;
+			while (read < nodes.size())
+			{
+				bool matched = false;
+				for (std::size_t rule = 0; rule < PeepholeRules.size() && !matched; ++rule)
+				{
+					const auto& entry = PeepholeRules[rule];
+					if (read + entry.Window > nodes.size())
+					{
+						continue;
+					}
+					const auto rewrite = entry.Apply(std::span<const InstructionNode>(nodes.data() + read, entry.Window), liveAfter[read + entry.Window - 1]);
+					if (!rewrite)
+					{
+						continue;
+					}
+					for (std::size_t i = 0; i < rewrite->Count; ++i)
+					{
+						nodes[write++] = rewrite->Nodes[i];
+					}
+					read += entry.Window;
+					stats.Removed += entry.Window - rewrite->Count;
+					++stats.Applied[rule];
+					matched = changed = true;
+				}
+				if (!matched)
+				{
+					if (write != read)
+					{
+						nodes[write] = nodes[read];
+					}
+					++write;
+					++read;
+				}
+			}
+			nodes.resize(write);
+		}
+		return stats;
+	}
+}
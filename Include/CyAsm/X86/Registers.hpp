@@ -3,6 +3,10 @@
 #include <cstdint>
 #include <array>
 #include <string_view>
+#include <optional>
+
+#include "../Utils.hpp"
+#include "../PerfectHash.hpp"
 
 namespace CyberAsm::X86
 {
@@ -169,6 +173,27 @@ namespace CyberAsm::X86
 		#include "RegisterIdTable.inl"
 	};
 
+	/// <summary>
+	/// Compile time perfect hash over all register mnemonics.
+	/// </summary>
+	constexpr PerfectHashTable<RegisterMnemonicTable.size()> RegisterHashTable(RegisterMnemonicTable);
+
+	/// <summary>
+	/// Looks up a register by its case insensitive mnemonic (without the '%' prefix) in constant time.
+	/// </summary>
+	/// <param name="mnemonic">The register name, for example 'rax' or 'RAX'.</param>
+	/// <returns>The register or std::nullopt if the name is unknown.</returns>
+	[[nodiscard]]
+	constexpr auto LookupRegister(const std::string_view mnemonic) noexcept -> std::optional<Register>
+	{
+		const auto index = RegisterHashTable.Find(mnemonic);
+		if (!index) [[unlikely]]
+		{
+			return std::nullopt;
+		}
+		return static_cast<Register>(*index);
+	}
+
 	[[nodiscard]]
 	constexpr auto LookupRegisterId(const Register reg) -> std::uint8_t
 	{
@@ -242,4 +267,54 @@ namespace CyberAsm::X86
 			(val >= static_cast<std::size_t>(Register::Xmm0) &&
 			val <= static_cast<std::size_t>(Register::Xmm15));
 	}
+
+	/// <summary>
+	/// Returns the 32-bit register which aliases the low half of a 64-bit GPR.
+	/// Writing the 32-bit register zero extends into the full 64-bit register.
+	/// </summary>
+	/// <param name="reg">The 64-bit register.</param>
+	/// <returns>The 32-bit alias or std::nullopt if the register is no 64-bit GPR.</returns>
+	[[nodiscard]]
+	constexpr auto LookupDWordAlias(const Register reg) noexcept -> std::optional<Register>
+	{
+		if (reg > Register::R15 || !IsMin64BitRegister(reg)) [[unlikely]]
+		{
+			return std::nullopt;
+		}
+
+		// The 32-bit alias always follows the 64-bit register:
+		return static_cast<Register>(static_cast<std::size_t>(reg) + 1);
+	}
+
+	/// <summary>
+	/// Returns the 64-bit GPR which contains the register, for example rax for eax, ax, ah and al.
+	/// </summary>
+	/// <param name="reg">The general purpose register.</param>
+	/// <returns>The 64-bit register or std::nullopt if the register is no GPR.</returns>
+	[[nodiscard]]
+	constexpr auto LookupQWordAlias(const Register reg) noexcept -> std::optional<Register>
+	{
+		if (reg > Register::R15B) [[unlikely]]
+		{
+			return std::nullopt;
+		}
+
+		// The 64-bit register always starts the group of its aliases:
+		auto index = static_cast<std::size_t>(reg);
+		while (!IsMin64BitRegister(static_cast<Register>(index)))
+		{
+			--index;
+		}
+		return static_cast<Register>(index);
+	}
+
+	/// <summary>
+	/// Checks if two registers are parts of the same 64-bit register, for example eax and ah.
+	/// </summary>
+	[[nodiscard]]
+	constexpr auto IsAliasing(const Register lhs, const Register rhs) noexcept -> bool
+	{
+		const auto lhsFull = LookupQWordAlias(lhs);
+		return lhs == rhs || (lhsFull && lhsFull == LookupQWordAlias(rhs));
+	}
 }
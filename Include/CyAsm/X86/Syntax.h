@@ -8,8 +8,19 @@ namespace CyberAsm::X64
 
 	constexpr auto Separator = ',';
 	constexpr auto Comment = '#';
+	constexpr auto LabelTerminator = ':';
+
+	constexpr auto ForwardLocalLabel = 'f';
+	constexpr auto BackwardLocalLabel = 'b';
 
 	constexpr auto HexPrefix = 'x';
 	constexpr auto BinPrefix = 'b';
 	constexpr auto OctPrefix = 'c';
+
+	constexpr auto NegativeSign = '-';
+
+	constexpr auto ByteSuffix = 'b';
+	constexpr auto WordSuffix = 'w';
+	constexpr auto LongSuffix = 'l';
+	constexpr auto QuadSuffix = 'q';
 }
@@ -0,0 +1,1052 @@
+#include <chrono>
+#include <filesystem>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "../Include/CyAsm/FileWriter.hpp"
+#include "../Include/CyAsm/InlineMachineStream.hpp"
+#include "../Include/CyAsm/MappedFileOutput.hpp"
+#include "../Include/CyAsm/SegmentedCodeBuffer.hpp"
+#include "../Include/CyAsm/StreamArena.hpp"
+#include "../Include/CyAsm/StreamReader.hpp"
+#include "../Include/CyAsm/X86/Assembler.hpp"
+#include "../Include/CyAsm/X86/AssemblyPipeline.hpp"
+#include "../Include/CyAsm/X86/BatchAssembler.hpp"
+#include "../Include/CyAsm/X86/Cas2.hpp"
+#include "../Include/CyAsm/X86/CharClassifier.hpp"
+#include "../Include/CyAsm/X86/Decoder.hpp"
+#include "../Include/CyAsm/X86/Instructions.hpp"
+#include "../Include/CyAsm/X86/ParallelAssembler.hpp"
+#include "../Include/CyAsm/X86/Registers.hpp"
+
+/// <summary>
+/// One measured benchmark.
+/// </summary>
+struct BenchResult final
+{
+	std::string Name = {};
+	std::size_t Iterations = 0;
+	double NanosecondsPerOp = 0.0;
+
+	/// <summary>
+	/// Bytes processed per iteration, 0 if the benchmark is not about throughput.
+	/// </summary>
+	std::size_t BytesPerOp = 0;
+
+	[[nodiscard]] auto OpsPerSecond() const noexcept -> double
+	{
+		return this->NanosecondsPerOp > 0.0 ? 1e9 / this->NanosecondsPerOp : 0.0;
+	}
+
+	[[nodiscard]] auto BytesPerSecond() const noexcept -> double
+	{
+		return this->OpsPerSecond() * static_cast<double>(this->BytesPerOp);
+	}
+};
+
+/// <summary>
+/// Collects the results of all benchmarks and scales the iteration counts.
+/// </summary>
+struct BenchContext final
+{
+	/// <summary>
+	/// Iteration counts are divided by this value, so quick runs finish in a second.
+	/// </summary>
+	std::size_t Divisor = 1;
+
+	std::vector<BenchResult> Results = {};
+
+	[[nodiscard]] auto Scale(const std::size_t iterations) const noexcept -> std::size_t
+	{
+		return std::max<std::size_t>(1, iterations / this->Divisor);
+	}
+};
+
+/// <summary>
+/// Keeps the compiler from optimizing away a benchmarked value.
+/// </summary>
+template <typename T>
+static inline void DoNotOptimize(const T& value)
+{
+	asm volatile("" : : "r,m"(value) : "memory");
+}
+
+/// <summary>
+/// Runs the function and returns the average nanoseconds per iteration.
+/// </summary>
+template <typename F>
+static auto MeasureNanoseconds(const std::size_t iterations, F&& function) -> double
+{
+	const auto begin = std::chrono::steady_clock::now();
+	for (std::size_t i = 0; i < iterations; ++i)
+	{
+		function(i);
+	}
+	const auto end = std::chrono::steady_clock::now();
+	return static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count()) / static_cast<double>(iterations);
+}
+
+/// <summary>
+/// Measures the function after one warm-up call and records the result.
+/// </summary>
+template <typename F>
+static void Run(BenchContext& context, std::string name, const std::size_t iterations, const std::size_t bytesPerOp, F&& function)
+{
+	function(0);
+	const auto scaled = context.Scale(iterations);
+	const double nanoseconds = MeasureNanoseconds(scaled, std::forward<F>(function));
+	context.Results.push_back(BenchResult{std::move(name), scaled, nanoseconds, bytesPerOp});
+}
+
+/// <summary>
+/// Runs the worker on several threads at once and records the wall time per iteration over all threads.
+/// The worker receives its iteration count and keeps its own state, such as an arena, on its stack.
+/// </summary>
+template <typename F>
+static void RunParallel(BenchContext& context, std::string name, const std::size_t iterations, const std::size_t threadCount, const std::size_t bytesPerOp, F&& worker)
+{
+	worker(1);
+	const auto perThread = std::max<std::size_t>(1, context.Scale(iterations) / threadCount);
+	const auto begin = std::chrono::steady_clock::now();
+	{
+		std::vector<std::jthread> threads = {};
+		threads.reserve(threadCount);
+		for (std::size_t i = 0; i < threadCount; ++i)
+		{
+			threads.emplace_back([&worker, perThread]
+			{
+				worker(perThread);
+			});
+		}
+	}
+	const auto end = std::chrono::steady_clock::now();
+	const auto total = perThread * threadCount;
+	const double nanoseconds = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count()) / static_cast<double>(total);
+	context.Results.push_back(BenchResult{std::move(name), total, nanoseconds, bytesPerOp});
+}
+
+/// <summary>
+/// Compares the linear variation scan with the precomputed variation index.
+/// For every variation of adc a canonical operand tuple selecting it is looked up:
+/// the scan cost grows with the position of the variation in the OperandTable, the index cost stays flat.
+/// </summary>
+static void BenchVariationLookup(BenchContext& context)
+{
+	using namespace CyberAsm::X86;
+
+	constexpr std::size_t iterations = 10'000'000;
+
+	const auto& table = OperandTable[static_cast<std::size_t>(Instruction::Adc)];
+	for (std::size_t variation = 0; variation < table.size(); ++variation)
+	{
+		// Find the first canonical operand tuple which resolves to this variation:
+		std::array<OperandFlags::Flags, MaxIndexedOperands> operands = {};
+		bool found = false;
+		for (std::size_t kind0 = 1; kind0 < OperandFlags::KindCount && !found; ++kind0)
+		{
+			for (std::size_t kind1 = 1; kind1 < OperandFlags::KindCount && !found; ++kind1)
+			{
+				if (VariationIndex[static_cast<std::size_t>(Instruction::Adc)][ComputeVariationIndexSlot(kind0, kind1)] == variation)
+				{
+					operands = {OperandFlags::Flags{1} << kind0, OperandFlags::Flags{1} << kind1};
+					found = true;
+				}
+			}
+		}
+		if (!found)
+		{
+			continue;
+		}
+
+		const std::span<const OperandFlags::Flags> span(operands);
+		Run(context, "lookup/variation/linear/" + std::to_string(variation), iterations, 0, [&](std::size_t)
+		{
+			DoNotOptimize(span);
+			DoNotOptimize(LookupOptimalInstructionVariation(Instruction::Adc, span).value_or(NoVariation));
+		});
+		Run(context, "lookup/variation/indexed/" + std::to_string(variation), iterations, 0, [&](std::size_t)
+		{
+			DoNotOptimize(span);
+			DoNotOptimize(LookupInstructionVariation(Instruction::Adc, span).value_or(NoVariation));
+		});
+	}
+}
+
+/// <summary>
+/// Compares a linear string compare scan with the perfect hash for all register names.
+/// </summary>
+static void BenchRegisterLookup(BenchContext& context)
+{
+	using namespace CyberAsm::X86;
+
+	constexpr std::size_t iterations = 10'000'000;
+
+	Run(context, "lookup/register/linear", iterations, 0, [](const std::size_t i)
+	{
+		const auto name = RegisterMnemonicTable[i % RegisterMnemonicTable.size()];
+		DoNotOptimize(name);
+		DoNotOptimize(std::find(RegisterMnemonicTable.begin(), RegisterMnemonicTable.end(), name));
+	});
+	Run(context, "lookup/register/hashed", iterations, 0, [](const std::size_t i)
+	{
+		const auto name = RegisterMnemonicTable[i % RegisterMnemonicTable.size()];
+		DoNotOptimize(name);
+		DoNotOptimize(LookupRegister(name).value_or(Register::Count));
+	});
+}
+
+/// <summary>
+/// Maps register operands to flags and looks up the variation, as the encoder does for every instruction.
+/// </summary>
+static void BenchAutoLookup(BenchContext& context)
+{
+	using namespace CyberAsm;
+	using namespace X86;
+
+	constexpr std::size_t iterations = 10'000'000;
+	constexpr std::array<Register, 4> registers = {Register::Al, Register::Bx, Register::Ecx, Register::R9};
+
+	Run(context, "lookup/auto/reg-reg", iterations, 0, [&](const std::size_t i)
+	{
+		const auto reg = registers[i % registers.size()];
+		DoNotOptimize(reg);
+		DoNotOptimize(AutoLookupInstruction(Instruction::Adc, reg, reg).value_or(NoVariation));
+	});
+	Run(context, "lookup/auto/reg-imm", iterations, 0, [&](const std::size_t i)
+	{
+		const auto reg = registers[i % registers.size()];
+		const Immediate immediate(i & 0x7F);
+		DoNotOptimize(reg);
+		DoNotOptimize(AutoLookupInstruction(Instruction::Adc, reg, immediate).value_or(NoVariation));
+	});
+}
+
+/// <summary>
+/// Encodes instructions for each register class, through the throwing and the non-throwing API.
+/// </summary>
+static void BenchEncode(BenchContext& context)
+{
+	using namespace CyberAsm;
+	using namespace X86;
+
+	constexpr std::size_t iterations = 5'000'000;
+
+	struct RegisterClass final
+	{
+		std::string_view Name;
+		std::array<Register, 4> Registers;
+	};
+	constexpr std::array<RegisterClass, 5> classes =
+	{
+		RegisterClass{"r8", {Register::Al, Register::Bl, Register::Cl, Register::Dl}},
+		RegisterClass{"r16", {Register::Ax, Register::Bx, Register::Cx, Register::Dx}},
+		RegisterClass{"r32", {Register::Eax, Register::Ebx, Register::Ecx, Register::Edx}},
+		RegisterClass{"r64", {Register::Rax, Register::Rbx, Register::Rcx, Register::Rdx}},
+		RegisterClass{"r64x", {Register::R8, Register::R9, Register::R10, Register::R15}},
+	};
+
+	for (const auto& registerClass : classes)
+	{
+		const auto& registers = registerClass.Registers;
+		const std::string name(registerClass.Name);
+		Run(context, "encode/reg-imm/" + name, iterations, 0, [&](const std::size_t i)
+		{
+			const auto reg = registers[i % registers.size()];
+			DoNotOptimize(reg);
+			DoNotOptimize(Cas2Encode<>(Instruction::Adc, reg, Immediate(i & 0x7F)));
+		});
+		Run(context, "encode/reg-reg/" + name, iterations, 0, [&](const std::size_t i)
+		{
+			const auto reg = registers[i % registers.size()];
+			DoNotOptimize(reg);
+			DoNotOptimize(Cas2Encode<>(Instruction::Adc, reg, registers[(i + 1) % registers.size()]));
+		});
+		Run(context, "encode/try-reg-imm/" + name, iterations, 0, [&](const std::size_t i)
+		{
+			const auto reg = registers[i % registers.size()];
+			DoNotOptimize(reg);
+			DoNotOptimize(TryCas2Encode<>(Instruction::Adc, reg, Immediate(i & 0x7F)));
+		});
+	}
+
+	// Speculative probing of a failing encoding, where the throwing API pays for unwinding:
+	Run(context, "encode/failure/throwing", iterations / 10, 0, [](const std::size_t i)
+	{
+		try
+		{
+			DoNotOptimize(Cas2Encode<>(Instruction::Adc, Register::Al, Immediate(0x100 + (i & 0xFF))));
+		}
+		catch (const std::runtime_error& ex)
+		{
+			DoNotOptimize(ex);
+		}
+	});
+	Run(context, "encode/failure/try", iterations / 10, 0, [](const std::size_t i)
+	{
+		DoNotOptimize(TryCas2Encode<>(Instruction::Adc, Register::Al, Immediate(0x100 + (i & 0xFF))));
+	});
+}
+
+/// <summary>
+/// Appends bytes to chunks and chunks to streams.
+/// </summary>
+static void BenchAppend(BenchContext& context)
+{
+	using namespace CyberAsm;
+	using namespace X86;
+
+	constexpr std::size_t iterations = 10'000'000;
+	constexpr std::size_t chunkBytes = 15;
+
+	Run(context, "bytechunk/append", iterations, chunkBytes, [](const std::size_t i)
+	{
+		ByteChunk chunk = {};
+		for (std::size_t j = 0; j < chunkBytes; ++j)
+		{
+			chunk << static_cast<std::uint8_t>(i + j);
+		}
+		DoNotOptimize(chunk);
+	});
+
+	// The stream is cleared regularly, so the measurement does not depend on the memory size:
+	constexpr std::size_t flushInterval = 1 << 16;
+	MachineStream<> stream = {};
+	stream.Reserve(flushInterval * ByteChunk::MaxByteChunkSize);
+
+	Run(context, "stream/append/byte", iterations, 1, [&](const std::size_t i)
+	{
+		if (i % flushInterval == 0) [[unlikely]]
+		{
+			stream.Clear();
+		}
+		stream << static_cast<std::uint8_t>(i);
+	});
+
+	const ByteChunk chunk = Cas2Encode<>(Instruction::Adc, Register::R9, Immediate(0x12345678));
+	Run(context, "stream/append/chunk", iterations, chunk.Size(), [&](const std::size_t i)
+	{
+		if (i % flushInterval == 0) [[unlikely]]
+		{
+			stream.Clear();
+		}
+		stream << chunk;
+	});
+	stream.Clear();
+	{
+		EmitCursor cursor = stream.BeginEmit();
+		Run(context, "stream/append/cursor", iterations, chunk.Size(), [&](const std::size_t i)
+		{
+			if (i % flushInterval == 0) [[unlikely]]
+			{
+				cursor.Commit();
+				stream.Clear();
+			}
+			cursor.Ensure(ByteChunk::MaxByteChunkSize);
+			cursor.Put(chunk);
+		});
+	}
+	stream.Clear();
+	{
+		EmitCursor cursor = stream.BeginEmit();
+		Run(context, "stream/append/encode-into", iterations, chunk.Size(), [&](const std::size_t i)
+		{
+			if (i % flushInterval == 0) [[unlikely]]
+			{
+				cursor.Commit();
+				stream.Clear();
+			}
+			DoNotOptimize(TryCas2EncodeInto<>(cursor, Instruction::Adc, Register::R9, Immediate(0x12345678)));
+		});
+	}
+	DoNotOptimize(stream.Size());
+}
+
+/// <summary>
+/// Creates, fills and destroys many small streams on several threads, like a JIT compiling tiny stubs.
+/// The default allocator goes through malloc for every growth step, the arena bumps a pointer
+/// and is reset once per compilation unit, the inline stream keeps the 56 byte stub inside the object.
+/// </summary>
+static void BenchStreamChurn(BenchContext& context)
+{
+	using namespace CyberAsm;
+	using namespace X86;
+
+	constexpr std::size_t iterations = 2'000'000;
+	constexpr std::size_t instructionsPerStream = 8;
+	constexpr std::size_t streamsPerUnit = 256;
+
+	const ByteChunk chunk = Cas2Encode<>(Instruction::Adc, Register::R9, Immediate(0x12345678));
+	const auto fill = [&chunk](MachineStream<>& stream)
+	{
+		for (std::size_t j = 0; j < instructionsPerStream; ++j)
+		{
+			stream << chunk;
+		}
+		DoNotOptimize(stream.Size());
+	};
+
+	const std::size_t hardwareThreads = std::max<std::size_t>(4, std::thread::hardware_concurrency());
+	for (const std::size_t threadCount : {std::size_t{1}, hardwareThreads})
+	{
+		const auto suffix = "/threads-" + std::to_string(threadCount);
+		RunParallel(context, "stream/churn/default" + suffix, iterations, threadCount, chunk.Size() * instructionsPerStream, [&](const std::size_t count)
+		{
+			for (std::size_t i = 0; i < count; ++i)
+			{
+				MachineStream<> stream = {};
+				fill(stream);
+			}
+		});
+		RunParallel(context, "stream/churn/arena" + suffix, iterations, threadCount, chunk.Size() * instructionsPerStream, [&](const std::size_t count)
+		{
+			StreamArena arena = {};
+			for (std::size_t i = 0; i < count; ++i)
+			{
+				if (i % streamsPerUnit == 0) [[unlikely]]
+				{
+					arena.Reset();
+				}
+				MachineStream<> stream = arena.CreateStream();
+				fill(stream);
+			}
+		});
+		RunParallel(context, "stream/churn/inline" + suffix, iterations, threadCount, chunk.Size() * instructionsPerStream, [&](const std::size_t count)
+		{
+			for (std::size_t i = 0; i < count; ++i)
+			{
+				InlineMachineStream<64> stream = {};
+				fill(*stream);
+			}
+		});
+	}
+}
+
+/// <summary>
+/// Emits a large image chunk by chunk into one growing stream and into a segmented buffer.
+/// The stream copies all code emitted so far on every reallocation, the segmented buffer never copies.
+/// </summary>
+static void BenchLargeImage(BenchContext& context)
+{
+	using namespace CyberAsm;
+	using namespace X86;
+
+	constexpr std::size_t iterations = 500;
+	constexpr std::size_t imageSize = 64 * 1024 * 1024;
+
+	const ByteChunk chunk = Cas2Encode<>(Instruction::Adc, Register::R9, Immediate(0x12345678));
+	const std::size_t chunkCount = imageSize / chunk.Size();
+	Run(context, "stream/image/vector", iterations, chunkCount * chunk.Size(), [&](std::size_t)
+	{
+		MachineStream<> stream = {};
+		EmitCursor cursor = stream.BeginEmit();
+		for (std::size_t i = 0; i < chunkCount; ++i)
+		{
+			cursor.Ensure(ByteChunk::MaxByteChunkSize);
+			cursor.Put(chunk);
+		}
+		cursor.Commit();
+		DoNotOptimize(stream.Size());
+	});
+	Run(context, "stream/image/segmented", iterations, chunkCount * chunk.Size(), [&](std::size_t)
+	{
+		SegmentedCodeBuffer code = {};
+		for (std::size_t i = 0; i < chunkCount; ++i)
+		{
+			code << chunk;
+		}
+		DoNotOptimize(code.Size());
+	});
+}
+
+/// <summary>
+/// Encodes an image and writes it to a temporary file:
+/// all at once after encoding, streamed block by block while encoding, and encoded directly into a file mapping.
+/// </summary>
+static void BenchFileOutput(BenchContext& context)
+{
+	using namespace CyberAsm;
+	using namespace X86;
+
+	constexpr std::size_t iterations = 1000;
+	constexpr std::size_t imageSize = 16 * 1024 * 1024;
+
+	const auto file = std::filesystem::temp_directory_path() / "CyberAsmBenchOutput.bin";
+	const ByteChunk chunk = Cas2Encode<>(Instruction::Adc, Register::R9, Immediate(0x12345678));
+	const std::size_t chunkCount = imageSize / chunk.Size();
+	Run(context, "io/write/ofstream", iterations, chunkCount * chunk.Size(), [&](std::size_t)
+	{
+		MachineStream<> stream = {};
+		EmitCursor cursor = stream.BeginEmit();
+		for (std::size_t i = 0; i < chunkCount; ++i)
+		{
+			cursor.Ensure(ByteChunk::MaxByteChunkSize);
+			cursor.Put(chunk);
+		}
+		cursor.Commit();
+		DoNotOptimize(stream(file));
+	});
+	Run(context, "io/write/streaming", iterations, chunkCount * chunk.Size(), [&](std::size_t)
+	{
+		FileWriter writer(file);
+		for (std::size_t i = 0; i < chunkCount; ++i)
+		{
+			writer << chunk;
+		}
+		writer.Close();
+	});
+	Run(context, "io/write/mmap", iterations, chunkCount * chunk.Size(), [&](std::size_t)
+	{
+		MappedFileOutput output(file, chunkCount * chunk.Size());
+		for (std::size_t i = 0; i < chunkCount; ++i)
+		{
+			const auto memory = output.Reserve(ByteChunk::MaxByteChunkSize);
+			std::memcpy(memory.data(), chunk.Data(), ByteChunk::MaxByteChunkSize);
+			output.Commit(chunk.Size());
+		}
+		output.Close();
+	});
+	std::filesystem::remove(file);
+}
+
+/// <summary>
+/// Searches and dumps a large stream.
+/// </summary>
+static void BenchStreamScan(BenchContext& context)
+{
+	using namespace CyberAsm;
+
+	constexpr std::size_t size = 1 << 20;
+	constexpr std::size_t iterations = 200;
+
+	// Filled with a byte pattern which never contains the needle:
+	MachineStream<> stream(size);
+	for (std::size_t i = 0; i < size; ++i)
+	{
+		stream << static_cast<std::uint8_t>(i % 0xFE);
+	}
+
+	Run(context, "stream/find/byte", iterations, size, [&](std::size_t)
+	{
+		DoNotOptimize(stream.Find(std::uint8_t{0xFF}));
+	});
+	Run(context, "stream/contains/byte", iterations, size, [&](std::size_t)
+	{
+		DoNotOptimize(stream.Contains(std::uint8_t{0xFF}));
+	});
+
+	std::array<std::uint8_t, 4> sequence = {0x10, 0x11, 0x12, 0x14};
+	Run(context, "stream/find/sequence", iterations, size, [&](std::size_t)
+	{
+		DoNotOptimize(stream.Find(std::span<std::uint8_t>(sequence)));
+	});
+	Run(context, "stream/contains/sequence", iterations, size, [&](std::size_t)
+	{
+		DoNotOptimize(stream.Contains(std::span<std::uint8_t>(sequence)));
+	});
+
+	// Small streams stay serial:
+	const MachineStream<> tiny(stream.begin(), 256);
+	Run(context, "stream/find/sequence-small", iterations * 1000, tiny.Size(), [&](std::size_t)
+	{
+		DoNotOptimize(tiny.Find(std::span<std::uint8_t>(sequence)));
+	});
+
+	// Gadget signature scan, one automaton pass against one search per pattern:
+	constexpr std::size_t patternCount = 64;
+	std::vector<std::vector<std::uint8_t>> patterns(patternCount);
+	for (std::size_t i = 0; i < patternCount; ++i)
+	{
+		for (std::size_t j = 0; j < 3 + i % 6; ++j)
+		{
+			patterns[i].push_back(static_cast<std::uint8_t>((i * 37 + j * 2) % 0xFE));
+		}
+	}
+	const std::vector<std::span<const std::uint8_t>> views(patterns.begin(), patterns.end());
+	const MultiPatternSearcher searcher(views);
+	const std::span<const std::uint8_t> code(stream.begin(), stream.end());
+	Run(context, "search/multi/automaton", iterations, size, [&](std::size_t)
+	{
+		DoNotOptimize(searcher.FindAll(code).size());
+	});
+	Run(context, "search/multi/per-pattern", iterations, size, [&](std::size_t)
+	{
+		std::size_t found = 0;
+		for (const auto& pattern : views)
+		{
+			found += FindSequence(code, pattern) != NotFound;
+		}
+		DoNotOptimize(found);
+	});
+
+	constexpr std::size_t dumpSize = 1 << 16;
+	const MachineStream<> dumped(stream.begin(), dumpSize);
+	Run(context, "stream/hexdump", iterations / 10, dumpSize, [&](std::size_t)
+	{
+		std::ostringstream out = {};
+		out << dumped;
+		DoNotOptimize(out.view().size());
+	});
+	for (const auto& [name, format] : {std::pair{"listing", DumpFormat::Listing}, std::pair{"c-array", DumpFormat::CArray}, std::pair{"raw-hex", DumpFormat::RawHex}})
+	{
+		Run(context, std::string("stream/dump/") + name, iterations / 10, dumpSize, [&](std::size_t)
+		{
+			DoNotOptimize(dumped.Dump(format).size());
+		});
+	}
+}
+
+/// <summary>
+/// Generates a source file with a realistic instruction mix including labels and branches.
+/// </summary>
+[[nodiscard]] static auto GenerateSource(const std::size_t lines) -> std::string
+{
+	constexpr std::array<std::string_view, 12> statements =
+	{
+		"adcq $0x7F, %rax\n",
+		"addl %ebx, %ecx\n",
+		"movq $0x123456789, %rdx\n",
+		"movl %r9d, %r10d\n",
+		"xorq %r11, %r11\n",
+		"addw $0x1234, %si\n",
+		"adcb %bl, %al\n",
+		"incq %r8\n",
+		"movb $5, %dil\n",
+		"addq $-8, %rsp\n",
+		"jne 1b\n",
+		"call 2f\n",
+	};
+
+	std::string source = {};
+	source.reserve(lines * 20);
+	for (std::size_t i = 0; i < lines; ++i)
+	{
+		if (i % 16 == 0)
+		{
+			source += "1:\n";
+		}
+		if (i % 64 == 63)
+		{
+			source += "2:\n";
+		}
+		source += statements[i % statements.size()];
+	}
+	source += "2:\n";
+	return source;
+}
+
+/// <summary>
+/// Decodes a mix of the encodings the assembler emits, in bytes per second of machine code.
+/// </summary>
+static void BenchDecode(BenchContext& context)
+{
+	using namespace CyberAsm;
+	using namespace X86;
+
+	constexpr std::size_t size = 1 << 20;
+	constexpr std::size_t iterations = 100;
+
+	const auto bytes = [](const ByteChunk& chunk)
+	{
+		return std::vector<std::uint8_t>(chunk.Data(), chunk.Data() + chunk.Size());
+	};
+	const std::array<std::vector<std::uint8_t>, 8> chunks =
+	{
+		bytes(Cas2Encode<>(Instruction::Adc, Register::Rax, Register::Rbx)),
+		bytes(Cas2Encode<>(Instruction::Add, Register::R10D, Immediate(5))),
+		bytes(Cas2Encode<>(Instruction::Xor, Register::Cx, Immediate(0x1234))),
+		bytes(Cas2Encode<>(Instruction::Mov, Register::R9, Immediate(0x1'2345'6789))),
+		bytes(Cas2Encode<>(Instruction::Inc, Register::Al)),
+		bytes(Cas2EncodeLea<>(Register::Rdi, Operand::FromMemory(Register::Rsp, Register::R12, 0x100))),
+		std::vector<std::uint8_t>{0x75, 0x10},
+		std::vector<std::uint8_t>{0xE8, 0x00, 0x01, 0x00, 0x00}
+	};
+	MachineStream<> stream(size + 16);
+	for (std::uint32_t seed = 12345; stream.Size() < size;)
+	{
+		seed = seed * 1103515245 + 12345;
+		stream << chunks[(seed >> 16) % chunks.size()];
+	}
+	const std::span<const std::uint8_t> code(stream.begin(), stream.Size());
+
+	Run(context, "decode/length", iterations, code.size(), [&](std::size_t)
+	{
+		std::size_t count = 0;
+		for (std::size_t offset = 0; offset < code.size(); ++count)
+		{
+			offset += *TryDecodeLength(code.subspan(offset));
+		}
+		DoNotOptimize(count);
+	});
+	Run(context, "decode/boundaries", iterations, code.size(), [&](std::size_t)
+	{
+		DoNotOptimize(DecodeBoundaries(code).size());
+	});
+	Run(context, "decode/full", iterations / 2, code.size(), [&](std::size_t)
+	{
+		std::size_t count = 0;
+		for (std::size_t offset = 0; offset < code.size(); ++count)
+		{
+			offset += TryDecode(code.subspan(offset))->Length;
+		}
+		DoNotOptimize(count);
+	});
+}
+
+/// <summary>
+/// Loads and indexes a generated source file.
+/// </summary>
+static void BenchSourceLoad(BenchContext& context)
+{
+	using namespace CyberAsm;
+
+	constexpr std::size_t iterations = 50;
+	const std::string source = GenerateSource(1'000'000);
+	const auto file = std::filesystem::temp_directory_path() / "CyberAsmBenchSource.asm";
+	{
+		std::ofstream out(file, std::ios::out | std::ios::binary | std::ios::trunc);
+		out << source;
+	}
+
+	Run(context, "source/read/copy", iterations, source.size(), [&](std::size_t)
+	{
+		std::string content = {};
+		ReadFile(content, file);
+		DoNotOptimize(content.size());
+	});
+	Run(context, "source/read/mmap", iterations, source.size(), [&](std::size_t)
+	{
+		// Touch every page, the mapping alone reads nothing:
+		const MappedSourceFile mapped(file);
+		const std::string_view text = mapped.Text();
+		std::size_t sum = 0;
+		for (std::size_t i = 0; i < text.size(); i += 4096)
+		{
+			sum += static_cast<std::uint8_t>(text[i]);
+		}
+		DoNotOptimize(sum);
+	});
+	LineIndex index = {};
+	Run(context, "source/index", iterations, source.size(), [&](std::size_t)
+	{
+		index.Build(source);
+		DoNotOptimize(index.Count());
+	});
+	Run(context, "source/split-lines", iterations, source.size(), [&](std::size_t)
+	{
+		std::vector<std::size_t> needles = {};
+		SplitLines(source, needles);
+		DoNotOptimize(needles.size());
+	});
+	std::filesystem::remove(file);
+}
+
+/// <summary>
+/// Finds the tokens of a generated source with the lexer and with the bitmask classifier.
+/// </summary>
+static void BenchClassify(BenchContext& context)
+{
+	using namespace CyberAsm;
+	using namespace X86;
+
+	constexpr std::size_t iterations = 50;
+	const std::string source = GenerateSource(200'000);
+	Run(context, "lex/lexer", iterations, source.size(), [&](std::size_t)
+	{
+		Lexer lexer(source);
+		std::size_t tokens = 0;
+		while (lexer.Next().Kind != TokenKind::EndOfFile)
+		{
+			++tokens;
+		}
+		DoNotOptimize(tokens);
+	});
+	Run(context, "lex/classified", iterations, source.size(), [&](std::size_t)
+	{
+		ClassifiedLexer lexer(source);
+		std::size_t tokens = 0;
+		while (lexer.Next().Kind != TokenKind::EndOfFile)
+		{
+			++tokens;
+		}
+		DoNotOptimize(tokens);
+	});
+	constexpr std::array<std::pair<SimdLevel, std::string_view>, 3> levels =
+	{{
+		{SimdLevel::Scalar, "lex/classify/scalar"},
+		{SimdLevel::Sse2, "lex/classify/sse2"},
+		{SimdLevel::Avx2, "lex/classify/avx2"}
+	}};
+	for (const auto& [level, name] : levels)
+	{
+		if (level > DetectSimdLevel())
+		{
+			continue;
+		}
+		Run(context, std::string(name), iterations, source.size(), [&](std::size_t)
+		{
+			std::size_t tokens = 0;
+			ClassifySource(source, [&tokens](std::size_t, const CharMasks& masks)
+			{
+				tokens += static_cast<std::size_t>(std::popcount(masks.TokenStarts));
+			}, level);
+			DoNotOptimize(tokens);
+		});
+	}
+}
+
+/// <summary>
+/// Assembles a whole file, either generated or given on the command line.
+/// </summary>
+static void BenchAssemble(BenchContext& context, const std::string& file)
+{
+	using namespace CyberAsm;
+	using namespace X86;
+
+	std::string source = {};
+	if (file.empty())
+	{
+		source = GenerateSource(100'000);
+	}
+	else
+	{
+		ReadFile(source, file);
+	}
+	const auto instructions = static_cast<std::size_t>(std::count(source.begin(), source.end(), '\n'));
+
+	constexpr std::size_t iterations = 20;
+	const auto scaled = context.Scale(iterations);
+	DoNotOptimize(Assemble<>(source).Size());
+	const double nanoseconds = MeasureNanoseconds(scaled, [&](std::size_t)
+	{
+		DoNotOptimize(Assemble<>(source).Size());
+	});
+	context.Results.push_back(BenchResult{"assemble/file", scaled, nanoseconds, source.size()});
+	context.Results.push_back(BenchResult{"assemble/line", scaled * instructions, nanoseconds / static_cast<double>(instructions), 0});
+
+	// The listing overhead, recording only and recording plus formatting:
+	AssemblyListing listing = {};
+	AssembleOptions options = {};
+	options.Listing = &listing;
+	Run(context, "assemble/listing-record", iterations, source.size(), [&](std::size_t)
+	{
+		listing.Clear();
+		DoNotOptimize(Assemble<>(source, options).Size());
+	});
+	Run(context, "assemble/listing-format", iterations, source.size(), [&](std::size_t)
+	{
+		listing.Clear();
+		const MachineStream<> stream = Assemble<>(source, options);
+		DoNotOptimize(FormatListing(source, std::span<const std::uint8_t>(stream.begin(), stream.end()), listing).size());
+	});
+
+	// Chunks on two threads and on every hardware thread, the stitching cost shows on a single core:
+	const std::size_t hardware = std::max<std::size_t>(std::thread::hardware_concurrency(), 1);
+	for (const std::size_t threads : {std::size_t{2}, hardware})
+	{
+		if (threads == 2 && hardware == 2)
+		{
+			continue;
+		}
+		const ParallelAssembleOptions parallel = {.Threads = threads, .MinChunkSize = 16 * 1024};
+		Run(context, "assemble/parallel/" + std::to_string(threads), iterations, source.size(), [&](std::size_t)
+		{
+			DoNotOptimize(AssembleParallel<>(source, {}, parallel).Size());
+		});
+	}
+}
+
+/// <summary>
+/// Assembles a batch of generated files of different sizes on every hardware thread, reading and writing real files.
+/// </summary>
+static void BenchBatch(BenchContext& context)
+{
+	using namespace CyberAsm;
+	using namespace X86;
+
+	const auto directory = std::filesystem::temp_directory_path() / "CyberAsmBenchBatch";
+	std::filesystem::create_directories(directory);
+	std::vector<BatchJob> jobs = {};
+	std::size_t bytes = 0;
+	for (std::size_t i = 0; i < 32; ++i)
+	{
+		const std::string source = GenerateSource(1'000 + i % 8 * 2'000);
+		const auto input = directory / ("file" + std::to_string(i) + ".asm");
+		std::ofstream out(input, std::ios::out | std::ios::binary | std::ios::trunc);
+		out << source;
+		bytes += source.size();
+		jobs.push_back(BatchJob{input, directory / ("file" + std::to_string(i) + ".bin")});
+	}
+
+	WorkStealingPool pool(0);
+	Run(context, "assemble/batch", 20, bytes, [&](std::size_t)
+	{
+		DoNotOptimize(AssembleBatch<>(jobs, pool).CodeBytes);
+	});
+	std::filesystem::remove_all(directory);
+}
+
+/// <summary>
+/// Assembles a file and writes it once after Finalize(), and streamed to the FileWriter while it is encoded.
+/// </summary>
+static void BenchStreamingOutput(BenchContext& context)
+{
+	using namespace CyberAsm;
+	using namespace X86;
+
+	const std::string source = GenerateSource(100'000);
+	const auto file = std::filesystem::temp_directory_path() / "CyberAsmBenchStreaming.bin";
+	Run(context, "assemble/file/finalized", 20, source.size(), [&](std::size_t)
+	{
+		const MachineStream<> stream = Assemble<>(source);
+		DoNotOptimize(stream(file));
+	});
+	Run(context, "assemble/file/streaming", 20, source.size(), [&](std::size_t)
+	{
+		FileWriter writer(file);
+		DoNotOptimize(AssembleStreaming<>(source, [&writer](const std::span<const std::uint8_t> code)
+		{
+			writer << code;
+		}, FileWriter::DefaultBlockSize));
+		writer.Close();
+	});
+	std::filesystem::remove(file);
+}
+
+static void BenchPipeline(BenchContext& context)
+{
+	using namespace CyberAsm;
+	using namespace X86;
+
+	const std::string source = GenerateSource(20'000);
+	for (const std::size_t batchSize : {16 * 1024, 256 * 1024})
+	{
+		Run(context, "assemble/pipeline/" + std::to_string(batchSize / 1024) + "K", 20, source.size(), [&](std::size_t)
+		{
+			std::istringstream input(source);
+			std::ostringstream output = {};
+			DoNotOptimize(AssemblePipelined<>(input, output, {.BatchSize = batchSize}).CodeBytes);
+		});
+	}
+}
+
+static void PrintTable(const BenchContext& context)
+{
+	std::cout << std::left << std::setw(36) << "benchmark" << std::right << std::setw(14) << "ns/op" << std::setw(16) << "ops/s" << std::setw(14) << "MiB/s" << '\n';
+	for (const auto& result : context.Results)
+	{
+		std::cout << std::left << std::setw(36) << result.Name << std::right << std::fixed << std::setprecision(2)
+			<< std::setw(14) << result.NanosecondsPerOp
+			<< std::setw(16) << std::setprecision(0) << result.OpsPerSecond()
+			<< std::setw(14) << std::setprecision(1);
+		if (result.BytesPerOp != 0)
+		{
+			std::cout << result.BytesPerSecond() / (1024.0 * 1024.0);
+		}
+		else
+		{
+			std::cout << '-';
+		}
+		std::cout << '\n';
+	}
+}
+
+static void PrintJson(const BenchContext& context, std::ostream& out)
+{
+	out << "{\n";
+	out << "  \"compiler\": \"" << __VERSION__ << "\",\n";
+	out << "  \"benchmarks\": [\n";
+	for (std::size_t i = 0; i < context.Results.size(); ++i)
+	{
+		const auto& result = context.Results[i];
+		out << "    {\"name\": \"" << result.Name << "\""
+			<< ", \"iterations\": " << result.Iterations
+			<< std::fixed << std::setprecision(3)
+			<< ", \"ns_per_op\": " << result.NanosecondsPerOp
+			<< ", \"ops_per_second\": " << result.OpsPerSecond()
+			<< ", \"bytes_per_op\": " << result.BytesPerOp
+			<< ", \"bytes_per_second\": " << result.BytesPerSecond()
+			<< '}' << (i + 1 < context.Results.size() ? "," : "") << '\n';
+	}
+	out << "  ]\n";
+	out << "}\n";
+}
+
+// Usage: CyberAsmBench [--quick] [--json [file]] [--source file.asm]
+auto main(const int argc, const char* const* const argv) -> int
+{
+	try
+	{
+		BenchContext context = {};
+		bool json = false;
+		std::string jsonFile = {};
+		std::string sourceFile = {};
+		for (int i = 1; i < argc; ++i)
+		{
+			const std::string_view arg = argv[i];
+			if (arg == "--quick")
+			{
+				context.Divisor = 100;
+			}
+			else if (arg == "--json")
+			{
+				json = true;
+				if (i + 1 < argc && argv[i + 1][0] != '-')
+				{
+					jsonFile = argv[++i];
+				}
+			}
+			else if (arg == "--source" && i + 1 < argc)
+			{
+				sourceFile = argv[++i];
+			}
+			else
+			{
+				std::cerr << "Usage: CyberAsmBench [--quick] [--json [file]] [--source file.asm]" << std::endl;
+				return -1;
+			}
+		}
+
+		BenchVariationLookup(context);
+		BenchRegisterLookup(context);
+		BenchAutoLookup(context);
+		BenchEncode(context);
+		BenchAppend(context);
+		BenchStreamChurn(context);
+		BenchLargeImage(context);
+		BenchFileOutput(context);
+		BenchStreamScan(context);
+		BenchDecode(context);
+		BenchSourceLoad(context);
+		BenchClassify(context);
+		BenchAssemble(context, sourceFile);
+		BenchBatch(context);
+		BenchStreamingOutput(context);
+		BenchPipeline(context);
+
+		if (!json)
+		{
+			PrintTable(context);
+			return 0;
+		}
+		if (jsonFile.empty())
+		{
+			PrintJson(context, std::cout);
+			return 0;
+		}
+		std::ofstream out(jsonFile);
+		PrintJson(context, out);
+		return out ? 0 : -1;
+	}
+	catch (const std::exception& ex)
+	{
+		std::cerr << ex.what() << std::endl;
+		return -1;
+	}
+}
@@ -1,22 +1,308 @@
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
 #include <iostream>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <vector>
 
-#include "../Include/CyAsm/X86/Cas2.hpp"
+#include "../Include/CyAsm/FileWriter.hpp"
+#include "../Include/CyAsm/MappedFileOutput.hpp"
+#include "../Include/CyAsm/StreamReader.hpp"
+#include "../Include/CyAsm/X86/AssemblyPipeline.hpp"
+#include "../Include/CyAsm/X86/BatchAssembler.hpp"
+#include "../Include/CyAsm/X86/ParallelAssembler.hpp"
 
 using namespace CyberAsm;
 
+[[nodiscard]] static auto Milliseconds(const std::chrono::nanoseconds duration) -> double
+{
+	return std::chrono::duration<double, std::milli>(duration).count();
+}
+
+/// <summary>
+/// Assembles all inputs concurrently, each into a .bin file next to it or in the output directory.
+/// Arguments starting with '@' name response files with one input per line.
+/// </summary>
+[[nodiscard]] static auto RunBatch(const std::span<const char* const> arguments, const std::filesystem::path& outputDirectory, const std::size_t threads, const X86::AssembleOptions& options) -> int
+{
+	using namespace X86;
+
+	std::vector<BatchJob> jobs = {};
+	for (const std::string_view argument : arguments)
+	{
+		if (argument.starts_with('@'))
+		{
+			for (auto& input : ReadResponseFile(argument.substr(1)))
+			{
+				jobs.push_back(BatchJob{std::move(input)});
+			}
+		}
+		else
+		{
+			jobs.push_back(BatchJob{argument});
+		}
+	}
+	for (auto& job : jobs)
+	{
+		job.Output = job.Input;
+		job.Output.replace_extension(".bin");
+		if (!outputDirectory.empty())
+		{
+			job.Output = outputDirectory / job.Output.filename();
+		}
+	}
+	if (!outputDirectory.empty())
+	{
+		std::filesystem::create_directories(outputDirectory);
+	}
+
+	WorkStealingPool pool(threads);
+	const BatchStats stats = AssembleBatch<>(jobs, pool, options);
+	for (std::size_t i = 0; i < jobs.size(); ++i)
+	{
+		const BatchFileResult& result = stats.Files[i];
+		if (!result.Succeeded())
+		{
+			std::cerr << jobs[i].Input.string() << ": " << result.Error << '\n';
+			continue;
+		}
+		std::cout << jobs[i].Input.string() << " -> " << jobs[i].Output.string() << ": " << result.SourceBytes << " -> " << result.CodeBytes
+			<< " bytes, read: " << Milliseconds(result.ReadTime) << " ms, encode: " << Milliseconds(result.EncodeTime)
+			<< " ms, write: " << Milliseconds(result.WriteTime) << " ms, thread " << result.Worker << '\n';
+	}
+	std::cout << "Batch: " << jobs.size() - stats.Failed << '/' << jobs.size() << " files on " << pool.ThreadCount() << " threads, "
+		<< stats.SourceBytes << " -> " << stats.CodeBytes << " bytes, " << stats.Steals << " stolen, wall: " << Milliseconds(stats.WallTime)
+		<< " ms, read: " << Milliseconds(stats.ReadTime) << " ms, encode: " << Milliseconds(stats.EncodeTime)
+		<< " ms, write: " << Milliseconds(stats.WriteTime) << " ms\n";
+	return stats.Failed == 0 ? 0 : -1;
+}
+
+/// <summary>
+/// Assembles the input into the output while it is read, every stage of the pipeline runs on its own thread.
+/// </summary>
+[[nodiscard]] static auto RunPipeline(const char* const inputFile, const char* const outputFile) -> int
+{
+	using namespace X86;
+
+	std::ifstream input(inputFile, std::ios::in | std::ios::binary);
+	if (!input) [[unlikely]]
+	{
+		std::cerr << "Failed to open " << inputFile << std::endl;
+		return -1;
+	}
+	std::ofstream output(outputFile, std::ios::out | std::ios::binary | std::ios::trunc);
+	if (!output) [[unlikely]]
+	{
+		std::cerr << "Failed to open " << outputFile << std::endl;
+		return -1;
+	}
+
+	const PipelineStats stats = AssemblePipelined<>(input, output);
+	output.close();
+	if (!output) [[unlikely]]
+	{
+		std::cerr << "Failed to write " << outputFile << std::endl;
+		return -1;
+	}
+	std::cout << "Pipeline: " << stats.SourceBytes << " -> " << stats.CodeBytes << " bytes, wall: " << Milliseconds(stats.WallTime)
+		<< " ms, peak pending: " << stats.PeakPendingBytes << " bytes\n";
+	for (std::size_t i = 0; i < PipelineStageCount; ++i)
+	{
+		const PipelineStageStats& stage = stats.Stages[i];
+		std::cout << "  " << PipelineStageNames[i] << ": " << stage.Batches << " batches, busy: " << Milliseconds(stage.BusyTime)
+			<< " ms, input wait: " << Milliseconds(stage.InputWaitTime) << " ms, output wait: " << Milliseconds(stage.OutputWaitTime)
+			<< " ms, utilization: " << stage.Utilization(stats.WallTime) * 100.0 << "%\n";
+	}
+	return 0;
+}
+
 auto main(const int argc, const char* const* const argv) -> int
 {
 	try
 	{
-		static_cast<void>(argc);
-		static_cast<void>(argv);
-
 		std::cout << "Cyber Assembly\n----------------\n";
 
 		using namespace X86;
 
-		const ByteChunk chunk = Cas2Encode<>(Instruction::Adc, Register::Rax, Immediate(5));
-		std::cout << chunk;
+		// Usage: CyberAsm [-O] [-j threads] [--stream | --mmap] [--listing file.lst] [input.asm] [output.bin]
+		//        CyberAsm [-O] [-j threads] --batch [--out-dir dir] input.asm... | @files.txt
+		//        CyberAsm --pipeline input.asm output.bin
+		AssembleOptions options = {};
+		PeepholeStats peephole = {};
+		AssemblyListing listing = {};
+		std::optional<std::size_t> threads = std::nullopt;
+		const char* listingFile = nullptr;
+		bool batch = false;
+		bool pipeline = false;
+		std::filesystem::path outputDirectory = {};
+		enum class OutputMode { File, Stream, Mapped } outputMode = OutputMode::File;
+		int argi = 1;
+		for (; argi < argc && argv[argi][0] == '-'; ++argi)
+		{
+			const std::string_view flag = argv[argi];
+			if (flag == "-O")
+			{
+				options.Peephole = true;
+				options.PeepholeResult = &peephole;
+			}
+			else if (flag == "-j" && argi + 1 < argc)
+			{
+				threads = std::strtoull(argv[++argi], nullptr, 10);
+			}
+			else if (flag == "--stream")
+			{
+				outputMode = OutputMode::Stream;
+			}
+			else if (flag == "--mmap")
+			{
+				outputMode = OutputMode::Mapped;
+			}
+			else if (flag == "--batch")
+			{
+				batch = true;
+			}
+			else if (flag == "--pipeline")
+			{
+				pipeline = true;
+			}
+			else if (flag == "--out-dir" && argi + 1 < argc)
+			{
+				outputDirectory = argv[++argi];
+			}
+			else if (flag == "--listing" && argi + 1 < argc)
+			{
+				listingFile = argv[++argi];
+				options.Listing = &listing;
+			}
+			else
+			{
+				std::cerr << "Usage: CyberAsm [-O] [-j threads] [--stream | --mmap] [--listing file.lst] [input.asm] [output.bin]\n"
+					"       CyberAsm [-O] [-j threads] --batch [--out-dir dir] input.asm... | @files.txt\n"
+					"       CyberAsm --pipeline input.asm output.bin" << std::endl;
+				return -1;
+			}
+		}
+		if (argc - argi < 1)
+		{
+			const ByteChunk chunk = Cas2Encode<>(Instruction::Adc, Register::Rax, Immediate(5));
+			std::cout << chunk;
+			return 0;
+		}
+
+		if (batch)
+		{
+			// Files are assembled side by side on every hardware thread, unless -j says otherwise:
+			return RunBatch(std::span(argv + argi, static_cast<std::size_t>(argc - argi)), outputDirectory, threads.value_or(0), options);
+		}
+
+		if (pipeline)
+		{
+			// Peephole optimization and listings need the whole source, the pipeline only sees one batch at a time:
+			if (options.Peephole || listingFile || argc - argi < 2)
+			{
+				std::cerr << "--pipeline needs an output file and supports neither -O nor --listing" << std::endl;
+				return -1;
+			}
+			return RunPipeline(argv[argi], argv[argi + 1]);
+		}
+
+		const auto readBegin = std::chrono::steady_clock::now();
+		const MappedSourceFile input(argv[argi]);
+		const std::string_view source = input.Text();
+		const auto readTime = std::chrono::steady_clock::now() - readBegin;
+
+		// The streaming writer receives the code while it is encoded, so disk writes overlap with encoding and only a block is resident:
+		if (outputMode == OutputMode::Stream && argc - argi >= 2)
+		{
+			if (options.Peephole || listingFile)
+			{
+				std::cerr << "--stream supports neither -O nor --listing" << std::endl;
+				return -1;
+			}
+			const auto streamBegin = std::chrono::steady_clock::now();
+			FileWriter writer(argv[argi + 1]);
+			const std::size_t size = AssembleStreaming<>(source, [&writer](const std::span<const std::uint8_t> code)
+			{
+				writer << code;
+			}, FileWriter::DefaultBlockSize);
+			writer.Close();
+			const auto streamTime = std::chrono::steady_clock::now() - streamBegin;
+			const FileOutputStats& io = writer.Stats();
+			std::cout << "Read: " << Milliseconds(readTime) << " ms, encode and write: " << Milliseconds(streamTime) << " ms, I/O: " << Milliseconds(io.IoTime)
+				<< " ms, stalled: " << Milliseconds(io.StallTime) << " ms, " << io.BytesWritten << '/' << size << " bytes written\n";
+			return 0;
+		}
+
+		const auto encodeBegin = std::chrono::steady_clock::now();
+		MachineStream<> stream = {};
+		const std::size_t chunks = AssembleParallel<>(source, stream, options, {.Threads = threads.value_or(1)});
+		if (chunks > 1)
+		{
+			std::cout << "Parallel: " << chunks << " chunks\n";
+		}
+		if (options.Peephole)
+		{
+			std::cout << "Peephole: " << peephole.Removed << " instructions removed in " << peephole.Passes << " passes";
+			for (std::size_t i = 0; i < PeepholeRules.size(); ++i)
+			{
+				std::cout << ", " << PeepholeRules[i].Name << ' ' << peephole.Applied[i];
+			}
+			std::cout << '\n';
+		}
+		const RelaxationStats relaxation = stream.Finalize(0, listing.Markers());
+		const auto encodeTime = std::chrono::steady_clock::now() - encodeBegin;
+		std::cout << "Branch relaxation: " << relaxation.Iterations << " iterations, "
+			<< relaxation.Widened << '/' << relaxation.Branches << " branches widened, "
+			<< relaxation.BytesSaved << " bytes saved\n";
+
+		if (listingFile)
+		{
+			std::ofstream listingOut(listingFile, std::ios::out | std::ios::trunc);
+			WriteListing(listingOut, source, std::span<const std::uint8_t>(stream.begin(), stream.end()), listing);
+			if (!listingOut) [[unlikely]]
+			{
+				std::cerr << "Failed to write " << listingFile << std::endl;
+				return -1;
+			}
+		}
+
+		// Without an output file the machine code is dumped:
+		if (argc - argi < 2)
+		{
+			std::cout << stream;
+			return 0;
+		}
+
+		// Labels are resolved by Finalize(), so the code is written after encoding:
+		FileOutputStats io = {};
+		switch (outputMode)
+		{
+			case OutputMode::Mapped:
+			{
+				MappedFileOutput output(argv[argi + 1], stream.Size());
+				output << stream;
+				output.Close();
+				io = output.Stats();
+				break;
+			}
+			default:
+			{
+				const auto ioBegin = std::chrono::steady_clock::now();
+				if (!stream(argv[argi + 1])) [[unlikely]]
+				{
+					std::cerr << "Failed to write " << argv[argi + 1] << std::endl;
+					return -1;
+				}
+				io.IoTime = std::chrono::steady_clock::now() - ioBegin;
+				io.BytesWritten = stream.Size();
+				break;
+			}
+		}
+		std::cout << "Read: " << Milliseconds(readTime) << " ms, encode: " << Milliseconds(encodeTime) << " ms, I/O: " << Milliseconds(io.IoTime) << " ms, stalled: "
+			<< Milliseconds(io.StallTime) << " ms, " << io.BytesWritten << " bytes written\n";
 		return 0;
 	}
 	catch (const std::exception& ex)
@@ -1,8 +1,23 @@
 #include <cassert>
+#include <functional>
 #include <iostream>
+#include <sstream>
 
 #include "../Include/CyAsm/X86/Instructions.hpp"
 #include "../Include/CyAsm/X86/Cas2.hpp"
+#include "../Include/CyAsm/X86/Assembler.hpp"
+#include "../Include/CyAsm/X86/AssemblyPipeline.hpp"
+#include "../Include/CyAsm/X86/BatchAssembler.hpp"
+#include "../Include/CyAsm/X86/CharClassifier.hpp"
+#include "../Include/CyAsm/X86/Decoder.hpp"
+#include "../Include/CyAsm/X86/ParallelAssembler.hpp"
+#include "../Include/CyAsm/FileWriter.hpp"
+#include "../Include/CyAsm/InlineMachineStream.hpp"
+#include "../Include/CyAsm/JitArena.hpp"
+#include "../Include/CyAsm/MappedFileOutput.hpp"
+#include "../Include/CyAsm/SegmentedCodeBuffer.hpp"
+#include "../Include/CyAsm/StreamArena.hpp"
+#include "../Include/CyAsm/StreamReader.hpp"
 
 static void RunAllTestsForX86()
 {
@@ -60,6 +75,29 @@ static void RunAllTestsForX86()
 		static_cast<void>(instruction);
 	}
 
+	// Test the variation index against the linear scan:
+	{
+		for (std::size_t instr = 0; instr < static_cast<std::size_t>(Instruction::Count); ++instr)
+		{
+			for (std::size_t kind0 = 1; kind0 < OperandFlags::KindCount; ++kind0)
+			{
+				for (std::size_t kind1 = 1; kind1 < OperandFlags::KindCount; ++kind1)
+				{
+					const std::array<const OperandFlags::Flags, 2> operands = {OperandFlags::Flags{1} << kind0, OperandFlags::Flags{1} << kind1};
+					const auto linear = LookupOptimalInstructionVariation(static_cast<Instruction>(instr), operands);
+					const auto indexed = LookupInstructionVariation(static_cast<Instruction>(instr), operands);
+					assert(linear == indexed);
+					static_cast<void>(linear);
+					static_cast<void>(indexed);
+				}
+			}
+		}
+		static_assert(LookupInstructionVariation(Instruction::Adc, std::array<const OperandFlags::Flags, 2>{OperandFlags::Reg64, OperandFlags::Imm32}) == 7);
+		static_assert(LookupInstructionVariation(Instruction::Adc, std::array<const OperandFlags::Flags, 2>{OperandFlags::Reg64Rax, OperandFlags::Imm32}) == 5);
+		static_assert(LookupInstructionVariation(Instruction::Adc, std::array<const OperandFlags::Flags, 2>{OperandFlags::Reg16Ax, OperandFlags::Imm8}) == 8);
+		static_assert(!LookupInstructionVariation(Instruction::Adc, std::array<const OperandFlags::Flags, 2>{OperandFlags::Imm8, OperandFlags::Reg8}));
+	}
+
 	// Test assembling for 8-bit:
 
 	// adc al, 22
@@ -223,17 +261,1881 @@ static void RunAllTestsForX86()
 	}
 
 #endif
-	// adc ax, 5
+	// adc ax, 5 (the sign extended imm8 form is as short as the accumulator form and preferred)
 	{
-		// TODO operand override
 		const auto machineCode = Cas2Encode<>(Instruction::Adc, Register::Ax, Immediate(5));
 		assert(machineCode.Size() == 4);
 		assert(machineCode[0] == 0x66);
-		assert(machineCode[1] == 0x15);
-		assert(machineCode[2] == 0x05);
-		assert(machineCode[3] == 0x00);
+		assert(machineCode[1] == 0x83);
+		assert(machineCode[2] == 0xD0);
+		assert(machineCode[3] == 0x05);
 		static_cast<void>(machineCode);
 	}
+
+	// Shortest encoding selection:
+	{
+		const auto encodes = [](const Instruction instruction, const Register reg, const std::uint64_t value, const std::u8string_view expected)
+		{
+			const auto machineCode = Cas2Encode<>(instruction, reg, Immediate(value));
+			return std::equal(machineCode.begin(), machineCode.end(), expected.begin(), expected.end());
+		};
+		const auto negative = [](const std::int64_t value)
+		{
+			return static_cast<std::uint64_t>(value);
+		};
+
+		// Sign extended imm8:
+		assert(encodes(Instruction::Adc, Register::Rbx, 5, u8"\x48\x83\xD3\x05"_mach));
+		assert(encodes(Instruction::Add, Register::Ecx, negative(-1), u8"\x83\xC1\xFF"_mach));
+		assert(encodes(Instruction::Add, Register::Bx, 0xFFFF, u8"\x66\x83\xC3\xFF"_mach));
+		assert(encodes(Instruction::Add, Register::R8, negative(-128), u8"\x49\x83\xC0\x80"_mach));
+
+		// 0x80 does not fit a signed imm8:
+		assert(encodes(Instruction::Add, Register::Ecx, 0x80, u8"\x81\xC1\x80\x00\x00\x00"_mach));
+		assert(encodes(Instruction::Add, Register::Eax, 0x80, u8"\x05\x80\x00\x00\x00"_mach));
+
+		// 64-bit operands sign extend imm32:
+		assert(encodes(Instruction::Add, Register::Rcx, negative(-129), u8"\x48\x81\xC1\x7F\xFF\xFF\xFF"_mach));
+
+		// mov uses the +r forms, 64-bit values without upper bits are moved zero extending through the 32-bit register:
+		assert(encodes(Instruction::Mov, Register::Al, 5, u8"\xB0\x05"_mach));
+		assert(encodes(Instruction::Mov, Register::R9W, 5, u8"\x66\x41\xB9\x05\x00"_mach));
+		assert(encodes(Instruction::Mov, Register::Rax, 5, u8"\xB8\x05\x00\x00\x00"_mach));
+		assert(encodes(Instruction::Mov, Register::R12, 0xFFFFFFFF, u8"\x41\xBC\xFF\xFF\xFF\xFF"_mach));
+		assert(encodes(Instruction::Mov, Register::Rdx, negative(-1), u8"\x48\xC7\xC2\xFF\xFF\xFF\xFF"_mach));
+		assert(encodes(Instruction::Mov, Register::Rsi, 0x123456789A, u8"\x48\xBE\x9A\x78\x56\x34\x12\x00\x00\x00"_mach));
+
+		// Values which fit neither signed nor unsigned into the register are rejected:
+		bool thrown = false;
+		try
+		{
+			static_cast<void>(Cas2Encode<>(Instruction::Add, Register::Al, Immediate(0x100)));
+		}
+		catch (const std::runtime_error&)
+		{
+			thrown = true;
+		}
+		assert(thrown);
+		static_cast<void>(thrown);
+		static_cast<void>(encodes);
+		static_cast<void>(negative);
+	}
+
+	// Test the immediate encoding index against the variation scan:
+	{
+		constexpr std::array<std::uint64_t, 16> values =
+		{
+			0, 1, 0x7F, 0x80, 0xFF, 0x100, 0x7FFF, 0x8000, 0xFFFF, 0x1'0000, 0x7FFF'FFFF, 0x8000'0000, 0xFFFF'FFFF,
+			0x1'0000'0000, 0x8000'0000'0000'0000, 0xFFFF'FFFF'FFFF'FF80
+		};
+		for (std::size_t instr = 0; instr < static_cast<std::size_t>(Instruction::Count); ++instr)
+		{
+			for (std::size_t r = 0; r < static_cast<std::size_t>(Register::Count); ++r)
+			{
+				for (const std::uint64_t value : values)
+				{
+					const auto instruction = static_cast<Instruction>(instr);
+					const Immediate immediate(value);
+					auto reg = static_cast<Register>(r);
+					const auto indexed = TrySelectImmediateEncoding(instruction, reg, immediate);
+					if (!FitsOperandSize(immediate, LookupRegisterSize(reg)))
+					{
+						assert(!indexed && indexed.Error().Code == ErrorCode::ImmediateTooLarge);
+						continue;
+					}
+					if (instruction == Instruction::Mov && value <= std::numeric_limits<std::uint32_t>::max())
+					{
+						reg = LookupDWordAlias(reg).value_or(reg);
+					}
+					const auto scanned = ScanImmediateEncoding(instruction, reg, immediate);
+					assert(scanned.has_value() == static_cast<bool>(indexed));
+					if (scanned)
+					{
+						const ImmediateEncoding& encoding = indexed.Value();
+						assert(encoding.Variation == scanned->Variation);
+						assert(encoding.Reg == scanned->Reg);
+						assert(encoding.OperandSize == scanned->OperandSize);
+						assert(encoding.ImmediateSize == scanned->ImmediateSize);
+						assert(encoding.HasModRm == scanned->HasModRm);
+						assert(encoding.RequiresRex == scanned->RequiresRex);
+						assert(encoding.Length == scanned->Length);
+						static_cast<void>(encoding);
+					}
+					static_cast<void>(scanned);
+				}
+			}
+		}
+		static_assert(TrySelectImmediateEncoding(Instruction::Adc, Register::Ax, Immediate(5)).Value().Variation == 8);
+		static_assert(TrySelectImmediateEncoding(Instruction::Mov, Register::Rax, Immediate(5)).Value().Reg == Register::Eax);
+	}
+
+	// Non-throwing API, usable in constant expressions:
+	{
+		static_assert(noexcept(TryCas2Encode<>(Instruction::Adc, Register::Rax, Immediate(5))));
+		static_assert(noexcept(TryCas2Encode<>(Instruction::Adc, Register::Rax, Register::Rbx)));
+		static_assert(noexcept(Mapper::TryMapFlags(Register::Rax)));
+
+		constexpr auto machineCode = TryCas2Encode<>(Instruction::Adc, Register::Rax, Immediate(5));
+		static_assert(machineCode.HasValue());
+		static_assert(machineCode->Size() == 4 && (*machineCode)[0] == 0x48 && (*machineCode)[3] == 0x05);
+
+		constexpr auto tooLarge = TryCas2Encode<>(Instruction::Add, Register::Al, Immediate(0x100));
+		static_assert(!tooLarge && tooLarge.Error().Code == ErrorCode::ImmediateTooLarge);
+		static_assert(tooLarge.Error().OperandIndex == 1 && tooLarge.Error().Value == 0x100);
+
+		constexpr auto sizeMismatch = TryCas2Encode<>(Instruction::Adc, Register::Rax, Register::Ebx);
+		static_assert(sizeMismatch.Error().Code == ErrorCode::OperandSizeMismatch && sizeMismatch.Error().OperandIndex == 1);
+
+		constexpr auto highByte = TryCas2Encode<>(Instruction::Adc, Register::Ah, Register::Sil);
+		static_assert(highByte.Error().Code == ErrorCode::HighByteRegisterWithRex && highByte.Error().OperandIndex == 0);
+		static_assert(highByte.Error().Value == static_cast<std::uint64_t>(Register::Ah));
+
+		constexpr auto noVariation = TryCas2Encode<>(Instruction::Jmp, Register::Rax, Register::Rbx);
+		static_assert(noVariation.Error().Code == ErrorCode::NoMatchingVariation);
+
+		constexpr std::array<OperandFlags::Flags, 2> operands = {OperandFlags::Reg64, OperandFlags::Imm8};
+		static_assert(TryLookupInstructionVariation(Instruction::Adc, operands).Value() == 8);
+		static_assert(Mapper::TryMapFlags(Register::Count).Error().Code == ErrorCode::InvalidRegister);
+
+		// The throwing wrappers report the diagnostic message with its operand and value:
+		const auto thrown = [](auto&& encode) -> std::string
+		{
+			try
+			{
+				static_cast<void>(encode());
+			}
+			catch (const std::runtime_error& ex)
+			{
+				return ex.what();
+			}
+			return {};
+		};
+		const std::string mismatch = thrown([] { return Cas2Encode<>(Instruction::Adc, Register::Rax, Register::Ebx); });
+		assert(mismatch.starts_with(DescribeError(ErrorCode::OperandSizeMismatch)) && mismatch.find(" (operand 1, value 0x") != std::string::npos);
+		const std::string large = thrown([] { return Cas2Encode<>(Instruction::Adc, Register::Eax, Immediate(0x1'2345'6789)); });
+		assert(large == std::string(DescribeError(ErrorCode::ImmediateTooLarge)) + " (operand 1, value 0x123456789)");
+		assert(Diagnostic{ErrorCode::InvalidAddress}.Describe() == DescribeError(ErrorCode::InvalidAddress));
+		assert((Fail(ErrorCode::UnknownOpCode, Diagnostic::NoOperand, 0xF4).Describe() == std::string(DescribeError(ErrorCode::UnknownOpCode)) + " (value 0xf4)"));
+		static_cast<void>(mismatch);
+		static_cast<void>(large);
+	}
+
+	// Encoding into caller provided memory:
+	{
+		constexpr auto encodeToBuffer = []
+		{
+			InstructionBuffer buffer = {};
+			const auto size = TryCas2EncodeTo<>(buffer, Instruction::Adc, Register::R8, Immediate(0x1234));
+			return std::pair{size.Value(), buffer};
+		};
+		static_assert(encodeToBuffer().first == 7 && encodeToBuffer().second.Size() == 7);
+		static_assert(encodeToBuffer().second.Bytes[0] == 0x49 && encodeToBuffer().second.Bytes[6] == 0x00);
+
+		const ByteChunk expected = Cas2Encode<>(Instruction::Adc, Register::R8, Immediate(0x1234));
+		std::array<std::uint8_t, 32> memory = {};
+		const auto size = TryCas2EncodeInto<>(std::span<std::uint8_t>(memory), Instruction::Adc, Register::R8, Immediate(0x1234));
+		assert(size && *size == expected.Size());
+		assert(std::equal(memory.begin(), memory.begin() + *size, expected.Data()));
+
+		// Short buffers are written exactly if the instruction fits:
+		std::array<std::uint8_t, 8> exact = {};
+		exact.fill(0xCC);
+		const auto exactSize = TryCas2EncodeInto<>(std::span<std::uint8_t>(exact.data(), 7), Instruction::Adc, Register::R8, Immediate(0x1234));
+		assert(exactSize && *exactSize == 7 && exact[6] == 0x00 && exact[7] == 0xCC);
+
+		const auto tooSmall = TryCas2EncodeInto<>(std::span<std::uint8_t>(exact.data(), 3), Instruction::Adc, Register::R8, Immediate(0x1234));
+		assert(!tooSmall && tooSmall.Error().Code == ErrorCode::BufferTooSmall && tooSmall.Error().Value == 7);
+
+		const auto failed = TryCas2EncodeInto<>(std::span<std::uint8_t>(memory), Instruction::Adc, Register::Rax, Register::Ebx);
+		assert(!failed && failed.Error().Code == ErrorCode::OperandSizeMismatch);
+
+		static_cast<void>(size);
+		static_cast<void>(exactSize);
+		static_cast<void>(tooSmall);
+		static_cast<void>(failed);
+	}
+}
+
+static void RunAllTestsForParser()
+{
+	using namespace CyberAsm;
+	using namespace X86;
+
+	// Integer literals:
+	{
+		static_assert(ParseInteger("255") == 255);
+		static_assert(ParseInteger("0xFF") == 0xFF);
+		static_assert(ParseInteger("0b101") == 5);
+		static_assert(ParseInteger("0c17") == 15);
+		static_assert(ParseInteger("-1") == ~UINT64_C(0));
+		static_assert(!ParseInteger("0xFFFFFFFFFFFFFFFFF"));
+		static_assert(!ParseInteger("12a"));
+	}
+
+	// Perfect hash lookups:
+	{
+		for (std::size_t i = 0; i < RegisterMnemonicTable.size(); ++i)
+		{
+			assert(LookupRegister(RegisterMnemonicTable[i]) == static_cast<Register>(i));
+		}
+		for (std::size_t i = 0; i < MnemonicTable.size(); ++i)
+		{
+			assert(LookupMnemonic(MnemonicTable[i])->Instr == static_cast<Instruction>(i));
+		}
+		static_assert(LookupRegister("RAX") == Register::Rax);
+		static_assert(LookupRegister("Xmm15") == Register::Xmm15);
+		static_assert(!LookupRegister("rax "));
+		static_assert(!LookupRegister("r16"));
+		static_assert(!LookupRegister(""));
+		static_assert(LookupMnemonic("ADCQ")->Instr == Instruction::Adc);
+		static_assert(LookupMnemonic("adcq")->SizeSuffix == WordSize::QWord);
+		static_assert(LookupMnemonic("addb")->SizeSuffix == WordSize::HWord);
+		static_assert(LookupMnemonic("AddW")->SizeSuffix == WordSize::Word);
+		static_assert(LookupMnemonic("adcl")->SizeSuffix == WordSize::DWord);
+		static_assert(!LookupMnemonic("adc")->SizeSuffix);
+		static_assert(!LookupMnemonic("adcx"));
+		static_assert(!LookupMnemonic("q"));
+	}
+
+	// Tokens are slices of the source:
+	{
+		constexpr std::string_view source = "adcq $0xFF, %rax # comment\n";
+		Lexer lexer(source);
+		const auto mnemonic = lexer.Next();
+		assert(mnemonic.Kind == TokenKind::Identifier && mnemonic.Lexeme == "adcq");
+		assert(mnemonic.Lexeme.data() == source.data());
+		const auto immediate = lexer.Next();
+		assert(immediate.Kind == TokenKind::Immediate && immediate.Lexeme == "0xFF");
+		const auto separator = lexer.Next();
+		assert(separator.Kind == TokenKind::Separator);
+		const auto reg = lexer.Next();
+		assert(reg.Kind == TokenKind::Register && reg.Lexeme == "rax");
+		const auto newLine = lexer.Next();
+		assert(newLine.Kind == TokenKind::NewLine);
+		const auto end = lexer.Next();
+		assert(end.Kind == TokenKind::EndOfFile);
+		static_cast<void>(mnemonic);
+		static_cast<void>(immediate);
+		static_cast<void>(separator);
+		static_cast<void>(reg);
+		static_cast<void>(newLine);
+		static_cast<void>(end);
+	}
+
+	// Operands are converted into Intel order:
+	{
+		Parser parser("\n  adcq $0xFF, %rax\n");
+		InstructionNode node = {};
+		const bool parsed = parser.Next(node);
+		assert(parsed);
+		assert(node.Instr == Instruction::Adc);
+		assert(node.SizeSuffix == WordSize::QWord);
+		assert(node.OperandCount == 2);
+		assert(node.Operands[0].IsRegister() && node.Operands[0].Reg == Register::Rax);
+		assert(node.Operands[1].IsImmediate() && node.Operands[1].Imm.UValue == 0xFF);
+		assert(node.Line == 2);
+		const bool more = parser.Next(node);
+		assert(!more);
+		static_cast<void>(parsed);
+		static_cast<void>(more);
+	}
+
+	// Suffix and register size mismatch:
+	{
+		bool thrown = false;
+		try
+		{
+			static_cast<void>(Assemble<>("adcb %rbx, %rax"));
+		}
+		catch (const std::runtime_error&)
+		{
+			thrown = true;
+		}
+		assert(thrown);
+		static_cast<void>(thrown);
+	}
+
+	// Examples/adc.asm:
+	{
+		constexpr std::string_view source =
+			"adcb $0xFF, %al\n"
+			"adcw $0xFF, %ax\n"
+			"adcl $0xFF, %eax\n"
+			"adcq $0xFF, %rax\n"
+			"adcb %bl, %al\n"
+			"adcw %bx, %ax\n"
+			"adcl %ebx, %eax\n"
+			"adcq %rbx, %rax";
+		const auto stream = Assemble<>(source);
+		assert(stream == u8"\x14\xFF"
+			u8"\x66\x15\xFF\x00"
+			u8"\x15\xFF\x00\x00\x00"
+			u8"\x48\x15\xFF\x00\x00\x00"
+			u8"\x10\xD8"
+			u8"\x66\x11\xD8"
+			u8"\x11\xD8"
+			u8"\x48\x11\xD8"_mach);
+		static_cast<void>(stream);
+	}
+
+	// Extended registers set REX.R and REX.B:
+	{
+		const auto stream = Assemble<>("addq %r9, %r10\naddl $5, %r8d");
+		assert(stream == u8"\x4D\x01\xCA\x41\x83\xC0\x05"_mach);
+		static_cast<void>(stream);
+	}
+}
+
+static void RunAllTestsForLabels()
+{
+	using namespace CyberAsm;
+	using namespace X86;
+
+	// Local label syntax:
+	static_assert(IsLocalLabelName("1"));
+	static_assert(IsLocalLabelName("42"));
+	static_assert(!IsLocalLabelName("1f"));
+	static_assert(!IsLocalLabelName(""));
+	static_assert(IsLocalLabelReference("1f"));
+	static_assert(IsLocalLabelReference("12b"));
+	static_assert(!IsLocalLabelReference("f"));
+	static_assert(!IsLocalLabelReference("1x"));
+
+	// Label definitions are separate statements on the same line:
+	{
+		Parser parser("loop: adcq %rbx, %rax\njne loop");
+		InstructionNode node = {};
+		bool parsed = parser.Next(node);
+		assert(parsed && node.Kind == StatementKind::LabelDefinition && node.Symbol == "loop" && node.Line == 1);
+		parsed = parser.Next(node);
+		assert(parsed && node.Kind == StatementKind::Instruction && node.Instr == Instruction::Adc && node.Line == 1);
+		parsed = parser.Next(node);
+		assert(parsed && node.Instr == Instruction::Jne && node.OperandCount == 1 && node.Operands[0].IsLabel() && node.Operands[0].Symbol == "loop");
+		parsed = parser.Next(node);
+		assert(!parsed);
+		static_cast<void>(parsed);
+	}
+
+	// Forward reference over an instruction:
+	{
+		const auto stream = Assemble<>("jmp done\nadcq %rbx, %rax\ndone:");
+		assert(stream == u8"\xEB\x03\x48\x11\xD8"_mach);
+		static_cast<void>(stream);
+	}
+
+	// Backward local label reference:
+	{
+		const auto stream = Assemble<>("1: adcq %rbx, %rax\njne 1b");
+		assert(stream == u8"\x48\x11\xD8\x75\xFB"_mach);
+		static_cast<void>(stream);
+	}
+
+	// Local labels can be redefined, 'f' and 'b' pick the nearest definition:
+	{
+		const auto stream = Assemble<>("1:\njmp 1f\n1:\njmp 1b\ncall 1f\n1:");
+		assert(stream == u8"\xEB\x00"
+			u8"\xEB\xFE"
+			u8"\xE8\x00\x00\x00\x00"_mach);
+		static_cast<void>(stream);
+	}
+
+	// Relaxation widens only the branches which overflow rel8:
+	{
+		std::string source = "jmp far\njmp near\n";
+		for (std::size_t i = 0; i < 42; ++i)
+		{
+			source += "adcq %rbx, %rax\n";
+		}
+		source += "near:\nadcq %rbx, %rax\nfar:";
+		MachineStream<> stream = {};
+		Assemble<>(source, stream);
+		assert(stream.Labels().Branches().size() == 2);
+		const RelaxationStats stats = stream.Finalize();
+		assert(stats.Branches == 2 && stats.Widened == 1 && stats.BytesSaved == 3 && stats.Iterations == 2);
+		assert(stream.Size() == 5 + 2 + 129);
+		assert(stream[0] == 0xE9 && stream[1] == 0x83 && stream[2] == 0 && stream[5] == 0xEB && stream[6] == 0x7E);
+		assert(*stream.Labels().Offset(*stream.FindLabel("far")) == stream.Size());
+		static_cast<void>(stats);
+	}
+
+	// Widening a branch can push an enclosing branch out of range, this takes another sweep:
+	{
+		std::string source = "jne l1\njmp l2\n";
+		for (std::size_t i = 0; i < 41; ++i)
+		{
+			source += "adcq %rbx, %rax\n";
+		}
+		source += "l1:\nadcq %rbx, %rax\nadcq %rbx, %rax\nl2:";
+		MachineStream<> stream = {};
+		Assemble<>(source, stream);
+		const RelaxationStats stats = stream.Finalize();
+		assert(stats.Widened == 2 && stats.BytesSaved == 0 && stats.Iterations == 3);
+		assert(stream.Size() == 6 + 5 + 129);
+		assert(stream[0] == 0x0F && stream[1] == 0x85 && stream[2] == 0x80 && stream[6] == 0xE9 && stream[7] == 0x81);
+		assert(stream[11] == 0x48 && stream[12] == 0x11 && stream[13] == 0xD8);
+		static_cast<void>(stats);
+	}
+
+	// Fixups after a widened branch move with the code:
+	{
+		MachineStream<> stream = {};
+		const Label target = stream.CreateLabel();
+		const std::array<std::uint8_t, 1> longJmp = {0xE9};
+		stream.InsertBranch(target, 0xEB, longJmp);
+		stream.InsertPadding(200, 0x90);
+		stream.InsertFixup(target, FixupKind::Absolute32);
+		stream.BindLabel(target);
+		const RelaxationStats stats = stream.Finalize(0x100);
+		assert(stats.Widened == 1);
+		assert(stream.Size() == 5 + 200 + 4);
+		assert(stream[205] == 0xD1 && stream[206] == 0x01);
+		static_cast<void>(stats);
+	}
+
+	// Programmatic labels and absolute fixups:
+	{
+		MachineStream<> stream = {};
+		const Label entry = stream.CreateLabel("entry");
+		const Label data = stream.CreateLabel();
+		assert(stream.FindLabel("entry") == entry);
+		assert(!stream.FindLabel("data"));
+		stream.BindLabel(entry);
+		stream.InsertFixup(data, FixupKind::Absolute64);
+		stream.InsertFixup(entry, FixupKind::Relative8);
+		stream.BindLabel(data);
+		assert(stream.Labels().Fixups().size() == 2);
+		stream.Finalize(0x1000);
+		assert(stream.Labels().Fixups().empty());
+		assert(stream == u8"\x09\x10\x00\x00\x00\x00\x00\x00\xF7"_mach);
+		assert(*stream.Labels().Offset(data) == 9);
+		static_cast<void>(entry);
+		static_cast<void>(data);
+	}
+
+	// Errors:
+	{
+		bool thrown = false;
+		try
+		{
+			static_cast<void>(Assemble<>("jmp nowhere"));
+		}
+		catch (const std::runtime_error&)
+		{
+			thrown = true;
+		}
+		assert(thrown);
+
+		thrown = false;
+		try
+		{
+			static_cast<void>(Assemble<>("a:\na:"));
+		}
+		catch (const std::runtime_error& ex)
+		{
+			thrown = std::string_view(ex.what()).starts_with("Line 2:");
+		}
+		assert(thrown);
+
+		thrown = false;
+		try
+		{
+			static_cast<void>(Assemble<>("jmp 1b\n1:"));
+		}
+		catch (const std::runtime_error&)
+		{
+			thrown = true;
+		}
+		assert(thrown);
+
+		thrown = false;
+		try
+		{
+			static_cast<void>(Assemble<>("adc label"));
+		}
+		catch (const std::runtime_error&)
+		{
+			thrown = true;
+		}
+		assert(thrown);
+
+		thrown = false;
+		try
+		{
+			MachineStream<> stream = {};
+			const Label far = stream.CreateLabel();
+			stream.InsertFixup(far, FixupKind::Relative8);
+			stream.InsertPadding(200);
+			stream.BindLabel(far);
+			stream.Finalize();
+		}
+		catch (const std::runtime_error&)
+		{
+			thrown = true;
+		}
+		assert(thrown);
+		static_cast<void>(thrown);
+	}
+}
+
+static void RunAllTestsForJit()
+{
+	using namespace CyberAsm;
+	using namespace X86;
+
+	JitArena arena = {};
+
+	// int f(int x) { return x + 5; }
+	MachineStream<> addFive = {};
+	addFive << std::initializer_list<std::uint8_t>{0x89, 0xF8}; // mov eax, edi
+	Assemble<>("addl $5, %eax", addFive);
+	addFive << std::initializer_list<std::uint8_t>{0xC3}; // ret
+	const void* const addFiveEntry = arena.Emit(addFive);
+
+	// int g() { return 42; } written directly into the arena:
+	const auto memory = arena.Reserve(16);
+	constexpr std::array<std::uint8_t, 6> returnConstant = {0xB8, 42, 0, 0, 0, 0xC3}; // mov eax, 42; ret
+	std::copy(returnConstant.begin(), returnConstant.end(), memory.begin());
+	const void* const returnConstantEntry = arena.Commit(returnConstant.size());
+
+	// Not callable before sealing:
+	{
+		bool thrown = false;
+		try
+		{
+			static_cast<void>(arena.Function<int(int)>(addFiveEntry));
+		}
+		catch (const std::runtime_error&)
+		{
+			thrown = true;
+		}
+		assert(thrown);
+		static_cast<void>(thrown);
+	}
+
+	// Both functions are sealed with a single protection change:
+	assert(arena.PendingBytes() != 0);
+	arena.Seal();
+	assert(arena.PendingBytes() == 0);
+	assert(arena.ProtectionFlips() == 1);
+	assert(arena.Function<int(int)>(addFiveEntry)(10) == 15);
+	assert(arena.Function<int()>(returnConstantEntry)() == 42);
+
+	// Code emitted after sealing goes to a new page:
+	const void* const secondEntry = arena.Emit(addFive);
+	assert(!arena.IsExecutable(secondEntry));
+	arena.Seal();
+	assert(arena.ProtectionFlips() == 2);
+	assert(arena.Function<int(int)>(secondEntry)(-5) == 0);
+	assert(arena.Function<int(int)>(addFiveEntry)(1) == 6);
+	static_cast<void>(secondEntry);
+	static_cast<void>(returnConstantEntry);
+}
+
+static void RunAllTestsForPeephole()
+{
+	using namespace CyberAsm;
+	using namespace X86;
+
+	const AssembleOptions optimize = {.Peephole = true};
+
+	// New encodings used by the rewrites:
+	{
+		const auto equals = [](const ByteChunk& machineCode, const std::u8string_view expected)
+		{
+			return std::equal(machineCode.begin(), machineCode.end(), expected.begin(), expected.end());
+		};
+		assert(equals(Cas2Encode<>(Instruction::Inc, Register::Rbx), u8"\x48\xFF\xC3"_mach));
+		assert(equals(Cas2Encode<>(Instruction::Inc, Register::Sil), u8"\x40\xFE\xC6"_mach));
+		assert(equals(Cas2EncodeLea<>(Register::Rdi, Operand::FromMemory(Register::Rsi, Register::Count, 100)), u8"\x48\x8D\x7E\x64"_mach));
+		assert(equals(Cas2EncodeLea<>(Register::Rax, Operand::FromMemory(Register::Rbp, Register::Rbp)), u8"\x48\x8D\x44\x2D\x00"_mach));
+		assert(equals(Cas2EncodeLea<>(Register::R8D, Operand::FromMemory(Register::Rsp, Register::R13)), u8"\x46\x8D\x04\x2C"_mach));
+		static_cast<void>(equals);
+	}
+
+	// mov r, 0 -> xor r32, r32, if the flags are dead:
+	{
+		const auto stream = Assemble<>("movq $0, %rax\naddq %rbx, %rcx", optimize);
+		assert(stream == u8"\x31\xC0\x48\x01\xD9"_mach);
+		static_cast<void>(stream);
+	}
+	{
+		// The flags of the add are read by the branch:
+		const auto stream = Assemble<>("1: addq %rbx, %rcx\nmovq $0, %rax\njne 1b", optimize);
+		assert(stream == u8"\x48\x01\xD9\xB8\x00\x00\x00\x00\x75\xF6"_mach);
+		static_cast<void>(stream);
+	}
+
+	// add r, 1 -> inc r, if the carry is dead:
+	{
+		const auto stream = Assemble<>("addq $1, %rax\naddq %rbx, %rcx", optimize);
+		assert(stream == u8"\x48\xFF\xC0\x48\x01\xD9"_mach);
+		static_cast<void>(stream);
+	}
+	{
+		// adc reads the carry, the branch target might as well:
+		const auto stream = Assemble<>("addq $1, %rax\nadcq $0, %rbx\naddq $1, %rax\njne 1f\n1:", optimize);
+		assert(stream == u8"\x48\x83\xC0\x01\x48\x83\xD3\x00\x48\x83\xC0\x01\x75\x00"_mach);
+		static_cast<void>(stream);
+	}
+
+	// Redundant moves:
+	{
+		PeepholeStats stats = {};
+		const auto stream = Assemble<>("movq %rbx, %rbx\nmovq %rax, %rcx\nmovq %rcx, %rax\nmovq $5, %rdx\nmovq $6, %rdx", {.Peephole = true, .PeepholeResult = &stats});
+		assert(stream == u8"\x48\x89\xC1\xBA\x06\x00\x00\x00"_mach);
+		assert(stats.Removed == 3);
+		static_cast<void>(stream);
+		static_cast<void>(stats);
+	}
+	{
+		// 32-bit moves zero extend and a move reading the destination is not overwritten:
+		const auto stream = Assemble<>("movl %eax, %eax\nmovq %rax, %rcx\nmovq %rcx, %rcx\nmovq $5, %rdx\nmovq %rdx, %rdx", optimize);
+		assert(stream == u8"\x89\xC0\x48\x89\xC1\xBA\x05\x00\x00\x00"_mach);
+		static_cast<void>(stream);
+	}
+
+	// mov d, s; add d, x -> lea d, [s + x]:
+	{
+		const auto stream = Assemble<>("movq %rsi, %rdi\naddq $100, %rdi\nmovq %rbp, %rax\naddq %rax, %rax\nxorl %ecx, %ecx", optimize);
+		assert(stream == u8"\x48\x8D\x7E\x64\x48\x8D\x44\x2D\x00\x31\xC9"_mach);
+		static_cast<void>(stream);
+	}
+	{
+		// Not across a label, the flags are live at the end of the file:
+		const auto stream = Assemble<>("movq %rsi, %rdi\n1: addq $100, %rdi\nmovq %rsi, %rdi\naddq $100, %rdi", optimize);
+		assert(stream == u8"\x48\x89\xF7\x48\x83\xC7\x64\x48\x89\xF7\x48\x83\xC7\x64"_mach);
+		static_cast<void>(stream);
+	}
+
+	// Disabled by default:
+	{
+		const auto stream = Assemble<>("movq $0, %rax\naddq %rbx, %rcx");
+		assert(stream == u8"\xB8\x00\x00\x00\x00\x48\x01\xD9"_mach);
+		static_cast<void>(stream);
+	}
+}
+
+static void RunAllTestsForMachineStream()
+{
+	using namespace CyberAsm;
+	using namespace X86;
+
+	// Raw memory is appended completely:
+	{
+		constexpr std::array<std::uint8_t, 4> raw = {0x01, 0x02, 0x03, 0x04};
+		MachineStream<> stream = {};
+		const std::size_t size = raw.size();
+		stream.Insert(raw.data(), size);
+		stream.Insert(raw.data(), size - raw.size());
+		assert(stream == u8"\x01\x02\x03\x04"_mach);
+		static_cast<void>(stream);
+	}
+
+	// Scalars are appended in little endian order, several in one go:
+	{
+		MachineStream<> stream = {};
+		stream << std::uint16_t{0x1234} << std::int32_t{-2} << std::int8_t{0x7F} << std::uint64_t{0x0102030405060708};
+		stream.Insert(std::uint16_t{0xABCD}, std::uint32_t{0x11223344});
+		assert(stream == u8"\x34\x12\xFE\xFF\xFF\xFF\x7F\x08\x07\x06\x05\x04\x03\x02\x01\xCD\xAB\x44\x33\x22\x11"_mach);
+		static_cast<void>(stream);
+	}
+
+	// The cursor writes unchecked after Ensure() and trims the stream on Commit():
+	{
+		MachineStream<> stream = {};
+		stream << std::uint8_t{0xCC};
+		{
+			EmitCursor cursor = stream.BeginEmit();
+			for (std::size_t i = 0; i < 1000; ++i)
+			{
+				cursor.Ensure(ByteChunk::MaxByteChunkSize);
+				cursor.Put(Cas2Encode<>(Instruction::Adc, Register::Rax, Register::Rbx));
+			}
+			assert(cursor.Offset() == 1 + 3000);
+			cursor.Ensure(sizeof(std::uint32_t));
+			cursor.PutLittle(std::uint32_t{0xDEADBEEF});
+			cursor.Commit();
+			assert(stream.Size() == 1 + 3000 + 4);
+			assert(cursor.Remaining() == 0 && cursor.Offset() == stream.Size());
+
+			// Usable again after a commit:
+			cursor.Ensure(1);
+			cursor.Put(std::uint8_t{0xC3});
+		}
+		assert(stream.Size() == 1 + 3000 + 4 + 1);
+		assert(stream[0] == 0xCC && stream[1] == 0x48 && stream[2] == 0x11 && stream[3] == 0xD8);
+		assert(stream[3001] == 0xEF && stream[3004] == 0xDE && stream[3005] == 0xC3);
+		static_cast<void>(stream);
+	}
+
+	// Instructions are encoded directly into the stream tail:
+	{
+		MachineStream<> stream = {};
+		const auto first = TryCas2EncodeInto<>(stream, Instruction::Mov, Register::Eax, Immediate(0));
+		assert(first && *first == 5 && stream.Size() == 5);
+		{
+			EmitCursor cursor = stream.BeginEmit();
+			const auto second = TryCas2EncodeInto<>(cursor, Instruction::Add, Register::Rcx, Register::Rbx);
+			const auto failed = TryCas2EncodeInto<>(cursor, Instruction::Add, Register::Al, Immediate(0x100));
+			assert(second && *second == 3 && !failed && cursor.Offset() == 8);
+			static_cast<void>(second);
+			static_cast<void>(failed);
+		}
+		assert(stream == u8"\xB8\x00\x00\x00\x00\x48\x01\xD9"_mach);
+		static_cast<void>(first);
+	}
+
+	// Arena streams allocate from the arena block until it is exhausted:
+	{
+		struct CountingResource final : std::pmr::memory_resource
+		{
+			std::size_t Allocations = 0;
+
+			auto do_allocate(const std::size_t bytes, const std::size_t alignment) -> void* override
+			{
+				++this->Allocations;
+				return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+			}
+
+			void do_deallocate(void* const memory, const std::size_t bytes, const std::size_t alignment) override
+			{
+				std::pmr::new_delete_resource()->deallocate(memory, bytes, alignment);
+			}
+
+			auto do_is_equal(const std::pmr::memory_resource& other) const noexcept -> bool override
+			{
+				return this == &other;
+			}
+		} upstream = {};
+
+		StreamArena arena(1024, &upstream);
+		for (std::size_t unit = 0; unit < 3; ++unit)
+		{
+			for (std::size_t i = 0; i < 8; ++i)
+			{
+				MachineStream<> stream = arena.CreateStream(64);
+				assert(stream.Resource() == arena.Resource());
+				stream << Cas2Encode<>(Instruction::Add, Register::Rcx, Register::Rbx) << std::uint8_t{0xC3};
+				assert(stream == u8"\x48\x01\xD9\xC3"_mach);
+
+				// Moves keep the arena:
+				MachineStream<> moved = std::move(stream);
+				assert(moved.Resource() == arena.Resource() && moved.Size() == 4);
+				static_cast<void>(moved);
+			}
+			assert(upstream.Allocations == 0);
+			arena.Reset();
+		}
+
+		// Growing past the block falls back to the upstream resource:
+		MachineStream<> large = arena.CreateStream();
+		large.InsertPadding(4096, 0x90);
+		assert(upstream.Allocations > 0 && large.Size() == 4096 && large[4095] == 0x90);
+
+		// Copies are independent of the arena:
+		const MachineStream<> copy = large;
+		assert(copy.Resource() == std::pmr::get_default_resource() && copy == large);
+		static_cast<void>(copy);
+	}
+
+	// Tiny stubs stay inside the object and spill to the heap when they grow:
+	{
+		InlineMachineStream<64> stub = {};
+		assert(stub.IsInline() && stub->Size() == 0);
+		*stub << std::uint8_t{0x49} << std::uint8_t{0xBB} << std::uint64_t{0x1122334455667788};
+		*stub << std::uint8_t{0x41} << std::uint8_t{0xFF} << std::uint8_t{0xE3};
+		assert(stub.IsInline() && stub->Size() == 13);
+		assert(*stub == u8"\x49\xBB\x88\x77\x66\x55\x44\x33\x22\x11\x41\xFF\xE3"_mach);
+		assert(stub->Find(std::uint8_t{0xFF}) == stub->begin() + 11);
+		assert(stub->Stream().size() == 13);
+
+		stub->InsertPadding(64, 0xCC);
+		assert(!stub.IsInline() && stub->Size() == 77 && (*stub)[12] == 0xE3 && (*stub)[76] == 0xCC);
+
+		const MachineStream<> copy = *stub;
+		assert(copy == *stub);
+		static_cast<void>(copy);
+	}
+
+	// Released code lives on the default resource and outlives the stub:
+	{
+		MachineStream<> released = {};
+		{
+			InlineMachineStream<64> stub = {};
+			*stub << std::uint8_t{0x41} << std::uint8_t{0xFF} << std::uint8_t{0xE3};
+			released = stub.Release();
+			assert(stub.IsInline() && stub->Size() == 0);
+		}
+		assert(released.Resource() == std::pmr::get_default_resource() && released == u8"\x41\xFF\xE3"_mach);
+	}
+
+	// Segmented buffers never move emitted code and gather into the same bytes as a flat stream:
+	{
+		SegmentedCodeBuffer code(64);
+		MachineStream<> flat = {};
+		code << std::uint8_t{0x90};
+		flat << std::uint8_t{0x90};
+		const std::uint8_t* const first = code.At(0);
+		for (std::size_t i = 0; i < 100; ++i)
+		{
+			const ByteChunk chunk = Cas2Encode<>(Instruction::Adc, Register::R9, Immediate(static_cast<std::int64_t>(i * 0x01010101)));
+			code << chunk;
+			flat << chunk;
+		}
+		code.WriteLittle(std::uint32_t{0xDEADBEEF});
+		flat << std::uint32_t{0xDEADBEEF};
+		assert(code.At(0) == first && code.Size() == flat.Size());
+		assert(code.SegmentCount() == (code.Size() + 63) / 64 && code.Segment(0).size() == 64);
+		assert(code.ToStream() == flat);
+
+		// Fields spanning two segments can be patched:
+		code.Patch(62, std::uint32_t{0x44332211});
+		flat.Stream()[62] = 0x11;
+		flat.Stream()[63] = 0x22;
+		flat.Stream()[64] = 0x33;
+		flat.Stream()[65] = 0x44;
+		std::vector<std::uint8_t> gathered(code.Size());
+		assert(code.CopyTo(gathered) == flat.Size());
+		assert(std::equal(gathered.begin(), gathered.end(), flat.begin()));
+
+		bool thrown = false;
+		try
+		{
+			static_cast<void>(SegmentedCodeBuffer(100));
+		}
+		catch (const std::runtime_error&)
+		{
+			thrown = true;
+		}
+		assert(thrown);
+
+		// Moves keep the addresses, cleared buffers reuse their segments:
+		SegmentedCodeBuffer moved = std::move(code);
+		assert(moved.At(0) == first && code.Size() == 0);
+		moved.Clear();
+		moved << std::uint8_t{0xC3};
+		assert(moved.At(0) == first && moved.Size() == 1 && moved.SegmentCount() == 1);
+		static_cast<void>(first);
+		static_cast<void>(thrown);
+	}
+}
+
+static void RunAllTestsForHexDump()
+{
+	using namespace CyberAsm;
+	using namespace X86;
+
+	MachineStream<> stream = {};
+	stream << Cas2Encode<>(Instruction::Adc, Register::Rax, Immediate(5)) << "Hi!" << std::uint8_t{0x7F} << std::uint8_t{0xFF} << std::uint8_t{0x20};
+
+	// Full lines get the ASCII column, the last line is padded:
+	stream.DumpTextLineLimit = 4;
+	assert(stream.Dump() ==
+		"48 83 D0 05  | H...\n"
+		"48 69 21 7F  | Hi!.\n"
+		"FF 20        | . \n");
+	assert(stream.Dump(DumpFormat::CArray) ==
+		"\t0x48, 0x83, 0xD0, 0x05,\n"
+		"\t0x48, 0x69, 0x21, 0x7F,\n"
+		"\t0xFF, 0x20,\n");
+	assert(stream.Dump(DumpFormat::RawHex) == "4883D005\n4869217F\nFF20\n");
+
+	// The vectorized formatter agrees with a byte by byte reference for all byte values and line lengths:
+	std::vector<std::uint8_t> bytes(256 + 37);
+	for (std::size_t i = 0; i < bytes.size(); ++i)
+	{
+		bytes[i] = static_cast<std::uint8_t>(i * 7);
+	}
+	for (const std::size_t lineLimit : {std::size_t{1}, std::size_t{3}, std::size_t{8}, std::size_t{13}, std::size_t{16}, std::size_t{64}})
+	{
+		std::string listing = {};
+		std::string carray = {};
+		std::string raw = {};
+		constexpr std::string_view digits = "0123456789ABCDEF";
+		for (std::size_t line = 0; line < bytes.size(); line += lineLimit)
+		{
+			const auto count = std::min(lineLimit, bytes.size() - line);
+			carray += '\t';
+			for (std::size_t i = 0; i < lineLimit; ++i)
+			{
+				if (i >= count)
+				{
+					listing += "   ";
+					continue;
+				}
+				const auto value = bytes[line + i];
+				const std::string hex = {digits[value >> 4], digits[value & 0xF]};
+				listing += hex + ' ';
+				carray += "0x" + hex + (i + 1 == count ? ",\n" : ", ");
+				raw += hex;
+			}
+			listing += " | ";
+			for (std::size_t i = 0; i < count; ++i)
+			{
+				const auto value = bytes[line + i];
+				listing += value >= 0x20 && value <= 0x7E ? static_cast<char>(value) : '.';
+			}
+			listing += '\n';
+			raw += '\n';
+		}
+		assert(HexDump(bytes, lineLimit, DumpFormat::Listing) == listing);
+		assert(HexDump(bytes, lineLimit, DumpFormat::CArray) == carray);
+		assert(HexDump(bytes, lineLimit, DumpFormat::RawHex) == raw);
+		assert(HexDumpSize(bytes.size(), lineLimit, DumpFormat::Listing) == listing.size());
+
+		// The stream output is written in blocks:
+		std::ostringstream out = {};
+		WriteHexDump(out, bytes, lineLimit, DumpFormat::Listing);
+		assert(out.str() == listing);
+	}
+	assert(HexDump({}, 8).empty());
+}
+
+static void RunAllTestsForByteSearch()
+{
+	using namespace CyberAsm;
+
+	// Pseudo random code with a small alphabet, so partial matches are frequent:
+	std::vector<std::uint8_t> haystack(ParallelSearchThreshold + 4096);
+	std::uint32_t seed = 12345;
+	for (auto& byte : haystack)
+	{
+		seed = seed * 1103515245 + 12345;
+		byte = static_cast<std::uint8_t>((seed >> 16) % 5);
+	}
+
+	// Every needle length, found near the start and end of the SIMD blocks, must agree with std::search:
+	const std::span<const std::uint8_t> small(haystack.data(), 4096);
+	for (std::size_t size = 1; size <= 40; ++size)
+	{
+		for (const std::size_t at : {std::size_t{0}, std::size_t{15}, std::size_t{31}, std::size_t{100}, small.size() - size})
+		{
+			const auto needle = small.subspan(at, size);
+			const auto expected = static_cast<std::size_t>(std::search(small.begin(), small.end(), needle.begin(), needle.end()) - small.begin());
+			assert(FindSequence(small, needle) == expected);
+			static_cast<void>(expected);
+		}
+	}
+	constexpr std::array<std::uint8_t, 3> absent = {0x10, 0x11, 0x12};
+	assert(FindSequence(small, absent) == NotFound);
+	assert(FindSequence(small, std::span<const std::uint8_t>()) == 0);
+	assert(FindSequence(std::span<const std::uint8_t>(), absent) == NotFound);
+	assert(FindByte(small, 0x10) == NotFound && FindByte(small, small[7]) <= 7);
+	static_cast<void>(absent);
+
+	// Large inputs are searched in parallel chunks, a match across a chunk border is found:
+	constexpr std::array<std::uint8_t, 6> marker = {0xDE, 0xAD, 0xBE, 0xEF, 0x13, 0x37};
+	std::copy(marker.begin(), marker.end(), haystack.begin() + 3 * ParallelSearchChunkSize - 2);
+	assert(FindSequence(haystack, marker) == 3 * ParallelSearchChunkSize - 2);
+
+	// The multi pattern searcher agrees with a naive scan:
+	const std::array<std::vector<std::uint8_t>, 6> patterns =
+	{{
+		{0x01, 0x02},
+		{0x02},
+		{0x01, 0x02, 0x03, 0x04},
+		{0x04, 0x04, 0x04},
+		{0xDE, 0xAD, 0xBE, 0xEF},
+		{0x03, 0x00, 0x01, 0x02, 0x03}
+	}};
+	std::vector<std::span<const std::uint8_t>> views(patterns.begin(), patterns.end());
+	const MultiPatternSearcher searcher(views);
+	assert(searcher.PatternCount() == patterns.size());
+
+	const auto naive = [&](const std::span<const std::uint8_t> input)
+	{
+		std::vector<PatternMatch> matches = {};
+		for (std::size_t offset = 0; offset < input.size(); ++offset)
+		{
+			for (std::size_t pattern = 0; pattern < patterns.size(); ++pattern)
+			{
+				const auto& bytes = patterns[pattern];
+				if (offset + bytes.size() <= input.size() && std::equal(bytes.begin(), bytes.end(), input.begin() + offset))
+				{
+					matches.push_back(PatternMatch{pattern, offset});
+				}
+			}
+		}
+		return matches;
+	};
+	const auto expected = naive(small);
+	assert(!expected.empty() && searcher.FindAll(small) == expected);
+	assert(searcher.FindFirst(small) == expected.front());
+	assert(searcher.ContainsAny(small) && !searcher.ContainsAny(absent));
+
+	// Parallel scans report matches across chunk borders exactly once:
+	const auto all = searcher.FindAll(haystack);
+	assert(all == naive(haystack));
+	assert(std::count(all.begin(), all.end(), PatternMatch{4, 3 * ParallelSearchChunkSize - 2}) == 1);
+	static_cast<void>(all);
+
+	// The stream API uses the same engine:
+	MachineStream<> stream(small.data(), small.size());
+	std::array<std::uint8_t, 3> sequence = {small[200], small[201], small[202]};
+	assert(stream.Find(sequence) == std::search(stream.begin(), stream.end(), sequence.begin(), sequence.end()));
+	assert(stream.Contains(sequence) && !stream.Contains(std::uint8_t{0x10}));
+	static_cast<void>(stream);
+	static_cast<void>(sequence);
+
+	bool thrown = false;
+	try
+	{
+		static_cast<void>(MultiPatternSearcher({std::span<const std::uint8_t>()}));
+	}
+	catch (const std::runtime_error&)
+	{
+		thrown = true;
+	}
+	assert(thrown);
+	static_cast<void>(thrown);
+}
+
+static void RunAllTestsForFileOutput()
+{
+	using namespace CyberAsm;
+	using namespace X86;
+
+	const auto file = std::filesystem::temp_directory_path() / "CyberAsmTestOutput.bin";
+	MachineStream<> expected = {};
+	for (std::size_t i = 0; i < 1000; ++i)
+	{
+		expected << Cas2Encode<>(Instruction::Adc, Register::R9, Immediate(static_cast<std::int64_t>(i)));
+	}
+	const auto readBack = [&file]
+	{
+		std::string content = {};
+		ReadFile(content, file);
+		return content;
+	};
+	const auto matches = [&expected](const std::string& content)
+	{
+		return content.size() == expected.Size() && std::equal(content.begin(), content.end(), expected.begin(), [](const char lhs, const std::uint8_t rhs)
+		{
+			return static_cast<std::uint8_t>(lhs) == rhs;
+		});
+	};
+
+	// The streaming writer flushes full blocks while code is appended:
+	{
+		FileWriter writer(file, 64);
+		for (std::size_t i = 0; i < 1000; ++i)
+		{
+			writer << Cas2Encode<>(Instruction::Adc, Register::R9, Immediate(static_cast<std::int64_t>(i)));
+		}
+		writer.Close();
+		assert(writer.Stats().BytesWritten == expected.Size());
+		assert(matches(readBack()));
+
+		// Writes after closing are rejected instead of filling a block which is never flushed:
+		const std::array<std::uint8_t, 128> late = {};
+		for (const std::size_t size : {std::size_t{1}, late.size()})
+		{
+			bool thrown = false;
+			try
+			{
+				writer.Write(late.data(), size);
+			}
+			catch (const std::runtime_error&)
+			{
+				thrown = true;
+			}
+			assert(thrown);
+			static_cast<void>(thrown);
+		}
+		assert(matches(readBack()));
+	}
+
+	// Streamed assembly hands out settled code while encoding, local and named labels reach back into code already written:
+	{
+		std::string source = "start:\n";
+		for (std::size_t i = 0; i < 40; ++i)
+		{
+			source += "1: adcq %rbx, %rax\njne 1b\njmp 2f\n";
+			for (std::size_t j = 0; j < i % 4 * 16; ++j)
+			{
+				source += "incl %r12d\n";
+			}
+			source += "2: jne start\njmp done\n";
+		}
+		source += "done: jmp start\n";
+		const MachineStream<> serial = Assemble<>(source);
+		for (const std::size_t flushSize : {1, 7, 100, 1 << 20})
+		{
+			std::vector<std::uint8_t> code = {};
+			std::size_t flushes = 0;
+			const std::size_t size = AssembleStreaming<>(source, [&](const std::span<const std::uint8_t> bytes)
+			{
+				code.insert(code.end(), bytes.begin(), bytes.end());
+				++flushes;
+			}, flushSize);
+			assert(size == serial.Size());
+			assert(std::equal(code.begin(), code.end(), serial.begin(), serial.end()));
+			assert(flushSize > serial.Size() || flushes > 1);
+			static_cast<void>(size);
+		}
+
+		FileWriter writer(file, 64);
+		const std::size_t size = AssembleStreaming<>(source, [&writer](const std::span<const std::uint8_t> bytes)
+		{
+			writer << bytes;
+		}, 64);
+		writer.Close();
+		assert(size == serial.Size() && writer.Stats().BytesWritten == size);
+		assert(std::filesystem::file_size(file) == size);
+		static_cast<void>(size);
+	}
+
+	// The mapped output grows past its capacity and is truncated to the committed size:
+	{
+		MappedFileOutput output(file, 100);
+		for (std::size_t i = 0; i < 1000; ++i)
+		{
+			const auto memory = output.Reserve(InstructionBuffer::Capacity);
+			const auto size = TryCas2EncodeInto<>(memory, Instruction::Adc, Register::R9, Immediate(static_cast<std::int64_t>(i)));
+			output.Commit(size.ValueOrThrow());
+		}
+		assert(output.Capacity() >= expected.Size() && output.Size() == expected.Size());
+		output.Close();
+		assert(output.Stats().BytesWritten == expected.Size());
+		assert(std::filesystem::file_size(file) == expected.Size());
+		assert(matches(readBack()));
+
+		// Writes after closing are rejected instead of writing through the released mapping:
+		const std::array<std::uint8_t, 4> late = {};
+		for (const auto& write : std::initializer_list<std::function<void()>>{
+			[&] { output.Write(late.data(), late.size()); },
+			[&] { static_cast<void>(output.Reserve(late.size())); },
+			[&] { output.Commit(0); }})
+		{
+			bool rejected = false;
+			try
+			{
+				write();
+			}
+			catch (const std::runtime_error&)
+			{
+				rejected = true;
+			}
+			assert(rejected);
+			static_cast<void>(rejected);
+		}
+		assert(output.Capacity() == 0 && std::filesystem::file_size(file) == expected.Size());
+
+		bool thrown = false;
+		try
+		{
+			MappedFileOutput invalid(file.parent_path() / "missing" / "output.bin", 16);
+		}
+		catch (const std::runtime_error&)
+		{
+			thrown = true;
+		}
+		assert(thrown);
+		static_cast<void>(thrown);
+	}
+	std::filesystem::remove(file);
+	static_cast<void>(readBack);
+	static_cast<void>(matches);
+}
+
+static void RunAllTestsForDecoder()
+{
+	using namespace CyberAsm;
+	using namespace X86;
+
+	// The length decoder is usable at compile time:
+	static_assert(*TryDecodeLength(std::array<std::uint8_t, 3>{0x48, 0x11, 0xD8}) == 3);
+
+	const auto decode = [](const std::initializer_list<std::uint8_t> bytes)
+	{
+		return TryDecode(std::span<const std::uint8_t>(bytes.begin(), bytes.size()));
+	};
+	const auto decodeLength = [](const std::initializer_list<std::uint8_t> bytes)
+	{
+		return TryDecodeLength(std::span<const std::uint8_t>(bytes.begin(), bytes.size()));
+	};
+
+	// Everything the encoder emits decodes to the same instruction and encodes to the same bytes again:
+	const auto roundTrip = [](const Result<ByteChunk>& chunk)
+	{
+		if (!chunk)
+		{
+			return true;
+		}
+		const std::span<const std::uint8_t> code(chunk->Data(), chunk->Size());
+		const Result<std::size_t> length = TryDecodeLength(code);
+		const Result<DecodedInstruction> decoded = TryDecode(code);
+		if (!length || *length != code.size() || !decoded || decoded->Length != code.size())
+		{
+			return false;
+		}
+		const Result<ByteChunk> encoded = TryCas2Encode<>(decoded->Node);
+		return encoded && *encoded == *chunk;
+	};
+	std::size_t checked = 0;
+	for (std::size_t instruction = 0; instruction < static_cast<std::size_t>(Instruction::Count); ++instruction)
+	{
+		const auto instr = static_cast<Instruction>(instruction);
+		for (std::size_t destination = 0; destination <= static_cast<std::size_t>(Register::R15B); ++destination)
+		{
+			const auto reg = static_cast<Register>(destination);
+			for (const std::uint64_t value : {std::uint64_t{0}, std::uint64_t{0x7F}, std::uint64_t{0x80}, std::uint64_t{0x1234}, std::uint64_t{0xFFFF'FFFF}, std::uint64_t{0x1'2345'6789}, ~std::uint64_t{0}})
+			{
+				const bool immediate = roundTrip(TryCas2Encode<>(instr, reg, Immediate(value)));
+				assert(immediate);
+				static_cast<void>(immediate);
+			}
+			for (std::size_t source = 0; source <= static_cast<std::size_t>(Register::R15B); ++source)
+			{
+				const bool registers = roundTrip(TryCas2Encode<>(instr, reg, static_cast<Register>(source)));
+				assert(registers);
+				static_cast<void>(registers);
+			}
+			const bool single = roundTrip(TryCas2Encode<>(instr, reg));
+			const bool indexed = roundTrip(TryCas2EncodeLea<>(reg, Operand::FromMemory(Register::R13, Register::R12, -0x80)));
+			const bool stack = roundTrip(TryCas2EncodeLea<>(reg, Operand::FromMemory(Register::Rsp)));
+			assert(single && indexed && stack);
+			static_cast<void>(single);
+			static_cast<void>(indexed);
+			static_cast<void>(stack);
+			checked += 3;
+		}
+	}
+	assert(checked > 0);
+	static_cast<void>(checked);
+
+	// Byte sequences emitted by GNU as:
+	{
+		const auto decoded = decode({0x44, 0x8D, 0xB9, 0x90, 0xEE, 0xFE, 0xFF});
+		assert(decoded && decoded->Length == 7 && FormatInstruction(*decoded) == "lea r15d, [rcx - 0x11170]");
+		static_cast<void>(decoded);
+	}
+	{
+		const auto decoded = decode({0x48, 0xB8, 0x9A, 0x78, 0x56, 0x34, 0x12, 0x00, 0x00, 0x00});
+		assert(decoded && decoded->Length == 10 && FormatInstruction(*decoded) == "mov rax, 0x123456789A");
+		static_cast<void>(decoded);
+	}
+	{
+		const auto decoded = decode({0x66, 0x41, 0x01, 0xEF});
+		assert(decoded && decoded->Node.Instr == Instruction::Add && decoded->Node.Operands[0].Reg == Register::R15W && decoded->Node.Operands[1].Reg == Register::Bp);
+		static_cast<void>(decoded);
+	}
+	{
+		const auto decoded = decode({0x42, 0xFE, 0x44, 0x11, 0x7F});
+		assert(decoded && FormatInstruction(*decoded) == "inc byte ptr [rcx + r10 + 0x7F]");
+		static_cast<void>(decoded);
+	}
+	{
+		const auto decoded = decode({0x48, 0x8D, 0x05, 0x10, 0x00, 0x00, 0x00});
+		assert(decoded && decoded->Node.Operands[1].Base == Register::Rip && decoded->Node.Operands[1].Displacement == 0x10);
+		static_cast<void>(decoded);
+	}
+	{
+		// 'adc qword ptr [r15 + r14 * 2 - 5], rsi' has a scaled index, which an Operand cannot hold:
+		assert(*decodeLength({0x4B, 0x11, 0x74, 0x77, 0xFB}) == 5);
+		assert(decode({0x4B, 0x11, 0x74, 0x77, 0xFB}).Error().Code == ErrorCode::UnsupportedOperands);
+		assert(decode({0x88, 0xE3})->Node.Operands[1].Reg == Register::Ah && decode({0x40, 0x88, 0xE3})->Node.Operands[1].Reg == Register::Spl);
+	}
+
+	// Malformed and unsupported code:
+	assert(decodeLength({0x0F, 0x05}).Error().Code == ErrorCode::UnknownOpCode);
+	assert(decodeLength({0x48}).Error().Code == ErrorCode::TruncatedInstruction);
+	assert(decodeLength({0x48, 0x81, 0xC0, 0x01}).Error().Code == ErrorCode::TruncatedInstruction);
+	assert(decodeLength({0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x48, 0x81, 0xC0, 0x01, 0x00, 0x00, 0x00}).Error().Code == ErrorCode::InstructionTooLong);
+	assert(*decodeLength({0x80, 0xC8, 0x01}) == 3 && decode({0x80, 0xC8, 0x01}).Error().Code == ErrorCode::UnknownOpCode);
+
+	// Boundaries and branch targets of assembled code:
+	{
+		MachineStream<> stream = {};
+		Assemble<>("jmp done\nadcq %rbx, %rax\nincl %r12d\ncall done\ndone:\njne done", stream);
+		static_cast<void>(stream.Finalize());
+		const std::span<const std::uint8_t> code(stream.begin(), stream.Size());
+		const auto boundaries = DecodeBoundaries(code);
+		assert((boundaries == std::vector<std::size_t>{0, 2, 5, 8, 13}));
+		const auto instructions = Disassemble(code);
+		assert(instructions.size() == boundaries.size());
+		assert(*instructions[0].BranchTarget(0) == 13 && *instructions[3].BranchTarget(8) == 13 && *instructions[4].BranchTarget(13) == 13);
+		assert(!instructions[1].BranchTarget(2));
+		assert(FormatInstruction(instructions[2]) == "inc r12d" && FormatInstruction(instructions[4], 13) == "jne 0xD");
+		static_cast<void>(instructions);
+	}
+
+	bool thrown = false;
+	try
+	{
+		constexpr std::array<std::uint8_t, 3> code = {0x90, 0x48, 0x11};
+		static_cast<void>(DecodeBoundaries(code));
+	}
+	catch (const std::runtime_error&)
+	{
+		thrown = true;
+	}
+	assert(thrown);
+	static_cast<void>(thrown);
+	static_cast<void>(decode);
+	static_cast<void>(decodeLength);
+	static_cast<void>(roundTrip);
+}
+
+static void RunAllTestsForListing()
+{
+	using namespace CyberAsm;
+	using namespace X86;
+
+	AssemblyListing listing = {};
+	listing.BytesPerRow = 4;
+	AssembleOptions options = {};
+	options.Listing = &listing;
+	const std::string_view source = "# entry\nstart: jne done\n\nadcq %rbx, %rax\nmovq $0x11223344, %rax\ndone:\r\nincl %r12d";
+	const MachineStream<> stream = Assemble<>(source, options);
+	assert(listing.Size() == 5);
+
+	// Every source line gets a row, long encodings continue below:
+	assert(FormatListing(source, std::span<const std::uint8_t>(stream.begin(), stream.end()), listing) ==
+		"     1                          # entry\n"
+		"     2  00000000  75 08         start: jne done\n"
+		"     3\n"
+		"     4  00000002  48 11 D8      adcq %rbx, %rax\n"
+		"     5  00000005  B8 44 33 22   movq $0x11223344, %rax\n"
+		"        00000009  11\n"
+		"     6  0000000A                done:\n"
+		"     7  0000000A  41 FF C4      incl %r12d\n");
+
+	// The recorded offsets move with widened branches:
+	std::string far = "jmp done\n";
+	for (std::size_t i = 0; i < 50; ++i)
+	{
+		far += "adcq %rbx, %rax\n";
+	}
+	far += "done:\nincl %r12d\n";
+	listing.Clear();
+	MachineStream<> widened = {};
+	Assemble<>(far, widened, options);
+	const RelaxationStats stats = widened.Finalize(0, listing.Markers());
+	assert(stats.Widened == 1);
+	assert(listing.Offsets()[0] == 0 && listing.Offsets()[1] == 5 && listing.Offsets()[51] == 5 + 50 * 3);
+	assert((listing.Lines().back() == 53 && listing.Offsets().back() == widened.Size() - 3));
+
+	// The stream output is written in blocks and matches the string:
+	std::ostringstream out = {};
+	WriteListing(out, far, std::span<const std::uint8_t>(widened.begin(), widened.end()), listing);
+	assert(out.str() == FormatListing(far, std::span<const std::uint8_t>(widened.begin(), widened.end()), listing));
+	assert(out.str().starts_with("     1  00000000  E9 96 00 00   jmp done\n        00000004  00\n     2  00000005  48 11 D8      adcq"));
+	static_cast<void>(stats);
+}
+
+static void RunAllTestsForSourceReader()
+{
+	using namespace CyberAsm;
+
+	// Lines, CRLF line breaks and comments:
+	const std::string_view source = "start: # entry\r\nadcq %rbx, %rax\n\n# only a comment\nincl %r12d # a # b";
+	const LineIndex index(source);
+	assert(index.Count() == 5);
+	assert((std::vector<std::size_t>(index.Starts().begin(), index.Starts().end()) == std::vector<std::size_t>{0, 16, 32, 33, 50}));
+	assert(index.Line(0) == "start: # entry" && index.Code(0) == "start: ");
+	assert(index.Line(1) == "adcq %rbx, %rax" && index.Code(1) == "adcq %rbx, %rax");
+	assert(index.Line(2).empty() && index.Code(3).empty());
+	assert(index.Line(4) == "incl %r12d # a # b" && index.Code(4) == "incl %r12d ");
+	assert(index.LineOf(0) == 0 && index.LineOf(15) == 0 && index.LineOf(16) == 1 && index.LineOf(32) == 2 && index.LineOf(1000) == 4);
+	assert(LineIndex("a\nb # c\r\n").Line(1) == "b # c" && LineIndex("a\nb # c\n").Code(1) == "b ");
+	assert(LineIndex("a\nbb\n").Line(1) == "bb" && LineIndex("a\nbb").Line(1) == "bb" && LineIndex("\n").Line(0).empty());
+	assert(LineIndex("").Count() == 0 && LineIndex("\n").Count() == 1 && LineIndex("a\n").Count() == 1 && LineIndex("a\nb").Count() == 2);
+
+	// The vectorized scan agrees with a byte by byte reference across block boundaries:
+	std::string text(1000, 'x');
+	std::uint32_t seed = 7;
+	for (auto& c : text)
+	{
+		seed = seed * 1664525 + 1013904223;
+		const auto pick = seed >> 24;
+		c = pick < 20 ? '\n' : pick < 30 ? '#' : 'x';
+	}
+	const LineIndex random(text);
+	std::size_t line = 0;
+	for (std::size_t start = 0; start < text.size(); ++line)
+	{
+		const auto end = std::min(text.find('\n', start), text.size());
+		const auto comment = std::min(text.find('#', start), end);
+		assert(random.Starts()[line] == start && random.Code(line).size() == comment - start);
+		static_cast<void>(comment);
+		start = end + 1;
+	}
+	assert(random.Count() == line);
+
+	std::vector<std::size_t> needles = {};
+	SplitLines(text, needles);
+	assert(needles.size() == static_cast<std::size_t>(std::count(text.begin(), text.end(), '\n')));
+	assert(std::all_of(needles.begin(), needles.end(), [&text](const std::size_t offset) { return text[offset] == '\n'; }));
+
+	// Mapped files match the copied contents:
+	const auto file = std::filesystem::temp_directory_path() / "CyberAsmTestSource.asm";
+	{
+		std::ofstream out(file, std::ios::out | std::ios::binary | std::ios::trunc);
+		out << text;
+	}
+	{
+		const MappedSourceFile mapped(file);
+		std::string copied = {};
+		ReadFile(copied, file);
+		assert(mapped.IsMapped() && mapped.Text() == text && copied == text);
+		static_cast<void>(mapped);
+	}
+	{
+		std::ofstream out(file, std::ios::out | std::ios::binary | std::ios::trunc);
+	}
+	{
+		const MappedSourceFile empty(file);
+		assert(!empty.IsMapped() && empty.Text().empty());
+		static_cast<void>(empty);
+	}
+	std::filesystem::remove(file);
+
+	bool thrown = false;
+	try
+	{
+		const MappedSourceFile missing(file);
+	}
+	catch (const std::runtime_error&)
+	{
+		thrown = true;
+	}
+	assert(thrown);
+	static_cast<void>(thrown);
+	static_cast<void>(index);
+	static_cast<void>(random);
+	static_cast<void>(line);
+}
+
+static void RunAllTestsForCharClassifier()
+{
+	using namespace CyberAsm;
+	using namespace X86;
+
+	// One block, bit i belongs to byte i:
+	{
+		const auto bits = [](const std::initializer_list<int> positions)
+		{
+			std::uint64_t mask = 0;
+			for (const int position : positions)
+			{
+				mask |= std::uint64_t{1} << position;
+			}
+			return mask;
+		};
+		CharClassifier classifier(SimdLevel::Scalar);
+		const CharMasks masks = classifier.ClassifyTail("adcq $-5, %rax # x, %y\n1: jne 1b");
+		assert(masks.Identifier == bits({0, 1, 2, 3, 7, 11, 12, 13, 23, 26, 27, 28, 30, 31}));
+		assert(masks.ImmediatePrefix == bits({5}) && masks.NegativeSign == bits({6}) && masks.Separator == bits({8}) && masks.RegisterPrefix == bits({10}));
+		assert(masks.Comment == bits({15, 16, 17, 18, 19, 20, 21}) && masks.NewLine == bits({22}) && masks.LabelTerminator == bits({24}));
+		assert(masks.Whitespace == bits({4, 9, 14, 25, 29}));
+		assert(masks.TokenStarts == bits({0, 5, 8, 10, 22, 23, 24, 26, 30}));
+		static_cast<void>(bits);
+		static_cast<void>(masks);
+	}
+
+	// All levels agree with each other and the token starts agree with the lexer, also across block boundaries:
+	std::string source = {};
+	std::uint32_t seed = 1;
+	constexpr std::array<std::string_view, 10> pieces = {"adcq", " ", "\t", "%rax", "$-0x7F", ", ", "\n", "# c, %x $y #\n", "loop:", "*"};
+	while (source.size() < 4000)
+	{
+		seed = seed * 1664525 + 1013904223;
+		source += pieces[(seed >> 16) % pieces.size()];
+	}
+	std::vector<CharMasks> reference = {};
+	ClassifySource(source, [&reference](std::size_t, const CharMasks& masks)
+	{
+		reference.push_back(masks);
+	}, SimdLevel::Scalar);
+	for (const SimdLevel level : {SimdLevel::Sse2, SimdLevel::Avx2})
+	{
+		if (level > DetectSimdLevel())
+		{
+			continue;
+		}
+		std::size_t block = 0;
+		ClassifySource(source, [&](std::size_t, const CharMasks& masks)
+		{
+			const CharMasks& expected = reference[block++];
+			assert(std::memcmp(&masks, &expected, sizeof(CharMasks)) == 0);
+			static_cast<void>(masks);
+			static_cast<void>(expected);
+		}, level);
+	}
+
+	// The line pass yields the same NewLine and Comment masks on every level:
+	for (const SimdLevel level : {SimdLevel::Scalar, SimdLevel::Sse2, SimdLevel::Avx2})
+	{
+		if (level > DetectSimdLevel())
+		{
+			continue;
+		}
+		std::size_t block = 0;
+		ClassifySourceLines(source, [&](std::size_t, const CharMasks& masks)
+		{
+			const CharMasks& expected = reference[block++];
+			assert(masks.NewLine == expected.NewLine && masks.Comment == expected.Comment && masks.TokenStarts == 0);
+			static_cast<void>(masks);
+			static_cast<void>(expected);
+		}, level);
+		assert(block == reference.size());
+	}
+
+	std::size_t tokens = 0;
+	std::size_t commentBytes = 0;
+	for (const CharMasks& masks : reference)
+	{
+		tokens += static_cast<std::size_t>(std::popcount(masks.TokenStarts));
+		commentBytes += static_cast<std::size_t>(std::popcount(masks.Comment));
+	}
+	std::size_t lexed = 0;
+	Lexer lexer(source);
+	while (lexer.Next().Kind != TokenKind::EndOfFile)
+	{
+		++lexed;
+	}
+	assert(tokens == lexed);
+	assert(commentBytes != 0);
+	static_cast<void>(tokens);
+	static_cast<void>(lexed);
+	static_cast<void>(commentBytes);
+
+	// The classified lexer yields the same tokens as the byte loop, also for malformed input and invalid bytes:
+	std::string noise = {};
+	constexpr std::string_view alphabet = "ab1_.%$-*,:# \t\r\n@\x80";
+	while (noise.size() < 4000)
+	{
+		seed = seed * 1664525 + 1013904223;
+		noise += alphabet[(seed >> 16) % alphabet.size()];
+	}
+	for (const std::string_view text : {std::string_view(source), std::string_view(noise), std::string_view("# only"), std::string_view("")})
+	{
+		for (const SimdLevel level : {SimdLevel::Scalar, SimdLevel::Sse2, SimdLevel::Avx2})
+		{
+			if (level > DetectSimdLevel())
+			{
+				continue;
+			}
+			Lexer bytes(text);
+			ClassifiedLexer classified(text, level);
+			for (;;)
+			{
+				const Token expected = bytes.Next();
+				const Token token = classified.Next();
+				assert(token.Kind == expected.Kind && token.Lexeme.data() == expected.Lexeme.data() && token.Lexeme.size() == expected.Lexeme.size());
+				assert(classified.Offset() == bytes.Offset());
+				static_cast<void>(token);
+				if (expected.Kind == TokenKind::EndOfFile)
+				{
+					break;
+				}
+			}
+		}
+	}
+}
+
+static void RunAllTestsForParallelAssembler()
+{
+	using namespace CyberAsm;
+	using namespace X86;
+
+	// Named and local labels referenced across chunk borders, and branches which only widen in the whole stream:
+	std::string source = "start:\n";
+	for (std::size_t i = 0; i < 40; ++i)
+	{
+		source += "1: adcq %rbx, %rax # chunk " + std::to_string(i) + "\n";
+		source += "jne 1b\njmp 2f\n";
+		for (std::size_t j = 0; j < i % 7 * 9; ++j)
+		{
+			source += "incl %r12d\r\n";
+		}
+		source += "2:\njne 1f\n";
+		source += "block" + std::to_string(i) + ": jmp block" + std::to_string((i * 17 + 5) % 40) + "\n";
+	}
+	source += "1: jmp start\n";
+
+	AssemblyListing serialListing = {};
+	AssembleOptions serialOptions = {};
+	serialOptions.Listing = &serialListing;
+	const MachineStream<> serial = Assemble<>(source, serialOptions);
+	assert(serial.Size() > 256);
+	const std::string serialText = FormatListing(source, std::span<const std::uint8_t>(serial.begin(), serial.end()), serialListing);
+	for (const std::size_t threads : {2, 3, 8})
+	{
+		for (const std::size_t chunkSize : {1, 64, 500})
+		{
+			AssemblyListing listing = {};
+			AssembleOptions options = {};
+			options.Listing = &listing;
+			MachineStream<> stream = {};
+			const std::size_t chunks = AssembleParallel<>(source, stream, options, {.Threads = threads, .MinChunkSize = chunkSize});
+			assert(chunks > 1);
+			stream.Finalize(0, listing.Markers());
+			assert(std::equal(stream.begin(), stream.end(), serial.begin(), serial.end()));
+			assert(FormatListing(source, std::span<const std::uint8_t>(stream.begin(), stream.end()), listing) == serialText);
+			static_cast<void>(chunks);
+		}
+	}
+
+	// Errors are those of the serial assembler, including their line numbers:
+	const auto error = [](const std::string_view text, const std::size_t threads) -> std::string
+	{
+		try
+		{
+			const MachineStream<> stream = AssembleParallel<>(text, {}, {.Threads = threads, .MinChunkSize = 1});
+			static_cast<void>(stream);
+		}
+		catch (const std::runtime_error& ex)
+		{
+			return ex.what();
+		}
+		return {};
+	};
+	const std::string lines = "adcq %rbx, %rax\nincl %r12d\nadcq %rbx, %rax\nincl %r12d\n";
+	for (const std::string& text : {lines + "jmp 1b\n" + lines, lines + "jne 3f\n" + lines, "twice:\n" + lines + "twice:\n", lines + "adcq %rbx\n" + lines, lines + "jmp nowhere\n"})
+	{
+		const std::string chunked = error(text, 4);
+		assert(!chunked.empty() && chunked == error(text, 1));
+		static_cast<void>(chunked);
+	}
+	assert(error(lines + "adcq %rbx\n" + lines, 4).starts_with("Line 5:"));
+
+	// The peephole optimizer needs the whole file, so it falls back to one chunk:
+	AssembleOptions peephole = {};
+	peephole.Peephole = true;
+	MachineStream<> optimized = {};
+	const std::size_t chunks = AssembleParallel<>(source, optimized, peephole, {.Threads = 4, .MinChunkSize = 1});
+	assert(chunks == 1);
+	static_cast<void>(chunks);
+	static_cast<void>(error);
+}
+
+static void RunAllTestsForBatchAssembler()
+{
+	using namespace CyberAsm;
+	using namespace X86;
+
+	// Every task runs exactly once, also when the weights are far off and the threads have to steal:
+	{
+		WorkStealingPool pool(4);
+		assert(pool.ThreadCount() == 4);
+		std::vector<std::uint64_t> weights(200, 1);
+		weights[7] = 1000;
+		std::vector<std::atomic<int>> runs(weights.size());
+		pool.Run(weights, [&runs](const std::size_t task, const std::size_t worker)
+		{
+			assert(worker < 4);
+			++runs[task];
+			static_cast<void>(worker);
+		});
+		assert(std::all_of(runs.begin(), runs.end(), [](const std::atomic<int>& count) { return count == 1; }));
+
+		bool thrown = false;
+		try
+		{
+			pool.Run(weights, [](const std::size_t task, std::size_t)
+			{
+				if (task == 42)
+				{
+					throw std::runtime_error("task");
+				}
+			});
+		}
+		catch (const std::runtime_error&)
+		{
+			thrown = true;
+		}
+		assert(thrown);
+		static_cast<void>(thrown);
+	}
+
+	// Response files skip blank lines and comments, the last line may end with a line break:
+	const auto directory = std::filesystem::temp_directory_path() / "CyberAsmTestBatch";
+	std::filesystem::create_directories(directory);
+	{
+		std::ofstream out(directory / "files.txt", std::ios::out | std::ios::binary | std::ios::trunc);
+		out << "a.asm\r\n# skipped\n  \"b c.asm\"  \n\n";
+	}
+	assert((ReadResponseFile(directory / "files.txt") == std::vector<std::filesystem::path>{"a.asm", "b c.asm"}));
+
+	// The outputs match the serial assembler, broken files report their error and leave the others alone:
+	std::vector<std::string> sources = {};
+	std::vector<BatchJob> jobs = {};
+	for (std::size_t i = 0; i < 9; ++i)
+	{
+		std::string source = "start:\n";
+		for (std::size_t j = 0; j < i * 40; ++j)
+		{
+			source += j % 3 == 0 ? "jne start\n" : "adcq %rbx, %rax\n";
+		}
+		source += i == 4 ? "jmp 1b\n" : "incl %r12d\n";
+		const auto input = directory / ("file" + std::to_string(i) + ".asm");
+		std::ofstream out(input, std::ios::out | std::ios::binary | std::ios::trunc);
+		out << source;
+		sources.push_back(std::move(source));
+		jobs.push_back(BatchJob{input, directory / ("file" + std::to_string(i) + ".bin")});
+	}
+	jobs.push_back(BatchJob{directory / "missing.asm", directory / "missing.bin"});
+
+	WorkStealingPool pool(3);
+	const BatchStats stats = AssembleBatch<>(jobs, pool);
+	assert(stats.Files.size() == jobs.size() && stats.Failed == 2);
+	assert(stats.Files[4].Error == "Line " + std::to_string(4 * 40 + 2) + ": Local label '1b' has no previous definition!");
+	assert(!stats.Files.back().Succeeded());
+	std::size_t codeBytes = 0;
+	for (std::size_t i = 0; i < sources.size(); ++i)
+	{
+		if (i == 4)
+		{
+			continue;
+		}
+		const MachineStream<> expected = Assemble<>(sources[i]);
+		std::string written = {};
+		ReadFile(written, jobs[i].Output);
+		assert(stats.Files[i].Succeeded() && stats.Files[i].SourceBytes == sources[i].size() && stats.Files[i].CodeBytes == expected.Size());
+		assert(std::equal(written.begin(), written.end(), expected.begin(), expected.end(), [](const char lhs, const std::uint8_t rhs) { return static_cast<std::uint8_t>(lhs) == rhs; }));
+		codeBytes += expected.Size();
+	}
+	assert(stats.CodeBytes == codeBytes);
+
+	// Inputs sharing an output file, for example same named files from different directories, are rejected before any thread runs:
+	const std::vector<BatchJob> clashing = {jobs[0], BatchJob{jobs[1].Input, directory / "sub" / ".." / jobs[0].Output.filename()}};
+	std::filesystem::remove(jobs[0].Output);
+	bool rejected = false;
+	try
+	{
+		static_cast<void>(AssembleBatch<>(clashing, pool));
+	}
+	catch (const std::runtime_error&)
+	{
+		rejected = true;
+	}
+	assert(rejected && !std::filesystem::exists(jobs[0].Output));
+	static_cast<void>(rejected);
+	std::filesystem::remove_all(directory);
+	static_cast<void>(codeBytes);
+}
+
+static void RunAllTestsForPipeline()
+{
+	using namespace CyberAsm;
+	using namespace X86;
+
+	// Values arrive in order through a queue smaller than the run, and closing wakes the other side:
+	{
+		SpscQueue<std::size_t> queue(2);
+		std::thread producer([&queue]
+		{
+			for (std::size_t i = 0; i < 1000; ++i)
+			{
+				const bool pushed = queue.Push(std::size_t{i});
+				assert(pushed);
+				static_cast<void>(pushed);
+			}
+			queue.Close();
+		});
+		std::size_t expected = 0;
+		std::size_t value = 0;
+		while (queue.Pop(value))
+		{
+			assert(value == expected);
+			++expected;
+		}
+		producer.join();
+		assert(expected == 1000);
+
+		SpscQueue<std::size_t> stopped(1);
+		std::thread blocked([&stopped]
+		{
+			while (stopped.Push(std::size_t{1}))
+			{
+			}
+		});
+		const bool popped = stopped.Pop(value);
+		assert(popped);
+		static_cast<void>(popped);
+		stopped.Close();
+		blocked.join();
+	}
+
+	// Code is settled up to the first reference to a label which is not bound yet, later code may refer into the discarded part:
+	{
+		constexpr std::array<std::uint8_t, 1> jmp = {0xE9};
+		MachineStream<> stream = {};
+		const Label entry = stream.CreateLabel();
+		const Label far = stream.CreateLabel();
+		stream.BindLabel(entry);
+		stream << std::uint8_t{0x90};
+		stream.InsertBranch(entry, 0xEB, jmp);
+		stream.InsertBranch(far, 0xEB, jmp);
+		stream << std::uint8_t{0x90};
+		const std::size_t settled = stream.SettlePrefix();
+		assert(settled == 3);
+		assert(stream[1] == 0xEB && stream[2] == 0xFD);
+		stream.DiscardPrefix(3);
+		assert(stream.Labels().Origin() == 3 && stream.Size() == 3);
+		for (std::size_t i = 0; i < 200; ++i)
+		{
+			stream << std::uint8_t{0x90};
+		}
+		stream.BindLabel(far);
+		stream.InsertBranch(entry, 0xEB, jmp);
+		stream.InsertFixup(far, FixupKind::Absolute32);
+		const std::size_t rest = stream.SettlePrefix();
+		assert(rest == stream.Size() && rest == 215);
+		assert((stream[0] == 0xE9 && stream[1] == 201 && stream[2] == 0 && stream[5] == 0x90));
+		assert((stream[206] == 0xE9 && stream[207] == 0x2A && stream[208] == 0xFF));
+		assert((stream[211] == 3 + 206 && stream[212] == 0));
+		static_cast<void>(settled);
+		static_cast<void>(rest);
+	}
+
+	// The pipeline output matches the serial assembler for any batch size, including branches widened across batches:
+	std::string source = "start:\n";
+	for (std::size_t i = 0; i < 60; ++i)
+	{
+		source += "1: adcq %rbx, %rax\njne 1b\njmp 2f\n";
+		for (std::size_t j = 0; j < i % 5 * 12; ++j)
+		{
+			source += "incl %r12d # filler\r\n";
+		}
+		source += "2: jne done\n";
+	}
+	source += "done: jmp start";
+	const MachineStream<> serial = Assemble<>(source);
+	for (const std::size_t batchSize : {1, 13, 256, 1 << 20})
+	{
+		std::istringstream input(source);
+		std::ostringstream output = {};
+		const PipelineStats stats = AssemblePipelined<>(input, output, {.BatchSize = batchSize, .QueueDepth = 2});
+		const std::string code = output.str();
+		assert(std::equal(code.begin(), code.end(), serial.begin(), serial.end(), [](const char lhs, const std::uint8_t rhs) { return static_cast<std::uint8_t>(lhs) == rhs; }));
+		assert(stats.SourceBytes == source.size() && stats.CodeBytes == serial.Size());
+		assert(stats[PipelineStage::Read].Batches >= stats[PipelineStage::Parse].Batches && stats[PipelineStage::Write].Batches >= 1);
+		static_cast<void>(stats);
+	}
+
+	// Errors keep their line numbers across batches:
+	const auto error = [](const std::string& text) -> std::string
+	{
+		std::istringstream input(text);
+		std::ostringstream output = {};
+		try
+		{
+			static_cast<void>(AssemblePipelined<>(input, output, {.BatchSize = 16, .QueueDepth = 1}));
+		}
+		catch (const std::runtime_error& ex)
+		{
+			return ex.what();
+		}
+		return {};
+	};
+	const std::string lines = "adcq %rbx, %rax\nincl %r12d\nadcq %rbx, %rax\nincl %r12d\n";
+	assert(error(lines + "adcq %rbx\n" + lines).starts_with("Line 5:"));
+	assert(error(lines + "jne 3f\n" + lines) == "Local label '3f' has no following definition!");
+	assert(!error(lines + "jmp nowhere\n").empty());
+	static_cast<void>(error);
 }
 
 auto main(const int argc, const char* const* const argv) -> int
@@ -245,6 +2147,21 @@ auto main(const int argc, const char* const* const argv) -> int
 		std::cout << "Running CyberAsm tests...\n";
 
 		RunAllTestsForX86();
+		RunAllTestsForParser();
+		RunAllTestsForLabels();
+		RunAllTestsForJit();
+		RunAllTestsForPeephole();
+		RunAllTestsForMachineStream();
+		RunAllTestsForHexDump();
+		RunAllTestsForByteSearch();
+		RunAllTestsForFileOutput();
+		RunAllTestsForDecoder();
+		RunAllTestsForListing();
+		RunAllTestsForSourceReader();
+		RunAllTestsForCharClassifier();
+		RunAllTestsForParallelAssembler();
+		RunAllTestsForBatchAssembler();
+		RunAllTestsForPipeline();
 
 		std::cout << "All tests ok!" << std::endl;
 